@@ -0,0 +1,835 @@
+/*
+ * aircat_bench.c - Pipeline benchmark with a virtual output device
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include <openssl/aes.h>
+
+#include "outputs.h"
+#include "config_file.h"
+#include "realtime.h"
+#include "file.h"
+#include "shoutcast.h"
+#include "raop.h"
+#include "fs.h"
+
+#include "synth.h"
+#include "bench_stage.h"
+#include "bench_pcm.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef VERSION
+	#define VERSION "1.0.0"
+#endif
+
+/* Warm up time before measure (in s of device time) */
+#define WARMUP_TIME 1
+
+/* Synthesized AirTunes stream length (looped, in s) */
+#define AIRTUNES_LOOP 5
+
+/* First UDP port for AirTunes streams */
+#define AIRTUNES_PORT 6000
+
+/* RTP header size */
+#define RTP_HEADER_SIZE 12
+
+enum bench_type {
+	TYPE_FILE,
+	TYPE_RADIO,
+	TYPE_AIRTUNES
+};
+
+struct bench_stream {
+	enum bench_type type;
+	/* Source handles */
+	struct file_handle *file;
+	struct shout_handle *shout;
+	struct raop_handle *raop;
+	/* AirTunes sender */
+	int sock;
+	struct sockaddr_in addr;
+	uint16_t seq;
+	uint32_t timestamp;
+	/* Output stream */
+	struct output_stream_handle *stream;
+	struct bench_stream *next;
+};
+
+/* Encoded AirTunes packets (payload is encrypted) */
+struct bench_packet {
+	unsigned char data[RTP_HEADER_SIZE + SYNTH_ALAC_MAX_FRAME_SIZE];
+	size_t len;
+};
+
+/* Stream sources */
+static struct bench_stream *streams = NULL;
+static struct bench_packet *packets = NULL;
+static unsigned int packet_count = 0;
+static unsigned char *radio_data = NULL;
+static size_t radio_len = 0;
+static const char *radio_type = NULL;
+static int radio_sock = -1;
+static unsigned int radio_port = 0;
+
+/* AES key and IV of AirTunes streams */
+static unsigned char aes_key[16] = "aircat-bench-key";
+static unsigned char aes_iv[16] = "aircat-bench-iv.";
+
+/* Program args */
+static const char *input = NULL;
+static const char *config_file = NULL;
+static unsigned int file_count = 0;
+static unsigned int radio_count = 0;
+static unsigned int airtunes_count = 0;
+static unsigned int duration = 10;
+static double speed = 1.0;
+static unsigned int latency = 0;
+static unsigned long samplerate = 44100;
+static int json = 0;
+
+/* Stop flag */
+static volatile int stop = 0;
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_load_input(unsigned char **data, size_t *len)
+{
+	FILE *fp;
+	long size;
+
+	fp = fopen(input, "rb");
+	if(fp == NULL)
+		return -1;
+
+	/* Load file in memory */
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	*data = malloc(size);
+	if(*data == NULL || size <= 0 ||
+	   fread(*data, 1, size, fp) != (size_t) size)
+	{
+		fclose(fp);
+		return -1;
+	}
+	*len = size;
+	fclose(fp);
+
+	return 0;
+}
+
+/******************************************************************************
+ *                          Radio (local HTTP server)                         *
+ ******************************************************************************/
+
+static void *bench_radio_client(void *user_data)
+{
+	int sock = (int) (long) user_data;
+	char header[256];
+	char req[1024];
+	size_t pos = 0;
+	ssize_t len;
+
+	/* Read request */
+	recv(sock, req, sizeof(req), 0);
+
+	/* Send answer */
+	len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+		       "Content-Type: %s\r\nicy-name: aircat-bench\r\n\r\n",
+		       radio_type);
+	if(send(sock, header, len, MSG_NOSIGNAL) != len)
+		goto end;
+
+	/* Send input file in loop: sender is throttled by TCP */
+	while(!stop)
+	{
+		len = send(sock, &radio_data[pos], radio_len - pos,
+			   MSG_NOSIGNAL);
+		if(len <= 0)
+			break;
+		pos += len;
+		if(pos >= radio_len)
+			pos = 0;
+	}
+
+end:
+	close(sock);
+	return NULL;
+}
+
+static void *bench_radio_server(void *user_data)
+{
+	pthread_t thread;
+	int sock;
+
+	/* Accept radio clients */
+	while(!stop)
+	{
+		sock = accept(radio_sock, NULL, NULL);
+		if(sock < 0)
+			break;
+		if(pthread_create(&thread, NULL, bench_radio_client,
+				  (void *) (long) sock) != 0)
+		{
+			close(sock);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	return NULL;
+}
+
+static int bench_radio_start(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	pthread_t thread;
+	const char *ext;
+
+	/* Get content type */
+	ext = strrchr(input, '.');
+	if(ext != NULL && strcasecmp(ext, ".mp3") == 0)
+		radio_type = "audio/mpeg";
+	else if(ext != NULL && strcasecmp(ext, ".aac") == 0)
+		radio_type = "audio/aac";
+	else
+	{
+		fprintf(stderr, "Radio streams need a MP3 or ADTS input\n");
+		return -1;
+	}
+
+	/* Load input */
+	if(bench_load_input(&radio_data, &radio_len) != 0)
+	{
+		fprintf(stderr, "Failed to load %s\n", input);
+		return -1;
+	}
+
+	/* Listen on a local port */
+	radio_sock = socket(AF_INET, SOCK_STREAM, 0);
+	if(radio_sock < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if(bind(radio_sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+	   listen(radio_sock, 16) != 0 ||
+	   getsockname(radio_sock, (struct sockaddr *) &addr, &len) != 0)
+		return -1;
+	radio_port = ntohs(addr.sin_port);
+
+	/* Start server */
+	if(pthread_create(&thread, NULL, bench_radio_server, NULL) != 0)
+		return -1;
+	pthread_detach(thread);
+
+	return 0;
+}
+
+/******************************************************************************
+ *                       AirTunes (local RTP sender)                          *
+ ******************************************************************************/
+
+static int bench_airtunes_prepare(void)
+{
+	size_t frames = AIRTUNES_LOOP * SYNTH_SAMPLERATE;
+	unsigned char frame[SYNTH_ALAC_MAX_FRAME_SIZE];
+	unsigned char iv[16];
+	AES_KEY aes;
+	int16_t *pcm;
+	size_t len, aes_len;
+	unsigned int i;
+
+	/* Synthesize and encode signal */
+	pcm = synth_signal(frames);
+	if(pcm == NULL)
+		return -1;
+	packet_count = frames / SYNTH_ALAC_FRAME_SAMPLES;
+	packets = malloc(packet_count * sizeof(struct bench_packet));
+	if(packets == NULL)
+	{
+		free(pcm);
+		return -1;
+	}
+
+	/* Encrypt payloads as done by AirTunes clients */
+	AES_set_encrypt_key(aes_key, 128, &aes);
+	for(i = 0; i < packet_count; i++)
+	{
+		len = synth_alac_encode(frame,
+					&pcm[i * SYNTH_ALAC_FRAME_SAMPLES *
+					     SYNTH_CHANNELS],
+					SYNTH_ALAC_FRAME_SAMPLES);
+		aes_len = len & ~0xf;
+		memcpy(iv, aes_iv, sizeof(iv));
+		AES_cbc_encrypt(frame, &packets[i].data[RTP_HEADER_SIZE],
+				aes_len, &aes, iv, AES_ENCRYPT);
+		memcpy(&packets[i].data[RTP_HEADER_SIZE+aes_len],
+		       &frame[aes_len], len - aes_len);
+		packets[i].len = RTP_HEADER_SIZE + len;
+	}
+	free(pcm);
+
+	return 0;
+}
+
+static void bench_airtunes_send(struct bench_stream *s)
+{
+	struct bench_packet *p;
+
+	/* Prepare RTP header */
+	p = &packets[s->seq % packet_count];
+	p->data[0] = 0x80;
+	p->data[1] = 0x60;
+	*((uint16_t *) &p->data[2]) = htons(s->seq);
+	*((uint32_t *) &p->data[4]) = htonl(s->timestamp);
+	*((uint32_t *) &p->data[8]) = htonl(0x1234 + s->sock);
+
+	/* Send packet */
+	sendto(s->sock, p->data, p->len, 0, (struct sockaddr *) &s->addr,
+	       sizeof(s->addr));
+	s->seq++;
+	s->timestamp += SYNTH_ALAC_FRAME_SAMPLES;
+}
+
+static void *bench_airtunes_sender(void *user_data)
+{
+	struct bench_stream *s;
+	double start, period;
+	uint64_t count = 0;
+	struct timespec ts;
+	double t;
+
+	/* Packet period on device clock */
+	period = SYNTH_ALAC_FRAME_SAMPLES / (SYNTH_SAMPLERATE * speed);
+	start = bench_now();
+
+	while(!stop)
+	{
+		/* Send next packet of all streams */
+		for(s = streams; s != NULL; s = s->next)
+			if(s->type == TYPE_AIRTUNES)
+				bench_airtunes_send(s);
+		count++;
+
+		/* Wait next packet time */
+		t = start + count * period;
+		ts.tv_sec = (time_t) t;
+		ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                 Streams                                    *
+ ******************************************************************************/
+
+static int bench_add_stream(struct output_handle *out, enum bench_type type)
+{
+	unsigned char ip[4] = { 127, 0, 0, 1 };
+	struct raop_attr attr;
+	struct bench_stream *s;
+	unsigned long rate = 0;
+	unsigned char channels = 0;
+	a_read_cb cb = NULL;
+	void *data = NULL;
+	char format[64];
+	char url[64];
+
+	/* Allocate stream */
+	s = calloc(1, sizeof(struct bench_stream));
+	if(s == NULL)
+		return -1;
+	s->type = type;
+	s->sock = -1;
+	s->next = streams;
+	streams = s;
+
+	/* Open source */
+	switch(type)
+	{
+		case TYPE_FILE:
+			if(file_open(&s->file, input) != 0)
+				return -1;
+			rate = file_get_samplerate(s->file);
+			channels = file_get_channels(s->file);
+			cb = &file_read;
+			data = s->file;
+			break;
+		case TYPE_RADIO:
+			snprintf(url, sizeof(url), "http://127.0.0.1:%u/",
+				 radio_port);
+			if(shoutcast_open(&s->shout, url, 0, 0) != 0)
+				return -1;
+			rate = shoutcast_get_samplerate(s->shout);
+			channels = shoutcast_get_channels(s->shout);
+			cb = &shoutcast_read;
+			data = s->shout;
+			break;
+		case TYPE_AIRTUNES:
+			/* Open RAOP server (format is modified) */
+			strcpy(format, synth_alac_format());
+			memset(&attr, 0, sizeof(attr));
+			attr.transport = RAOP_UDP;
+			attr.port = AIRTUNES_PORT;
+			attr.ip = ip;
+			attr.aes_key = aes_key;
+			attr.aes_iv = aes_iv;
+			attr.codec = RAOP_ALAC;
+			attr.format = format;
+			if(raop_open(&s->raop, &attr) != 0)
+				return -1;
+			rate = raop_get_samplerate(s->raop);
+			channels = raop_get_channels(s->raop);
+			cb = &raop_read;
+			data = s->raop;
+
+			/* Open sender socket */
+			s->sock = socket(AF_INET, SOCK_DGRAM, 0);
+			if(s->sock < 0)
+				return -1;
+			s->addr.sin_family = AF_INET;
+			s->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			s->addr.sin_port = htons(attr.port);
+			s->seq = 1;
+			s->timestamp = 0;
+			raop_flush(s->raop, s->seq);
+			break;
+	}
+
+	/* Add and play stream */
+	s->stream = output_add_stream(out, NULL, rate, channels, 0, 0, cb,
+				      data);
+	if(s->stream == NULL)
+		return -1;
+	output_play_stream(out, s->stream);
+
+	return 0;
+}
+
+static void bench_close_streams(struct output_handle *out)
+{
+	struct bench_stream *s;
+
+	while(streams != NULL)
+	{
+		s = streams;
+		streams = s->next;
+
+		/* Remove output stream */
+		if(s->stream != NULL)
+			output_remove_stream(out, s->stream);
+
+		/* Close source */
+		if(s->file != NULL)
+			file_close(s->file);
+		if(s->shout != NULL)
+			shoutcast_close(s->shout);
+		if(s->raop != NULL)
+			raop_close(s->raop);
+		if(s->sock >= 0)
+			close(s->sock);
+		free(s);
+	}
+}
+
+/******************************************************************************
+ *                                 Report                                     *
+ ******************************************************************************/
+
+struct bench_snapshot {
+	double time;
+	double cpu;
+	struct rusage usage;
+	uint64_t stages[STAGE_COUNT];
+};
+
+static void bench_snapshot(struct bench_snapshot *s)
+{
+	s->time = bench_now();
+	s->cpu = bench_cpu_time();
+	getrusage(RUSAGE_SELF, &s->usage);
+	bench_stage_get(s->stages);
+}
+
+static void bench_report(struct bench_snapshot *a, struct bench_snapshot *b,
+			 struct bench_pcm_stats *pcm)
+{
+	double real, cpu, stage, wakeups;
+	unsigned int count;
+	int i;
+
+	/* Calculate figures */
+	real = b->time - a->time;
+	cpu = b->cpu - a->cpu;
+	wakeups = (b->usage.ru_nvcsw - a->usage.ru_nvcsw +
+		   b->usage.ru_nivcsw - a->usage.ru_nivcsw) / real;
+	count = file_count + radio_count + airtunes_count;
+
+	if(json)
+	{
+		printf("{\"streams\": {\"file\": %u, \"radio\": %u, "
+		       "\"airtunes\": %u}, \"speed\": %.2f, "
+		       "\"samplerate\": %lu, \"real_time\": %.3f, "
+		       "\"cpu_time\": %.3f, \"cpu_load\": %.2f, "
+		       "\"stages\": {", file_count, radio_count,
+		       airtunes_count, speed, samplerate, real, cpu,
+		       cpu * 100 / real);
+		for(i = 0; i < STAGE_COUNT; i++)
+			printf("%s\"%s\": %.6f", i ? ", " : "",
+			       bench_stage_names[i],
+			       (b->stages[i] - a->stages[i]) / 1e9);
+		printf("}, \"peak_rss_kb\": %ld, \"wakeups_per_s\": %.1f, "
+		       "\"periods\": %lu, \"xruns\": %lu, "
+		       "\"max_overrun_ms\": %.2f, \"min_headroom_ms\": %.2f}\n",
+		       b->usage.ru_maxrss, wakeups, pcm->periods, pcm->xruns,
+		       pcm->max_overrun, pcm->min_headroom);
+		return;
+	}
+
+	printf("Streams:        %u (%u file, %u radio, %u airtunes)\n", count,
+	       file_count, radio_count, airtunes_count);
+	printf("Device:         %lu Hz, clock x%.2f, %.2f s\n", samplerate,
+	       speed, real);
+	printf("CPU:            %.3f s (%.1f%% of one core)\n", cpu,
+	       cpu * 100 / real);
+	printf("\n%-12s %12s %10s\n", "stage", "cpu (ms)", "load (%)");
+	for(i = 0; i < STAGE_COUNT; i++)
+	{
+		stage = (b->stages[i] - a->stages[i]) / 1e9;
+		printf("%-12s %12.2f %10.2f\n", bench_stage_names[i],
+		       stage * 1000, stage * 100 / real);
+		cpu -= stage;
+	}
+	printf("%-12s %12.2f %10.2f\n", "other", cpu * 1000, cpu * 100 / real);
+	printf("\nPeak RSS:       %ld kB\n", b->usage.ru_maxrss);
+	printf("Wakeups:        %.1f /s\n", wakeups);
+	printf("Periods:        %lu (%.1f /s)\n", pcm->periods,
+	       pcm->periods / real);
+	printf("Underruns:      %lu\n", pcm->xruns);
+	printf("Max overrun:    %.2f ms\n", pcm->max_overrun);
+	printf("Min headroom:   %.2f ms\n", pcm->min_headroom);
+}
+
+/******************************************************************************
+ *                                  Main                                      *
+ ******************************************************************************/
+
+static void signal_handler(int signum)
+{
+	stop = 1;
+}
+
+static void bench_sleep(double time)
+{
+	struct timespec ts;
+	double end;
+
+	/* Sleep on device clock until end or signal */
+	end = bench_now() + time / speed;
+	while(!stop && (time = end - bench_now()) > 0)
+	{
+		if(time > 0.1)
+			time = 0.1;
+		ts.tv_sec = (time_t) time;
+		ts.tv_nsec = (long) ((time - ts.tv_sec) * 1e9);
+		nanosleep(&ts, NULL);
+	}
+}
+
+static void print_usage(const char *name)
+{
+	printf("Usage: %s [OPTIONS]\n"
+		"\n"
+		"Run concurrent streams through the whole AirCat pipeline on a "
+		"virtual\n"
+		"output device and report CPU usage of each stage, memory, "
+		"wakeups\n"
+		"and output deadline misses.\n"
+		"\n"
+		"Options:\n"
+		"-i      --input=FILE         Media file used by file (MP3, M4A) "
+						"and\n"
+		"                             radio (MP3, ADTS) streams\n"
+		"-f      --file=N             Play N local files\n"
+		"-r      --radio=N            Play N radios from a local "
+						"server\n"
+		"-a      --airtunes=N         Play N synthesized AirTunes "
+						"streams\n"
+		"-d      --duration=SEC       Measure duration on device clock "
+						"(default: 10)\n"
+		"-s      --speed=X            Run device clock X times faster "
+						"(default: 1)\n"
+		"-l      --latency=MS         Output latency\n"
+		"-R      --samplerate=HZ      Output samplerate "
+						"(default: 44100)\n"
+		"-c      --config=FILE        Use real-time settings of "
+						"configuration\n"
+		"-j      --json               Print report as JSON\n"
+		"-h      --help               Print this usage and exit\n"
+		"        --version            Print version and exit\n",
+		 name);
+}
+
+static void parse_opt(int argc, char * const argv[])
+{
+	int c;
+
+	/* Get options */
+	while(1)
+	{
+		int option_index = 0;
+		static const char *short_options = "i:f:r:a:d:s:l:R:c:jh";
+		static struct option long_options[] =
+		{
+			{"version",    no_argument,        0, 0},
+			{"input",      required_argument,  0, 'i'},
+			{"file",       required_argument,  0, 'f'},
+			{"radio",      required_argument,  0, 'r'},
+			{"airtunes",   required_argument,  0, 'a'},
+			{"duration",   required_argument,  0, 'd'},
+			{"speed",      required_argument,  0, 's'},
+			{"latency",    required_argument,  0, 'l'},
+			{"samplerate", required_argument,  0, 'R'},
+			{"config",     required_argument,  0, 'c'},
+			{"json",       no_argument,        0, 'j'},
+			{"help",       no_argument,        0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		/* Get next option */
+		c = getopt_long(argc, argv, short_options, long_options,
+				&option_index);
+		if(c == EOF)
+			break;
+
+		/* Parse option */
+		switch(c)
+		{
+			case 0:
+				/* Version */
+				printf("AirCat bench " VERSION "\n");
+				exit(EXIT_SUCCESS);
+				break;
+			case 'i':
+				input = optarg;
+				break;
+			case 'f':
+				file_count = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				radio_count = strtoul(optarg, NULL, 10);
+				break;
+			case 'a':
+				airtunes_count = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				duration = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				speed = atof(optarg);
+				break;
+			case 'l':
+				latency = strtoul(optarg, NULL, 10);
+				break;
+			case 'R':
+				samplerate = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				config_file = optarg;
+				break;
+			case 'j':
+				json = 1;
+				break;
+			case 'h':
+				print_usage(argv[0]);
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Check options */
+	if(speed <= 0 || duration == 0 || samplerate == 0)
+	{
+		print_usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if(file_count + radio_count + airtunes_count == 0)
+		airtunes_count = 1;
+	if((file_count > 0 || radio_count > 0) && input == NULL)
+	{
+		fprintf(stderr, "File and radio streams need an input file\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct config_handle *config = NULL;
+	struct outputs_handle *outputs = NULL;
+	struct output_handle *out = NULL;
+	struct bench_snapshot start, end;
+	struct bench_pcm_stats pcm;
+	pthread_t sender;
+	struct json *cfg;
+	int ret = EXIT_FAILURE;
+	unsigned int i;
+
+	/* Parse options */
+	parse_opt(argc, argv);
+
+	/* Setup signal handler */
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Init file system */
+	fs_init();
+
+	/* Init real-time scheduling from configuration */
+	if(config_file != NULL)
+	{
+		config_open(&config, config_file);
+		cfg = config_get_json(config, "realtime");
+		realtime_init(cfg);
+		json_free(cfg);
+	}
+
+	/* Open output on virtual device */
+	bench_pcm_set_speed(speed);
+	cfg = json_new();
+	json_set_string(cfg, "device", "bench");
+	json_set_int(cfg, "samplerate", samplerate);
+	if(latency > 0)
+		json_set_int(cfg, "latency", latency);
+	outputs_open(&outputs, cfg);
+	json_free(cfg);
+	if(output_open(&out, outputs, "bench") != 0)
+	{
+		fprintf(stderr, "Failed to open output\n");
+		goto end;
+	}
+
+	/* Prepare sources */
+	if(radio_count > 0 && bench_radio_start() != 0)
+		goto end;
+	if(airtunes_count > 0 && bench_airtunes_prepare() != 0)
+		goto end;
+
+	/* Add streams */
+	for(i = 0; i < file_count; i++)
+		if(bench_add_stream(out, TYPE_FILE) != 0)
+			goto open_error;
+	for(i = 0; i < radio_count; i++)
+		if(bench_add_stream(out, TYPE_RADIO) != 0)
+			goto open_error;
+	for(i = 0; i < airtunes_count; i++)
+		if(bench_add_stream(out, TYPE_AIRTUNES) != 0)
+			goto open_error;
+
+	/* Start AirTunes sender */
+	if(airtunes_count > 0 &&
+	   pthread_create(&sender, NULL, bench_airtunes_sender, NULL) != 0)
+		goto end;
+
+	/* Warm up and measure */
+	bench_sleep(WARMUP_TIME);
+	bench_pcm_get_stats(&pcm, 1);
+	bench_snapshot(&start);
+	bench_sleep(duration);
+	bench_snapshot(&end);
+	bench_pcm_get_stats(&pcm, 1);
+
+	/* Print report */
+	bench_report(&start, &end, &pcm);
+	ret = EXIT_SUCCESS;
+
+	/* Stop sender */
+	stop = 1;
+	if(airtunes_count > 0)
+		pthread_join(sender, NULL);
+	goto end;
+
+open_error:
+	fprintf(stderr, "Failed to open stream\n");
+end:
+	/* Stop local servers and close streams */
+	stop = 1;
+	if(radio_sock >= 0)
+	{
+		shutdown(radio_sock, SHUT_RDWR);
+		close(radio_sock);
+	}
+	bench_close_streams(out);
+
+	/* Close output */
+	if(out != NULL)
+		output_close(out);
+	if(outputs != NULL)
+		outputs_close(outputs);
+
+	/* Free resources */
+	if(packets != NULL)
+		free(packets);
+	if(radio_data != NULL)
+		free(radio_data);
+	if(config != NULL)
+		config_close(config);
+	realtime_free();
+	fs_free();
+
+	return ret;
+}
+
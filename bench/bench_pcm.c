@@ -0,0 +1,409 @@
+/*
+ * bench_pcm.c - Virtual ALSA PCM device for benchmarks
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <asoundlib.h>
+
+#include "bench_stage.h"
+#include "bench_pcm.h"
+
+struct _snd_pcm {
+	/* Format */
+	unsigned int samplerate;
+	unsigned int channels;
+	/* Buffer size and software thresholds (in frames) */
+	double buffer_size;
+	double start_threshold;
+	double avail_min;
+	/* Device state */
+	int running;
+	int xrun;
+	double start;
+	double written;
+};
+
+/* Speed of device clock */
+static double bench_pcm_speed = 1.0;
+
+/* Statistics */
+static struct bench_pcm_stats bench_pcm_stats = { 0, 0, 0, 0.0, -1.0 };
+static pthread_mutex_t bench_pcm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void bench_pcm_set_speed(double speed)
+{
+	if(speed > 0)
+		bench_pcm_speed = speed;
+}
+
+void bench_pcm_get_stats(struct bench_pcm_stats *stats, int reset)
+{
+	pthread_mutex_lock(&bench_pcm_mutex);
+	memcpy(stats, &bench_pcm_stats, sizeof(struct bench_pcm_stats));
+	if(stats->min_headroom < 0)
+		stats->min_headroom = 0;
+	if(reset)
+	{
+		memset(&bench_pcm_stats, 0, sizeof(struct bench_pcm_stats));
+		bench_pcm_stats.min_headroom = -1.0;
+	}
+	pthread_mutex_unlock(&bench_pcm_mutex);
+}
+
+static double bench_pcm_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_pcm_sleep_until(double t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) t;
+	ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	      EINTR);
+}
+
+/* Device time at which frame count will be consumed */
+static double bench_pcm_time_of(snd_pcm_t *pcm, double frames)
+{
+	return pcm->start + frames / (pcm->samplerate * bench_pcm_speed);
+}
+
+/* Frames consumed by device at time now */
+static double bench_pcm_consumed(snd_pcm_t *pcm, double now)
+{
+	double frames;
+
+	if(!pcm->running)
+		return 0;
+	frames = (now - pcm->start) * pcm->samplerate * bench_pcm_speed;
+	return frames < pcm->written ? frames : pcm->written;
+}
+
+static int bench_pcm_update(snd_pcm_t *pcm, double now)
+{
+	double late;
+
+	if(pcm->xrun)
+		return -EPIPE;
+	if(!pcm->running)
+		return 0;
+
+	/* Buffer is not empty */
+	late = (now - pcm->start) * pcm->samplerate * bench_pcm_speed -
+	       pcm->written;
+	if(late <= 0)
+		return 0;
+
+	/* Underrun: update statistics (in ms of audio) */
+	late = late * 1000 / pcm->samplerate;
+	pthread_mutex_lock(&bench_pcm_mutex);
+	bench_pcm_stats.xruns++;
+	if(late > bench_pcm_stats.max_overrun)
+		bench_pcm_stats.max_overrun = late;
+	pthread_mutex_unlock(&bench_pcm_mutex);
+
+	pcm->running = 0;
+	pcm->xrun = 1;
+	return -EPIPE;
+}
+
+int snd_pcm_open(snd_pcm_t **pcm, const char *name, snd_pcm_stream_t stream,
+		 int mode)
+{
+	*pcm = calloc(1, sizeof(struct _snd_pcm));
+	if(*pcm == NULL)
+		return -ENOMEM;
+	(*pcm)->samplerate = 44100;
+	(*pcm)->channels = 2;
+	(*pcm)->buffer_size = 44100 / 10;
+
+	return 0;
+}
+
+int snd_pcm_close(snd_pcm_t *pcm)
+{
+	free(pcm);
+	return 0;
+}
+
+/* Virtual device is not on a card: mixer falls back to "default" */
+int snd_pcm_info(snd_pcm_t *pcm, snd_pcm_info_t *info)
+{
+	return -ENODEV;
+}
+
+int snd_pcm_set_params(snd_pcm_t *pcm, snd_pcm_format_t format,
+		       snd_pcm_access_t access, unsigned int channels,
+		       unsigned int rate, int soft_resample,
+		       unsigned int latency)
+{
+	if(rate == 0 || channels == 0)
+		return -EINVAL;
+
+	/* Set format and buffer size (with 4 periods) */
+	pcm->samplerate = rate;
+	pcm->channels = channels;
+	pcm->buffer_size = (double) latency * rate / 1000000;
+	if(pcm->buffer_size < 4)
+		pcm->buffer_size = 4;
+	pcm->start_threshold = pcm->buffer_size;
+	pcm->avail_min = pcm->buffer_size / 4;
+
+	/* Device is prepared */
+	pcm->running = 0;
+	pcm->xrun = 0;
+	pcm->written = 0;
+
+	return 0;
+}
+
+int snd_pcm_get_params(snd_pcm_t *pcm, snd_pcm_uframes_t *buffer_size,
+		       snd_pcm_uframes_t *period_size)
+{
+	*buffer_size = pcm->buffer_size;
+	*period_size = pcm->buffer_size / 4;
+
+	return 0;
+}
+
+/* Software parameters are kept in memory allocated by libasound */
+struct bench_pcm_sw_params {
+	double start_threshold;
+	double avail_min;
+};
+
+int snd_pcm_sw_params_current(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
+{
+	struct bench_pcm_sw_params *p = (struct bench_pcm_sw_params *) params;
+
+	p->start_threshold = pcm->start_threshold;
+	p->avail_min = pcm->avail_min;
+
+	return 0;
+}
+
+int snd_pcm_sw_params_set_start_threshold(snd_pcm_t *pcm,
+					  snd_pcm_sw_params_t *params,
+					  snd_pcm_uframes_t val)
+{
+	((struct bench_pcm_sw_params *) params)->start_threshold = val;
+	return 0;
+}
+
+int snd_pcm_sw_params_set_avail_min(snd_pcm_t *pcm,
+				    snd_pcm_sw_params_t *params,
+				    snd_pcm_uframes_t val)
+{
+	((struct bench_pcm_sw_params *) params)->avail_min = val;
+	return 0;
+}
+
+int snd_pcm_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
+{
+	struct bench_pcm_sw_params *p = (struct bench_pcm_sw_params *) params;
+
+	pcm->start_threshold = p->start_threshold;
+	pcm->avail_min = p->avail_min;
+
+	return 0;
+}
+
+int snd_pcm_prepare(snd_pcm_t *pcm)
+{
+	pcm->running = 0;
+	pcm->xrun = 0;
+	pcm->written = 0;
+
+	return 0;
+}
+
+int snd_pcm_drop(snd_pcm_t *pcm)
+{
+	return snd_pcm_prepare(pcm);
+}
+
+int snd_pcm_drain(snd_pcm_t *pcm)
+{
+	double now = bench_pcm_now();
+
+	/* Wait end of samples in buffer */
+	if(!pcm->xrun && pcm->written > 0)
+	{
+		if(!pcm->running)
+		{
+			pcm->running = 1;
+			pcm->start = now;
+		}
+		bench_pcm_sleep_until(bench_pcm_time_of(pcm, pcm->written));
+	}
+
+	return snd_pcm_prepare(pcm);
+}
+
+int snd_pcm_recover(snd_pcm_t *pcm, int err, int silent)
+{
+	if(err != -EPIPE)
+		return err;
+
+	return snd_pcm_prepare(pcm);
+}
+
+int snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
+{
+	double now = bench_pcm_now();
+	int ret;
+
+	ret = bench_pcm_update(pcm, now);
+	if(ret < 0)
+		return ret;
+
+	*delayp = pcm->written - bench_pcm_consumed(pcm, now);
+	return 0;
+}
+
+snd_pcm_sframes_t snd_pcm_avail_update(snd_pcm_t *pcm)
+{
+	double now = bench_pcm_now();
+	int ret;
+
+	ret = bench_pcm_update(pcm, now);
+	if(ret < 0)
+		return ret;
+
+	return pcm->buffer_size - pcm->written +
+	       bench_pcm_consumed(pcm, now);
+}
+
+snd_pcm_state_t snd_pcm_state(snd_pcm_t *pcm)
+{
+	bench_pcm_update(pcm, bench_pcm_now());
+
+	if(pcm->xrun)
+		return SND_PCM_STATE_XRUN;
+	return pcm->running ? SND_PCM_STATE_RUNNING : SND_PCM_STATE_PREPARED;
+}
+
+int snd_pcm_wait(snd_pcm_t *pcm, int timeout)
+{
+	double now = bench_pcm_now();
+	double end;
+	int ret;
+
+	ret = bench_pcm_update(pcm, now);
+	if(ret < 0)
+		return ret;
+
+	/* Block until available room reaches minimum */
+	end = pcm->written + pcm->avail_min - pcm->buffer_size;
+	if(pcm->running && end > bench_pcm_consumed(pcm, now))
+	{
+		end = bench_pcm_time_of(pcm, end);
+		if(timeout >= 0 && end > now + timeout / 1000.0)
+		{
+			bench_pcm_sleep_until(now + timeout / 1000.0);
+			return 0;
+		}
+		bench_pcm_sleep_until(end);
+	}
+
+	return 1;
+}
+
+snd_pcm_sframes_t snd_pcm_rewindable(snd_pcm_t *pcm)
+{
+	double now = bench_pcm_now();
+	int ret;
+
+	ret = bench_pcm_update(pcm, now);
+	if(ret < 0)
+		return ret;
+
+	return pcm->written - bench_pcm_consumed(pcm, now);
+}
+
+snd_pcm_sframes_t snd_pcm_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+	snd_pcm_sframes_t max;
+
+	max = snd_pcm_rewindable(pcm);
+	if(max < 0)
+		return max;
+	if(frames > (snd_pcm_uframes_t) max)
+		frames = max;
+	pcm->written -= frames;
+
+	return frames;
+}
+
+snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t *pcm, const void *buffer,
+				 snd_pcm_uframes_t size)
+{
+	double now, headroom, end;
+	int ret;
+
+	/* Account CPU time of output thread since last period */
+	bench_stage_tick(STAGE_MIXER);
+
+	/* Check underrun */
+	now = bench_pcm_now();
+	ret = bench_pcm_update(pcm, now);
+	if(ret < 0)
+		return ret;
+
+	pthread_mutex_lock(&bench_pcm_mutex);
+	bench_pcm_stats.periods++;
+	bench_pcm_stats.frames += size;
+	if(pcm->running)
+	{
+		/* Update lowest buffer fill */
+		headroom = (pcm->written - bench_pcm_consumed(pcm, now)) *
+			   1000 / pcm->samplerate;
+		if(bench_pcm_stats.min_headroom < 0 ||
+		   headroom < bench_pcm_stats.min_headroom)
+			bench_pcm_stats.min_headroom = headroom;
+	}
+	pthread_mutex_unlock(&bench_pcm_mutex);
+
+	/* Start device when start threshold is reached */
+	end = pcm->written + size;
+	if(!pcm->running && end >= pcm->start_threshold)
+	{
+		pcm->running = 1;
+		pcm->start = now;
+	}
+
+	/* Block until enough room is available in buffer */
+	if(pcm->running && end - pcm->buffer_size >
+			   bench_pcm_consumed(pcm, now))
+		bench_pcm_sleep_until(bench_pcm_time_of(pcm,
+						end - pcm->buffer_size));
+	pcm->written = end;
+
+	return size;
+}
+
@@ -0,0 +1,50 @@
+/*
+ * bench_pcm.h - Virtual ALSA PCM device for benchmarks
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_PCM_H
+#define _BENCH_PCM_H
+
+#include <stdint.h>
+
+/*
+ * The snd_pcm_*() functions used by the ALSA output module are replaced by a
+ * virtual device which discards samples and consumes them on a clock running
+ * speed times faster than real time. Like a real device, writes block while
+ * the buffer (sized from the requested latency) is full, the device starts at
+ * its start threshold, snd_pcm_wait() blocks until available room reaches its
+ * minimum, and an underrun is reported with -EPIPE when the buffer has been
+ * empty before next write.
+ */
+
+struct bench_pcm_stats {
+	unsigned long periods;		/* Calls to snd_pcm_writei() */
+	unsigned long xruns;		/* Underruns */
+	uint64_t frames;		/* Frames played */
+	double max_overrun;		/* Worst write after underrun (in ms) */
+	double min_headroom;		/* Lowest buffer fill before write
+					   (in ms) */
+};
+
+/* Set speed of device clock (1.0 for real time) */
+void bench_pcm_set_speed(double speed);
+
+/* Get statistics and reset them */
+void bench_pcm_get_stats(struct bench_pcm_stats *stats, int reset);
+
+#endif
+
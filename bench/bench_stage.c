@@ -0,0 +1,206 @@
+/*
+ * bench_stage.c - CPU time accounting of pipeline stages for benchmarks
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "cache.h"
+#include "resample.h"
+#include "file.h"
+#include "shoutcast.h"
+#include "raop.h"
+#include "rtp.h"
+#include "demux.h"
+#include "decoder.h"
+
+#include "bench_stage.h"
+
+/* Nested stage call */
+struct bench_call {
+	uint64_t start;
+	uint64_t child;
+};
+
+const char *bench_stage_names[STAGE_COUNT] = {
+	"mixer", "cache", "resample", "file", "radio", "airtunes", "rtp",
+	"demux", "decode"
+};
+
+/* Cumulated CPU time of stages (in ns) */
+static uint64_t bench_stage_times[STAGE_COUNT];
+static pthread_mutex_t bench_stage_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* CPU time of wrapped calls done by current thread (since last tick) */
+static __thread uint64_t bench_stage_child = 0;
+static __thread uint64_t bench_stage_last = 0;
+
+uint64_t bench_stage_thread_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_stage_add(enum bench_stage stage, uint64_t time)
+{
+	pthread_mutex_lock(&bench_stage_mutex);
+	bench_stage_times[stage] += time;
+	pthread_mutex_unlock(&bench_stage_mutex);
+}
+
+static void bench_stage_enter(struct bench_call *c)
+{
+	/* Save time of previous nested calls */
+	c->child = bench_stage_child;
+	bench_stage_child = 0;
+	c->start = bench_stage_thread_time();
+}
+
+static void bench_stage_leave(struct bench_call *c, enum bench_stage stage)
+{
+	uint64_t time;
+
+	/* Account time without nested stages */
+	time = bench_stage_thread_time() - c->start;
+	bench_stage_add(stage, time > bench_stage_child ?
+			       time - bench_stage_child : 0);
+
+	/* Time is a nested call for caller */
+	bench_stage_child = c->child + time;
+}
+
+void bench_stage_tick(enum bench_stage stage)
+{
+	uint64_t now, time;
+
+	now = bench_stage_thread_time();
+	if(bench_stage_last != 0)
+	{
+		time = now - bench_stage_last;
+		bench_stage_add(stage, time > bench_stage_child ?
+				       time - bench_stage_child : 0);
+	}
+	bench_stage_child = 0;
+	bench_stage_last = now;
+}
+
+void bench_stage_get(uint64_t *times)
+{
+	pthread_mutex_lock(&bench_stage_mutex);
+	memcpy(times, bench_stage_times, sizeof(bench_stage_times));
+	pthread_mutex_unlock(&bench_stage_mutex);
+}
+
+/******************************************************************************
+ *                              Stage wrappers                                *
+ ******************************************************************************/
+
+#define BENCH_WRAP_READ(name, stage) \
+int __real_##name(void *h, unsigned char *buffer, size_t size, \
+		  struct a_format *fmt); \
+int __wrap_##name(void *h, unsigned char *buffer, size_t size, \
+		  struct a_format *fmt) \
+{ \
+	struct bench_call c; \
+	int ret; \
+\
+	bench_stage_enter(&c); \
+	ret = __real_##name(h, buffer, size, fmt); \
+	bench_stage_leave(&c, stage); \
+\
+	return ret; \
+}
+
+BENCH_WRAP_READ(cache_read, STAGE_CACHE)
+BENCH_WRAP_READ(resample_read, STAGE_RESAMPLE)
+BENCH_WRAP_READ(file_read, STAGE_FILE)
+BENCH_WRAP_READ(shoutcast_read, STAGE_RADIO)
+BENCH_WRAP_READ(raop_read, STAGE_AIRTUNES)
+
+ssize_t __real_rtp_read(struct rtp_handle *h, unsigned char *buffer,
+			size_t len);
+ssize_t __wrap_rtp_read(struct rtp_handle *h, unsigned char *buffer,
+			size_t len)
+{
+	struct bench_call c;
+	ssize_t ret;
+
+	bench_stage_enter(&c);
+	ret = __real_rtp_read(h, buffer, len);
+	bench_stage_leave(&c, STAGE_RTP);
+
+	return ret;
+}
+
+int __real_demux_get_frames(struct demux_handle *h, unsigned char **buffers,
+			    size_t *lens, int count);
+int __wrap_demux_get_frames(struct demux_handle *h, unsigned char **buffers,
+			    size_t *lens, int count)
+{
+	struct bench_call c;
+	int ret;
+
+	bench_stage_enter(&c);
+	ret = __real_demux_get_frames(h, buffers, lens, count);
+	bench_stage_leave(&c, STAGE_DEMUX);
+
+	return ret;
+}
+
+int __real_decoder_decode(struct decoder_handle *h, unsigned char *in_buffer,
+			  size_t in_size, unsigned char *out_buffer,
+			  size_t out_size, struct decoder_info *info);
+int __wrap_decoder_decode(struct decoder_handle *h, unsigned char *in_buffer,
+			  size_t in_size, unsigned char *out_buffer,
+			  size_t out_size, struct decoder_info *info)
+{
+	struct bench_call c;
+	int ret;
+
+	bench_stage_enter(&c);
+	ret = __real_decoder_decode(h, in_buffer, in_size, out_buffer,
+				    out_size, info);
+	bench_stage_leave(&c, STAGE_DECODE);
+
+	return ret;
+}
+
+int __real_decoder_decode_frames(struct decoder_handle *h,
+				 struct decoder_frame *frames,
+				 unsigned int count, unsigned char *out_buffer,
+				 size_t out_size, struct decoder_info *info);
+int __wrap_decoder_decode_frames(struct decoder_handle *h,
+				 struct decoder_frame *frames,
+				 unsigned int count, unsigned char *out_buffer,
+				 size_t out_size, struct decoder_info *info)
+{
+	struct bench_call c;
+	int ret;
+
+	bench_stage_enter(&c);
+	ret = __real_decoder_decode_frames(h, frames, count, out_buffer,
+					   out_size, info);
+	bench_stage_leave(&c, STAGE_DECODE);
+
+	return ret;
+}
+
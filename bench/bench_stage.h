@@ -0,0 +1,56 @@
+/*
+ * bench_stage.h - CPU time accounting of pipeline stages for benchmarks
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_STAGE_H
+#define _BENCH_STAGE_H
+
+#include <stdint.h>
+
+/*
+ * Entry points of each stage are wrapped at link time (see --wrap in
+ * Makefile.am) and the CPU time of the calling thread is accounted to the
+ * stage, minus the time spent in nested stages.
+ */
+enum bench_stage {
+	STAGE_MIXER,		/*!< Output thread (mix, volume, device) */
+	STAGE_CACHE,		/*!< cache_read() */
+	STAGE_RESAMPLE,		/*!< resample_read() */
+	STAGE_FILE,		/*!< file_read() */
+	STAGE_RADIO,		/*!< shoutcast_read() */
+	STAGE_AIRTUNES,		/*!< raop_read() */
+	STAGE_RTP,		/*!< rtp_read() */
+	STAGE_DEMUX,		/*!< demux_get_frames() */
+	STAGE_DECODE,		/*!< decoder_decode*() */
+	STAGE_COUNT
+};
+
+extern const char *bench_stage_names[STAGE_COUNT];
+
+/* Get CPU time of calling thread (in ns) */
+uint64_t bench_stage_thread_time(void);
+
+/* Account CPU time of calling thread since last call to stage, without time
+ * spent in wrapped stages: used for the output thread.
+ */
+void bench_stage_tick(enum bench_stage stage);
+
+/* Copy cumulated CPU time of all stages (in ns) */
+void bench_stage_get(uint64_t *times);
+
+#endif
+
@@ -0,0 +1,753 @@
+/*
+ * codec_bench.c - Decoder benchmark
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "decoder.h"
+#include "convert.h"
+#include "synth.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef VERSION
+	#define VERSION "1.0.0"
+#endif
+
+/* PCM frame size in bytes */
+#define PCM_FRAME_SIZE 4096
+
+/* Chunk size used to feed compressed streams (MP3 and ADTS) */
+#define STREAM_CHUNK_SIZE 4096
+
+/* Output buffer size in samples */
+#define OUT_SIZE 8192
+
+/* Benchmark input */
+struct bench_input {
+	const char *name;		/* Codec name */
+	const char *source;		/* "synthetic" or file path */
+	enum a_codec codec;
+	/* Decoder configuration */
+	unsigned char config[SYNTH_ALAC_CONFIG_SIZE];
+	size_t config_len;
+	/* Encoded frames */
+	unsigned char *data;
+	size_t len;
+	struct decoder_frame *frames;
+	unsigned int count;
+};
+
+/* Benchmark result */
+struct bench_result {
+	unsigned long long samples;
+	unsigned long samplerate;
+	unsigned char channels;
+	double cpu_time;
+	unsigned long allocs;
+	unsigned long long alloc_bytes;
+};
+
+/* Thresholds (0 to disable) */
+static double min_realtime = 0;
+static double max_ns = 0;
+static long max_allocs = -1;
+
+/* Program args */
+static unsigned int duration = 30;	/* Synthesized signal duration */
+static unsigned int repeat = 3;		/* Runs per input (best is kept) */
+static int use_batch = 0;		/* Use decoder_decode_frames() */
+static int json = 0;			/* Machine readable output */
+static const char *only = NULL;		/* Codec filter */
+
+/******************************************************************************
+ *                           Allocation counting                              *
+ ******************************************************************************/
+
+/* glibc entry points used to count allocations done by decoders and codec
+ * libraries while they are running.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int alloc_count_enabled = 0;
+static unsigned long alloc_count = 0;
+static unsigned long long alloc_bytes = 0;
+
+void *malloc(size_t size)
+{
+	if(alloc_count_enabled)
+	{
+		alloc_count++;
+		alloc_bytes += size;
+	}
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if(alloc_count_enabled)
+	{
+		alloc_count++;
+		alloc_bytes += nmemb * size;
+	}
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if(alloc_count_enabled)
+	{
+		alloc_count++;
+		alloc_bytes += size;
+	}
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+/******************************************************************************
+ *                               Input corpus                                 *
+ ******************************************************************************/
+
+static int bench_add_frame(struct bench_input *in, size_t pos, size_t len)
+{
+	struct decoder_frame *frames;
+
+	/* Grow frame list */
+	if((in->count & 255) == 0)
+	{
+		frames = realloc(in->frames, (in->count + 256) *
+					     sizeof(struct decoder_frame));
+		if(frames == NULL)
+			return -1;
+		in->frames = frames;
+	}
+
+	/* Frame data is set when all input is encoded */
+	in->frames[in->count].buffer = (unsigned char *) pos;
+	in->frames[in->count].len = len;
+	in->count++;
+
+	return 0;
+}
+
+static void bench_fix_frames(struct bench_input *in)
+{
+	unsigned int i;
+
+	/* Convert offsets to pointers */
+	for(i = 0; i < in->count; i++)
+		in->frames[i].buffer = in->data +
+				       (size_t) in->frames[i].buffer;
+}
+
+static int bench_encode_pcm(struct bench_input *in, const int16_t *pcm,
+			    size_t frames)
+{
+	size_t i, len;
+
+	/* Big endian 16-bit PCM (default format of PCM decoder) */
+	in->len = frames * SYNTH_CHANNELS * 2;
+	in->data = malloc(in->len);
+	if(in->data == NULL)
+		return -1;
+	for(i = 0; i < frames * SYNTH_CHANNELS; i++)
+	{
+		in->data[i*2] = (uint16_t) pcm[i] >> 8;
+		in->data[i*2+1] = pcm[i] & 0xFF;
+	}
+
+	/* Split in frames */
+	for(i = 0; i < in->len; i += len)
+	{
+		len = in->len - i > PCM_FRAME_SIZE ? PCM_FRAME_SIZE :
+						     in->len - i;
+		if(bench_add_frame(in, i, len) != 0)
+			return -1;
+	}
+	bench_fix_frames(in);
+
+	return 0;
+}
+
+static int bench_encode_alac(struct bench_input *in, const int16_t *pcm,
+			     size_t frames)
+{
+	size_t i, n, len;
+
+	/* Decoder configuration */
+	synth_alac_config(in->config);
+	in->config_len = SYNTH_ALAC_CONFIG_SIZE;
+
+	/* Allocate worst case output */
+	in->data = malloc((frames / SYNTH_ALAC_FRAME_SAMPLES + 1) *
+			  SYNTH_ALAC_MAX_FRAME_SIZE);
+	if(in->data == NULL)
+		return -1;
+	in->len = 0;
+
+	/* Encode frames */
+	for(i = 0; i < frames; i += n)
+	{
+		n = frames - i > SYNTH_ALAC_FRAME_SAMPLES ?
+					   SYNTH_ALAC_FRAME_SAMPLES : frames - i;
+		len = synth_alac_encode(&in->data[in->len],
+					&pcm[i*SYNTH_CHANNELS], n);
+		if(bench_add_frame(in, in->len, len) != 0)
+			return -1;
+		in->len += len;
+	}
+	bench_fix_frames(in);
+
+	return 0;
+}
+
+static int bench_load_file(struct bench_input *in, const char *path)
+{
+	const char *ext;
+	size_t i, len;
+	FILE *fp;
+
+	/* Get codec from extension */
+	ext = strrchr(path, '.');
+	if(ext != NULL && strcasecmp(ext, ".mp3") == 0)
+	{
+		in->codec = CODEC_MP3;
+		in->name = "mp3";
+	}
+	else if(ext != NULL && (strcasecmp(ext, ".aac") == 0 ||
+				strcasecmp(ext, ".adts") == 0))
+	{
+		in->codec = CODEC_AAC;
+		in->name = "aac";
+	}
+	else
+	{
+		fprintf(stderr, "Unsupported file %s (only MP3 and ADTS)\n",
+			path);
+		return -1;
+	}
+	in->source = path;
+
+	/* Load file in memory */
+	fp = fopen(path, "rb");
+	if(fp == NULL)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	in->len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	in->data = malloc(in->len);
+	if(in->data == NULL || fread(in->data, 1, in->len, fp) != in->len)
+	{
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	/* First bytes are used as configuration (ADTS header or MP3 frame) */
+	in->config_len = in->len > SYNTH_ALAC_CONFIG_SIZE ?
+					       SYNTH_ALAC_CONFIG_SIZE : in->len;
+	memcpy(in->config, in->data, in->config_len);
+
+	/* Split stream in chunks */
+	for(i = 0; i < in->len; i += len)
+	{
+		len = in->len - i > STREAM_CHUNK_SIZE ? STREAM_CHUNK_SIZE :
+							in->len - i;
+		if(bench_add_frame(in, i, len) != 0)
+			return -1;
+	}
+	bench_fix_frames(in);
+
+	return 0;
+}
+
+/******************************************************************************
+ *                                Benchmark                                   *
+ ******************************************************************************/
+
+static double bench_cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_decode(struct decoder_handle *dec, struct bench_input *in,
+			unsigned char *out, struct bench_result *r)
+{
+	struct decoder_info info;
+	unsigned int i;
+	size_t pos;
+	int samples;
+
+	for(i = 0; i < in->count; i++)
+	{
+		/* Decode all data of frame */
+		for(pos = 0; pos < in->frames[i].len; pos += info.used)
+		{
+			samples = decoder_decode(dec, &in->frames[i].buffer[pos],
+						 in->frames[i].len - pos, out,
+						 OUT_SIZE, &info);
+			if(samples > 0)
+			{
+				r->samples += samples;
+				r->samplerate = info.samplerate;
+				r->channels = info.channels;
+			}
+			else if(samples < 0 && samples != DECODER_ERROR_BUFLEN &&
+				samples != DECODER_ERROR_SYNC)
+				return -1;
+
+			/* Get remaining samples */
+			while(samples > 0 && info.remaining > 0)
+			{
+				samples = decoder_decode(dec, NULL, 0, out,
+							 OUT_SIZE, &info);
+				if(samples > 0)
+					r->samples += samples;
+			}
+
+			/* Skip undecodable data */
+			if(info.used == 0)
+				break;
+		}
+	}
+
+	return 0;
+}
+
+static int bench_decode_batch(struct decoder_handle *dec,
+			      struct bench_input *in, unsigned char *out,
+			      struct bench_result *r)
+{
+	struct decoder_frame *frames;
+	struct decoder_info info;
+	unsigned int i = 0;
+	int samples;
+
+	/* Work on a copy since partially consumed frames are moved */
+	frames = malloc(in->count * sizeof(struct decoder_frame));
+	if(frames == NULL)
+		return -1;
+	memcpy(frames, in->frames, in->count * sizeof(struct decoder_frame));
+
+	do {
+		/* Decode as many frames as possible */
+		info.samplerate = 0;
+		info.channels = 0;
+		samples = decoder_decode_frames(dec, &frames[i], in->count - i,
+						out, OUT_SIZE, &info);
+		if(samples < 0)
+			break;
+		r->samples += samples;
+		r->samplerate = info.samplerate;
+		r->channels = info.channels;
+
+		/* Move to next frames */
+		i += info.used;
+		if(i < in->count && frames[i].used > 0)
+		{
+			frames[i].buffer += frames[i].used;
+			frames[i].len -= frames[i].used;
+		}
+		else if(i < in->count && samples == 0 && info.remaining == 0)
+		{
+			/* Skip undecodable frame */
+			i++;
+		}
+	} while(i < in->count || info.remaining > 0);
+
+	free(frames);
+
+	return samples < 0 ? -1 : 0;
+}
+
+static int bench_run(struct bench_input *in, struct bench_result *res)
+{
+	struct decoder_handle *dec;
+	struct bench_result r;
+	unsigned long samplerate;
+	unsigned char channels;
+	unsigned char *out;
+	unsigned int n;
+	double start;
+	int ret;
+
+	/* Allocate output buffer */
+	out = malloc(OUT_SIZE * 4);
+	if(out == NULL)
+		return -1;
+
+	memset(res, 0, sizeof(struct bench_result));
+	for(n = 0; n < repeat; n++)
+	{
+		memset(&r, 0, sizeof(struct bench_result));
+		alloc_count = 0;
+		alloc_bytes = 0;
+
+		/* Time decoder opening and decoding */
+		alloc_count_enabled = 1;
+		start = bench_cpu_time();
+		if(decoder_open(&dec, in->codec, in->config, in->config_len,
+				&samplerate, &channels) != 0)
+		{
+			alloc_count_enabled = 0;
+			decoder_close(dec);
+			free(out);
+			return -1;
+		}
+		if(use_batch)
+			ret = bench_decode_batch(dec, in, out, &r);
+		else
+			ret = bench_decode(dec, in, out, &r);
+		r.cpu_time = bench_cpu_time() - start;
+		alloc_count_enabled = 0;
+		r.allocs = alloc_count;
+		r.alloc_bytes = alloc_bytes;
+		decoder_close(dec);
+		if(ret != 0)
+		{
+			free(out);
+			return -1;
+		}
+
+		/* Keep best run */
+		if(n == 0 || r.cpu_time < res->cpu_time)
+			memcpy(res, &r, sizeof(struct bench_result));
+	}
+
+	free(out);
+
+	return 0;
+}
+
+static int bench_report(const char *name, const char *source,
+			unsigned long long samples, unsigned long samplerate,
+			unsigned char channels, double cpu_time,
+			long allocs, unsigned long long bytes)
+{
+	double audio_time, realtime, ns;
+	int ok = 1;
+
+	/* Calculate figures */
+	audio_time = samplerate && channels ? (double) samples / samplerate /
+					      channels : 0;
+	realtime = cpu_time > 0 ? audio_time / cpu_time : 0;
+	ns = samples > 0 ? cpu_time * 1e9 / samples : 0;
+
+	/* Check thresholds */
+	if(min_realtime > 0 && audio_time > 0 && realtime < min_realtime)
+		ok = 0;
+	if(max_ns > 0 && ns > max_ns)
+		ok = 0;
+	if(max_allocs >= 0 && allocs > max_allocs)
+		ok = 0;
+
+	/* Print result */
+	if(json)
+		printf("{\"codec\": \"%s\", \"source\": \"%s\", "
+		       "\"samples\": %llu, \"samplerate\": %lu, "
+		       "\"channels\": %u, \"cpu_time\": %.6f, "
+		       "\"x_realtime\": %.1f, \"ns_per_sample\": %.2f, "
+		       "\"allocs\": %ld, \"alloc_bytes\": %llu, "
+		       "\"status\": \"%s\"}\n", name, source, samples,
+		       samplerate, channels, cpu_time, realtime, ns, allocs,
+		       bytes, ok ? "ok" : "fail");
+	else
+		printf("%-8s %-24.24s %12llu %10.1f %10.2f %8ld %12llu%s\n",
+		       name, source, samples, realtime, ns, allocs, bytes,
+		       ok ? "" : " FAIL");
+
+	return ok ? 0 : -1;
+}
+
+static int bench_convert(void)
+{
+	int32_t *left, *right;
+	unsigned char *in;
+	void *out;
+	size_t count = SYNTH_SAMPLERATE * SYNTH_CHANNELS;
+	double start, t[4] = { 0, 0, 0, 0 };
+	unsigned int n, i;
+	int ret = 0;
+
+	/* Allocate buffers (1s of stereo samples) */
+	in = malloc(count * 4);
+	out = malloc(count * 4);
+	left = malloc(count / 2 * 4);
+	right = malloc(count / 2 * 4);
+	if(in == NULL || out == NULL || left == NULL || right == NULL)
+		goto end;
+	for(i = 0; i < count * 4; i++)
+		in[i] = i * 7 + 3;
+	for(i = 0; i < count / 2; i++)
+	{
+		left[i] = (int32_t) (i * 2654435761U) >> 3;
+		right[i] = -left[i];
+	}
+
+	/* Run each kernel on duration seconds */
+	for(n = 0; n < duration; n++)
+	{
+		start = bench_cpu_time();
+		convert_s16le(out, in, count);
+		t[0] += bench_cpu_time() - start;
+		start = bench_cpu_time();
+		convert_s16be(out, in, count);
+		t[1] += bench_cpu_time() - start;
+		start = bench_cpu_time();
+		convert_s24be(out, in, count);
+		t[2] += bench_cpu_time() - start;
+		start = bench_cpu_time();
+		convert_fixed_q28(out, left, right, count / 2);
+		t[3] += bench_cpu_time() - start;
+	}
+
+	/* Report */
+	ret |= bench_report("convert", "s16le", (unsigned long long) count *
+			    duration, SYNTH_SAMPLERATE, SYNTH_CHANNELS, t[0],
+			    0, 0);
+	ret |= bench_report("convert", "s16be", (unsigned long long) count *
+			    duration, SYNTH_SAMPLERATE, SYNTH_CHANNELS, t[1],
+			    0, 0);
+	ret |= bench_report("convert", "s24be", (unsigned long long) count *
+			    duration, SYNTH_SAMPLERATE, SYNTH_CHANNELS, t[2],
+			    0, 0);
+	ret |= bench_report("convert", "fixed_q28", (unsigned long long)
+			    count * duration, SYNTH_SAMPLERATE, SYNTH_CHANNELS,
+			    t[3], 0, 0);
+
+end:
+	free(in);
+	free(out);
+	free(left);
+	free(right);
+
+	return ret;
+}
+
+static void bench_free_input(struct bench_input *in)
+{
+	free(in->data);
+	free(in->frames);
+	memset(in, 0, sizeof(struct bench_input));
+}
+
+static int bench_input(struct bench_input *in)
+{
+	struct bench_result r;
+
+	/* Filter codec */
+	if(only != NULL && strcmp(only, in->name) != 0)
+		return 0;
+
+	/* Run benchmark */
+	if(bench_run(in, &r) != 0)
+	{
+		fprintf(stderr, "Failed to decode %s (%s)\n", in->source,
+			in->name);
+		return -1;
+	}
+
+	return bench_report(in->name, in->source, r.samples, r.samplerate,
+			    r.channels, r.cpu_time, r.allocs, r.alloc_bytes);
+}
+
+static void print_usage(const char *name)
+{
+	printf("Usage: %s [OPTIONS] [FILE...]\n"
+		"\n"
+		"Benchmark decoders on synthesized PCM and ALAC streams and on\n"
+		"MP3 and ADTS AAC files given as arguments.\n"
+		"\n"
+		"Options:\n"
+		"-d      --duration=SEC       Synthesized signal duration "
+						"(default: 30)\n"
+		"-r      --repeat=N           Runs per input, best is kept "
+						"(default: 3)\n"
+		"-c      --codec=NAME         Only run pcm, alac, mp3, aac or "
+						"convert\n"
+		"-b      --batch              Use batched decoding API\n"
+		"-j      --json               Print one JSON object per line\n"
+		"        --min-realtime=X     Fail under X times realtime\n"
+		"        --max-ns=N           Fail over N ns per sample\n"
+		"        --max-allocs=N       Fail over N allocations per run\n"
+		"-h      --help               Print this usage and exit\n"
+		"        --version            Print version and exit\n",
+		 name);
+}
+
+static void parse_opt(int argc, char * const argv[])
+{
+	int c;
+
+	/* Get options */
+	while(1)
+	{
+		int option_index = 0;
+		static const char *short_options = "d:r:c:bjh";
+		static struct option long_options[] =
+		{
+			{"version",      no_argument,        0, 0},
+			{"min-realtime", required_argument,  0, 0},
+			{"max-ns",       required_argument,  0, 0},
+			{"max-allocs",   required_argument,  0, 0},
+			{"duration",     required_argument,  0, 'd'},
+			{"repeat",       required_argument,  0, 'r'},
+			{"codec",        required_argument,  0, 'c'},
+			{"batch",        no_argument,        0, 'b'},
+			{"json",         no_argument,        0, 'j'},
+			{"help",         no_argument,        0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		/* Get next option */
+		c = getopt_long(argc, argv, short_options, long_options,
+				&option_index);
+		if(c == EOF)
+			break;
+
+		/* Parse option */
+		switch(c)
+		{
+			case 0:
+				switch(option_index)
+				{
+					case 0:
+						/* Version */
+						printf("AirCat codec bench "
+						       VERSION "\n");
+						exit(EXIT_SUCCESS);
+						break;
+					case 1:
+						min_realtime = atof(optarg);
+						break;
+					case 2:
+						max_ns = atof(optarg);
+						break;
+					case 3:
+						max_allocs = atol(optarg);
+						break;
+				}
+				break;
+			case 'd':
+				duration = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				repeat = strtoul(optarg, NULL, 10);
+				if(repeat == 0)
+					repeat = 1;
+				break;
+			case 'c':
+				only = optarg;
+				break;
+			case 'b':
+				use_batch = 1;
+				break;
+			case 'j':
+				json = 1;
+				break;
+			case 'h':
+				print_usage(argv[0]);
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_input in;
+	size_t frames;
+	int16_t *pcm;
+	int ret = 0;
+	int i;
+
+	/* Parse options */
+	parse_opt(argc, argv);
+
+	/* Synthesize test signal */
+	frames = (size_t) duration * SYNTH_SAMPLERATE;
+	pcm = synth_signal(frames);
+	if(pcm == NULL)
+	{
+		fprintf(stderr, "Failed to synthesize signal\n");
+		return EXIT_FAILURE;
+	}
+
+	if(!json)
+		printf("%-8s %-24s %12s %10s %10s %8s %12s\n", "codec",
+		       "source", "samples", "x-realtime", "ns/sample",
+		       "allocs", "alloc-bytes");
+
+	/* PCM */
+	memset(&in, 0, sizeof(in));
+	in.name = "pcm";
+	in.source = "synthetic";
+	in.codec = CODEC_PCM;
+	if(bench_encode_pcm(&in, pcm, frames) != 0 || bench_input(&in) != 0)
+		ret = -1;
+	bench_free_input(&in);
+
+	/* ALAC */
+	in.name = "alac";
+	in.source = "synthetic";
+	in.codec = CODEC_ALAC;
+	if(bench_encode_alac(&in, pcm, frames) != 0 || bench_input(&in) != 0)
+		ret = -1;
+	bench_free_input(&in);
+	free(pcm);
+
+	/* MP3 and AAC files */
+	for(i = optind; i < argc; i++)
+	{
+		if(bench_load_file(&in, argv[i]) != 0 || bench_input(&in) != 0)
+			ret = -1;
+		bench_free_input(&in);
+	}
+
+	/* Sample format conversion */
+	if((only == NULL || strcmp(only, "convert") == 0) &&
+	   bench_convert() != 0)
+		ret = -1;
+
+	return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
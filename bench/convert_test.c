@@ -0,0 +1,198 @@
+/*
+ * convert_test.c - Check SIMD sample conversions against scalar conversions
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Conversion functions are built with SIMD code enabled by compiler flags
+ * (SSE2, SSSE3 or NEON) and their output is compared with the scalar macros
+ * used for tails of SIMD loops, on random and edge-case samples, for all
+ * lengths up to TEST_MAX_COUNT and all input alignments.
+ */
+#include "convert.c"
+
+/* Maximum sample count and input offset tested */
+#define TEST_MAX_COUNT 67
+#define TEST_MAX_OFFSET 16
+#define TEST_RANDOM_ROUNDS 200
+
+/* Edge-case bytes: zero, sign bit and full scale */
+static const unsigned char test_edge_bytes[] = {
+	0x00, 0x01, 0x7f, 0x80, 0x81, 0xfe, 0xff
+};
+
+/* Edge-case Q28 samples: around rounding and clipping bounds */
+static const int32_t test_edge_q28[] = {
+	0, 1, -1, 15, 16, -16, -17,
+	Q28_ONE - 17, Q28_ONE - 16, Q28_ONE - 1, Q28_ONE, Q28_ONE + 1,
+	-Q28_ONE + 15, -Q28_ONE - 16, -Q28_ONE - 17, -Q28_ONE, -Q28_ONE - 1,
+	Q28_ONE * 4, -Q28_ONE * 4, 0x70000000, -0x70000000
+};
+
+static unsigned long test_seed = 1;
+static unsigned long test_failed = 0;
+
+static unsigned char test_rand(void)
+{
+	/* Deterministic generator: results don't depend on libc */
+	test_seed = test_seed * 1103515245 + 12345;
+	return test_seed >> 16;
+}
+
+static void test_fill(unsigned char *buffer, size_t len, int edge)
+{
+	size_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		if(edge)
+			buffer[i] = test_edge_bytes[test_rand() %
+						sizeof(test_edge_bytes)];
+		else
+			buffer[i] = test_rand();
+	}
+}
+
+static void test_check(const char *name, const sample_t *out,
+		       const sample_t *ref, size_t count, size_t offset)
+{
+	/* Compare bit by bit (and guard after last sample) */
+	if(memcmp(out, ref, (count + 1) * sizeof(sample_t)) == 0)
+		return;
+
+	fprintf(stderr, "%s: mismatch for %lu samples at offset %lu\n", name,
+		(unsigned long) count, (unsigned long) offset);
+	test_failed++;
+}
+
+static void test_bytes(const unsigned char *in, size_t count, size_t offset)
+{
+	sample_t out[TEST_MAX_COUNT + 1], ref[TEST_MAX_COUNT + 1];
+	const unsigned char *p = in + offset;
+	size_t i;
+
+#define TEST_BYTES(fn, size, from) \
+	memset(out, 0xa5, sizeof(out)); \
+	memset(ref, 0xa5, sizeof(ref)); \
+	fn(out, p, count); \
+	for(i = 0; i < count; i++) \
+		ref[i] = TO_SAMPLE(from(&p[i*size])); \
+	test_check(#fn, out, ref, count, offset);
+
+	TEST_BYTES(convert_s8, 1, FROM_S8);
+	TEST_BYTES(convert_s16le, 2, FROM_S16LE);
+	TEST_BYTES(convert_s16be, 2, FROM_S16BE);
+	TEST_BYTES(convert_s24le, 3, FROM_S24LE);
+	TEST_BYTES(convert_s24be, 3, FROM_S24BE);
+	TEST_BYTES(convert_s32le, 4, FROM_S32LE);
+	TEST_BYTES(convert_s32be, 4, FROM_S32BE);
+
+#undef TEST_BYTES
+}
+
+static void test_q28(const int32_t *left, const int32_t *right, size_t count)
+{
+	sample_t out[TEST_MAX_COUNT * 2 + 1], ref[TEST_MAX_COUNT * 2 + 1];
+	sample_t *p = ref;
+	size_t i;
+
+	memset(out, 0xa5, sizeof(out));
+	memset(ref, 0xa5, sizeof(ref));
+
+	/* Convert with SIMD code and with scalar code */
+	convert_fixed_q28(out, left, right, count);
+	for(i = 0; i < count; i++)
+	{
+		*p++ = convert_q28(left[i]);
+		if(right != NULL)
+			*p++ = convert_q28(right[i]);
+	}
+
+	test_check(right != NULL ? "convert_fixed_q28 (stereo)" :
+				   "convert_fixed_q28 (mono)",
+		   out, ref, right != NULL ? count * 2 : count, 0);
+}
+
+static void test_fill_q28(int32_t *buffer, size_t count, int edge)
+{
+	size_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(edge)
+		{
+			buffer[i] = test_edge_q28[test_rand() %
+				      (sizeof(test_edge_q28) / sizeof(int32_t))];
+			continue;
+		}
+
+		/* Random sample in decoder range, with some overflows */
+		buffer[i] = (int32_t) ((uint32_t) test_rand() << 24 |
+				       (uint32_t) test_rand() << 16 |
+				       (uint32_t) test_rand() << 8 |
+				       test_rand()) >> 2;
+	}
+}
+
+int main(void)
+{
+	unsigned char in[TEST_MAX_COUNT * 4 + TEST_MAX_OFFSET];
+	int32_t left[TEST_MAX_COUNT], right[TEST_MAX_COUNT];
+	size_t count, offset;
+	int round;
+
+#if defined(CONVERT_SSE2) && defined(__SSSE3__)
+	printf("Checking SSE2 and SSSE3 conversions");
+#elif defined(CONVERT_SSE2)
+	printf("Checking SSE2 conversions");
+#elif defined(CONVERT_NEON)
+	printf("Checking NEON conversions");
+#else
+	printf("Checking scalar conversions (no SIMD code enabled)");
+#endif
+#ifdef USE_FLOAT
+	printf(" to float samples\n");
+#else
+	printf(" to 32-bit samples\n");
+#endif
+
+	for(round = 0; round < TEST_RANDOM_ROUNDS; round++)
+	{
+		/* Packed samples: all lengths for all input alignments */
+		test_fill(in, sizeof(in), round & 1);
+		for(count = 0; count <= TEST_MAX_COUNT; count++)
+			for(offset = 0; offset < TEST_MAX_OFFSET; offset++)
+				test_bytes(in, count, offset);
+
+		/* Planar fixed point samples */
+		test_fill_q28(left, TEST_MAX_COUNT, round & 1);
+		test_fill_q28(right, TEST_MAX_COUNT, round & 1);
+		for(count = 0; count <= TEST_MAX_COUNT; count++)
+		{
+			test_q28(left, NULL, count);
+			test_q28(left, right, count);
+		}
+	}
+
+	if(test_failed > 0)
+	{
+		fprintf(stderr, "%lu conversions failed\n", test_failed);
+		return EXIT_FAILURE;
+	}
+	printf("All conversions match\n");
+
+	return EXIT_SUCCESS;
+}
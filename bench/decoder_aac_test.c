@@ -0,0 +1,246 @@
+/*
+ * decoder_aac_test.c - Check direct decoding of AAC frames in output buffer
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The AAC decoder is built against a fake faad which decodes ADTS frames made
+ * of a header and a frame number into samples numbered from frame number. As
+ * faad does, a frame which doesn't fit in buffer passed to NeAACDecDecode2() is
+ * lost. Frames are decoded in batches with the sample count requested by the
+ * cache (2048), and returned samples are checked to be complete and in order,
+ * across a channel count change (mono to stereo).
+ */
+#include "decoder_aac.c"
+
+/* Sample count requested by cache and frame count by file */
+#define TEST_OUT_SIZE 2048
+#define TEST_BATCH 8
+#define TEST_FRAMES 64
+#define TEST_FRAME_LEN 8
+
+/* Fake faad */
+static unsigned long fake_direct = 0;
+static unsigned long fake_lost = 0;
+static int32_t fake_buffer[MAX_FRAME_LENGTH * 8];
+static NeAACDecConfiguration fake_config;
+
+static const unsigned long fake_samplerates[] = {
+	96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000,
+	11025, 8000, 7350
+};
+
+static void fake_header(const unsigned char *in, unsigned long *samplerate,
+			unsigned char *channels)
+{
+	*samplerate = fake_samplerates[(in[2] >> 2) & 0x0F];
+	*channels = ((in[2] & 0x01) << 2) | (in[3] >> 6);
+	if(*channels == 7)
+		*channels = 8;
+}
+
+NeAACDecHandle NeAACDecOpen(void)
+{
+	return &fake_config;
+}
+
+NeAACDecConfigurationPtr NeAACDecGetCurrentConfiguration(NeAACDecHandle h)
+{
+	return &fake_config;
+}
+
+unsigned char NeAACDecSetConfiguration(NeAACDecHandle h,
+				       NeAACDecConfigurationPtr config)
+{
+	return 1;
+}
+
+long NeAACDecInit(NeAACDecHandle h, unsigned char *buffer, unsigned long size,
+		  unsigned long *samplerate, unsigned char *channels)
+{
+	fake_header(buffer, samplerate, channels);
+	return 0;
+}
+
+char NeAACDecInit2(NeAACDecHandle h, unsigned char *buffer, unsigned long size,
+		   unsigned long *samplerate, unsigned char *channels)
+{
+	return -1;
+}
+
+static void *fake_decode(NeAACDecFrameInfo *info, unsigned char *buffer,
+			 unsigned long size, int32_t *out,
+			 unsigned long out_size)
+{
+	unsigned long i;
+
+	/* Decode header: LC frames of 1024 samples per channel */
+	memset(info, 0, sizeof(NeAACDecFrameInfo));
+	if(size < TEST_FRAME_LEN)
+	{
+		info->error = 1;
+		return NULL;
+	}
+	fake_header(buffer, &info->samplerate, &info->channels);
+	info->bytesconsumed = TEST_FRAME_LEN;
+	info->samples = 1024 * info->channels;
+
+	/* Frame doesn't fit in buffer: it is lost */
+	if(info->samples * 4 > out_size)
+	{
+		info->error = 27;
+		info->samples = 0;
+		fake_lost++;
+		return NULL;
+	}
+
+	/* Samples are numbered from frame number */
+	for(i = 0; i < info->samples; i++)
+		out[i] = (buffer[7] << 16) | i;
+
+	return out;
+}
+
+void *NeAACDecDecode(NeAACDecHandle h, NeAACDecFrameInfo *info,
+		     unsigned char *buffer, unsigned long size)
+{
+	return fake_decode(info, buffer, size, fake_buffer,
+			   sizeof(fake_buffer));
+}
+
+void *NeAACDecDecode2(NeAACDecHandle h, NeAACDecFrameInfo *info,
+		      unsigned char *buffer, unsigned long size,
+		      void **out, unsigned long out_size)
+{
+	fake_direct++;
+	return fake_decode(info, buffer, size, *out, out_size);
+}
+
+void NeAACDecClose(NeAACDecHandle h)
+{
+}
+
+static void test_frame(unsigned char *frame, unsigned char n,
+		       unsigned char channels)
+{
+	/* ADTS header: AAC LC, 44.1kHz */
+	frame[0] = 0xFF;
+	frame[1] = 0xF1;
+	frame[2] = 0x50 | (channels >> 2);
+	frame[3] = (channels & 0x03) << 6;
+	frame[4] = TEST_FRAME_LEN >> 3;
+	frame[5] = (TEST_FRAME_LEN & 0x07) << 5 | 0x1F;
+	frame[6] = 0xFC;
+	frame[7] = n;
+}
+
+int main(void)
+{
+	unsigned char frames[TEST_FRAMES][TEST_FRAME_LEN];
+	struct decoder_frame batch[TEST_BATCH];
+	int32_t out[TEST_OUT_SIZE];
+	struct decoder_info info;
+	struct decoder *dec;
+	unsigned long sample = 0, n = 0, samplerate;
+	unsigned char channels;
+	int first = 0, count, failed = 0;
+	int samples, i;
+
+	/* Mono stream switching to stereo in middle of output buffer */
+	for(i = 0; i < TEST_FRAMES; i++)
+		test_frame(frames[i], i, i <= TEST_FRAMES / 2 ? 1 : 2);
+
+	if(decoder_aac_open(&dec, frames[0], TEST_FRAME_LEN, &samplerate,
+			    &channels) != 0)
+	{
+		fprintf(stderr, "Failed to open decoder\n");
+		return EXIT_FAILURE;
+	}
+
+	do
+	{
+		/* Prepare next batch as file does */
+		count = TEST_FRAMES - first;
+		if(count > TEST_BATCH)
+			count = TEST_BATCH;
+		for(i = 0; i < count; i++)
+		{
+			batch[i].buffer = frames[first + i];
+			batch[i].len = TEST_FRAME_LEN;
+			batch[i].used = 0;
+		}
+
+		/* Decode with format of previous samples */
+		info.samplerate = samplerate;
+		info.channels = channels;
+		samples = decoder_aac_decode_frames(dec, batch, count,
+						    (unsigned char *) out,
+						    TEST_OUT_SIZE, &info);
+		if(samples < 0)
+		{
+			fprintf(stderr, "Decoding failed\n");
+			return EXIT_FAILURE;
+		}
+		samplerate = info.samplerate;
+		channels = info.channels;
+
+		/* Check samples are in order */
+		for(i = 0; i < samples && !failed; i++)
+		{
+			if(out[i] != ((n << 16) | sample))
+			{
+				fprintf(stderr, "Sample %lu of frame %lu: got "
+					"%08x\n", sample, n, out[i]);
+				failed = 1;
+			}
+			if(++sample == 1024 * channels)
+			{
+				sample = 0;
+				n++;
+			}
+		}
+
+		/* Skip consumed frames */
+		for(i = 0; i < count && batch[i].used == batch[i].len; i++)
+			first++;
+	} while(!failed && (samples > 0 || count > 0));
+	decoder_aac_close(dec);
+
+	/* All samples of all frames must have been returned */
+	if(!failed && (n != TEST_FRAMES || sample != 0))
+	{
+		fprintf(stderr, "Stopped at sample %lu of frame %lu\n", sample,
+			n);
+		failed = 1;
+	}
+	if(fake_lost > 0)
+	{
+		fprintf(stderr, "%lu frames lost\n", fake_lost);
+		failed = 1;
+	}
+	if(fake_direct == 0)
+	{
+		fprintf(stderr, "No frame decoded in output buffer\n");
+		failed = 1;
+	}
+	if(failed)
+		return EXIT_FAILURE;
+
+	printf("%lu of %d frames decoded in output buffer\n", fake_direct,
+	       TEST_FRAMES);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,268 @@
+/*
+ * fs_aio_test.c - Check asynchronous reads of FS
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A temporary file filled with a pattern is read with batches of requests at
+ * random offsets, with and without callback:
+ *  - through io_uring (when AirCat is built with liburing),
+ *  - through worker pool, with a file system without asynchronous read, while
+ *    file is read sequentially by another thread,
+ *  - through io_uring with io_uring_submit() failing (wrapped at link), so
+ *    requests are returned to worker pool.
+ * Results, end of file and stat requests are checked.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "fs.h"
+
+#define TEST_FILE_SIZE (1024 * 1024)
+#define TEST_REQUESTS 128
+#define TEST_MAX_COUNT 32768
+
+static unsigned char test_data[TEST_FILE_SIZE];
+static unsigned long test_failed = 0;
+static unsigned long test_seed = 1;
+
+/* Submit calls and failures injected in io_uring_submit() */
+static unsigned long submit_calls = 0;
+static int submit_fail = 0;
+
+#ifdef HAVE_LIBURING
+int __real_io_uring_submit(struct io_uring *ring);
+
+int __wrap_io_uring_submit(struct io_uring *ring)
+{
+	submit_calls++;
+	if(submit_fail)
+		return -EBUSY;
+	return __real_io_uring_submit(ring);
+}
+#endif
+
+/* Callback completions */
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int done_count = 0;
+
+static unsigned long test_rand(void)
+{
+	/* Deterministic generator: results don't depend on libc */
+	test_seed = test_seed * 1103515245 + 12345;
+	return (test_seed >> 16) & 0x7FFF;
+}
+
+static int test_check(struct fs_aio *req)
+{
+	size_t len = req->count;
+
+	/* Read is truncated at end of file */
+	if(req->offset + len > TEST_FILE_SIZE)
+		len = TEST_FILE_SIZE - req->offset;
+
+	return req->ret == (ssize_t) len &&
+	       memcmp(req->buf, &test_data[req->offset], len) == 0;
+}
+
+static void test_callback(struct fs_aio *req, void *user_data)
+{
+	if(!test_check(req))
+		__sync_fetch_and_add(&test_failed, 1);
+
+	/* Request can be freed in callback */
+	pthread_mutex_lock(&done_mutex);
+	done_count++;
+	pthread_cond_broadcast(&done_cond);
+	pthread_mutex_unlock(&done_mutex);
+}
+
+static void test_reads(struct fs_file *f, const char *name)
+{
+	static unsigned char buffers[TEST_REQUESTS][TEST_MAX_COUNT];
+	struct fs_aio reqs[TEST_REQUESTS];
+	unsigned long failed = test_failed;
+	int i, callbacks = 0;
+
+	/* Submit requests: last ones are read across end of file */
+	memset(reqs, 0, sizeof(reqs));
+	done_count = 0;
+	for(i = 0; i < TEST_REQUESTS; i++)
+	{
+		reqs[i].file = f;
+		reqs[i].buf = buffers[i];
+		reqs[i].count = 1 + (test_rand() << 15 | test_rand()) %
+				    TEST_MAX_COUNT;
+		reqs[i].offset = (test_rand() << 15 | test_rand()) %
+				 TEST_FILE_SIZE;
+		if(i >= TEST_REQUESTS - 4)
+			reqs[i].offset = TEST_FILE_SIZE - i % 4;
+		if(i & 1)
+		{
+			reqs[i].callback = test_callback;
+			callbacks++;
+		}
+		if(fs_aio_read(&reqs[i]) != 0)
+			test_failed++;
+	}
+
+	/* Wait requests without callback */
+	for(i = 0; i < TEST_REQUESTS; i += 2)
+	{
+		if(fs_aio_wait(&reqs[i], 5000) != 0)
+		{
+			fprintf(stderr, "%s: request %d timed out\n", name, i);
+			test_failed++;
+			continue;
+		}
+		if(!test_check(&reqs[i]))
+		{
+			fprintf(stderr, "%s: request %d returned %zd (errno "
+				"%d)\n", name, i, reqs[i].ret, reqs[i].err);
+			test_failed++;
+		}
+	}
+
+	/* Wait callbacks */
+	pthread_mutex_lock(&done_mutex);
+	while(done_count < callbacks)
+		pthread_cond_wait(&done_cond, &done_mutex);
+	pthread_mutex_unlock(&done_mutex);
+
+	printf("%s: %s\n", name, test_failed == failed ? "ok" : "failed");
+}
+
+static void *test_sequential(void *user_data)
+{
+	struct fs_file *f = user_data;
+	unsigned char buffer[4096];
+	size_t pos = 0;
+	ssize_t len;
+
+	/* Read whole file while requests are done */
+	fs_lseek(f, 0, SEEK_SET);
+	while(pos < TEST_FILE_SIZE)
+	{
+		len = fs_read(f, buffer, sizeof(buffer));
+		if(len <= 0 || memcmp(buffer, &test_data[pos], len) != 0)
+			break;
+		pos += len;
+	}
+
+	return (void *) (long) (pos == TEST_FILE_SIZE);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/fs_aio_test.XXXXXX";
+	struct fs_handle no_aio;
+	struct fs_handle *handle;
+	struct fs_file *f;
+	struct fs_aio stat;
+	pthread_t thread;
+	void *ret;
+	int fd, i;
+
+	/* Create test file */
+	for(i = 0; i < TEST_FILE_SIZE; i++)
+		test_data[i] = test_rand();
+	fd = mkstemp(path);
+	if(fd < 0 || write(fd, test_data, TEST_FILE_SIZE) != TEST_FILE_SIZE)
+	{
+		fprintf(stderr, "Failed to create test file\n");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+
+	/* Open test file */
+	fs_init();
+	f = fs_open(path, O_RDONLY, 0);
+	if(f == NULL)
+	{
+		fprintf(stderr, "Failed to open test file\n");
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+	handle = f->handle;
+
+	/* Read through io_uring */
+	test_reads(f, "io_uring");
+#ifdef HAVE_LIBURING
+	if(submit_calls == 0)
+	{
+		fprintf(stderr, "io_uring not used\n");
+		test_failed++;
+	}
+#endif
+
+	/* Read through worker pool while file is read by another thread */
+	memcpy(&no_aio, handle, sizeof(struct fs_handle));
+	no_aio.aio_read = NULL;
+	f->handle = &no_aio;
+	pthread_create(&thread, NULL, test_sequential, f);
+	test_reads(f, "worker pool");
+	pthread_join(thread, &ret);
+	if(ret == NULL)
+	{
+		fprintf(stderr, "Sequential read disturbed by requests\n");
+		test_failed++;
+	}
+	f->handle = handle;
+
+	/* Read with submit failures, then through io_uring again */
+	submit_fail = 1;
+	test_reads(f, "submit failure");
+	submit_fail = 0;
+	test_reads(f, "io_uring after failure");
+
+	/* Stat */
+	memset(&stat, 0, sizeof(stat));
+	stat.url = path;
+	fs_aio_stat(&stat, 1);
+	if(fs_aio_wait(&stat, 5000) != 0 || stat.ret != 0 ||
+	   stat.stat.st_size != TEST_FILE_SIZE)
+	{
+		fprintf(stderr, "Stat failed\n");
+		test_failed++;
+	}
+
+	/* Close and remove test file */
+	fs_close(f);
+	fs_free();
+	unlink(path);
+
+	if(test_failed > 0)
+	{
+		fprintf(stderr, "%lu requests failed\n", test_failed);
+		return EXIT_FAILURE;
+	}
+	printf("All requests succeeded\n");
+
+	return EXIT_SUCCESS;
+}
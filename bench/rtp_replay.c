@@ -0,0 +1,798 @@
+/*
+ * rtp_replay.c - Deterministic RTP loss / reorder replay on jitter buffer
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "rtp.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef VERSION
+	#define VERSION "1.0.0"
+#endif
+
+/*
+ * Stream format and jitter buffer settings are the same as RAOP module:
+ * ALAC packets of 352 samples at 44100 Hz, a pool of 1000 ms, a delay of
+ * 100 ms, a resent threshold of 10 % and a fill threshold of 5 %.
+ */
+#define REPLAY_SAMPLERATE 44100
+#define REPLAY_SAMPLES 352
+#define REPLAY_POOL 1000
+#define REPLAY_DELAY 100
+#define REPLAY_RESENT_RATIO 10
+#define REPLAY_FILL_RATIO 5
+#define REPLAY_PAYLOAD 0x60
+#define REPLAY_SSRC 0x41697243
+
+/* Duration of a packet (in ms) */
+#define REPLAY_PERIOD (REPLAY_SAMPLES * 1000.0 / REPLAY_SAMPLERATE)
+
+/* RTP header and payload header (packet index and resent flag) sizes */
+#define RTP_HEADER_SIZE 12
+#define REPLAY_HEADER_SIZE 5
+#define REPLAY_MAX_SIZE 1400
+
+/* Time to play remaining packets after end of trace (in ms) */
+#define REPLAY_END_MARGIN 2000
+
+/* Packet arrival on virtual clock */
+struct replay_event {
+	double time;		/* Arrival time (in ms) */
+	unsigned long order;	/* Insertion order for same arrival time */
+	unsigned long index;	/* Packet index from start of stream */
+	int resent;		/* Packet is a retransmit reply */
+};
+
+/* Replay statistics */
+struct replay_stats {
+	/* Network */
+	unsigned long sent;
+	unsigned long delivered;
+	unsigned long duplicated;
+	unsigned long late;
+	/* Retransmission */
+	unsigned long requests;
+	unsigned long requested;
+	unsigned long replies;
+	unsigned long recovered;
+	/* Playback */
+	unsigned long played;
+	unsigned long lost;
+	unsigned long underruns;
+	unsigned long misplaced;
+	double first_play;
+	double latency_min;
+	double latency_max;
+	double latency_sum;
+};
+
+/* Pending packets sorted by arrival time */
+static struct replay_event *events = NULL;
+static unsigned long event_count = 0;
+static unsigned long event_size = 0;
+static unsigned long event_order = 0;
+
+/* Virtual clock (in ms) */
+static double now = 0;
+
+/* Stream */
+static unsigned long packet_count = 0;
+static struct replay_stats stats;
+static uint32_t seed_state;
+
+/* Options */
+static const char *trace_file = NULL;
+static const char *write_file = NULL;
+static unsigned int duration = 60;
+static double loss = 0;
+static double burst = 1;
+static double reorder = 0;
+static unsigned int depth = 3;
+static double duplicate = 0;
+static double net_delay = 2;
+static double jitter = 0;
+static double resent_loss = -1;
+static unsigned long seed = 1;
+static unsigned int first_seq = 65000;
+static unsigned int payload_size = 1024;
+static unsigned int buffer_delay = REPLAY_DELAY;
+static int json = 0;
+
+/* xorshift generator: same sequence on all platforms for a seed */
+static double replay_rand(void)
+{
+	seed_state ^= seed_state << 13;
+	seed_state ^= seed_state >> 17;
+	seed_state ^= seed_state << 5;
+	return (seed_state >> 8) / 16777216.0;
+}
+
+/******************************************************************************
+ *                                Event queue                                 *
+ ******************************************************************************/
+
+static int replay_before(struct replay_event *a, struct replay_event *b)
+{
+	if(a->time != b->time)
+		return a->time < b->time;
+	return a->order < b->order;
+}
+
+static int replay_push(double time, unsigned long index, int resent)
+{
+	struct replay_event *e, tmp;
+	unsigned long i, p;
+
+	/* Grow queue */
+	if(event_count == event_size)
+	{
+		event_size = event_size ? event_size * 2 : 1024;
+		e = realloc(events, event_size * sizeof(struct replay_event));
+		if(e == NULL)
+			return -1;
+		events = e;
+	}
+
+	/* Add event at end */
+	i = event_count++;
+	events[i].time = time;
+	events[i].order = event_order++;
+	events[i].index = index;
+	events[i].resent = resent;
+
+	/* Move it up in heap */
+	while(i > 0)
+	{
+		p = (i - 1) / 2;
+		if(!replay_before(&events[i], &events[p]))
+			break;
+		tmp = events[p];
+		events[p] = events[i];
+		events[i] = tmp;
+		i = p;
+	}
+
+	return 0;
+}
+
+static void replay_pop(struct replay_event *e)
+{
+	struct replay_event tmp;
+	unsigned long i = 0, c;
+
+	/* Get first event and replace it by last one */
+	*e = events[0];
+	events[0] = events[--event_count];
+
+	/* Move it down in heap */
+	while((c = 2 * i + 1) < event_count)
+	{
+		if(c + 1 < event_count &&
+		   replay_before(&events[c + 1], &events[c]))
+			c++;
+		if(!replay_before(&events[c], &events[i]))
+			break;
+		tmp = events[c];
+		events[c] = events[i];
+		events[i] = tmp;
+		i = c;
+	}
+}
+
+/******************************************************************************
+ *                                  Traces                                    *
+ ******************************************************************************/
+
+/* Synthetic trace: a Gilbert model gives lost bursts with a mean length of
+ * burst packets and an average loss ratio, and reordered packets are delayed
+ * by 1 to depth packet durations.
+ */
+static int replay_generate(void)
+{
+	double p_bad, p_good, time;
+	unsigned long i;
+	int bad = 0;
+	FILE *fp = NULL;
+
+	/* Transitions of Gilbert model */
+	p_good = 1 / burst;
+	p_bad = loss / (burst * (1 - loss));
+
+	/* Open trace output */
+	if(write_file != NULL)
+	{
+		fp = fopen(write_file, "w");
+		if(fp == NULL)
+		{
+			fprintf(stderr, "Failed to write trace %s\n",
+				write_file);
+			return -1;
+		}
+		fprintf(fp, "# first sequence: %u\n", first_seq);
+		fprintf(fp, "# arrival (ms) sequence\n");
+	}
+
+	packet_count = duration * 1000 / REPLAY_PERIOD;
+	for(i = 0; i < packet_count; i++)
+	{
+		/* Update channel state */
+		bad = bad ? replay_rand() >= p_good : replay_rand() < p_bad;
+		if(bad)
+			continue;
+
+		/* Arrival time */
+		time = i * REPLAY_PERIOD + net_delay + replay_rand() * jitter;
+		if(replay_rand() < reorder)
+			time += (1 + (unsigned int) (replay_rand() * depth)) *
+				REPLAY_PERIOD;
+		if(replay_push(time, i, 0) != 0)
+			goto error;
+		if(fp != NULL)
+			fprintf(fp, "%.3f %lu\n", time,
+				(first_seq + i) & 0xFFFF);
+
+		/* Duplicated packet */
+		if(replay_rand() < duplicate)
+		{
+			time += REPLAY_PERIOD * replay_rand();
+			if(replay_push(time, i, 0) != 0)
+				goto error;
+			if(fp != NULL)
+				fprintf(fp, "%.3f %lu\n", time,
+					(first_seq + i) & 0xFFFF);
+			stats.duplicated++;
+		}
+	}
+
+	if(fp != NULL)
+		fclose(fp);
+	return 0;
+
+error:
+	if(fp != NULL)
+		fclose(fp);
+	return -1;
+}
+
+/* Recorded trace: one packet per line with its arrival time (in ms, relative
+ * to sending of first packet) and its sequence number. Lines starting with
+ * '#' are ignored, except "# first sequence: N" which gives sequence number of
+ * first sent packet when it is not the first received one.
+ */
+static int replay_load(void)
+{
+	struct replay_event *e;
+	char line[256];
+	unsigned int seq, prev_seq = 0;
+	long index = 0, min = 0, max = 0;
+	int has_first = 0;
+	unsigned long i, n = 0;
+	double time;
+	FILE *fp;
+
+	/* Open trace */
+	fp = fopen(trace_file, "r");
+	if(fp == NULL)
+	{
+		fprintf(stderr, "Failed to open trace %s\n", trace_file);
+		return -1;
+	}
+
+	/* Parse lines: sequence numbers are unwrapped from first packet */
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		if(sscanf(line, "# first sequence: %u", &seq) == 1)
+		{
+			first_seq = seq & 0xFFFF;
+			prev_seq = first_seq;
+			has_first = 1;
+			continue;
+		}
+		if(line[0] == '#' || sscanf(line, "%lf %u", &time, &seq) != 2)
+			continue;
+		if(n > 0 || has_first)
+			index += (int16_t) (seq - prev_seq);
+		else
+			first_seq = seq;
+		prev_seq = seq;
+		if(index < min)
+			min = index;
+		if(index > max)
+			max = index;
+		if(replay_push(time, index, 0) != 0)
+		{
+			fclose(fp);
+			return -1;
+		}
+		n++;
+	}
+	fclose(fp);
+
+	if(n == 0)
+	{
+		fprintf(stderr, "Trace %s is empty\n", trace_file);
+		return -1;
+	}
+
+	/* Index from first sent packet: order in heap is not changed */
+	for(i = 0, e = events; i < event_count; i++, e++)
+		e->index -= min;
+	first_seq = (first_seq + min) & 0xFFFF;
+	packet_count = max - min + 1;
+
+	return 0;
+}
+
+/******************************************************************************
+ *                               RTP receiver                                 *
+ ******************************************************************************/
+
+static size_t replay_packet(unsigned char *buffer, unsigned long index,
+			    int resent)
+{
+	uint16_t seq = first_seq + index;
+	uint32_t ts = index * REPLAY_SAMPLES;
+	size_t len = RTP_HEADER_SIZE + payload_size;
+
+	/* RTP header */
+	buffer[0] = 0x80;
+	buffer[1] = REPLAY_PAYLOAD;
+	buffer[2] = seq >> 8;
+	buffer[3] = seq;
+	buffer[4] = ts >> 24;
+	buffer[5] = ts >> 16;
+	buffer[6] = ts >> 8;
+	buffer[7] = ts;
+	buffer[8] = REPLAY_SSRC >> 24;
+	buffer[9] = (REPLAY_SSRC >> 16) & 0xFF;
+	buffer[10] = (REPLAY_SSRC >> 8) & 0xFF;
+	buffer[11] = REPLAY_SSRC & 0xFF;
+
+	/* Payload: packet index to check play order */
+	memset(buffer + RTP_HEADER_SIZE, index & 0xFF, payload_size);
+	buffer[12] = index >> 24;
+	buffer[13] = index >> 16;
+	buffer[14] = index >> 8;
+	buffer[15] = index;
+	buffer[16] = resent;
+
+	return len;
+}
+
+/* Sender side of RAOP retransmission: packets are answered with a retransmit
+ * reply sent over network with same delay and jitter.
+ */
+static void replay_resent_cb(void *user_data, unsigned int seq,
+			     unsigned int count)
+{
+	unsigned long sent, index;
+	double time;
+	int16_t delta;
+
+	(void) user_data;
+
+	stats.requests++;
+	stats.requested += count;
+
+	/* Request reaches sender after network delay */
+	time = now + net_delay + replay_rand() * jitter;
+	sent = time / REPLAY_PERIOD;
+	if(sent >= packet_count)
+		sent = packet_count - 1;
+
+	for(; count > 0; count--, seq++)
+	{
+		/* Find packet index from sequence number */
+		delta = (uint16_t) seq - (uint16_t) (first_seq + sent);
+		if(delta > 0 || (long) sent + delta < 0)
+			continue;
+		index = sent + delta;
+
+		/* Lost reply */
+		if(replay_rand() < resent_loss)
+			continue;
+
+		/* Send reply */
+		replay_push(time + net_delay + replay_rand() * jitter, index,
+			    1);
+		stats.replies++;
+	}
+}
+
+static void replay_deliver(struct rtp_handle *rtp, struct replay_event *e,
+			   unsigned long expected)
+{
+	unsigned char buffer[RTP_HEADER_SIZE + REPLAY_MAX_SIZE];
+	size_t len;
+
+	if(e->index < expected)
+		stats.late++;
+
+	/* Retransmit replies are put in buffer with rtp_put() as done by RAOP
+	 * module, other packets are put as received by rtp_read()
+	 */
+	len = replay_packet(buffer, e->index, e->resent);
+	rtp_put(rtp, buffer, len);
+	stats.delivered++;
+}
+
+static int replay_run(void)
+{
+	unsigned char buffer[REPLAY_MAX_SIZE];
+	struct rtp_handle *rtp;
+	struct rtp_attr attr;
+	struct replay_event e;
+	unsigned long expected = 0, index;
+	double end = 0, latency;
+	ssize_t len;
+
+	/* Open RTP receiver: port 0 as packets are put directly */
+	memset(&attr, 0, sizeof(struct rtp_attr));
+	attr.port = 0;
+	attr.payload = REPLAY_PAYLOAD;
+	attr.max_packet_size = RTP_HEADER_SIZE + payload_size;
+	attr.pool_packet_count = REPLAY_POOL / REPLAY_PERIOD;
+	attr.delay_packet_count = buffer_delay / REPLAY_PERIOD;
+	attr.resent_ratio = REPLAY_RESENT_RATIO;
+	attr.fill_ratio = REPLAY_FILL_RATIO;
+	attr.resent_cb = &replay_resent_cb;
+	attr.resent_data = NULL;
+	if(attr.pool_packet_count < attr.delay_packet_count)
+		attr.pool_packet_count = attr.delay_packet_count;
+	if(rtp_open(&rtp, &attr) != 0)
+	{
+		fprintf(stderr, "Failed to open RTP receiver\n");
+		return -1;
+	}
+	stats.sent = packet_count;
+	stats.first_play = -1;
+
+	/* Play one packet per period */
+	for(now = 0; expected < packet_count; now += REPLAY_PERIOD)
+	{
+		/* Deliver arrived packets */
+		while(event_count > 0 && events[0].time <= now)
+		{
+			replay_pop(&e);
+			replay_deliver(rtp, &e, expected);
+			if(e.time > end)
+				end = e.time;
+		}
+
+		/* Stop when all packets have been received and played */
+		if(event_count == 0 && now > end + REPLAY_END_MARGIN)
+			break;
+
+		/* Get next packet */
+		len = rtp_read(rtp, buffer, sizeof(buffer));
+		if(len == RTP_LOST_PACKET)
+		{
+			stats.lost++;
+			expected++;
+		}
+		else if(len == RTP_NO_PACKET)
+		{
+			/* Buffer is refilling during stream */
+			if(stats.first_play >= 0 && event_count > 0)
+				stats.underruns++;
+		}
+		else if(len >= REPLAY_HEADER_SIZE)
+		{
+			/* Check packet order */
+			index = ((unsigned long) buffer[0] << 24) |
+				(buffer[1] << 16) | (buffer[2] << 8) |
+				buffer[3];
+			if(index != expected)
+				stats.misplaced++;
+			expected = index + 1;
+			if(buffer[4])
+				stats.recovered++;
+
+			/* Update latency */
+			latency = now - index * REPLAY_PERIOD;
+			if(stats.first_play < 0)
+			{
+				stats.first_play = now;
+				stats.latency_min = latency;
+				stats.latency_max = latency;
+			}
+			if(latency < stats.latency_min)
+				stats.latency_min = latency;
+			if(latency > stats.latency_max)
+				stats.latency_max = latency;
+			stats.latency_sum += latency;
+			stats.played++;
+		}
+	}
+
+	rtp_close(rtp);
+
+	return 0;
+}
+
+/******************************************************************************
+ *                                  Report                                    *
+ ******************************************************************************/
+
+static double replay_cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void replay_report(double cpu)
+{
+	unsigned long concealed;
+	double avg, rate;
+
+	/* Calculate figures */
+	concealed = (stats.lost + stats.underruns) * REPLAY_SAMPLES;
+	avg = stats.played ? stats.latency_sum / stats.played : 0;
+	rate = cpu > 0 ? (stats.delivered + stats.played + stats.lost) / cpu :
+			 0;
+
+	if(json)
+	{
+		printf("{\"packets\": %lu, \"stream_time\": %.3f, "
+		       "\"cpu_time\": %.3f, \"packets_per_s\": %.0f, "
+		       "\"delivered\": %lu, \"duplicated\": %lu, \"late\": %lu, "
+		       "\"resent_requests\": %lu, \"resent_packets\": %lu, "
+		       "\"resent_replies\": %lu, \"recovered\": %lu, "
+		       "\"played\": %lu, \"lost\": %lu, \"underruns\": %lu, "
+		       "\"misplaced\": %lu, \"concealed_frames\": %lu, "
+		       "\"startup_ms\": %.2f, \"latency_ms\": {\"min\": %.2f, "
+		       "\"avg\": %.2f, \"max\": %.2f}}\n", stats.sent,
+		       stats.sent * REPLAY_PERIOD / 1000, cpu, rate,
+		       stats.delivered, stats.duplicated, stats.late,
+		       stats.requests, stats.requested, stats.replies,
+		       stats.recovered,
+		       stats.played, stats.lost, stats.underruns,
+		       stats.misplaced, concealed, stats.first_play,
+		       stats.latency_min, avg, stats.latency_max);
+		return;
+	}
+
+	printf("Packets:        %lu (%.2f s of stream)\n", stats.sent,
+	       stats.sent * REPLAY_PERIOD / 1000);
+	printf("Throughput:     %.0f packets/s (%.3f s CPU)\n", rate, cpu);
+	printf("\nDelivered:      %lu (%lu duplicated, %lu late)\n",
+	       stats.delivered, stats.duplicated, stats.late);
+	printf("Resent:         %lu requests, %lu packets, %lu replies\n",
+	       stats.requests, stats.requested, stats.replies);
+	printf("Recovered:      %lu\n", stats.recovered);
+	printf("\nPlayed:         %lu\n", stats.played);
+	printf("Lost:           %lu\n", stats.lost);
+	printf("Underruns:      %lu\n", stats.underruns);
+	printf("Misplaced:      %lu\n", stats.misplaced);
+	printf("Concealed:      %lu frames (%.2f s)\n", concealed,
+	       (double) concealed / REPLAY_SAMPLERATE);
+	printf("\nStartup:        %.2f ms\n", stats.first_play);
+	printf("Latency:        %.2f / %.2f / %.2f ms (min / avg / max)\n",
+	       stats.latency_min, avg, stats.latency_max);
+}
+
+/******************************************************************************
+ *                                  Main                                      *
+ ******************************************************************************/
+
+static void print_usage(const char *name)
+{
+	printf("Usage: %s [OPTIONS]\n"
+		"\n"
+		"Replay a synthetic or recorded RTP packet trace into the "
+		"jitter buffer\n"
+		"on a virtual clock and report retransmissions, concealed "
+		"frames and\n"
+		"latency.\n"
+		"\n"
+		"Options:\n"
+		"-t      --trace=FILE         Replay recorded trace "
+						"(arrival ms, sequence)\n"
+		"-w      --write=FILE         Write synthetic trace to file\n"
+		"-d      --duration=SEC       Synthetic stream duration "
+						"(default: 60)\n"
+		"-l      --loss=PCT           Packet loss (default: 0)\n"
+		"-b      --burst=N            Mean length of loss bursts "
+						"(default: 1)\n"
+		"-r      --reorder=PCT        Reordered packets (default: 0)\n"
+		"-o      --depth=N            Maximum reorder distance in "
+						"packets\n"
+		"                             (default: 3)\n"
+		"-u      --duplicate=PCT      Duplicated packets "
+						"(default: 0)\n"
+		"-n      --delay=MS           Network delay (default: 2)\n"
+		"-J      --jitter=MS          Network jitter (default: 0)\n"
+		"-L      --resent-loss=PCT    Retransmit loss "
+						"(default: same as loss)\n"
+		"-B      --buffer=MS          Jitter buffer delay "
+						"(default: 100)\n"
+		"-p      --size=BYTES         Payload size (default: 1024)\n"
+		"-S      --seq=N              First sequence number "
+						"(default: 65000)\n"
+		"-s      --seed=N             Random seed (default: 1)\n"
+		"-j      --json               Print report as JSON\n"
+		"-h      --help               Print this usage and exit\n"
+		"        --version            Print version and exit\n",
+		 name);
+}
+
+static void parse_opt(int argc, char * const argv[])
+{
+	int c;
+
+	/* Get options */
+	while(1)
+	{
+		int option_index = 0;
+		static const char *short_options =
+						 "t:w:d:l:b:r:o:u:n:J:L:B:p:S:s:jh";
+		static struct option long_options[] =
+		{
+			{"version",     no_argument,        0, 0},
+			{"trace",       required_argument,  0, 't'},
+			{"write",       required_argument,  0, 'w'},
+			{"duration",    required_argument,  0, 'd'},
+			{"loss",        required_argument,  0, 'l'},
+			{"burst",       required_argument,  0, 'b'},
+			{"reorder",     required_argument,  0, 'r'},
+			{"depth",       required_argument,  0, 'o'},
+			{"duplicate",   required_argument,  0, 'u'},
+			{"delay",       required_argument,  0, 'n'},
+			{"jitter",      required_argument,  0, 'J'},
+			{"resent-loss", required_argument,  0, 'L'},
+			{"buffer",      required_argument,  0, 'B'},
+			{"size",        required_argument,  0, 'p'},
+			{"seq",         required_argument,  0, 'S'},
+			{"seed",        required_argument,  0, 's'},
+			{"json",        no_argument,        0, 'j'},
+			{"help",        no_argument,        0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		/* Get next option */
+		c = getopt_long(argc, argv, short_options, long_options,
+				&option_index);
+		if(c == EOF)
+			break;
+
+		/* Parse option */
+		switch(c)
+		{
+			case 0:
+				/* Version */
+				printf("AirCat RTP replay " VERSION "\n");
+				exit(EXIT_SUCCESS);
+				break;
+			case 't':
+				trace_file = optarg;
+				break;
+			case 'w':
+				write_file = optarg;
+				break;
+			case 'd':
+				duration = strtoul(optarg, NULL, 10);
+				break;
+			case 'l':
+				loss = atof(optarg) / 100;
+				break;
+			case 'b':
+				burst = atof(optarg);
+				break;
+			case 'r':
+				reorder = atof(optarg) / 100;
+				break;
+			case 'o':
+				depth = strtoul(optarg, NULL, 10);
+				break;
+			case 'u':
+				duplicate = atof(optarg) / 100;
+				break;
+			case 'n':
+				net_delay = atof(optarg);
+				break;
+			case 'J':
+				jitter = atof(optarg);
+				break;
+			case 'L':
+				resent_loss = atof(optarg) / 100;
+				break;
+			case 'B':
+				buffer_delay = strtoul(optarg, NULL, 10);
+				break;
+			case 'p':
+				payload_size = strtoul(optarg, NULL, 10);
+				break;
+			case 'S':
+				first_seq = strtoul(optarg, NULL, 10) & 0xFFFF;
+				break;
+			case 's':
+				seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'j':
+				json = 1;
+				break;
+			case 'h':
+				print_usage(argv[0]);
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Check options */
+	if(duration == 0 || loss < 0 || loss >= 1 || burst < 1 ||
+	   reorder < 0 || depth == 0 || duplicate < 0 || net_delay < 0 ||
+	   jitter < 0 || buffer_delay < REPLAY_PERIOD ||
+	   payload_size < REPLAY_HEADER_SIZE ||
+	   payload_size > REPLAY_MAX_SIZE)
+	{
+		print_usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if(resent_loss < 0)
+		resent_loss = loss;
+	seed_state = seed ? seed : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = EXIT_FAILURE;
+	double cpu;
+
+	/* Parse options */
+	parse_opt(argc, argv);
+
+	/* Prepare packet arrivals */
+	memset(&stats, 0, sizeof(stats));
+	if(trace_file != NULL)
+	{
+		if(replay_load() != 0)
+			goto end;
+	}
+	else if(replay_generate() != 0)
+		goto end;
+
+	/* Replay: retransmissions do not depend on trace source */
+	seed_state = (seed ^ 0x9E3779B9) ? seed ^ 0x9E3779B9 : 1;
+	cpu = replay_cpu_time();
+	if(replay_run() != 0)
+		goto end;
+	cpu = replay_cpu_time() - cpu;
+
+	/* Print report */
+	replay_report(cpu);
+	ret = EXIT_SUCCESS;
+
+end:
+	free(events);
+
+	return ret;
+}
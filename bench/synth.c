@@ -0,0 +1,257 @@
+/*
+ * synth.c - Test signal synthesis and encoding for benchmarks
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "synth.h"
+
+/* ALAC rice parameters */
+#define ALAC_HISTORY_MULT 40
+#define ALAC_INITIAL_HISTORY 10
+#define ALAC_KMODIFIER 14
+#define ALAC_RICE_THRESHOLD 8
+
+/* Bit writer for ALAC encoder */
+struct bit_writer {
+	unsigned char *buffer;
+	size_t pos;
+};
+
+int16_t *synth_signal(size_t frames)
+{
+	double phase = 0, freq;
+	uint32_t noise = 1;
+	int16_t *pcm;
+	double v;
+	size_t i;
+
+	/* Allocate interleaved stereo buffer */
+	pcm = malloc(frames * SYNTH_CHANNELS * sizeof(int16_t));
+	if(pcm == NULL)
+		return NULL;
+
+	/* Logarithmic sweep from 20Hz to 20kHz mixed with some noise at
+	 * -6dBFS to avoid trivially compressible input
+	 */
+	for(i = 0; i < frames; i++)
+	{
+		freq = 20.0 * pow(1000.0, (double) (i % SYNTH_SAMPLERATE) /
+				  SYNTH_SAMPLERATE);
+		phase += 2 * M_PI * freq / SYNTH_SAMPLERATE;
+		if(phase > 2 * M_PI)
+			phase -= 2 * M_PI;
+		noise = noise * 1103515245 + 12345;
+		v = 0.45 * sin(phase) + 0.05 * ((double) (noise >> 16) /
+						 32768.0 - 1.0);
+		pcm[i*2] = (int16_t) (v * 32767);
+		pcm[i*2+1] = (int16_t) (v * 32767 * 0.8);
+	}
+
+	return pcm;
+}
+
+void synth_alac_config(unsigned char *config)
+{
+	unsigned char *c;
+
+	/* Decoder configuration (same layout as built by RAOP) */
+	memset(config, 0, SYNTH_ALAC_CONFIG_SIZE);
+	c = &config[24];
+	c[0] = SYNTH_ALAC_FRAME_SAMPLES >> 24;
+	c[1] = SYNTH_ALAC_FRAME_SAMPLES >> 16;
+	c[2] = SYNTH_ALAC_FRAME_SAMPLES >> 8;
+	c[3] = SYNTH_ALAC_FRAME_SAMPLES & 0xFF;
+	c[5] = 16;
+	c[6] = ALAC_HISTORY_MULT;
+	c[7] = ALAC_INITIAL_HISTORY;
+	c[8] = ALAC_KMODIFIER;
+	c[9] = SYNTH_CHANNELS;
+	c[10] = 0x00;
+	c[11] = 0xFF;
+	c[20] = (SYNTH_SAMPLERATE >> 24) & 0xFF;
+	c[21] = (SYNTH_SAMPLERATE >> 16) & 0xFF;
+	c[22] = (SYNTH_SAMPLERATE >> 8) & 0xFF;
+	c[23] = SYNTH_SAMPLERATE & 0xFF;
+}
+
+const char *synth_alac_format(void)
+{
+	return "96 352 0 16 40 10 14 2 255 0 0 44100";
+}
+
+static void synth_put_bits(struct bit_writer *w, uint32_t value, int bits)
+{
+	int i;
+
+	/* Write bits MSB first */
+	for(i = bits - 1; i >= 0; i--)
+	{
+		if(value & (1UL << i))
+			w->buffer[w->pos / 8] |= 0x80 >> (w->pos % 8);
+		w->pos++;
+	}
+}
+
+static int synth_clz(uint32_t v)
+{
+	int n = 0;
+
+	if(v == 0)
+		return 32;
+	while(!(v & 0x80000000))
+	{
+		v <<= 1;
+		n++;
+	}
+	return n;
+}
+
+static void synth_put_rice(struct bit_writer *w, uint32_t value, int k,
+			   uint32_t mask, int sample_size)
+{
+	uint32_t div, q, r;
+
+	/* Same parameters as decoder_alac_entropy_decode_value() */
+	div = k != 1 ? ((1UL << k) - 1) & mask : 1;
+	q = value / div;
+	r = value % div;
+
+	/* Escape with raw value */
+	if(q > ALAC_RICE_THRESHOLD)
+	{
+		synth_put_bits(w, (1UL << (ALAC_RICE_THRESHOLD + 1)) - 1,
+			       ALAC_RICE_THRESHOLD + 1);
+		synth_put_bits(w, value, sample_size);
+		return;
+	}
+
+	/* Unary prefix */
+	synth_put_bits(w, (1UL << q) - 1, q);
+	synth_put_bits(w, 0, 1);
+	if(k == 1)
+		return;
+
+	/* Remainder (decoder reads back one bit less for 0) */
+	if(r == 0)
+		synth_put_bits(w, 0, k - 1);
+	else
+		synth_put_bits(w, r + 1, k);
+}
+
+static void synth_alac_channel(struct bit_writer *w, const int16_t *pcm,
+			       size_t samples, int sample_size)
+{
+	int history = ALAC_INITIAL_HISTORY;
+	int sign_modifier = 0;
+	int32_t prev = 0, err;
+	uint32_t value;
+	size_t i, run;
+	int k;
+
+	for(i = 0; i < samples; i++)
+	{
+		/* First order prediction */
+		err = i == 0 ? pcm[0] : pcm[i*SYNTH_CHANNELS] - prev;
+		prev = pcm[i*SYNTH_CHANNELS];
+
+		/* Fold sign in low bit */
+		value = err >= 0 ? (uint32_t) err * 2 : (uint32_t) -err * 2 - 1;
+		value -= sign_modifier;
+
+		/* Rice parameter from history */
+		k = 31 - ALAC_KMODIFIER - synth_clz((history >> 9) + 3);
+		if(k < 0)
+			k += ALAC_KMODIFIER;
+		else
+			k = ALAC_KMODIFIER;
+		synth_put_rice(w, value, k, 0xFFFFFFFF, sample_size);
+
+		/* Update history */
+		value += sign_modifier;
+		sign_modifier = 0;
+		history += (value * ALAC_HISTORY_MULT) -
+			   ((history * ALAC_HISTORY_MULT) >> 9);
+		if(value > 0xFFFF)
+			history = 0xFFFF;
+
+		/* Run of zero residuals */
+		if(history < 128 && i + 1 < samples)
+		{
+			sign_modifier = 1;
+			for(run = 0; i + 1 + run < samples && run < 0xFFFF;
+			    run++)
+			{
+				if(pcm[(i+1+run)*SYNTH_CHANNELS] != prev)
+					break;
+			}
+			k = synth_clz(history) + ((history + 16) / 64) - 24;
+			synth_put_rice(w, run, k, (1UL << ALAC_KMODIFIER) - 1,
+				       16);
+			i += run;
+			history = 0;
+		}
+	}
+}
+
+size_t synth_alac_encode(unsigned char *out, const int16_t *pcm, size_t frames)
+{
+	struct bit_writer w;
+	int ch;
+
+	if(frames > SYNTH_ALAC_FRAME_SAMPLES)
+		frames = SYNTH_ALAC_FRAME_SAMPLES;
+
+	/* Bits are or'ed in output */
+	memset(out, 0, SYNTH_ALAC_MAX_FRAME_SIZE);
+	w.buffer = out;
+	w.pos = 0;
+
+	/* Frame header */
+	synth_put_bits(&w, SYNTH_CHANNELS - 1, 3);
+	synth_put_bits(&w, 0, 4);
+	synth_put_bits(&w, 0, 12);
+	synth_put_bits(&w, frames != SYNTH_ALAC_FRAME_SAMPLES, 1);
+	synth_put_bits(&w, 0, 2);
+	synth_put_bits(&w, 0, 1);
+	if(frames != SYNTH_ALAC_FRAME_SAMPLES)
+		synth_put_bits(&w, frames, 32);
+
+	/* No interlacing */
+	synth_put_bits(&w, 0, 8);
+	synth_put_bits(&w, 0, 8);
+
+	/* First order predictor (31 coefficients are skipped) */
+	for(ch = 0; ch < SYNTH_CHANNELS; ch++)
+	{
+		synth_put_bits(&w, 0, 4);
+		synth_put_bits(&w, 0, 4);
+		synth_put_bits(&w, 4, 3);
+		synth_put_bits(&w, 31, 5);
+		synth_put_bits(&w, 0, 31 * 16);
+	}
+
+	/* Residuals (samples are stored on 17 bits for stereo) */
+	for(ch = 0; ch < SYNTH_CHANNELS; ch++)
+		synth_alac_channel(&w, &pcm[ch], frames,
+				   16 + SYNTH_CHANNELS - 1);
+
+	return (w.pos + 7) / 8;
+}
+
@@ -0,0 +1,52 @@
+/*
+ * synth.h - Test signal synthesis and encoding for benchmarks
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SYNTH_H
+#define _SYNTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Synthesized signal format: 16-bit interleaved stereo at 44.1kHz */
+#define SYNTH_SAMPLERATE 44100
+#define SYNTH_CHANNELS 2
+
+/* ALAC frame size (as used by AirTunes), configuration size and maximum size
+ * of an encoded frame (in bytes)
+ */
+#define SYNTH_ALAC_FRAME_SAMPLES 352
+#define SYNTH_ALAC_CONFIG_SIZE 55
+#define SYNTH_ALAC_MAX_FRAME_SIZE 4096
+
+/* Synthesize frames of a sweep mixed with noise: buffer must be freed */
+int16_t *synth_signal(size_t frames);
+
+/* Fill ALAC decoder configuration (SYNTH_ALAC_CONFIG_SIZE bytes) */
+void synth_alac_config(unsigned char *config);
+
+/* RAOP format string of ALAC stream (fmtp attribute of SDP) */
+const char *synth_alac_format(void);
+
+/* Encode up to SYNTH_ALAC_FRAME_SAMPLES frames of pcm in one ALAC frame:
+ * out must be at least SYNTH_ALAC_MAX_FRAME_SIZE bytes and the encoded size is
+ * returned.
+ */
+size_t synth_alac_encode(unsigned char *out, const int16_t *pcm, size_t frames);
+
+#endif
+
@@ -0,0 +1,400 @@
+/*
+ * vring_bench.c - Ring buffer benchmark: lock-free mirrored vs mutex vring
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "vring.h"
+#include "vring_mutex.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef VERSION
+	#define VERSION "1.0.0"
+#endif
+
+/* Ring buffer implementation */
+struct ring_ops {
+	const char *name;
+	int (*open)(void **h, size_t size, size_t max_rw_size);
+	ssize_t (*read)(void *h, unsigned char **buffer, size_t len);
+	ssize_t (*read_forward)(void *h, size_t len);
+	ssize_t (*write)(void *h, unsigned char **buffer);
+	ssize_t (*write_forward)(void *h, size_t len);
+	void (*close)(void *h);
+};
+
+#define RING_OPS(prefix, handle) \
+static int prefix##_bench_open(void **h, size_t size, size_t max_rw_size) \
+{ \
+	return prefix##_open((struct handle **) h, size, max_rw_size); \
+} \
+static ssize_t prefix##_bench_read(void *h, unsigned char **buffer, \
+				   size_t len) \
+{ \
+	return prefix##_read(h, buffer, len, 0); \
+} \
+static ssize_t prefix##_bench_read_forward(void *h, size_t len) \
+{ \
+	return prefix##_read_forward(h, len); \
+} \
+static ssize_t prefix##_bench_write(void *h, unsigned char **buffer) \
+{ \
+	return prefix##_write(h, buffer); \
+} \
+static ssize_t prefix##_bench_write_forward(void *h, size_t len) \
+{ \
+	return prefix##_write_forward(h, len); \
+} \
+static void prefix##_bench_close(void *h) \
+{ \
+	prefix##_close(h); \
+}
+
+RING_OPS(vring, vring_handle)
+RING_OPS(vring_mutex, vring_mutex_handle)
+
+static struct ring_ops rings[] = {
+	{
+		"mutex", vring_mutex_bench_open, vring_mutex_bench_read,
+		vring_mutex_bench_read_forward, vring_mutex_bench_write,
+		vring_mutex_bench_write_forward, vring_mutex_bench_close
+	},
+	{
+		"lock-free", vring_bench_open, vring_bench_read,
+		vring_bench_read_forward, vring_bench_write,
+		vring_bench_write_forward, vring_bench_close
+	},
+};
+
+#define RING_COUNT (sizeof(rings) / sizeof(struct ring_ops))
+
+/* Transfer between producer and consumer threads */
+struct ring_transfer {
+	struct ring_ops *ops;
+	void *ring;
+	uint64_t total;
+};
+
+/* Options */
+static size_t buffer_size = 65536;
+static size_t max_rw_size = 8192;
+static size_t chunk_size = 1500;
+static unsigned long total_mb = 256;
+static int json = 0;
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Chunk size varies around its mean to cross end of buffer at any position */
+static size_t bench_chunk(uint32_t *state)
+{
+	size_t len;
+
+	*state = *state * 1103515245 + 12345;
+	len = chunk_size / 2 + (*state >> 8) % chunk_size + 1;
+	return len > max_rw_size ? max_rw_size : len;
+}
+
+/******************************************************************************
+ *                           Single thread round trip                         *
+ ******************************************************************************/
+
+static double bench_round_trip(struct ring_ops *ops, uint64_t total)
+{
+	unsigned char *buffer;
+	uint32_t state = 1;
+	uint64_t done = 0;
+	double start;
+	unsigned long count = 0;
+	ssize_t len, size;
+	void *ring;
+
+	if(ops->open(&ring, buffer_size, max_rw_size) != 0)
+		return -1;
+
+	/* Write a chunk and read it back */
+	start = bench_now();
+	while(done < total)
+	{
+		len = ops->write(ring, &buffer);
+		size = bench_chunk(&state);
+		if(len > size)
+			len = size;
+		memset(buffer, done, len);
+		ops->write_forward(ring, len);
+
+		len = ops->read(ring, &buffer, len);
+		ops->read_forward(ring, len);
+		done += len;
+		count++;
+	}
+	start = bench_now() - start;
+
+	ops->close(ring);
+
+	/* Time of a write + read (in ns) */
+	return start * 1e9 / count;
+}
+
+/******************************************************************************
+ *                        Producer / consumer transfer                        *
+ ******************************************************************************/
+
+static void *bench_producer(void *user_data)
+{
+	struct ring_transfer *t = user_data;
+	unsigned char *buffer;
+	uint32_t state = 1;
+	uint64_t done = 0;
+	ssize_t len, i;
+	size_t size;
+
+	while(done < t->total)
+	{
+		/* Wait for space */
+		len = t->ops->write(t->ring, &buffer);
+		size = bench_chunk(&state);
+		while(len < (ssize_t) size)
+		{
+			sched_yield();
+			len = t->ops->write(t->ring, &buffer);
+		}
+		if(size > t->total - done)
+			size = t->total - done;
+
+		/* Fill with position in stream */
+		for(i = 0; i < (ssize_t) size; i++)
+			buffer[i] = done + i;
+		t->ops->write_forward(t->ring, size);
+		done += size;
+	}
+
+	return NULL;
+}
+
+static double bench_transfer(struct ring_ops *ops, uint64_t total, int *error)
+{
+	struct ring_transfer t;
+	unsigned char *buffer;
+	uint64_t done = 0;
+	pthread_t thread;
+	double start;
+	ssize_t len, i;
+
+	t.ops = ops;
+	t.total = total;
+	if(ops->open(&t.ring, buffer_size, max_rw_size) != 0)
+		return -1;
+
+	/* Start producer */
+	start = bench_now();
+	if(pthread_create(&thread, NULL, bench_producer, &t) != 0)
+	{
+		ops->close(t.ring);
+		return -1;
+	}
+
+	/* Consume and check data */
+	*error = 0;
+	while(done < total)
+	{
+		len = ops->read(t.ring, &buffer, 0);
+		if(len <= 0)
+		{
+			sched_yield();
+			continue;
+		}
+		for(i = 0; i < len; i++)
+			if(buffer[i] != (unsigned char) (done + i))
+				*error = 1;
+		ops->read_forward(t.ring, len);
+		done += len;
+	}
+	pthread_join(thread, NULL);
+	start = bench_now() - start;
+
+	ops->close(t.ring);
+
+	/* Throughput (in MB/s) */
+	return total / start / 1e6;
+}
+
+/******************************************************************************
+ *                                  Main                                      *
+ ******************************************************************************/
+
+static void print_usage(const char *name)
+{
+	printf("Usage: %s [OPTIONS]\n"
+		"\n"
+		"Compare lock-free mirrored vring with previous mutex based "
+		"vring.\n"
+		"\n"
+		"Options:\n"
+		"-s      --size=BYTES         Ring buffer size "
+						"(default: 65536)\n"
+		"-m      --max-rw=BYTES       Maximum read/write size "
+						"(default: 8192)\n"
+		"-c      --chunk=BYTES        Mean chunk size (default: 1500)\n"
+		"-t      --total=MB           Data to transfer (default: 256)\n"
+		"-j      --json               Print report as JSON\n"
+		"-h      --help               Print this usage and exit\n"
+		"        --version            Print version and exit\n",
+		 name);
+}
+
+static void parse_opt(int argc, char * const argv[])
+{
+	int c;
+
+	/* Get options */
+	while(1)
+	{
+		int option_index = 0;
+		static const char *short_options = "s:m:c:t:jh";
+		static struct option long_options[] =
+		{
+			{"version", no_argument,        0, 0},
+			{"size",    required_argument,  0, 's'},
+			{"max-rw",  required_argument,  0, 'm'},
+			{"chunk",   required_argument,  0, 'c'},
+			{"total",   required_argument,  0, 't'},
+			{"json",    no_argument,        0, 'j'},
+			{"help",    no_argument,        0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		/* Get next option */
+		c = getopt_long(argc, argv, short_options, long_options,
+				&option_index);
+		if(c == EOF)
+			break;
+
+		/* Parse option */
+		switch(c)
+		{
+			case 0:
+				/* Version */
+				printf("AirCat vring bench " VERSION "\n");
+				exit(EXIT_SUCCESS);
+				break;
+			case 's':
+				buffer_size = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				max_rw_size = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				chunk_size = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				total_mb = strtoul(optarg, NULL, 10);
+				break;
+			case 'j':
+				json = 1;
+				break;
+			case 'h':
+				print_usage(argv[0]);
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Check options */
+	if(chunk_size == 0 || total_mb == 0 || max_rw_size == 0 ||
+	   max_rw_size > buffer_size)
+	{
+		print_usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	double round_trip[RING_COUNT], transfer[RING_COUNT];
+	int error[RING_COUNT];
+	uint64_t total;
+	int ret = EXIT_SUCCESS;
+	unsigned int i;
+
+	/* Parse options */
+	parse_opt(argc, argv);
+	total = (uint64_t) total_mb * 1000000;
+
+	/* Run benchmarks */
+	for(i = 0; i < RING_COUNT; i++)
+	{
+		round_trip[i] = bench_round_trip(&rings[i], total);
+		transfer[i] = bench_transfer(&rings[i], total, &error[i]);
+		if(round_trip[i] < 0 || transfer[i] < 0)
+		{
+			fprintf(stderr, "Failed to open %s ring buffer\n",
+				rings[i].name);
+			return EXIT_FAILURE;
+		}
+		if(error[i])
+			ret = EXIT_FAILURE;
+	}
+
+	/* Print report */
+	if(json)
+	{
+		printf("{\"size\": %lu, \"max_rw_size\": %lu, "
+		       "\"chunk_size\": %lu, \"total_mb\": %lu, \"rings\": {",
+		       (unsigned long) buffer_size,
+		       (unsigned long) max_rw_size,
+		       (unsigned long) chunk_size, total_mb);
+		for(i = 0; i < RING_COUNT; i++)
+			printf("%s\"%s\": {\"round_trip_ns\": %.1f, "
+			       "\"transfer_mb_s\": %.1f, \"valid\": %s}",
+			       i ? ", " : "", rings[i].name, round_trip[i],
+			       transfer[i], error[i] ? "false" : "true");
+		printf("}}\n");
+		return ret;
+	}
+
+	printf("Ring: %lu bytes, max %lu bytes per access, %lu bytes chunks, "
+	       "%lu MB\n\n", (unsigned long) buffer_size,
+	       (unsigned long) max_rw_size, (unsigned long) chunk_size,
+	       total_mb);
+	printf("%-12s %16s %16s %8s\n", "ring", "round trip (ns)",
+	       "transfer (MB/s)", "data");
+	for(i = 0; i < RING_COUNT; i++)
+		printf("%-12s %16.1f %16.1f %8s\n", rings[i].name,
+		       round_trip[i], transfer[i], error[i] ? "CORRUPT" : "ok");
+
+	return ret;
+}
@@ -0,0 +1,40 @@
+/*
+ * vring_mutex.h - Mutex based ring buffer (reference for benchmark)
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VRING_MUTEX_H
+#define _VRING_MUTEX_H
+
+/*
+ * Previous implementation of vring: every access takes a mutex and data
+ * written across end of buffer is copied from a reserve of max_rw_size bytes.
+ * It is kept to compare with the lock-free mirrored vring in vring_bench.
+ */
+struct vring_mutex_handle;
+
+int vring_mutex_open(struct vring_mutex_handle **handle, size_t buffer_size,
+		     size_t max_rw_size);
+size_t vring_mutex_get_length(struct vring_mutex_handle *h);
+ssize_t vring_mutex_read(struct vring_mutex_handle *h, unsigned char **buffer,
+			 size_t len, size_t pos);
+ssize_t vring_mutex_read_forward(struct vring_mutex_handle *h, size_t len);
+ssize_t vring_mutex_write(struct vring_mutex_handle *h,
+			  unsigned char **buffer);
+ssize_t vring_mutex_write_forward(struct vring_mutex_handle *h, size_t len);
+void vring_mutex_close(struct vring_mutex_handle *h);
+
+#endif
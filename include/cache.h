@@ -35,6 +35,8 @@ int cache_read(void *h, unsigned char *buffer, size_t size,
 	       struct a_format *fmt);
 ssize_t cache_write(void *h, const unsigned char *buffer, size_t size,
 		    struct a_format *fmt);
+int cache_convert(struct cache_handle *h, unsigned long samplerate,
+		  unsigned char channels);
 void cache_flush(struct cache_handle *h);
 void cache_lock(struct cache_handle *h);
 void cache_unlock(struct cache_handle *h);
@@ -29,6 +29,13 @@ struct decoder_info {
 	unsigned char channels;		// Channel count for this frame
 };
 
+/* Input frame for batched decoding */
+struct decoder_frame {
+	unsigned char *buffer;		// Frame data
+	size_t len;			// Frame length
+	size_t used;			// Bytes consumed from frame (set by decoder)
+};
+
 enum {
 	DECODER_ERROR_BUFLEN = -1,
 	DECODER_ERROR_SYNC = -2
@@ -41,6 +48,9 @@ struct decoder_handle {
 		    unsigned long*, unsigned char*);
 	int (*decode)(struct decoder*, unsigned char*, size_t, unsigned char*,
 		      size_t, struct decoder_info*);
+	int (*decode_frames)(struct decoder*, struct decoder_frame*,
+			     unsigned int, unsigned char*, size_t,
+			     struct decoder_info*);
 	int (*close)(struct decoder*);
 };
 
@@ -50,6 +60,21 @@ int decoder_open(struct decoder_handle **handle, enum a_codec codec,
 int decoder_decode(struct decoder_handle *h, unsigned char *in_buffer,
 		   size_t in_size, unsigned char *out_buffer,
 		   size_t out_size, struct decoder_info *info);
+
+/* Batched decoding: remaining PCM is returned first and frames are then decoded
+ * in order until out_size samples have been returned. Consumed bytes are set in
+ * used field of each frame and info->used is set to count of frames completely
+ * consumed.
+ * If info->samplerate and info->channels are not zero, only samples in this
+ * format are returned: decoding stops at first format change and the decoded
+ * samples are kept in decoder for next call. Otherwise, decoding stops at first
+ * format change following returned samples. In both cases, info reports format
+ * of returned samples.
+ */
+int decoder_decode_frames(struct decoder_handle *h,
+			  struct decoder_frame *frames, unsigned int count,
+			  unsigned char *out_buffer, size_t out_size,
+			  struct decoder_info *info);
 int decoder_close(struct decoder_handle *h);
 
 #endif
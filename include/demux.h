@@ -88,6 +88,22 @@ ssize_t demux_get_frame(struct demux_handle *h, unsigned char **buffer);
  */
 void demux_set_used_frame(struct demux_handle *h, ssize_t len);
 
+/**
+ * Get current frame and next frames already available in demuxer, without
+ * waiting for them: a maximum of count frames is returned in buffers and lens.
+ * Return value is the number of frames, 0 when demuxer is buffering and -1 at
+ * end of stream.
+ * Used frames must be specified with demux_set_used_frames().
+ */
+int demux_get_frames(struct demux_handle *h, unsigned char **buffers,
+		     size_t *lens, int count);
+
+/**
+ * Set used frames returned by demux_get_frames(): count frames have been
+ * completely consumed and len bytes are used in next one.
+ */
+void demux_set_used_frames(struct demux_handle *h, int count, ssize_t len);
+
 /**
  * Get next frame in demuxer.
  * This function has the same behavior as demux_get_frame() but it force next
@@ -23,6 +23,8 @@
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 
+#include "json.h"
+
 enum fs_type {
 	FS_UNKNOWN,
 	FS_REG,
@@ -41,9 +43,12 @@ struct fs_dirent {
 	/* Custom values */
 	unsigned int comment_len;
 	char *comment;
-	/* Stat on entry */
+	/* Stat on entry: only valid when has_stat is set (see fs_stat_dirent()) */
+	int has_stat;
 	struct stat stat;
-	/* Name */
+	/* Name: must be last since entries of a fs_scandir() list are allocated
+	 * with only the space of their name.
+	 */
 	unsigned int name_len;
 	char name[256];
 };
@@ -69,6 +74,37 @@ struct fs_dir {
 	struct fs_handle *handle;
 };
 
+/* Asynchronous I/O request: fill fields of operation and submit it with
+ * fs_aio_read() or fs_aio_stat(). On completion, ret is set to result of
+ * operation (as fs_read() or fs_stat()) with err set to errno value, then
+ * callback is called from an I/O thread, or fs_aio_wait() returns if callback
+ * is NULL. Request (and its URL or buffer) must not be changed nor freed until
+ * its completion.
+ */
+struct fs_aio {
+	/* Read: file, buffer, length and offset in file (position of file is
+	 * not changed). File system must support positioned reads (see
+	 * fs_pread()).
+	 */
+	struct fs_file *file;
+	void *buf;
+	size_t count;
+	off_t offset;
+	/* Stat: URL and result */
+	const char *url;
+	struct stat stat;
+	/* Result */
+	ssize_t ret;
+	int err;
+	/* Completion callback */
+	void (*callback)(struct fs_aio *, void *);
+	void *user_data;
+	/* Private data */
+	int done;
+	void *priv;
+	struct fs_aio *next;
+};
+
 struct fs_handle {
 	/* File I/O */
 	int (*open)(struct fs_file *, const char *, int, mode_t);
@@ -78,6 +114,8 @@ struct fs_handle {
 	ssize_t (*write)(struct fs_file *, const void *, size_t);
 	ssize_t (*write_to)(struct fs_file *, const void *, size_t, long);
 	off_t (*lseek)(struct fs_file *, off_t, int);
+	/* Positioned read (optional): position of file is not changed */
+	ssize_t (*pread)(struct fs_file *, void *, size_t, off_t);
 	int (*ftruncate)(struct fs_file *, off_t);
 	void (*close)(struct fs_file *);
 	/* Filesystem I/O */
@@ -97,12 +135,29 @@ struct fs_handle {
 	int (*fstat)(struct fs_file *, struct stat *);
 	int (*statvfs)(const char *, struct statvfs *);
 	int (*fstatvfs)(struct fs_file *, struct statvfs *);
+	/* Asynchronous I/O (optional): aio_read() returns 0 if request is
+	 * submitted and aio_stat() returns count of requests submitted. Other
+	 * requests are done with synchronous calls in a shared worker pool.
+	 */
+	int (*aio_read)(struct fs_aio *);
+	int (*aio_stat)(struct fs_aio *, int);
+	/* Files are read through block cache: remote file is opened with
+	 * FS_O_CACHED added to flags.
+	 */
+	int remote;
 };
 
+/* Open flag of a remote file read by block cache (which reads ahead) */
+#define FS_O_CACHED 010000000000
+
 /* FS initializer */
 void fs_init(void);
 void fs_free(void);
 
+/* FS configuration: block cache of remote file systems */
+int fs_set_config(struct json *config);
+struct json *fs_get_config(void);
+
 /* File I/O */
 struct fs_file *fs_open(const char *url, int flags, mode_t mode);
 struct fs_file *fs_creat(const char *url, mode_t mode);
@@ -113,6 +168,11 @@ ssize_t fs_write(struct fs_file *f, const void *buf, size_t count);
 ssize_t fs_write_timeout(struct fs_file *f, const void *buf, size_t count,
 			 long timeout);
 off_t fs_lseek(struct fs_file *f, off_t offset, int whence);
+/* Read at offset without changing position of file: it can be called while
+ * file is used by another thread. Return: count of bytes read, 0 at end of
+ * file, -1 on error (errno is set to ENOSYS if file system doesn't support it).
+ */
+ssize_t fs_pread(struct fs_file *f, void *buf, size_t count, off_t offset);
 int fs_ftruncate(struct fs_file *f, off_t length);
 void fs_close(struct fs_file *f);
 
@@ -136,6 +196,21 @@ int fs_fstat(struct fs_file *f, struct stat *buf);
 int fs_statvfs(const char *url, struct statvfs *buf);
 int fs_fstatvfs(struct fs_file *f, struct statvfs *buf);
 
+/* Stat an entry of directory path (from fs_readdir() or fs_scandir()): entry
+ * is only stat on first call. Return: stat of entry or NULL on error.
+ */
+struct stat *fs_stat_dirent(const char *path, struct fs_dirent *d);
+
+/* Asynchronous I/O: submit a read or a batch of count stat requests (see
+ * struct fs_aio).
+ */
+int fs_aio_read(struct fs_aio *req);
+int fs_aio_stat(struct fs_aio *reqs, int count);
+/* Wait completion of a request without callback (timeout in ms, -1 for no
+ * timeout). Return 0 when request is completed, -1 on timeout.
+ */
+int fs_aio_wait(struct fs_aio *req, long timeout);
+
 /* Custom alphasort function */
 int fs_alphasort(const struct fs_dirent **a, const struct fs_dirent **b);
 int fs_alphasort_reverse(const struct fs_dirent **a,
@@ -149,11 +224,17 @@ int fs_alphasort_last(const struct fs_dirent **a, const struct fs_dirent **b);
 int fs_file_only(const struct fs_dirent *d);
 int fs_dir_only(const struct fs_dirent *d);
 
-/* Custom scandir function */
+/* Folder entry (directory, network, server or disk) */
+int fs_dirent_is_dir(const struct fs_dirent *d);
+
+/* Custom scandir function: entries are not stat (see fs_stat_dirent()) and
+ * list must be freed with fs_scandir_free().
+ */
 int fs_scandir(const char *path, struct fs_dirent ***list,
 	       int (*selector)(const struct fs_dirent *),
 	       int (*compar)(const struct fs_dirent **,
 			     const struct fs_dirent **));
+void fs_scandir_free(struct fs_dirent **list);
 
 #endif
 
@@ -25,7 +25,11 @@ enum {
 	HTTP_PROXY_PORT,
 	HTTP_FOLLOW_REDIRECT,
 	HTTP_MAX_REDIRECT,
-	HTTP_EXTRA_HEADER
+	HTTP_EXTRA_HEADER,
+	HTTP_KEEP_ALIVE,
+	HTTP_CONNECT_TIMEOUT,	/* In ms (with TLS handshake), 0 to disable */
+	HTTP_TCP_NODELAY,	/* Disable Nagle algorithm (default) */
+	HTTP_RCVBUF		/* Socket receive buffer, 0 for system default */
 };
 
 struct http_handle;
@@ -111,6 +115,14 @@ void http_close_connection(struct http_handle *h);
 /* Close connection and free handle */
 void http_close(struct http_handle *h);
 
+/* Connections are kept alive by default (see HTTP_KEEP_ALIVE option): when a
+ * response has been fully read, its connection is moved to a pool shared by
+ * all handles and reused by next request to same host. Idle connections are
+ * closed after a timeout or by this function, which should be called at end of
+ * program execution. It also frees TLS sessions kept to resume handshakes.
+ */
+void http_free_pool(void);
+
 #endif
 
 
@@ -19,6 +19,9 @@
 #ifndef _OUTPUT_H
 #define _OUTPUT_H
 
+#include <stdint.h>
+#include <time.h>
+
 #include "format.h"
 
 #define OUTPUT_VOLUME_MAX 65535
@@ -66,6 +69,12 @@ struct output_stream_handle *output_add_stream(struct output_handle *h,
 void output_remove_stream(struct output_handle *h,
 			  struct output_stream_handle *s);
 
+/* Route output (when s is NULL) or stream to zones: zones is a comma separated
+ * list of zone names or NULL to use default routing from configuration.
+ */
+int output_set_route(struct output_handle *h, struct output_stream_handle *s,
+		     const char *zones);
+
 /* Play/Pause output stream */
 int output_play_stream(struct output_handle *h, struct output_stream_handle *s);
 int output_pause_stream(struct output_handle *h,
@@ -96,6 +105,22 @@ unsigned long output_get_status_stream(struct output_handle *h,
 				       struct output_stream_handle *s,
 				       enum output_stream_key key);
 
+/* Output stream clock */
+struct output_clock {
+	/* Samples of stream emitted by device (per channel) */
+	uint64_t position;
+	/* Output format of position */
+	unsigned long samplerate;
+	unsigned char channels;
+	/* Monotonic time at which position was emitted */
+	struct timespec time;
+	/* Delay of samples queued in cache and device (in ms) */
+	unsigned long delay;
+};
+int output_get_clock_stream(struct output_handle *h,
+			    struct output_stream_handle *s,
+			    struct output_clock *clock);
+
 /* Output stream event */
 enum stream_event {
 	STREAM_EVENT_READY,	/*!< Stream is ready to play (cache is full) */
@@ -0,0 +1,49 @@
+/*
+ * realtime.h - Real-time scheduling, CPU affinity and memory locking
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _REALTIME_H
+#define _REALTIME_H
+
+#include <stddef.h>
+
+#include "json.h"
+
+/* Thread classes which can be scheduled with SCHED_FIFO */
+enum realtime_class {
+	REALTIME_NONE,		/*!< Only set thread name */
+	REALTIME_OUTPUT,	/*!< Audio output thread (mixer and RTP path) */
+	REALTIME_CACHE,		/*!< Decode-ahead threads (cache) */
+	REALTIME_CLASS_COUNT
+};
+
+/* Real-time initializer */
+int realtime_init(struct json *config);
+void realtime_free(void);
+
+/* Configuration (scheduling changes apply to next started threads) */
+int realtime_set_config(struct json *config);
+struct json *realtime_get_config(void);
+
+/* Setup calling thread: name, scheduling policy and CPU affinity */
+int realtime_set_thread(enum realtime_class cls, const char *name);
+
+/* Touch all pages of an audio buffer to avoid page faults in audio path */
+void realtime_prefault(void *buffer, size_t size);
+
+#endif
+
@@ -0,0 +1,47 @@
+/*
+ * resolver.h - Asynchronous hostname resolver with cache
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RESOLVER_H
+#define _RESOLVER_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* Maximum addresses kept for one hostname */
+#define RESOLVER_MAX_ADDR 8
+
+/* Resolved address (IPv4 or IPv6) */
+struct resolver_addr {
+	struct sockaddr_storage addr;
+	socklen_t len;
+};
+
+/* Resolve a hostname to a list of addresses with port set, in the order
+ * returned by getaddrinfo(). Lookups are done in a worker thread and results
+ * are cached, so a slow DNS server blocks the caller at most timeout ms (-1 to
+ * wait end of lookup). When a cached result has expired and its refresh times
+ * out, the expired addresses are returned.
+ * Return: number of addresses copied in addrs, or -1 on error / timeout.
+ */
+int resolver_lookup(const char *hostname, unsigned int port,
+		    struct resolver_addr *addrs, int count, long timeout);
+
+/* Free resolver cache (at end of program execution) */
+void resolver_free(void);
+
+#endif
@@ -24,9 +24,11 @@ struct vring_handle;
 /**
  * Open a new Virtual Ring buffer of buffer_size bytes with a direct read/write
  * of maximum max_rw_size bytes.
- * The allocated memory is buffer_size + max_rw_size bytes.
- * All functions are thread-safe but a read/write access must be unique
- * since a direct access is performed.
+ * The buffer (rounded up to page size) is mapped twice in a row in memory, so
+ * data across end of buffer is always contiguous and no copy is done.
+ * Ring buffer is lock-free: it must be used by a single writer thread (with
+ * vring_write() and vring_write_forward()) and a single reader thread (with
+ * vring_read() and vring_read_forward()).
  */
 int vring_open(struct vring_handle **handle, size_t buffer_size,
 	       size_t max_rw_size);
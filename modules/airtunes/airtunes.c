@@ -81,7 +81,7 @@ struct airtunes_stream {
 	char id[AIRTUNES_ID_SIZE+1];
 	/* Stream name */
 	char *name;
-	/* Stream status */
+	/* Stream status: played and position in ms, duration in seconds */
 	unsigned long played;
 	unsigned long position;
 	unsigned long duration;
@@ -904,6 +904,21 @@ static void airtunes_dmap_parse(void *user_data, enum dmap_type type,
 	*p = strdup(str);
 }
 
+static unsigned long airtunes_get_played(struct airtunes_handle *h,
+					 struct output_stream_handle *stream)
+{
+	struct output_clock clock;
+
+	/* Get samples of stream emitted by device */
+	if(output_get_clock_stream(h->output, stream, &clock) != 0 ||
+	   clock.samplerate == 0)
+		return output_get_status_stream(h->output, stream,
+						OUTPUT_STREAM_PLAYED);
+
+	/* Convert in ms */
+	return clock.position * 1000 / clock.samplerate;
+}
+
 static int airtunes_read_set_param(struct airtunes_handle *h,
 				   struct rtsp_client *c,
 				   struct airtunes_client_data *cdata,
@@ -958,17 +973,18 @@ static int airtunes_read_set_param(struct airtunes_handle *h,
 			/* Lock mutex */
 			pthread_mutex_lock(&h->mutex);
 
-			/* Convert values in seconds */
-			cdata->infos->duration = (end - start) /
+			/* Convert duration in seconds and position in ms
+			 * (RTP times are 32-bit and can wrap)
+			 */
+			cdata->infos->duration = (uint32_t) (end - start) /
 						 cdata->samplerate;
-			cdata->infos->position = (cur - start) /
+			cdata->infos->position = (uint64_t) (uint32_t)
+						 (cur - start) * 1000 /
 						 cdata->samplerate;
 
-			/* Get played samples */
-			start = output_get_status_stream(h->output,
-							 cdata->stream,
-							 OUTPUT_STREAM_PLAYED);
-			cdata->infos->played = start / 1000;
+			/* Get played ms at this position */
+			cdata->infos->played = airtunes_get_played(h,
+								 cdata->stream);
 
 			/* Unlock mutex */
 			pthread_mutex_unlock(&h->mutex);
@@ -1156,6 +1172,8 @@ static int airtunes_close_callback(struct rtsp_client *c, void *user_data)
 #define ADD_STRING(j, k, s) json_object_object_add(j, k, \
 			       s != NULL ? json_object_new_string(s) : NULL);
 #define ADD_INT(j, k, i) json_object_object_add(j, k, json_object_new_int(i));
+#define ADD_INT64(j, k, i) json_object_object_add(j, k, \
+					       json_object_new_int64(i));
 
 static int airtunes_httpd_status(void *user_data, struct httpd_req *req,
 				 struct httpd_res **res)
@@ -1164,6 +1182,7 @@ static int airtunes_httpd_status(void *user_data, struct httpd_req *req,
 	struct airtunes_stream *s;
 	json_object *root, *tmp;
 	unsigned long played;
+	int64_t pos;
 	char *str;
 
 	/* Create JSON array */
@@ -1182,9 +1201,13 @@ static int airtunes_httpd_status(void *user_data, struct httpd_req *req,
 		if(tmp == NULL)
 			continue;
 
-		/* Get played samples from output stream */
-		played = output_get_status_stream(h->output, s->stream,
-						  OUTPUT_STREAM_PLAYED) / 1000;
+		/* Get played ms from output stream */
+		played = airtunes_get_played(h, s->stream);
+
+		/* Position in ms (played can be behind progress update) */
+		pos = (int64_t) s->position + played - s->played;
+		if(pos < 0)
+			pos = 0;
 
 		/* Add values to it */
 		ADD_STRING(tmp, "id", s->id);
@@ -1192,7 +1215,8 @@ static int airtunes_httpd_status(void *user_data, struct httpd_req *req,
 		ADD_STRING(tmp, "title", s->title);
 		ADD_STRING(tmp, "artist", s->artist);
 		ADD_STRING(tmp, "album", s->album);
-		ADD_INT(tmp, "pos", s->position + played - s->played);
+		ADD_INT(tmp, "pos", pos / 1000);
+		ADD_INT64(tmp, "pos_ms", pos);
 		ADD_INT(tmp, "length", s->duration);
 		ADD_INT(tmp, "volume", s->volume);
 
@@ -341,6 +341,7 @@ int raop_read(void *user_data, unsigned char *buffer, size_t size,
 	      struct a_format *fmt)
 {
 	struct raop_handle *h = (struct raop_handle *) user_data;
+	struct decoder_frame frame;
 	struct decoder_info info;
 	int total_samples = 0;
 	int samples;
@@ -364,46 +365,36 @@ silence:
 		size -= samples;
 	}
 
-	/* Process remaining pcm data */
-	if(h->pcm_remaining > 0)
-	{
-		/* Get remaining pcm data from decoder */
-		samples = decoder_decode(h->dec, NULL, 0, buffer, size, &info);
-		if(samples < 0)
-		{
-			/* Unlock buffer access */
-			pthread_mutex_unlock(&h->mutex);
-			return -1;
-		}
-
-		h->pcm_remaining -= samples;
-		total_samples += samples;
-		buffer += samples * 4;
-		size -= samples;
-	}
-
 	/* Fill output buffer */
 	while(size > 0)
 	{
-		/* Get next packet */
-		raop_get_next_packet(h);
+		/* Get next packet when remaining pcm data has been played */
+		if(h->pcm_remaining == 0)
+		{
+			raop_get_next_packet(h);
 
-		/* Play silence */
-		if(h->silence_remaining > 0)
-			goto silence;
+			/* Play silence */
+			if(h->silence_remaining > 0)
+				goto silence;
+		}
 
-		/* Decode next frame */
-		samples = decoder_decode(h->dec, h->packet, h->packet_len,
-					 buffer, size, &info);
+		/* Decode remaining pcm data and next frame */
+		frame.buffer = h->packet;
+		frame.len = h->packet_len;
+		info.samplerate = 0;
+		info.channels = 0;
+		samples = decoder_decode_frames(h->dec, &frame,
+						frame.len > 0 ? 1 : 0, buffer,
+						size, &info);
 		if(samples <= 0)
 			break;
 
 		/* Move input buffer to next frame (ignore RTP errors) */
-		if(h->transport == RAOP_TCP && info.used < h->packet_len)
+		if(h->transport == RAOP_TCP && frame.used < h->packet_len)
 		{
-			memmove(h->packet, &h->packet[info.used],
-				h->packet_len - info.used);
-			h->packet_len -=  info.used;
+			memmove(h->packet, &h->packet[frame.used],
+				h->packet_len - frame.used);
+			h->packet_len -=  frame.used;
 		}
 		else
 		{
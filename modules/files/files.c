@@ -242,10 +242,24 @@ static void files_play_prev(struct files_handle *h)
 	files_event_player(h);
 }
 
+static uint64_t files_get_played(struct files_handle *h)
+{
+	struct output_clock clock;
+
+	/* Get samples of stream emitted by device */
+	if(output_get_clock_stream(h->output, h->stream, &clock) != 0 ||
+	   clock.samplerate == 0)
+		return output_get_status_stream(h->output, h->stream,
+						OUTPUT_STREAM_PLAYED);
+
+	/* Convert in ms */
+	return clock.position * 1000 / clock.samplerate;
+}
+
 static void *files_thread(void *user_data)
 {
 	struct files_handle *h = (struct files_handle *) user_data;
-	unsigned long played;
+	uint64_t played;
 
 	while(!h->stop)
 	{
@@ -255,13 +269,13 @@ static void *files_thread(void *user_data)
 		if(h->playlist_cur != -1 &&
 		   h->playlist_cur+1 <= h->playlist_len)
 		{
-			/* Get current played from stream */
-			played = output_get_status_stream(h->output, h->stream,
-						  OUTPUT_STREAM_PLAYED) / 1000;
+			/* Get current played from stream (in ms) */
+			played = files_get_played(h);
 
 			/* Check position */
 			if(h->file != NULL && 
-			   (played + h->pos >= file_get_length(h->file)-1
+			   (played + (uint64_t) h->pos * 1000 >=
+			    (file_get_length(h->file) - 1) * 1000
 			   || file_get_status(h->file) == FILE_EOF))
 			{
 				files_play_next(h);
@@ -333,7 +347,7 @@ static int files_add(struct files_handle *h, unsigned long media_id,
 
 static int files_file_only(const struct fs_dirent *d)
 {
-	return (d->stat.st_mode & S_IFREG) && files_ext_check(d->name) ? 1 : 0;
+	return d->type == FS_REG && files_ext_check(d->name) ? 1 : 0;
 }
 
 static int files_add_from_db(void *user_data, int64_t media_id,
@@ -421,7 +435,7 @@ static int files_add_multiple(struct files_handle *h, const char *resource,
 		{
 			/* Make file path */
 			if(asprintf(&f_path, "%s/%s", path, list[i]->name) < 0)
-				goto next;
+				continue;
 
 			/* Add file to playlist */
 			idx = files_add(h, media_id, f_path, path_len);
@@ -432,13 +446,10 @@ static int files_add_multiple(struct files_handle *h, const char *resource,
 
 			/* Free file path */
 			free(f_path);
-next:
-			/* Free entry */
-			free(list[i]);
 		}
 
 		/* Free list */
-		free(list);
+		fs_scandir_free(list);
 	}
 	else if(st.st_mode & S_IFREG)
 	{
@@ -716,7 +727,7 @@ static int files_seek(struct files_handle *h, unsigned long pos)
 
 static struct json *files_json_status(struct files_handle *h, int tags)
 {
-	unsigned long played;
+	uint64_t played;
 	struct json *status;
 
 	/* Create basic JSON object */
@@ -733,10 +744,10 @@ static struct json *files_json_status(struct files_handle *h, int tags)
 		json_add(status, "tag",
 			 json_copy(h->playlist[h->playlist_cur].tag));
 
-	/* Get curent postion in output stream  */
-	played = output_get_status_stream(h->output, h->stream,
-					  OUTPUT_STREAM_PLAYED) / 1000;
-	json_set_int(status, "pos", played + h->pos);
+	/* Get curent postion in output stream (in seconds and ms) */
+	played = files_get_played(h) + (uint64_t) h->pos * 1000;
+	json_set_int(status, "pos", played / 1000);
+	json_set_int64(status, "pos_ms", played);
 
 	/* Add stream length */
 	json_set_int(status, "length", file_get_length(h->file));
@@ -864,7 +864,7 @@ end:
 static int files_list_filter(const struct fs_dirent *d)
 {
 	/* Check file ext */
-	if(d->stat.st_mode & S_IFREG)
+	if(d->type == FS_REG)
 		return files_ext_check(d->name);
 
 	return 1;
@@ -880,6 +880,7 @@ char *files_list_files(struct db_handle *db, const char *cover_path,
 	int (*_filter)(const struct fs_dirent *) = files_list_filter;
 	struct fs_dirent **list_dir = NULL;
 	struct json *root, *tmp;
+	struct stat *st;
 	char *real_path = NULL;
 	char *str = NULL;
 	char *tag_sort;
@@ -961,14 +962,13 @@ char *files_list_files(struct db_handle *db, const char *cover_path,
 	for(i = offset; i < list_count && count > 0; i++)
 	{
 		/* Process entry */
-		if(list_dir[i]->stat.st_mode & S_IFDIR ||
-		   list_dir[i]->type == FS_DIR || list_dir[i]->type == FS_NET ||
+		if(list_dir[i]->type == FS_DIR || list_dir[i]->type == FS_NET ||
 		   list_dir[i]->type == FS_SRV)
 		{
 			/* Create a new JSON object */
 			tmp = json_new();
 			if(tmp == NULL)
-				goto next;
+				continue;
 
 			/* Add folder name */
 			json_set_string(tmp, "folder", list_dir[i]->name);
@@ -985,20 +985,23 @@ char *files_list_files(struct db_handle *db, const char *cover_path,
 
 			count--;
 		}
-		else if(!only_dir && list_dir[i]->stat.st_mode & S_IFREG)
+		else if(!only_dir && list_dir[i]->type == FS_REG)
 		{
 			/* Create a new JSON object */
 			tmp = json_new();
 			if(tmp == NULL)
-				goto next;
+				continue;
 
 			/* Add file name */
 			json_set_string(tmp, "file", list_dir[i]->name);
 
+			/* Stat file (only listed files of page are stat) */
+			st = fs_stat_dirent(real_path, list_dir[i]);
+
 			/* Add meta to JSON if available */
 			files_list_add_meta(db, tmp, real_path,
 					    list_dir[i]->name, path_id,
-					    list_dir[i]->stat.st_mtime, 0,
+					    st != NULL ? st->st_mtime : 0, 0,
 					    NULL);
 
 			/* Add to array */
@@ -1007,14 +1010,10 @@ char *files_list_files(struct db_handle *db, const char *cover_path,
 
 			count--;
 		}
-next:
-		/* Free dir entry */
-		free(list_dir[i]);
 	}
 
 	/* Free list */
-	if(list_dir != NULL)
-		free(list_dir);
+	fs_scandir_free(list_dir);
 
 do_sql:
 	/* No more files to retrieve */
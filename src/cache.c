@@ -23,6 +23,8 @@
 #include <unistd.h>
 #include <pthread.h>
 
+#include "realtime.h"
+#include "resample.h"
 #include "cache.h"
 
 #ifdef HAVE_CONFIG_H
@@ -123,6 +125,7 @@ int cache_open(struct cache_handle **handle, unsigned long time,
 		h->buffer = malloc(h->size * 4);
 		if(h->buffer == NULL)
 			return -1;
+		realtime_prefault(h->buffer, h->size * 4);
 	}
 
 	/* Init thread mutex */
@@ -176,6 +179,7 @@ static void cache_resize(struct cache_handle *h, int unset_is_ready)
 		if(p == NULL)
 			return;
 		h->buffer = p;
+		realtime_prefault(h->buffer, size*4);
 
 		/* Unset is_ready */
 		if((unset_is_ready && h->len < size) || h->size == 0)
@@ -427,12 +431,16 @@ static void *cache_read_thread(void *user_data)
 	ssize_t size;
 	int ret = 0;
 
+	/* Set thread name and scheduling */
+	realtime_set_thread(REALTIME_CACHE, "cache");
+
 	/* Allocate buffer */
 	if(h->input_callback != NULL)
 	{
 		buffer = malloc(BUFFER_SIZE);
 		if(buffer == NULL)
 			return NULL;
+		realtime_prefault(buffer, BUFFER_SIZE);
 	}
 
 	/* Read indefinitively the input callback */
@@ -683,7 +691,7 @@ ssize_t cache_write(void *user_data, const unsigned char *buffer, size_t size,
 	pthread_mutex_lock(&h->mutex);
 
 	/* Calculate size to write in cache */
-	in_size = h->size - h->len;
+	in_size = h->len < h->size ? h->size - h->len : 0;
 	if(size > in_size)
 		size = in_size;
 	if(size == 0)
@@ -711,6 +719,105 @@ end:
 	return size;
 }
 
+static void cache_free_format(struct cache_handle *h)
+{
+	struct cache_format *cf;
+
+	/* Flush format list */
+	while(h->fmt_first != NULL)
+	{
+		cf = h->fmt_first;
+		h->fmt_first = cf->next;
+		free(cf);
+	}
+	h->fmt_last = NULL;
+	h->fmt_len = 0;
+}
+
+int cache_convert(struct cache_handle *h, unsigned long samplerate,
+		  unsigned char channels)
+{
+	struct a_format fmt = A_FORMAT_INIT;
+	struct resample_handle *res;
+	unsigned char *buffer;
+	unsigned long pos = 0, len = 0, size;
+	ssize_t in, out;
+	int ret = 0;
+
+	if(h == NULL || samplerate == 0 || channels == 0)
+		return -1;
+
+	/* Lock input callback and cache access */
+	cache_lock(h);
+	pthread_mutex_lock(&h->mutex);
+
+	/* Nothing to do */
+	if(samplerate == h->samplerate && channels == h->channels)
+		goto end;
+
+	/* Convert cached samples to new format */
+	if(h->buffer != NULL && h->len > 0 &&
+	   resample_open(&res, h->samplerate, h->channels, samplerate,
+			 channels, NULL, NULL, NULL) == 0)
+	{
+		/* Allocate new buffer */
+		size = ((uint64_t) h->len) * samplerate / h->samplerate *
+		       channels / h->channels + BUFFER_SIZE;
+		buffer = malloc(size * 4);
+		if(buffer == NULL)
+		{
+			resample_close(res);
+			ret = -1;
+			goto end;
+		}
+
+		/* Resample all cached data */
+		do {
+			in = resample_write(res, &h->buffer[pos*4],
+					    h->len - pos, &fmt);
+			if(in > 0)
+				pos += in;
+			out = resample_read(res, &buffer[len*4], size - len,
+					    &fmt);
+			if(out > 0)
+				len += out;
+		} while((in > 0 || out > 0) && len < size);
+		resample_close(res);
+
+		/* Replace buffer */
+		free(h->buffer);
+		h->buffer = buffer;
+		h->len = len;
+		h->size = size;
+	}
+	else if(h->buffer != NULL)
+		h->len = 0;
+
+	/* Only one format is now available in cache */
+	cache_free_format(h);
+	fmt.samplerate = samplerate;
+	fmt.channels = channels;
+	cache_put_format(h, &fmt);
+	h->fmt_len = h->len;
+
+	/* Update format and cache size */
+	h->samplerate = samplerate;
+	h->channels = channels;
+	if(h->buffer != NULL)
+		cache_resize(h, 0);
+
+	/* Drop data in old format pending in thread */
+	if(h->use_thread)
+		h->flush = 1;
+
+end:
+	/* Unlock cache access and input callback */
+	pthread_mutex_unlock(&h->mutex);
+	cache_unlock(h);
+
+	return ret;
+}
+
 void cache_flush(struct cache_handle *h)
 {
 	struct cache_format *cf;
@@ -0,0 +1,520 @@
+/*
+ * convert.c - Sample format conversion for decoders
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__SSE2__)
+#define CONVERT_SSE2
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+#include "convert.h"
+
+/* Fixed point Q28 format used by libmad */
+#define Q28_ONE (1L << 28)
+#define Q28_SCALE (1.0f / Q28_ONE)
+
+/* Output sample of pipeline */
+#ifdef USE_FLOAT
+	#define CONVERT_SCALE (1.0f / 0x7fffffff)
+	typedef float sample_t;
+	#define TO_SAMPLE(v) ((float) (int32_t) (v) * CONVERT_SCALE)
+#else
+	typedef int32_t sample_t;
+	#define TO_SAMPLE(v) ((int32_t) (v))
+#endif
+
+/* Scalar helpers (used as reference and for tails of SIMD loops) */
+#define FROM_S8(b)    ((uint32_t) (b)[0] << 24)
+#define FROM_S16LE(b) ((uint32_t) (b)[1] << 24 | (uint32_t) (b)[0] << 16)
+#define FROM_S16BE(b) ((uint32_t) (b)[0] << 24 | (uint32_t) (b)[1] << 16)
+#define FROM_S24LE(b) ((uint32_t) (b)[2] << 24 | (uint32_t) (b)[1] << 16 | \
+		       (uint32_t) (b)[0] << 8)
+#define FROM_S24BE(b) ((uint32_t) (b)[0] << 24 | (uint32_t) (b)[1] << 16 | \
+		       (uint32_t) (b)[2] << 8)
+#define FROM_S32LE(b) ((uint32_t) (b)[3] << 24 | (uint32_t) (b)[2] << 16 | \
+		       (uint32_t) (b)[1] << 8 | (uint32_t) (b)[0])
+#define FROM_S32BE(b) ((uint32_t) (b)[0] << 24 | (uint32_t) (b)[1] << 16 | \
+		       (uint32_t) (b)[2] << 8 | (uint32_t) (b)[3])
+
+#ifdef USE_FLOAT
+static inline float convert_q28(int32_t s)
+{
+	return (float) s * Q28_SCALE;
+}
+#else
+static inline int32_t convert_q28(int32_t s)
+{
+	/* Round sample */
+	s += (1L << 4);
+
+	/* Clip */
+	if(s >= Q28_ONE)
+		s = Q28_ONE - 1;
+	else if(s < -Q28_ONE)
+		s = -Q28_ONE;
+
+	return (s << 3) & 0xFFFFFF00;
+}
+#endif
+
+#if defined(CONVERT_SSE2)
+static inline void convert_store(sample_t *p, __m128i v)
+{
+#ifdef USE_FLOAT
+	_mm_storeu_ps(p, _mm_mul_ps(_mm_cvtepi32_ps(v),
+				    _mm_set1_ps(CONVERT_SCALE)));
+#else
+	_mm_storeu_si128((__m128i *) p, v);
+#endif
+}
+
+static inline __m128i convert_swap16(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#elif defined(CONVERT_NEON)
+static inline void convert_store(sample_t *p, int32x4_t v)
+{
+#ifdef USE_FLOAT
+	vst1q_f32(p, vmulq_n_f32(vcvtq_f32_s32(v), CONVERT_SCALE));
+#else
+	vst1q_s32(p, v);
+#endif
+}
+#endif
+
+void convert_s8(void *out, const unsigned char *in, size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2)
+	__m128i zero = _mm_setzero_si128();
+	__m128i v, lo, hi;
+
+	/* 16 samples per iteration */
+	for(; i + 16 <= count; i += 16, p += 16)
+	{
+		v = _mm_loadu_si128((const __m128i *) &in[i]);
+		lo = _mm_unpacklo_epi8(zero, v);
+		hi = _mm_unpackhi_epi8(zero, v);
+		convert_store(p, _mm_unpacklo_epi16(zero, lo));
+		convert_store(p + 4, _mm_unpackhi_epi16(zero, lo));
+		convert_store(p + 8, _mm_unpacklo_epi16(zero, hi));
+		convert_store(p + 12, _mm_unpackhi_epi16(zero, hi));
+	}
+#elif defined(CONVERT_NEON)
+	int16x8_t lo, hi;
+	int8x16_t v;
+
+	/* 16 samples per iteration */
+	for(; i + 16 <= count; i += 16, p += 16)
+	{
+		v = vreinterpretq_s8_u8(vld1q_u8(&in[i]));
+		lo = vshll_n_s8(vget_low_s8(v), 8);
+		hi = vshll_n_s8(vget_high_s8(v), 8);
+		convert_store(p, vshll_n_s16(vget_low_s16(lo), 16));
+		convert_store(p + 4, vshll_n_s16(vget_high_s16(lo), 16));
+		convert_store(p + 8, vshll_n_s16(vget_low_s16(hi), 16));
+		convert_store(p + 12, vshll_n_s16(vget_high_s16(hi), 16));
+	}
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S8(&in[i]));
+}
+
+void convert_s16le(void *out, const unsigned char *in, size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2)
+	__m128i zero = _mm_setzero_si128();
+	__m128i v;
+
+	/* 8 samples per iteration */
+	for(; i + 8 <= count; i += 8, p += 8)
+	{
+		v = _mm_loadu_si128((const __m128i *) &in[i*2]);
+		convert_store(p, _mm_unpacklo_epi16(zero, v));
+		convert_store(p + 4, _mm_unpackhi_epi16(zero, v));
+	}
+#elif defined(CONVERT_NEON)
+	int16x8_t v;
+
+	/* 8 samples per iteration */
+	for(; i + 8 <= count; i += 8, p += 8)
+	{
+		v = vreinterpretq_s16_u8(vld1q_u8(&in[i*2]));
+		convert_store(p, vshll_n_s16(vget_low_s16(v), 16));
+		convert_store(p + 4, vshll_n_s16(vget_high_s16(v), 16));
+	}
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S16LE(&in[i*2]));
+}
+
+void convert_s16be(void *out, const unsigned char *in, size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2)
+	__m128i zero = _mm_setzero_si128();
+	__m128i v;
+
+	/* 8 samples per iteration */
+	for(; i + 8 <= count; i += 8, p += 8)
+	{
+		v = _mm_loadu_si128((const __m128i *) &in[i*2]);
+		v = convert_swap16(v);
+		convert_store(p, _mm_unpacklo_epi16(zero, v));
+		convert_store(p + 4, _mm_unpackhi_epi16(zero, v));
+	}
+#elif defined(CONVERT_NEON)
+	int16x8_t v;
+
+	/* 8 samples per iteration */
+	for(; i + 8 <= count; i += 8, p += 8)
+	{
+		v = vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(&in[i*2])));
+		convert_store(p, vshll_n_s16(vget_low_s16(v), 16));
+		convert_store(p + 4, vshll_n_s16(vget_high_s16(v), 16));
+	}
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S16BE(&in[i*2]));
+}
+
+#if defined(CONVERT_NEON)
+static inline size_t convert_s24_neon(sample_t *p, const unsigned char *in,
+				      size_t count, int big_endian)
+{
+	uint16x8_t lo, hi;
+	uint16x8x2_t v;
+	uint8x8x3_t b;
+	size_t i = 0;
+
+	/* 8 samples per iteration: bytes are deinterleaved in 3 planes */
+	for(; i + 8 <= count; i += 8, p += 8)
+	{
+		b = vld3_u8(&in[i*3]);
+		if(big_endian)
+		{
+			hi = vorrq_u16(vshll_n_u8(b.val[0], 8),
+				       vmovl_u8(b.val[1]));
+			lo = vshll_n_u8(b.val[2], 8);
+		}
+		else
+		{
+			hi = vorrq_u16(vshll_n_u8(b.val[2], 8),
+				       vmovl_u8(b.val[1]));
+			lo = vshll_n_u8(b.val[0], 8);
+		}
+		v = vzipq_u16(lo, hi);
+		convert_store(p, vreinterpretq_s32_u16(v.val[0]));
+		convert_store(p + 4, vreinterpretq_s32_u16(v.val[1]));
+	}
+
+	return i;
+}
+#endif
+
+void convert_s24le(void *out, const unsigned char *in, size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2) && defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					   -1, 6, 7, 8, -1, 9, 10, 11);
+	__m128i v;
+
+	/* 4 samples per iteration (16 bytes are loaded for 12 used) */
+	for(; i + 6 <= count; i += 4, p += 4)
+	{
+		v = _mm_loadu_si128((const __m128i *) &in[i*3]);
+		convert_store(p, _mm_shuffle_epi8(v, mask));
+	}
+#elif defined(CONVERT_NEON)
+	i = convert_s24_neon(p, in, count, 0);
+	p += i;
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S24LE(&in[i*3]));
+}
+
+void convert_s24be(void *out, const unsigned char *in, size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2) && defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3,
+					   -1, 8, 7, 6, -1, 11, 10, 9);
+	__m128i v;
+
+	/* 4 samples per iteration (16 bytes are loaded for 12 used) */
+	for(; i + 6 <= count; i += 4, p += 4)
+	{
+		v = _mm_loadu_si128((const __m128i *) &in[i*3]);
+		convert_store(p, _mm_shuffle_epi8(v, mask));
+	}
+#elif defined(CONVERT_NEON)
+	i = convert_s24_neon(p, in, count, 1);
+	p += i;
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S24BE(&in[i*3]));
+}
+
+void convert_s32le(void *out, const unsigned char *in, size_t count)
+{
+#ifndef USE_FLOAT
+	/* Same format: only copy samples */
+	memcpy(out, in, count * 4);
+#else
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2)
+	/* 4 samples per iteration */
+	for(; i + 4 <= count; i += 4, p += 4)
+		convert_store(p, _mm_loadu_si128((const __m128i *) &in[i*4]));
+#elif defined(CONVERT_NEON)
+	/* 4 samples per iteration */
+	for(; i + 4 <= count; i += 4, p += 4)
+		convert_store(p, vreinterpretq_s32_u8(vld1q_u8(&in[i*4])));
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S32LE(&in[i*4]));
+#endif
+}
+
+void convert_s32be(void *out, const unsigned char *in, size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2)
+	__m128i v;
+
+	/* 4 samples per iteration */
+	for(; i + 4 <= count; i += 4, p += 4)
+	{
+		/* Swap bytes in 16-bit words and then swap words */
+		v = _mm_loadu_si128((const __m128i *) &in[i*4]);
+		v = convert_swap16(v);
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		convert_store(p, v);
+	}
+#elif defined(CONVERT_NEON)
+	/* 4 samples per iteration */
+	for(; i + 4 <= count; i += 4, p += 4)
+		convert_store(p, vreinterpretq_s32_u8(
+					       vrev32q_u8(vld1q_u8(&in[i*4]))));
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+		*p++ = TO_SAMPLE(FROM_S32BE(&in[i*4]));
+}
+
+void convert_float(void *out, const float *in, size_t count)
+{
+#ifdef USE_FLOAT
+	/* Same format: only copy samples */
+	memcpy(out, in, count * 4);
+#else
+	int32_t *p = out;
+	size_t i;
+
+	/* Scale and clip samples */
+	for(i = 0; i < count; i++)
+	{
+		if(in[i] >= 1.0f)
+			p[i] = 0x7fffffff;
+		else if(in[i] <= -1.0f)
+			p[i] = INT32_MIN;
+		else
+			p[i] = (int32_t) ((double) in[i] * 2147483648.0);
+	}
+#endif
+}
+
+void convert_fixed_q28(void *out, const int32_t *left, const int32_t *right,
+		       size_t count)
+{
+	sample_t *p = out;
+	size_t i = 0;
+
+#if defined(CONVERT_SSE2)
+#ifdef USE_FLOAT
+	__m128 scale = _mm_set1_ps(Q28_SCALE);
+	__m128 l, r;
+
+	/* 4 samples per channel per iteration */
+	for(; i + 4 <= count; i += 4)
+	{
+		l = _mm_mul_ps(_mm_cvtepi32_ps(
+			     _mm_loadu_si128((const __m128i *) &left[i])), scale);
+		if(right == NULL)
+		{
+			_mm_storeu_ps(p, l);
+			p += 4;
+			continue;
+		}
+		r = _mm_mul_ps(_mm_cvtepi32_ps(
+			    _mm_loadu_si128((const __m128i *) &right[i])), scale);
+		_mm_storeu_ps(p, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(p + 4, _mm_unpackhi_ps(l, r));
+		p += 8;
+	}
+#else
+	const __m128i round = _mm_set1_epi32(1L << 4);
+	const __m128i max = _mm_set1_epi32(Q28_ONE - 1);
+	const __m128i min = _mm_set1_epi32(-Q28_ONE);
+	const __m128i mask = _mm_set1_epi32(0xFFFFFF00);
+	__m128i v[2], m;
+	int c, channels = right == NULL ? 1 : 2;
+
+	/* 4 samples per channel per iteration */
+	for(; i + 4 <= count; i += 4)
+	{
+		v[0] = _mm_loadu_si128((const __m128i *) &left[i]);
+		if(right != NULL)
+			v[1] = _mm_loadu_si128((const __m128i *) &right[i]);
+
+		/* Round, clip and scale as libmad output */
+		for(c = 0; c < channels; c++)
+		{
+			v[c] = _mm_add_epi32(v[c], round);
+			m = _mm_cmpgt_epi32(v[c], max);
+			v[c] = _mm_or_si128(_mm_and_si128(m, max),
+					    _mm_andnot_si128(m, v[c]));
+			m = _mm_cmplt_epi32(v[c], min);
+			v[c] = _mm_or_si128(_mm_and_si128(m, min),
+					    _mm_andnot_si128(m, v[c]));
+			v[c] = _mm_and_si128(_mm_slli_epi32(v[c], 3), mask);
+		}
+
+		/* Interleave channels */
+		if(right == NULL)
+		{
+			_mm_storeu_si128((__m128i *) p, v[0]);
+			p += 4;
+			continue;
+		}
+		_mm_storeu_si128((__m128i *) p, _mm_unpacklo_epi32(v[0], v[1]));
+		_mm_storeu_si128((__m128i *) (p + 4),
+				 _mm_unpackhi_epi32(v[0], v[1]));
+		p += 8;
+	}
+#endif
+#elif defined(CONVERT_NEON)
+#ifdef USE_FLOAT
+	float32x4x2_t v;
+
+	/* 4 samples per channel per iteration */
+	for(; i + 4 <= count; i += 4)
+	{
+		v.val[0] = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(&left[i])),
+				       Q28_SCALE);
+		if(right == NULL)
+		{
+			vst1q_f32(p, v.val[0]);
+			p += 4;
+			continue;
+		}
+		v.val[1] = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(&right[i])),
+				       Q28_SCALE);
+		vst2q_f32(p, v);
+		p += 8;
+	}
+#else
+	const int32x4_t round = vdupq_n_s32(1L << 4);
+	const int32x4_t max = vdupq_n_s32(Q28_ONE - 1);
+	const int32x4_t min = vdupq_n_s32(-Q28_ONE);
+	const int32x4_t mask = vdupq_n_s32(0xFFFFFF00);
+	int c, channels = right == NULL ? 1 : 2;
+	int32x4x2_t v;
+
+	/* 4 samples per channel per iteration */
+	for(; i + 4 <= count; i += 4)
+	{
+		v.val[0] = vld1q_s32(&left[i]);
+		if(right != NULL)
+			v.val[1] = vld1q_s32(&right[i]);
+
+		/* Round, clip and scale as libmad output */
+		for(c = 0; c < channels; c++)
+		{
+			v.val[c] = vaddq_s32(v.val[c], round);
+			v.val[c] = vmaxq_s32(vminq_s32(v.val[c], max), min);
+			v.val[c] = vandq_s32(vshlq_n_s32(v.val[c], 3), mask);
+		}
+
+		/* Interleave channels */
+		if(right == NULL)
+		{
+			vst1q_s32(p, v.val[0]);
+			p += 4;
+			continue;
+		}
+		vst2q_s32(p, v);
+		p += 8;
+	}
+#endif
+#endif
+
+	/* Remaining samples */
+	for(; i < count; i++)
+	{
+		*p++ = convert_q28(left[i]);
+		if(right != NULL)
+			*p++ = convert_q28(right[i]);
+	}
+}
+
@@ -0,0 +1,55 @@
+/*
+ * convert.h - Sample format conversion for decoders
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CONVERT_H
+#define _CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * All functions convert count samples to the native 32-bit sample format of
+ * the pipeline (left aligned int32_t or float with USE_FLOAT).
+ */
+
+/* Signed 8-bit samples */
+void convert_s8(void *out, const unsigned char *in, size_t count);
+
+/* Signed 16-bit samples (little and big endian) */
+void convert_s16le(void *out, const unsigned char *in, size_t count);
+void convert_s16be(void *out, const unsigned char *in, size_t count);
+
+/* Signed 24-bit packed samples (little and big endian) */
+void convert_s24le(void *out, const unsigned char *in, size_t count);
+void convert_s24be(void *out, const unsigned char *in, size_t count);
+
+/* Signed 32-bit samples (little and big endian) */
+void convert_s32le(void *out, const unsigned char *in, size_t count);
+void convert_s32be(void *out, const unsigned char *in, size_t count);
+
+/* Native float samples (already converted by decoder) */
+void convert_float(void *out, const float *in, size_t count);
+
+/* Planar fixed point Q28 samples (libmad) to interleaved: count is number of
+ * samples per channel and right must be NULL for mono
+ */
+void convert_fixed_q28(void *out, const int32_t *left, const int32_t *right,
+		       size_t count);
+
+#endif
+
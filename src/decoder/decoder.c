@@ -71,6 +71,35 @@ int decoder_decode(struct decoder_handle *h, unsigned char *in_buffer,
 			 info);
 }
 
+int decoder_decode_frames(struct decoder_handle *h,
+			  struct decoder_frame *frames, unsigned int count,
+			  unsigned char *out_buffer, size_t out_size,
+			  struct decoder_info *info)
+{
+	unsigned int i;
+	int ret;
+
+	if(h == NULL || h->dec == NULL || info == NULL ||
+	   (frames == NULL && count > 0))
+		return -1;
+
+	/* Reset frame consumption */
+	for(i = 0; i < count; i++)
+		frames[i].used = 0;
+
+	/* Decode frames */
+	ret = h->decode_frames(h->dec, frames, count, out_buffer, out_size,
+			       info);
+
+	/* Count frames completely consumed */
+	i = 0;
+	while(i < count && frames[i].used >= frames[i].len)
+		i++;
+	info->used = i;
+
+	return ret;
+}
+
 int decoder_close(struct decoder_handle *h)
 {
 	if(h == NULL)
@@ -35,12 +35,27 @@
 #error "Buffer size for AAC decoder is too small!"
 #endif
 
+/* Biggest frame length in samples per channel (HE-AAC) */
+#define MAX_FRAME_LENGTH 2048
+
+/* Check if ADTS header */
+#define IS_ADTS(b) (b[0] == 0xFF && (b[1] & 0xF6) == 0xF0)
+
+/* Samplerate index and channel configuration from ADTS header */
+#define ADTS_FORMAT(b) (((b[2] & 0x3D) << 2) | (b[3] >> 6))
+
 struct decoder {
 	NeAACDecHandle hDec;
 	/* Output buffer */
 	unsigned char *pcm_buffer;
 	unsigned long pcm_length;
 	unsigned long pcm_remain;
+	/* Buffer to keep samples decoded in output buffer */
+	unsigned char *keep_buffer;
+	unsigned long keep_size;
+	/* Size of next frame in samples (to decode directly in output buffer) */
+	unsigned long frame_size;
+	unsigned char adts_format;
 	/* Infos */
 	unsigned long samplerate;
 	unsigned char channels;
@@ -64,16 +79,18 @@ int decoder_aac_open(struct decoder **decoder, const unsigned char *dec_config,
 	dec->pcm_buffer = NULL;
 	dec->pcm_length = 0;
 	dec->pcm_remain = 0;
+	dec->keep_buffer = NULL;
+	dec->keep_size = 0;
 
 	/* Initialize faad */
 	dec->hDec = NeAACDecOpen();
 
-	/* Set the default object type and samplerate */
+	/* Set output format to native sample format */
 	config = NeAACDecGetCurrentConfiguration(dec->hDec);
 #ifdef USE_FLOAT
 	config->outputFormat = FAAD_FMT_FLOAT;
 #else
-	config->outputFormat = FAAD_FMT_24BIT;
+	config->outputFormat = FAAD_FMT_32BIT;
 #endif
 	NeAACDecSetConfiguration(dec->hDec, config);
 
@@ -81,9 +98,11 @@ int decoder_aac_open(struct decoder **decoder, const unsigned char *dec_config,
 	dec->pcm_remain = 0;
 
 	/* Check if ADTS or ADIF header */
+	dec->adts_format = 0;
+	if(dec_config != NULL && dec_config_size >= 4 && IS_ADTS(dec_config))
+		dec->adts_format = ADTS_FORMAT(dec_config);
 	if(dec_config != NULL &&
-	  ((dec_config[0] == 0xFF && (dec_config[1] & 0xF6) == 0xF0) ||
-	   memcmp(dec_config, "ADIF", 4) == 0))
+	  (IS_ADTS(dec_config) || memcmp(dec_config, "ADIF", 4) == 0))
 	{
 		/* Init decoder from frame */
 		ret = NeAACDecInit(dec->hDec, (unsigned char *) dec_config,
@@ -106,6 +125,9 @@ int decoder_aac_open(struct decoder **decoder, const unsigned char *dec_config,
 		return -1;
 	}
 
+	/* Size of first frame is not known: assume biggest frame length */
+	dec->frame_size = MAX_FRAME_LENGTH * dec->channels;
+
 	/* Retunr samplerate and channels */
 	if(samplerate != NULL)
 		*samplerate = dec->samplerate;
@@ -142,25 +164,99 @@ static long decoder_aac_fill_output(struct decoder *dec,
 		/* TODO */
 	}
 	else
-#ifdef USE_FLOAT
-		/* 32-bit wide sample (float or 32-bit fixed) */
+		/* Samples are already in native format */
 		memcpy(output_buffer, &dec->pcm_buffer[pos * 4], size * 4);
-#else
+
+	dec->pcm_remain -= size;
+
+	return size;
+}
+
+static unsigned long decoder_aac_decode_frame(struct decoder *dec,
+					      NeAACDecFrameInfo *frameInfo,
+					      unsigned char *in_buffer,
+					      size_t in_size,
+					      unsigned char *out_buffer,
+					      size_t out_size)
+{
+	unsigned char format;
+	void *out = out_buffer;
+	int direct = 1;
+
+	/* No PCM remaining in decoder */
+	dec->pcm_remain = 0;
+	dec->pcm_length = 0;
+
+	/* A frame which doesn't fit in output buffer is lost: the size of
+	 * previous frame is used, and a new format in ADTS header (samplerate
+	 * or channel count) is decoded in faad buffer.
+	 */
+	if(in_size >= 4 && IS_ADTS(in_buffer))
 	{
-		int32_t *p_in = (int32_t*) &dec->pcm_buffer[pos*4];
-		int32_t *p_out = (int32_t*) output_buffer;
-		size_t i;
-		for(i = 0; i < size; i++)
+		format = ADTS_FORMAT(in_buffer);
+		if(format != dec->adts_format)
+			direct = 0;
+		dec->adts_format = format;
+	}
+
+	/* Decode directly into output buffer when next frame fits */
+	if(direct && out_buffer != NULL && out_size >= dec->frame_size)
+	{
+		NeAACDecDecode2(dec->hDec, frameInfo, in_buffer, in_size, &out,
+				out_size * 4);
+		if(frameInfo->error > 0)
 		{
-			*(p_out++) = (*p_in << 8);
-			p_in++;
+			/* Frame size is unknown: use faad buffer for next one */
+			dec->frame_size = ~0UL;
+			return 0;
 		}
+
+		/* Update format */
+		dec->samplerate = frameInfo->samplerate;
+		dec->channels = frameInfo->channels;
+		if(frameInfo->samples > 0)
+			dec->frame_size = frameInfo->samples;
+
+		return frameInfo->samples;
 	}
-#endif
 
-	dec->pcm_remain -= size;
+	/* Decode into faad buffer */
+	dec->pcm_buffer = (unsigned char*) NeAACDecDecode(dec->hDec, frameInfo,
+							  in_buffer, in_size);
+	if(frameInfo->error > 0)
+		return 0;
 
-	return size;
+	/* Keep PCM in decoder */
+	dec->pcm_remain = frameInfo->samples;
+	dec->pcm_length = frameInfo->samples;
+	dec->samplerate = frameInfo->samplerate;
+	dec->channels = frameInfo->channels;
+	if(frameInfo->samples > 0)
+		dec->frame_size = frameInfo->samples;
+
+	return 0;
+}
+
+static void decoder_aac_keep(struct decoder *dec, unsigned char *buffer,
+			     unsigned long len)
+{
+	unsigned char *keep;
+
+	/* Grow internal buffer */
+	if(len > dec->keep_size)
+	{
+		keep = realloc(dec->keep_buffer, len * 4);
+		if(keep == NULL)
+			return;
+		dec->keep_buffer = keep;
+		dec->keep_size = len;
+	}
+
+	/* Copy samples decoded in output buffer */
+	memcpy(dec->keep_buffer, buffer, len * 4);
+	dec->pcm_buffer = dec->keep_buffer;
+	dec->pcm_remain = len;
+	dec->pcm_length = len;
 }
 
 int decoder_aac_decode(struct decoder *dec, unsigned char *in_buffer,
@@ -194,8 +290,8 @@ int decoder_aac_decode(struct decoder *dec, unsigned char *in_buffer,
 	}
 
 	/* Decode a new frame */
-	dec->pcm_buffer = (unsigned char*) NeAACDecDecode(dec->hDec, &frameInfo,
-							  in_buffer, in_size);
+	size = decoder_aac_decode_frame(dec, &frameInfo, in_buffer, in_size,
+					out_buffer, out_size);
 
 	if(frameInfo.error > 0)
 	{
@@ -207,11 +303,8 @@ int decoder_aac_decode(struct decoder *dec, unsigned char *in_buffer,
 	}
 
 	/* Fill output buffer with PCM */
-	dec->pcm_remain = frameInfo.samples;
-	dec->pcm_length = frameInfo.samples;
-	dec->samplerate = frameInfo.samplerate;
-	dec->channels = frameInfo.channels;
-	size = decoder_aac_fill_output(dec, out_buffer, out_size);
+	if(size == 0)
+		size = decoder_aac_fill_output(dec, out_buffer, out_size);
 
 	/* Update buffer */
 	info->used = frameInfo.bytesconsumed;
@@ -222,6 +315,89 @@ int decoder_aac_decode(struct decoder *dec, unsigned char *in_buffer,
 	return size;
 }
 
+int decoder_aac_decode_frames(struct decoder *dec,
+			      struct decoder_frame *frames, unsigned int count,
+			      unsigned char *out_buffer, size_t out_size,
+			      struct decoder_info *info)
+{
+	NeAACDecFrameInfo frameInfo;
+	unsigned long samplerate;
+	unsigned char channels;
+	struct decoder_frame *f;
+	unsigned long direct;
+	unsigned int i;
+	int total = 0;
+
+	/* Format of returned samples (0 to accept first decoded format) */
+	samplerate = info->samplerate;
+	channels = info->channels;
+
+	/* Empty remaining PCM before decoding frames */
+	if(dec->pcm_remain > 0)
+	{
+		if(samplerate != 0 && (samplerate != dec->samplerate ||
+				       channels != dec->channels))
+			goto end;
+		total = decoder_aac_fill_output(dec, out_buffer, out_size);
+		samplerate = dec->samplerate;
+		channels = dec->channels;
+	}
+
+	/* Decode frames until output buffer is full */
+	for(i = 0; i < count && total < out_size; i++)
+	{
+		f = &frames[i];
+		while(f->used < f->len && total < out_size)
+		{
+			/* Decode next frame */
+			direct = decoder_aac_decode_frame(dec, &frameInfo,
+							  &f->buffer[f->used],
+							  f->len - f->used,
+							  &out_buffer[total * 4],
+							  out_size - total);
+			f->used += frameInfo.bytesconsumed;
+			if(frameInfo.error > 0 || frameInfo.bytesconsumed == 0)
+				goto end;
+			if(frameInfo.samples == 0)
+				continue;
+
+			/* Stop on format change */
+			if(samplerate != 0 && (samplerate != dec->samplerate ||
+					       channels != dec->channels))
+			{
+				/* Keep samples decoded in output buffer */
+				if(direct > 0)
+					decoder_aac_keep(dec,
+							 &out_buffer[total * 4],
+							 direct);
+				goto end;
+			}
+			samplerate = dec->samplerate;
+			channels = dec->channels;
+
+			/* Samples decoded directly in output buffer */
+			if(direct > 0)
+			{
+				total += direct;
+				continue;
+			}
+
+			/* Fill output buffer with PCM */
+			total += decoder_aac_fill_output(dec,
+							 &out_buffer[total * 4],
+							 out_size - total);
+		}
+	}
+
+end:
+	/* Fill decoder info */
+	info->remaining = dec->pcm_remain;
+	info->samplerate = total > 0 ? samplerate : dec->samplerate;
+	info->channels = total > 0 ? channels : dec->channels;
+
+	return total;
+}
+
 int decoder_aac_close(struct decoder *dec)
 {
 	if(dec == NULL)
@@ -231,6 +407,10 @@ int decoder_aac_close(struct decoder *dec)
 	if(dec->hDec != NULL)
 		NeAACDecClose(dec->hDec);
 
+	/* Free internal buffer */
+	if(dec->keep_buffer != NULL)
+		free(dec->keep_buffer);
+
 	/* Free structure */
 	free(dec);
 
@@ -241,5 +421,6 @@ struct decoder_handle decoder_aac = {
 	.dec = NULL,
 	.open = &decoder_aac_open,
 	.decode = &decoder_aac_decode,
+	.decode_frames = &decoder_aac_decode_frames,
 	.close = &decoder_aac_close,
 };
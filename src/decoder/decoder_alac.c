@@ -28,6 +28,7 @@
 #include <stdint.h>
 
 #include "decoder_alac.h"
+#include "convert.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -140,14 +141,8 @@ static long decoder_alac_fill_output(struct decoder *dec,
 				     unsigned char *output_buffer,
 				     size_t output_size)
 {
-#ifdef USE_FLOAT
-	float *p = (float*) output_buffer;
-#else
-	int32_t *p = (int32_t*) output_buffer;
-#endif 
 	unsigned long pos;
 	unsigned long size;
-	int i;
 
 	pos = (dec->pcm_length - dec->pcm_remain) * 2;
 	if(output_size < dec->pcm_remain)
@@ -155,17 +150,8 @@ static long decoder_alac_fill_output(struct decoder *dec,
 	else
 		size = dec->pcm_remain;
 
-	/* Copy samples to output buffer */
-	for(i = 0; i < size * 2; i += 2)
-	{
-#ifdef USE_FLOAT
-		*p++ = (float)((int32_t) (dec->buffer[i+1+pos] << 24) |
-				       (dec->buffer[i+pos] << 16)) / 0x7fffffff;
-#else
-		*p++ = (int32_t) (dec->buffer[i+1+pos] << 24) |
-				 (dec->buffer[i+pos] << 16);
-#endif
-	}
+	/* Convert 16-bit samples to output buffer */
+	convert_s16le(output_buffer, &dec->buffer[pos], size);
 
 	dec->pcm_remain -= size;
 
@@ -228,6 +214,51 @@ int decoder_alac_decode(struct decoder *dec, unsigned char *in_buffer,
 	return size;
 }
 
+int decoder_alac_decode_frames(struct decoder *dec,
+			       struct decoder_frame *frames, unsigned int count,
+			       unsigned char *out_buffer, size_t out_size,
+			       struct decoder_info *info)
+{
+	int decode_size;
+	unsigned int i;
+	int total = 0;
+
+	/* Empty remaining PCM before decoding frames */
+	if(dec->pcm_remain > 0)
+		total = decoder_alac_fill_output(dec, out_buffer, out_size);
+
+	/* Decode frames until output buffer is full */
+	for(i = 0; i < count && total < out_size; i++)
+	{
+		if(frames[i].len == 0)
+			continue;
+
+		/* Decode the frame (a frame is always consumed entirely) */
+		decoder_alac_decode_frame(&dec->alac, frames[i].buffer,
+					  dec->buffer, &decode_size);
+		frames[i].used = frames[i].len;
+		if(decode_size <= 0)
+		{
+			if(total == 0)
+				total = -1;
+			break;
+		}
+
+		/* Fill output buffer with PCM */
+		dec->pcm_remain = decode_size / 2;
+		dec->pcm_length = decode_size / 2;
+		total += decoder_alac_fill_output(dec, &out_buffer[total * 4],
+						  out_size - total);
+	}
+
+	/* Fill decoder info */
+	info->remaining = dec->pcm_remain;
+	info->samplerate = dec->alac.samplerate;
+	info->channels = dec->alac.numchannels;
+
+	return total;
+}
+
 int decoder_alac_close(struct decoder *dec)
 {
 	int i;
@@ -256,6 +287,7 @@ struct decoder_handle decoder_alac = {
 	.dec = NULL,
 	.open = &decoder_alac_open,
 	.decode = &decoder_alac_decode,
+	.decode_frames = &decoder_alac_decode_frames,
 	.close = &decoder_alac_close,
 };
 
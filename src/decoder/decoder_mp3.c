@@ -22,6 +22,7 @@
 #include <mad.h>
 
 #include "decoder_mp3.h"
+#include "convert.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -95,56 +96,71 @@ int decoder_mp3_open(struct decoder **decoder, const unsigned char *config,
 	return 0;
 }
 
-#ifdef USE_FLOAT
-inline float mad_scale(mad_fixed_t sample)
-{
-	return (float) (sample / (float) (1L << MAD_F_FRACBITS));
-}
-#else
-inline int32_t mad_scale(mad_fixed_t sample)
+static long decoder_mp3_fill_output(struct decoder *dec,
+				    unsigned char *output_buffer,
+				    size_t output_size)
 {
+	unsigned short channels = dec->Synth.pcm.channels;
+	unsigned short pos;
+	unsigned long len;
 
-	/* Round sample */
-	sample += (1L << 4);
+	pos = dec->Synth.pcm.length - dec->pcm_remain;
+
+	/* Calculate samples per channel to return */
+	len = output_size / channels;
+	if(len > dec->pcm_remain)
+		len = dec->pcm_remain;
+
+	/* Convert and interleave channels */
+	convert_fixed_q28(output_buffer, &dec->Synth.pcm.samples[0][pos],
+			  channels == 2 ? &dec->Synth.pcm.samples[1][pos] :
+					  NULL, len);
 
-	/* Clip */
-	if (sample >= MAD_F_ONE)
-		sample = MAD_F_ONE - 1;
-	else if (sample < -MAD_F_ONE)
-		sample = -MAD_F_ONE;
+	dec->pcm_remain -= len;
 
-	return (sample << 3) & 0xFFFFFF00;
+	return len * channels;
 }
-#endif
 
-static long decoder_mp3_fill_output(struct decoder *dec,
-				    unsigned char *output_buffer,
-				    size_t output_size)
+static int decoder_mp3_decode_frame(struct decoder *dec,
+				    unsigned char *in_buffer, size_t in_size,
+				    size_t *used)
 {
-#ifdef USE_FLOAT
-	float *p = (float*) output_buffer;
-#else
-	int32_t *p = (int32_t*) output_buffer;
-#endif
-	unsigned short pos;
-	int i;
+	/* Copy data to internal buffer */
+	if(in_size > BUFFER_SIZE-dec->buffer_len)
+		in_size = BUFFER_SIZE-dec->buffer_len;
+	memcpy(dec->buffer+dec->buffer_len, in_buffer, in_size);
+	dec->buffer_len += in_size;
+	*used = in_size;
 
-	pos = dec->Synth.pcm.length - dec->pcm_remain;
+	/* Add frame to stream */
+	mad_stream_buffer(&dec->Stream, dec->buffer, dec->buffer_len);
 
-	for(i = 0; pos < dec->Synth.pcm.length && i < output_size;
-	    pos++, i += dec->Synth.pcm.channels)
+	/* Decode a new frame */
+	while(mad_frame_decode(&dec->Frame, &dec->Stream))
 	{
-		/* Left channel */
-		*(p++) = mad_scale(dec->Synth.pcm.samples[0][pos]);
-
-		/* Right channel */
-		if(dec->Synth.pcm.channels == 2)
-			*(p++) = mad_scale(dec->Synth.pcm.samples[1][pos]);
+		if(MAD_RECOVERABLE(dec->Stream.error))
+		{
+			/* Needs more frame */
+			continue;
+		}
+		else
+		{
+			if(dec->Stream.error == MAD_ERROR_BUFLEN)
+				return DECODER_ERROR_BUFLEN;
+			else
+				return DECODER_ERROR_SYNC;
+		}
 	}
 
-	dec->pcm_remain = dec->Synth.pcm.length - pos;
+	/* Move remaining data to buffer start */
+	dec->buffer_len -= dec->Stream.next_frame - dec->Stream.buffer;
+	memmove(dec->buffer, dec->Stream.next_frame, dec->buffer_len);
 
-	return i;
+	/* Synthethise PCM */
+	mad_synth_frame(&dec->Synth, &dec->Frame);
+	dec->pcm_remain = dec->Synth.pcm.length;
+
+	return 0;
 }
 
 int decoder_mp3_decode(struct decoder *dec, unsigned char *in_buffer,
@@ -152,6 +168,8 @@ int decoder_mp3_decode(struct decoder *dec, unsigned char *in_buffer,
 		       size_t out_size, struct decoder_info *info)
 {
 	unsigned short size = 0;
+	size_t used;
+	int ret;
 
 	/* Reset position of PCM output buffer */
 	if(in_buffer == NULL && out_buffer == NULL)
@@ -180,49 +198,22 @@ int decoder_mp3_decode(struct decoder *dec, unsigned char *in_buffer,
 	if(in_size == 0)
 		return 0;
 
-	/* Copy data to internal buffer */
-	if(in_size > BUFFER_SIZE-dec->buffer_len)
-		in_size = BUFFER_SIZE-dec->buffer_len;
-	memcpy(dec->buffer+dec->buffer_len, in_buffer, in_size);
-	dec->buffer_len += in_size;
-
-	/* Add frame to stream */
-	mad_stream_buffer(&dec->Stream, dec->buffer, dec->buffer_len);
-
 	/* Decode a new frame */
-	while(mad_frame_decode(&dec->Frame, &dec->Stream))
+	ret = decoder_mp3_decode_frame(dec, in_buffer, in_size, &used);
+	if(ret < 0)
 	{
-		if(MAD_RECOVERABLE(dec->Stream.error))
-		{
-			/* Needs more frame */
-			continue;
-		}
-		else
-		{
-			/* Update buffer */
-			info->used = in_size;
-			info->remaining = 0;
+		/* Update buffer */
+		info->used = used;
+		info->remaining = 0;
 
-			if(dec->Stream.error == MAD_ERROR_BUFLEN)
-				return DECODER_ERROR_BUFLEN;
-			else
-				return DECODER_ERROR_SYNC;
-		}
+		return ret;
 	}
 
-	/* Move remaining data to buffer start */
-	dec->buffer_len -= dec->Stream.next_frame - dec->Stream.buffer;
-	memmove(dec->buffer, dec->Stream.next_frame, dec->buffer_len);
-
-	/* Synthethise PCM */
-	mad_synth_frame(&dec->Synth, &dec->Frame);
-
 	/* Fill output buffer with PCM */
-	dec->pcm_remain = dec->Synth.pcm.length;
 	size = decoder_mp3_fill_output(dec, out_buffer, out_size);
 
 	/* Update buffer */
-	info->used = in_size;
+	info->used = used;
 	info->remaining = dec->pcm_remain;
 	info->samplerate = dec->Frame.header.samplerate;
 	info->channels = MAD_NCHANNELS(&dec->Frame.header);
@@ -230,6 +221,84 @@ int decoder_mp3_decode(struct decoder *dec, unsigned char *in_buffer,
 	return size;
 }
 
+int decoder_mp3_decode_frames(struct decoder *dec,
+			      struct decoder_frame *frames, unsigned int count,
+			      unsigned char *out_buffer, size_t out_size,
+			      struct decoder_info *info)
+{
+	unsigned long samplerate;
+	unsigned char channels;
+	struct decoder_frame *f;
+	unsigned int i;
+	int total = 0;
+	size_t used;
+	int ret = 0;
+
+	/* Format of returned samples (0 to accept first decoded format) */
+	samplerate = info->samplerate;
+	channels = info->channels;
+
+	/* Empty remaining PCM before decoding frames */
+	if(dec->pcm_remain > 0)
+	{
+		if(samplerate != 0 &&
+		   (samplerate != dec->Frame.header.samplerate ||
+		    channels != MAD_NCHANNELS(&dec->Frame.header)))
+			goto end;
+		total = decoder_mp3_fill_output(dec, out_buffer, out_size);
+		samplerate = dec->Frame.header.samplerate;
+		channels = MAD_NCHANNELS(&dec->Frame.header);
+	}
+
+	/* Decode frames until output buffer is full */
+	for(i = 0; i < count && total < out_size; i++)
+	{
+		f = &frames[i];
+		while(f->used < f->len && total < out_size)
+		{
+			/* Decode next frame */
+			ret = decoder_mp3_decode_frame(dec, &f->buffer[f->used],
+						       f->len - f->used, &used);
+			f->used += used;
+			if(ret == DECODER_ERROR_BUFLEN && used > 0)
+			{
+				/* Needs more data */
+				ret = 0;
+				continue;
+			}
+			else if(ret < 0)
+				goto end;
+
+			/* Stop on format change */
+			if(samplerate != 0 &&
+			   (samplerate != dec->Frame.header.samplerate ||
+			    channels != MAD_NCHANNELS(&dec->Frame.header)))
+				goto end;
+			samplerate = dec->Frame.header.samplerate;
+			channels = MAD_NCHANNELS(&dec->Frame.header);
+
+			/* Fill output buffer with PCM */
+			total += decoder_mp3_fill_output(dec,
+							 &out_buffer[total * 4],
+							 out_size - total);
+		}
+	}
+
+end:
+	/* Fill decoder info */
+	info->remaining = dec->pcm_remain;
+	info->samplerate = total > 0 ? samplerate :
+				       dec->Frame.header.samplerate;
+	info->channels = total > 0 ? channels :
+				     MAD_NCHANNELS(&dec->Frame.header);
+
+	/* Return error only when no samples are available */
+	if(total == 0 && ret == DECODER_ERROR_SYNC)
+		return ret;
+
+	return total;
+}
+
 int decoder_mp3_close(struct decoder *dec)
 {
 	if(dec == NULL)
@@ -250,5 +319,6 @@ struct decoder_handle decoder_mp3 = {
 	.dec = NULL,
 	.open = &decoder_mp3_open,
 	.decode = &decoder_mp3_decode,
+	.decode_frames = &decoder_mp3_decode_frames,
 	.close = &decoder_mp3_close,
 };
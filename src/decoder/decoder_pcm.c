@@ -28,6 +28,7 @@
 #include <stdint.h>
 
 #include "decoder_pcm.h"
+#include "convert.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -107,57 +108,33 @@ static int decoder_pcm_parse_riff(struct decoder *dec, const char *config,
 	return 0;
 }
 
-#ifdef USE_FLOAT
-	#define CONV8(b)  (float)(FROM_8(b)) / 0x7fffffff
-	#define CONV16(b) (float)(FROM_16(b)) / 0x7fffffff
-	#define CONV24(b) (float)(FROM_24(b)) / 0x7fffffff
-	#define CONV32(b) (float)(FROM_32(b)) / 0x7fffffff
-#else
-	#define CONV8(b)  FROM_8(b)
-	#define CONV16(b) FROM_16(b)
-	#define CONV24(b) FROM_24(b)
-	#define CONV32(b) FROM_32(b)
-#endif
-
 static long decoder_pcm_fill_output(struct decoder *dec,
 				    unsigned char *output_buffer,
 				    size_t output_size)
 {
-#ifdef USE_FLOAT
-	float *p = (float*) output_buffer;
-#else
-	int32_t *p = (int32_t*) output_buffer;
-#endif 
-	unsigned long pos;
-	unsigned long size;
-	int i;
-
-	/* Calculate position and size to exract from buffer */
-	pos = (dec->pcm_length - dec->pcm_remain) * dec->bytes;
+	unsigned char *in;
+
+	/* Calculate position to exract from buffer */
+	in = &dec->buffer[(dec->pcm_length - dec->pcm_remain) * dec->bytes];
 
 	/* Calculate size to return */
 	if(output_size > dec->pcm_remain)
 		output_size = dec->pcm_remain;
-	size = (output_size * dec->bytes) + pos;
 
 	/* Convert samples to 32bit */
 	switch(dec->bits)
 	{
 		case 32:
-			for(i = pos; i < size; i += 4)
-				*p++ = CONV32(&dec->buffer[i]);
+			convert_s32be(output_buffer, in, output_size);
 			break;
 		case 24:
-			for(i = pos; i < size; i += 3)
-				*p++ = CONV24(&dec->buffer[i]);
+			convert_s24be(output_buffer, in, output_size);
 			break;
 		case 16:
-			for(i = pos; i < size; i += 2)
-				*p++ = CONV16(&dec->buffer[i]);
+			convert_s16be(output_buffer, in, output_size);
 			break;
 		case 8:
-			for(i = pos; i < size; i++)
-				*p++ = CONV8(&dec->buffer[i]);
+			convert_s8(output_buffer, in, output_size);
 			break;
 		default:
 			;
@@ -168,6 +145,21 @@ static long decoder_pcm_fill_output(struct decoder *dec,
 	return output_size;
 }
 
+static size_t decoder_pcm_load(struct decoder *dec, unsigned char *in_buffer,
+			       size_t in_size)
+{
+	/* Copy frame */
+	if(in_size > BUFFER_SIZE)
+		in_size = BUFFER_SIZE;
+	memcpy(dec->buffer, in_buffer, in_size);
+
+	/* Update PCM length */
+	dec->pcm_remain = in_size / dec->bytes;
+	dec->pcm_length = dec->pcm_remain;
+
+	return in_size;
+}
+
 int decoder_pcm_decode(struct decoder *dec, unsigned char *in_buffer,
 		       size_t in_size, unsigned char *out_buffer,
 		       size_t out_size, struct decoder_info *info)
@@ -202,14 +194,9 @@ int decoder_pcm_decode(struct decoder *dec, unsigned char *in_buffer,
 		return 0;
 
 	/* Copy frame */
-	if(in_size > BUFFER_SIZE)
-		in_size = BUFFER_SIZE;
-	memcpy(dec->buffer, in_buffer, in_size);
+	in_size = decoder_pcm_load(dec, in_buffer, in_size);
 
 	/* Fill output buffer with PCM */
-	dec->pcm_remain = in_size / dec->bytes;
-	dec->pcm_length = dec->pcm_remain;
-
 	size = decoder_pcm_fill_output(dec, out_buffer, out_size);
 
 	/* Fill decoder info */
@@ -221,6 +208,44 @@ int decoder_pcm_decode(struct decoder *dec, unsigned char *in_buffer,
 	return size;
 }
 
+int decoder_pcm_decode_frames(struct decoder *dec,
+			      struct decoder_frame *frames, unsigned int count,
+			      unsigned char *out_buffer, size_t out_size,
+			      struct decoder_info *info)
+{
+	struct decoder_frame *f;
+	unsigned int i;
+	int total = 0;
+
+	/* Empty remaining PCM before decoding frames */
+	if(dec->pcm_remain > 0)
+		total = decoder_pcm_fill_output(dec, out_buffer, out_size);
+
+	/* Convert frames until output buffer is full */
+	for(i = 0; i < count && total < out_size; i++)
+	{
+		f = &frames[i];
+		while(f->used < f->len && total < out_size)
+		{
+			/* Copy next part of frame */
+			f->used += decoder_pcm_load(dec, &f->buffer[f->used],
+						    f->len - f->used);
+
+			/* Fill output buffer with PCM */
+			total += decoder_pcm_fill_output(dec,
+							 &out_buffer[total * 4],
+							 out_size - total);
+		}
+	}
+
+	/* Fill decoder info */
+	info->remaining = dec->pcm_remain;
+	info->samplerate = dec->samplerate;
+	info->channels = dec->channels;
+
+	return total;
+}
+
 int decoder_pcm_close(struct decoder *dec)
 {
 	if(dec == NULL)
@@ -236,5 +261,6 @@ struct decoder_handle decoder_pcm = {
 	.dec = NULL,
 	.open = &decoder_pcm_open,
 	.decode = &decoder_pcm_decode,
+	.decode_frames = &decoder_pcm_decode_frames,
 	.close = &decoder_pcm_close,
 };
@@ -24,6 +24,7 @@
 #include "demux_mp3.h"
 #include "demux_mp4.h"
 #include "demux.h"
+#include "realtime.h"
 #include "vring.h"
 #include "fs.h"
 
@@ -173,6 +174,9 @@ static void *demux_thread(void *user_data)
 	struct demux_handle *h = user_data;
 	ssize_t len;
 
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "demux");
+
 	/* Thread running */
 	h->thread_running = 1;
 
@@ -240,6 +244,67 @@ void demux_set_used_frame(struct demux_handle *h, ssize_t len)
 		h->frame_pos = 0;
 }
 
+int demux_get_frames(struct demux_handle *h, unsigned char **buffers,
+		     size_t *lens, int count)
+{
+	struct demux_frame *f;
+	size_t offset;
+	ssize_t len;
+	int i;
+
+	if(h == NULL || buffers == NULL || lens == NULL || count <= 0)
+		return -1;
+
+	/* Get current frame */
+	len = demux_get_frame(h, &buffers[0]);
+	if(len <= 0)
+		return len;
+	lens[0] = len;
+
+	/* Get next frames already in ring buffer: they are peeked after
+	 * current frame and read position is not changed
+	 */
+	offset = h->frame_len + sizeof(struct demux_frame);
+	for(i = 1; i < count; i++)
+	{
+		/* Fill ring buffer */
+		if(!h->use_thread)
+			demux_fill_buffer(h);
+
+		/* Check that a complete frame is available */
+		len = vring_read(h->ring, (unsigned char **) &f, 0, offset);
+		if(len < sizeof(struct demux_frame) ||
+		   f->len + sizeof(struct demux_frame) > len)
+			break;
+
+		buffers[i] = f->data;
+		lens[i] = f->len;
+		offset += f->len + sizeof(struct demux_frame);
+	}
+
+	return i;
+}
+
+void demux_set_used_frames(struct demux_handle *h, int count, ssize_t len)
+{
+	unsigned char *buffer;
+
+	if(h == NULL)
+		return;
+
+	/* Forward to frame following completely consumed frames */
+	for(; count > 0; count--)
+	{
+		h->frame_pos = h->frame_len;
+		if(demux_get_frame(h, &buffer) <= 0)
+			return;
+	}
+
+	/* Set used bytes in current frame */
+	if(len > 0)
+		demux_set_used_frame(h, len);
+}
+
 ssize_t demux_get_next_frame(struct demux_handle *h, unsigned char **buffer)
 {
 	struct demux_frame *f;
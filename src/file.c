@@ -33,6 +33,9 @@
 #include "config.h"
 #endif
 
+/* Maximum demuxed frames passed to decoder in one call */
+#define FILE_MAX_FRAMES 8
+
 struct file_handle {
 	/* Demuxer */
 	struct demux_handle *demux;
@@ -211,11 +214,15 @@ int file_read(void *user_data, unsigned char *buffer, size_t size,
 	      struct a_format *fmt)
 {
 	struct file_handle *h = (struct file_handle *) user_data;
+	struct decoder_frame frames[FILE_MAX_FRAMES];
+	unsigned char *buffers[FILE_MAX_FRAMES];
+	size_t lens[FILE_MAX_FRAMES];
 	struct decoder_info info;
-	unsigned char *frame = NULL;
 	int total_samples = 0;
+	int count = 0;
 	ssize_t len = 0;
 	int samples;
+	int i;
 
 	if(h == NULL)
 		return -1;
@@ -223,89 +230,80 @@ int file_read(void *user_data, unsigned char *buffer, size_t size,
 	/* Lock stream access */
 	pthread_mutex_lock(&h->mutex);
 
-	/* Process remaining pcm data */
-	if(h->pcm_remaining > 0)
-	{
-		/* Get remaining pcm data from decoder */
-		samples = decoder_decode(h->dec, NULL, 0, buffer, size, &info);
-		if(samples < 0)
-		{
-		
-			/* Unlock stream access */
-			pthread_mutex_unlock(&h->mutex);
-
-			return -1;
-		}
-
-		/* Update audio format */
-		if(info.samplerate != h->samplerate ||
-		   info.channels != h->channels)
-		{
-			h->pcm_pos_off = h->pcm_pos * 1000 / h->samplerate /
-					 h->channels;
-			h->pcm_pos = 0;
-			h->samplerate = info.samplerate;
-			h->channels = info.channels;
-		}
-
-		h->pcm_remaining -= samples;
-		total_samples += samples;
-	}
-
 	/* Fill output buffer */
 	while(total_samples < size)
 	{
-		/* Get frame */
-		len = demux_get_frame(h->demux, &frame);
+		/* Get frames already available in demuxer */
+		count = 0;
+		len = demux_get_frames(h->demux, buffers, lens,
+				       FILE_MAX_FRAMES);
 		if(len <= 0)
 		{
-			/* File is buffering */
-			if(len == 0)
+			/* Remaining pcm data can still be returned */
+			if(h->pcm_remaining == 0)
 			{
-				/* Notify demux is buffering */
-				if(h->event_cb != NULL && h->buffering == 0)
-					h->event_cb(h->event_udata,
-						    FILE_EVENT_BUFFERING, NULL);
-				h->buffering = 1;
+				/* File is buffering */
+				if(len == 0)
+				{
+					/* Notify demux is buffering */
+					if(h->event_cb != NULL &&
+					   h->buffering == 0)
+						h->event_cb(h->event_udata,
+							  FILE_EVENT_BUFFERING,
+							  NULL);
+					h->buffering = 1;
+				}
+				break;
 			}
-			break;
 		}
-		else if(h->buffering == 1)
+		else
 		{
 			/* Notify demux cache is ready */
-			if(h->event_cb != NULL)
+			if(h->event_cb != NULL && h->buffering == 1)
 				h->event_cb(h->event_udata,
 					    FILE_EVENT_READY, NULL);
 			h->buffering = 0;
+			count = len;
 		}
-
-		/* Decode next frame */
-		samples = decoder_decode(h->dec, frame,
-					 len > 0 ? len : 0,
-					 &buffer[total_samples * 4],
-					 size - total_samples, &info);
-		if(samples <= 0)
+		for(i = 0; i < count; i++)
 		{
-			/* Set used bytes in frame */
-			if(len > 0 && info.used > 0)
-				demux_set_used_frame(h->demux, info.used);
-			break;
+			frames[i].buffer = buffers[i];
+			frames[i].len = lens[i];
 		}
 
-		/* Update used data in frame */
-		demux_set_used_frame(h->demux, info.used);
+		/* Only accept current format after first samples */
+		info.samplerate = total_samples > 0 ? h->samplerate : 0;
+		info.channels = total_samples > 0 ? h->channels : 0;
+
+		/* Decode remaining pcm data and next frames */
+		samples = decoder_decode_frames(h->dec, frames, count,
+						&buffer[total_samples * 4],
+						size - total_samples, &info);
+
+		/* Update used frames and used data in next frame */
+		if(count > 0)
+			demux_set_used_frames(h->demux, info.used,
+					      info.used < count ?
+					      frames[info.used].used : 0);
 
 		/* Update remaining counter */
-		h->pcm_remaining = info.remaining;
+		if(samples >= 0)
+			h->pcm_remaining = info.remaining;
 
-		/* Check audio format */
-		if(info.samplerate != h->samplerate ||
-		   info.channels != h->channels)
-		{
-			/* Reset internal position */
-			decoder_decode(h->dec, NULL, 0, NULL, 0, NULL);
-			h->pcm_remaining += samples;
+		/* Nothing decoded and no data consumed */
+		if(samples < 0 || (samples == 0 &&
+		   (count == 0 || (info.used == 0 && frames[0].used == 0))))
 			break;
+
+		/* Update audio format */
+		if(samples > 0 && (info.samplerate != h->samplerate ||
+				   info.channels != h->channels))
+		{
+			h->pcm_pos_off = h->pcm_pos * 1000 / h->samplerate /
+					 h->channels;
+			h->pcm_pos = 0;
+			h->samplerate = info.samplerate;
+			h->channels = info.channels;
 		}
 
 		/* Update samples returned */
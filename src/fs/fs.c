@@ -18,7 +18,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <errno.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -27,6 +29,8 @@
 #include "fs_posix.h"
 #include "fs_http.h"
 #include "fs_smb.h"
+#include "fs_cache.h"
+#include "fs_aio.h"
 #include "fs.h"
 
 void fs_init(void)
@@ -37,10 +41,22 @@ void fs_init(void)
 #ifdef HAVE_LIBSMBCLIENT
 	fs_smb_init();
 #endif
+
+	/* Initialize block cache */
+	fs_cache_init();
+
+	/* Initialize asynchronous I/O worker pool */
+	fs_aio_init();
 }
 
 void fs_free(void)
 {
+	/* Stop asynchronous I/O worker pool */
+	fs_aio_free();
+
+	/* Free block cache */
+	fs_cache_free();
+
 	/* Free all file system */
 #ifdef HAVE_LIBSMBCLIENT
 	fs_smb_free();
@@ -49,6 +65,31 @@ void fs_free(void)
 	fs_posix_free();
 }
 
+int fs_set_config(struct json *config)
+{
+	struct json *tmp = NULL;
+
+	/* Set block cache configuration */
+	if(config != NULL)
+		json_get_ex(config, "cache", &tmp);
+	return fs_cache_set_config(tmp);
+}
+
+struct json *fs_get_config(void)
+{
+	struct json *cfg;
+
+	/* Create a JSON object */
+	cfg = json_new();
+	if(cfg == NULL)
+		return NULL;
+
+	/* Add block cache configuration */
+	json_add(cfg, "cache", fs_cache_get_config());
+
+	return cfg;
+}
+
 static struct fs_handle *fs_find_filesystem(const char *url)
 {
 	struct fs_handle *h = NULL;
@@ -79,6 +120,7 @@ struct fs_file *fs_open(const char *url, int flags, mode_t mode)
 {
 	struct fs_handle *h;
 	struct fs_file *f;
+	int ret;
 
 	/* Get file system from URL */
 	h = fs_find_filesystem(url);
@@ -91,8 +133,11 @@ struct fs_file *fs_open(const char *url, int flags, mode_t mode)
 		return NULL;
 	f->handle = h;
 
-	/* Open file */
-	if(h->open(f, url, flags, mode) != 0)
+	/* Open file through block cache or directly */
+	ret = h->remote ? fs_cache_open(f, h, url, flags, mode) : 1;
+	if(ret > 0)
+		ret = h->open(f, url, flags, mode);
+	if(ret != 0)
 	{
 		/* Free file */
 		free(f);
@@ -171,6 +216,21 @@ off_t fs_lseek(struct fs_file *f, off_t offset, int whence)
 	return f->handle->lseek(f, offset, whence);
 }
 
+ssize_t fs_pread(struct fs_file *f, void *buf, size_t count, off_t offset)
+{
+	if(f == NULL)
+		return -1;
+
+	/* Not supported by file system */
+	if(f->handle->pread == NULL)
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+
+	return f->handle->pread(f, buf, count, offset);
+}
+
 int fs_ftruncate(struct fs_file *f, off_t length)
 {
 	if(f == NULL)
@@ -408,6 +468,70 @@ int fs_fstatvfs(struct fs_file *f, struct statvfs *buf)
 	return f->handle->fstatvfs(f, buf);
 }
 
+int fs_aio_read(struct fs_aio *req)
+{
+	struct fs_handle *h;
+
+	if(req == NULL || req->file == NULL)
+		return -1;
+	req->done = 0;
+
+	/* Submit read to file system or to worker pool */
+	h = req->file->handle;
+	if(h->aio_read == NULL || h->aio_read(req) != 0)
+		fs_aio_queue(req);
+
+	return 0;
+}
+
+int fs_aio_stat(struct fs_aio *reqs, int count)
+{
+	struct fs_handle *h;
+	int i, n, sent;
+
+	if(reqs == NULL)
+		return -1;
+
+	for(i = 0; i < count; i += n)
+	{
+		/* Group following requests on same file system */
+		h = fs_find_filesystem(reqs[i].url);
+		for(n = 1; i + n < count; n++)
+			if(fs_find_filesystem(reqs[i+n].url) != h)
+				break;
+
+		/* Prepare requests */
+		for(sent = 0; sent < n; sent++)
+		{
+			reqs[i+sent].file = NULL;
+			reqs[i+sent].done = 0;
+		}
+
+		/* Unknown file system */
+		if(h == NULL)
+		{
+			for(sent = 0; sent < n; sent++)
+				fs_aio_complete(&reqs[i+sent], -1, ENOENT);
+			continue;
+		}
+
+		/* Submit batch to file system */
+		sent = 0;
+		if(h->aio_stat != NULL)
+		{
+			sent = h->aio_stat(&reqs[i], n);
+			if(sent < 0)
+				sent = 0;
+		}
+
+		/* Submit other requests to worker pool */
+		for(; sent < n; sent++)
+			fs_aio_queue(&reqs[i+sent]);
+	}
+
+	return 0;
+}
+
 int fs_alphasort(const struct fs_dirent **a, const struct fs_dirent **b)
 {
 	return strcoll((*a)->name, (*b)->name);
@@ -420,41 +544,94 @@ int fs_alphasort_reverse(const struct fs_dirent **a, const struct fs_dirent **b)
 
 int fs_alphasort_first(const struct fs_dirent **a, const struct fs_dirent **b)
 {
-	if(((*a)->stat.st_mode & S_IFMT) != ((*b)->stat.st_mode & S_IFMT))
-		return ((*a)->stat.st_mode & S_IFDIR) ? 0 : 1;
+	if(fs_dirent_is_dir(*a) != fs_dirent_is_dir(*b))
+		return fs_dirent_is_dir(*a) ? -1 : 1;
 
 	return strcoll((*a)->name, (*b)->name);
 }
 
 int fs_alphasort_last(const struct fs_dirent **a, const struct fs_dirent **b)
 {
-	if(((*a)->stat.st_mode & S_IFMT) != ((*b)->stat.st_mode & S_IFMT))
-		return ((*b)->stat.st_mode & S_IFDIR) ? 0 : 1;
+	if(fs_dirent_is_dir(*a) != fs_dirent_is_dir(*b))
+		return fs_dirent_is_dir(*b) ? -1 : 1;
 
 	return strcoll((*b)->name, (*a)->name);
 }
 
 int fs_file_only(const struct fs_dirent *d)
 {
-	return d->stat.st_mode & S_IFREG ? 1 : 0;
+	return d->type == FS_REG ? 1 : 0;
 }
 
 int fs_dir_only(const struct fs_dirent *d)
 {
-	return d->stat.st_mode & S_IFDIR ? 1 : 0;
+	return fs_dirent_is_dir(d);
+}
+
+int fs_dirent_is_dir(const struct fs_dirent *d)
+{
+	return d->type == FS_DIR || d->type == FS_NET || d->type == FS_SRV ||
+	       d->type == FS_DSK ? 1 : 0;
 }
 
+struct stat *fs_stat_dirent(const char *path, struct fs_dirent *d)
+{
+	size_t len, name_len;
+	char *url;
+
+	if(path == NULL || d == NULL)
+		return NULL;
+
+	/* Already done */
+	if(d->has_stat)
+		return &d->stat;
+
+	/* Make path of entry */
+	len = strlen(path);
+	name_len = strlen(d->name);
+	url = malloc(len + name_len + 2);
+	if(url == NULL)
+		return NULL;
+	memcpy(url, path, len);
+	url[len] = '/';
+	memcpy(&url[len+1], d->name, name_len + 1);
+
+	/* Stat entry */
+	if(fs_stat(url, &d->stat) == 0)
+		d->has_stat = 1;
+	free(url);
+
+	return d->has_stat ? &d->stat : NULL;
+}
+
+/* Entries of a fs_scandir() list are allocated from an arena of chunks, with
+ * only the space needed by their name. The chunk list is stored just before
+ * the first entry of list.
+ */
+#define FS_SCANDIR_CHUNK 65536
+#define FS_SCANDIR_ALIGN __alignof__(struct fs_dirent)
+#define FS_SCANDIR_SIZE(len) ((offsetof(struct fs_dirent, name) + (len) + 1 + \
+			      FS_SCANDIR_ALIGN - 1) & ~(FS_SCANDIR_ALIGN - 1))
+
+struct fs_scandir_chunk {
+	struct fs_scandir_chunk *next;
+	size_t used;
+	char data[];
+};
+
 int fs_scandir(const char *path, struct fs_dirent ***list,
 	       int (*selector)(const struct fs_dirent *),
 	       int (*compar)(const struct fs_dirent **,
 			     const struct fs_dirent **))
 {
-	struct fs_dirent **_list = NULL;
-	struct fs_dirent **new;
-	struct fs_dirent *d;
+	struct fs_scandir_chunk *first = NULL, *last = NULL, *c;
+	struct fs_dirent **_list;
+	struct fs_dirent *d, *e;
 	struct fs_dir *dir;
 	size_t count = 0;
-	size_t size = 0;
+	size_t offset;
+	size_t size;
+	size_t len;
 
 	/* Open directory */
 	dir = fs_opendir(path);
@@ -473,37 +650,87 @@ int fs_scandir(const char *path, struct fs_dirent ***list,
 		if(selector != NULL && selector(d) == 0)
 			continue;
 
-		/* Reallocate list */
-		if(count == size)
+		/* Allocate a new chunk when last is full */
+		len = strlen(d->name);
+		size = FS_SCANDIR_SIZE(len);
+		if(last == NULL || last->used + size > FS_SCANDIR_CHUNK)
 		{
-			if(size == 0)
-				size = 10;
-			else
-				size *= 2;
-			new = realloc(_list, size * sizeof(struct fs_dirent *));
-			if(new == NULL)
+			c = malloc(sizeof(struct fs_scandir_chunk) +
+				   FS_SCANDIR_CHUNK);
+			if(c == NULL)
 				break;
-			_list = new;
+			c->next = NULL;
+			c->used = 0;
+			if(last != NULL)
+				last->next = c;
+			else
+				first = c;
+			last = c;
 		}
 
-		/* Allocate new entry */
-		_list[count] = malloc(sizeof(struct fs_dirent));
-		if(_list[count] == NULL)
-			break;
-
-		/* Copy data */
-		memcpy(_list[count], d, sizeof(struct fs_dirent));
+		/* Copy entry without comment (which is freed with directory) */
+		e = (struct fs_dirent *) &last->data[last->used];
+		memcpy(e, d, offsetof(struct fs_dirent, name));
+		memcpy(e->name, d->name, len + 1);
+		e->name_len = len;
+		e->comment_len = 0;
+		e->comment = NULL;
+		last->used += size;
 		count++;
 	}
 
 	/* Close directory */
 	fs_closedir(dir);
 
+	/* Allocate list with chunk list before first entry */
+	_list = malloc((count + 1) * sizeof(struct fs_dirent *));
+	if(_list == NULL)
+	{
+		for(c = first; c != NULL; c = first)
+		{
+			first = c->next;
+			free(c);
+		}
+		return -1;
+	}
+	*_list++ = (struct fs_dirent *) first;
+
+	/* Fill list */
+	count = 0;
+	for(c = first; c != NULL; c = c->next)
+	{
+		for(offset = 0; offset < c->used; offset += size)
+		{
+			e = (struct fs_dirent *) &c->data[offset];
+			size = FS_SCANDIR_SIZE(e->name_len);
+			_list[count++] = e;
+		}
+	}
+
 	/* Sort list */
-	qsort(_list, count, sizeof(struct fs_dirent *), (__compar_fn_t) compar);
+	if(compar != NULL)
+		qsort(_list, count, sizeof(struct fs_dirent *),
+		      (__compar_fn_t) compar);
 
 	/* Return values */
 	*list = _list;
 	return count;
 }
 
+void fs_scandir_free(struct fs_dirent **list)
+{
+	struct fs_scandir_chunk *c, *next;
+
+	if(list == NULL)
+		return;
+
+	/* Free chunks */
+	for(c = (struct fs_scandir_chunk *) list[-1]; c != NULL; c = next)
+	{
+		next = c->next;
+		free(c);
+	}
+
+	/* Free list */
+	free(&list[-1]);
+}
@@ -0,0 +1,230 @@
+/*
+ * fs_aio.c - Asynchronous I/O worker pool for FS
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "realtime.h"
+#include "fs_aio.h"
+
+/* Worker pool: threads are started on first request. Reads are positioned
+ * (fs_pread()), so a file can be read by several requests and by its owner at
+ * same time.
+ */
+#define FS_AIO_THREADS 4
+
+static pthread_t threads[FS_AIO_THREADS];
+static int thread_count = 0;
+static int idle = 0;
+static int stop = 0;
+
+/* Queue of pending requests */
+static struct fs_aio *queue = NULL;
+static struct fs_aio **queue_last = &queue;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+/* Completion of requests without callback */
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+void fs_aio_init(void)
+{
+	stop = 0;
+}
+
+void fs_aio_free(void)
+{
+	struct fs_aio *req;
+	int i;
+
+	/* Stop worker threads */
+	pthread_mutex_lock(&mutex);
+	stop = 1;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	for(i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	thread_count = 0;
+
+	/* Cancel pending requests */
+	while(queue != NULL)
+	{
+		req = queue;
+		queue = req->next;
+		fs_aio_complete(req, -1, ECANCELED);
+	}
+	queue_last = &queue;
+}
+
+static ssize_t fs_aio_do(struct fs_aio *req)
+{
+	/* Stat */
+	if(req->file == NULL)
+		return fs_stat(req->url, &req->stat);
+
+	/* Read at offset */
+	return fs_pread(req->file, req->buf, req->count, req->offset);
+}
+
+static void *fs_aio_thread(void *user_data)
+{
+	struct fs_aio *req;
+	ssize_t ret;
+	int err;
+
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "fs-aio");
+
+	/* Lock queue */
+	pthread_mutex_lock(&mutex);
+
+	while(!stop)
+	{
+		/* Wait a request */
+		if(queue == NULL)
+		{
+			idle++;
+			pthread_cond_wait(&cond, &mutex);
+			idle--;
+			continue;
+		}
+
+		/* Remove first request from queue */
+		req = queue;
+		queue = req->next;
+		if(queue == NULL)
+			queue_last = &queue;
+
+		/* Unlock queue */
+		pthread_mutex_unlock(&mutex);
+
+		/* Do request */
+		errno = 0;
+		ret = fs_aio_do(req);
+		err = errno;
+
+		/* Complete request */
+		fs_aio_complete(req, ret, err);
+
+		/* Lock queue */
+		pthread_mutex_lock(&mutex);
+	}
+
+	/* Unlock queue */
+	pthread_mutex_unlock(&mutex);
+
+	return NULL;
+}
+
+void fs_aio_queue(struct fs_aio *req)
+{
+	ssize_t ret;
+
+	/* Lock queue */
+	pthread_mutex_lock(&mutex);
+
+	/* Start a new thread when all are busy */
+	if(!stop && idle == 0 && thread_count < FS_AIO_THREADS)
+	{
+		if(pthread_create(&threads[thread_count], NULL, fs_aio_thread,
+				  NULL) == 0)
+			thread_count++;
+	}
+
+	/* No thread available: do request now */
+	if(thread_count == 0 || stop)
+	{
+		pthread_mutex_unlock(&mutex);
+		errno = 0;
+		ret = fs_aio_do(req);
+		fs_aio_complete(req, ret, errno);
+		return;
+	}
+
+	/* Add request to queue */
+	req->next = NULL;
+	*queue_last = req;
+	queue_last = &req->next;
+	pthread_cond_signal(&cond);
+
+	/* Unlock queue */
+	pthread_mutex_unlock(&mutex);
+}
+
+void fs_aio_complete(struct fs_aio *req, ssize_t ret, int err)
+{
+	/* Set result */
+	req->ret = ret;
+	req->err = err;
+
+	/* Call callback: request may be freed in it */
+	if(req->callback != NULL)
+	{
+		req->callback(req, req->user_data);
+		return;
+	}
+
+	/* Wake up waiting thread */
+	pthread_mutex_lock(&done_mutex);
+	req->done = 1;
+	pthread_cond_broadcast(&done_cond);
+	pthread_mutex_unlock(&done_mutex);
+}
+
+int fs_aio_wait(struct fs_aio *req, long timeout)
+{
+	struct timespec ts;
+	int ret = 0;
+
+	if(req == NULL)
+		return -1;
+
+	/* Calculate end of wait */
+	if(timeout >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000;
+		if(ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	/* Wait end of request */
+	pthread_mutex_lock(&done_mutex);
+	while(!req->done && ret != ETIMEDOUT)
+	{
+		if(timeout >= 0)
+			ret = pthread_cond_timedwait(&done_cond, &done_mutex,
+						     &ts);
+		else
+			pthread_cond_wait(&done_cond, &done_mutex);
+	}
+	ret = req->done ? 0 : -1;
+	pthread_mutex_unlock(&done_mutex);
+
+	return ret;
+}
+
@@ -0,0 +1,36 @@
+/*
+ * fs_aio.h - Asynchronous I/O worker pool for FS
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FS_AIO_H
+#define _FS_AIO_H
+
+#include "fs.h"
+
+void fs_aio_init(void);
+void fs_aio_free(void);
+
+/* Do a request with synchronous calls in worker pool: a read request has its
+ * file set and a stat request has a NULL file.
+ */
+void fs_aio_queue(struct fs_aio *req);
+
+/* Complete a request: call its callback or wake up fs_aio_wait() */
+void fs_aio_complete(struct fs_aio *req, ssize_t ret, int err);
+
+#endif
+
@@ -0,0 +1,954 @@
+/*
+ * fs_cache.c - A block cache for remote file systems
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "json.h"
+#include "fs_cache.h"
+
+/* Files are cached by blocks of FS_CACHE_BLOCK_SIZE bytes shared by all files
+ * opened with same URL. Most recently used blocks are kept in memory and, when
+ * a disk cache is configured, blocks removed from memory are moved to a local
+ * file until it is full.
+ * When a file is read sequentially, next blocks are read with the missing one
+ * and the read-ahead is doubled on each miss until its configured size.
+ */
+#define FS_CACHE_BLOCK_SIZE 32768
+#define FS_CACHE_HASH_SIZE 256
+
+/* Default configuration (sizes in kB) */
+#define FS_CACHE_MEMORY 4096
+#define FS_CACHE_DISK 0
+#define FS_CACHE_PATH "/tmp"
+#define FS_CACHE_READ_AHEAD 256
+
+/* Cached file */
+struct fs_cache_entry {
+	char *url;
+	/* Attributes of file when blocks have been cached */
+	off_t stat_size;
+	time_t stat_mtime;
+	/* Size of file, -1 if unknown */
+	off_t size;
+	/* Opened files and cached blocks */
+	int files;
+	unsigned long blocks;
+	struct fs_cache_entry *next;
+};
+
+struct fs_cache_block {
+	struct fs_cache_entry *entry;
+	off_t index;
+	size_t len;
+	/* Data in memory, or slot in disk cache when data is NULL */
+	unsigned char *data;
+	long slot;
+	/* Hash table and LRU list */
+	struct fs_cache_block *hash_next;
+	struct fs_cache_block *prev;
+	struct fs_cache_block *next;
+};
+
+/* LRU list: most recently used block is first */
+struct fs_cache_list {
+	struct fs_cache_block *first;
+	struct fs_cache_block *last;
+	unsigned long count;
+	unsigned long max;
+};
+
+struct fs_cache_handle {
+	/* File of remote file system */
+	struct fs_file file;
+	off_t file_pos;
+	/* Cached file */
+	struct fs_cache_entry *entry;
+	off_t pos;
+	/* Sequential access detection */
+	off_t last_end;
+	unsigned long read_ahead;
+	/* Mutex for positioned reads from other threads */
+	pthread_mutex_t mutex;
+};
+
+/* Configuration */
+static unsigned long cache_memory = FS_CACHE_MEMORY;
+static unsigned long cache_disk = FS_CACHE_DISK;
+static unsigned long cache_read_ahead = FS_CACHE_READ_AHEAD;
+static char *cache_path = NULL;
+
+/* Cache shared by all files */
+static struct fs_cache_entry *entries = NULL;
+static struct fs_cache_block *hash[FS_CACHE_HASH_SIZE];
+static struct fs_cache_list mem_list;
+static struct fs_cache_list disk_list;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Disk cache file with stack of free slots */
+static int disk_fd = -1;
+static long *disk_slots = NULL;
+static long disk_free = 0;
+
+/******************************************************************************
+ *                       Block cache (called with cache locked)               *
+ ******************************************************************************/
+
+static void fs_cache_list_remove(struct fs_cache_list *l,
+				 struct fs_cache_block *b)
+{
+	if(b->prev != NULL)
+		b->prev->next = b->next;
+	else
+		l->first = b->next;
+	if(b->next != NULL)
+		b->next->prev = b->prev;
+	else
+		l->last = b->prev;
+	b->prev = NULL;
+	b->next = NULL;
+	l->count--;
+}
+
+static void fs_cache_list_push(struct fs_cache_list *l,
+			       struct fs_cache_block *b)
+{
+	b->prev = NULL;
+	b->next = l->first;
+	if(l->first != NULL)
+		l->first->prev = b;
+	else
+		l->last = b;
+	l->first = b;
+	l->count++;
+}
+
+static inline unsigned int fs_cache_hash(struct fs_cache_entry *e,
+					 off_t index)
+{
+	return (((uintptr_t) e >> 4) ^ (index * 2654435761UL)) %
+	       FS_CACHE_HASH_SIZE;
+}
+
+static struct fs_cache_block *fs_cache_find(struct fs_cache_entry *e,
+					    off_t index)
+{
+	struct fs_cache_block *b;
+
+	for(b = hash[fs_cache_hash(e, index)]; b != NULL; b = b->hash_next)
+		if(b->entry == e && b->index == index)
+			return b;
+
+	return NULL;
+}
+
+static void fs_cache_entry_release(struct fs_cache_entry *e)
+{
+	struct fs_cache_entry **p;
+
+	/* Entry is still used */
+	if(e->files > 0 || e->blocks > 0)
+		return;
+
+	/* Remove entry */
+	for(p = &entries; *p != NULL; p = &(*p)->next)
+	{
+		if(*p == e)
+		{
+			*p = e->next;
+			break;
+		}
+	}
+	free(e->url);
+	free(e);
+}
+
+static void fs_cache_block_free(struct fs_cache_block *b)
+{
+	struct fs_cache_block **p;
+
+	/* Remove from hash table */
+	for(p = &hash[fs_cache_hash(b->entry, b->index)]; *p != NULL;
+	    p = &(*p)->hash_next)
+	{
+		if(*p == b)
+		{
+			*p = b->hash_next;
+			break;
+		}
+	}
+
+	/* Remove from memory or disk */
+	if(b->data != NULL)
+	{
+		fs_cache_list_remove(&mem_list, b);
+		free(b->data);
+	}
+	else
+	{
+		fs_cache_list_remove(&disk_list, b);
+		disk_slots[disk_free++] = b->slot;
+	}
+
+	/* Release entry */
+	b->entry->blocks--;
+	fs_cache_entry_release(b->entry);
+	free(b);
+}
+
+static int fs_cache_disk_open(void)
+{
+	char *name;
+	long i;
+
+	if(disk_fd >= 0)
+		return 0;
+	if(cache_disk * 1024 < FS_CACHE_BLOCK_SIZE || cache_path == NULL)
+		return -1;
+
+	/* Create an anonymous file in cache directory */
+	if(asprintf(&name, "%s/aircat-cache-XXXXXX", cache_path) < 0)
+		return -1;
+	disk_fd = mkstemp(name);
+	if(disk_fd >= 0)
+		unlink(name);
+	free(name);
+	if(disk_fd < 0)
+		return -1;
+
+	/* All slots are free */
+	disk_list.max = cache_disk * 1024 / FS_CACHE_BLOCK_SIZE;
+	disk_slots = malloc(disk_list.max * sizeof(long));
+	if(disk_slots == NULL)
+	{
+		close(disk_fd);
+		disk_fd = -1;
+		return -1;
+	}
+	for(i = 0; i < (long) disk_list.max; i++)
+		disk_slots[i] = disk_list.max - 1 - i;
+	disk_free = disk_list.max;
+
+	return 0;
+}
+
+static void fs_cache_disk_close(void)
+{
+	/* Free all blocks on disk */
+	while(disk_list.last != NULL)
+		fs_cache_block_free(disk_list.last);
+
+	if(disk_fd >= 0)
+		close(disk_fd);
+	disk_fd = -1;
+	if(disk_slots != NULL)
+		free(disk_slots);
+	disk_slots = NULL;
+	disk_free = 0;
+}
+
+/* Move least recently used block of memory to disk cache or free it */
+static void fs_cache_spill(void)
+{
+	struct fs_cache_block *b = mem_list.last;
+	long slot;
+
+	/* No disk cache */
+	if(fs_cache_disk_open() != 0)
+	{
+		fs_cache_block_free(b);
+		return;
+	}
+
+	/* Get a free slot */
+	if(disk_free == 0)
+		fs_cache_block_free(disk_list.last);
+	slot = disk_slots[--disk_free];
+
+	/* Write block */
+	if(pwrite(disk_fd, b->data, b->len, slot * FS_CACHE_BLOCK_SIZE) !=
+	    (ssize_t) b->len)
+	{
+		disk_slots[disk_free++] = slot;
+		fs_cache_block_free(b);
+		return;
+	}
+
+	/* Move block to disk */
+	fs_cache_list_remove(&mem_list, b);
+	free(b->data);
+	b->data = NULL;
+	b->slot = slot;
+	fs_cache_list_push(&disk_list, b);
+}
+
+/* Get a block as most recently used one, and read it back from disk cache */
+static int fs_cache_use(struct fs_cache_block *b)
+{
+	unsigned char *data;
+
+	/* Block is in memory */
+	if(b->data != NULL)
+	{
+		fs_cache_list_remove(&mem_list, b);
+		fs_cache_list_push(&mem_list, b);
+		return 0;
+	}
+
+	/* Read block from disk */
+	data = malloc(FS_CACHE_BLOCK_SIZE);
+	if(data == NULL ||
+	   pread(disk_fd, data, b->len, b->slot * FS_CACHE_BLOCK_SIZE) !=
+	   (ssize_t) b->len)
+	{
+		free(data);
+		fs_cache_block_free(b);
+		return -1;
+	}
+
+	/* Move block to memory */
+	fs_cache_list_remove(&disk_list, b);
+	disk_slots[disk_free++] = b->slot;
+	while(mem_list.count >= mem_list.max && mem_list.last != NULL)
+		fs_cache_spill();
+	b->data = data;
+	fs_cache_list_push(&mem_list, b);
+
+	return 0;
+}
+
+static void fs_cache_add(struct fs_cache_entry *e, off_t index,
+			 const unsigned char *data, size_t len)
+{
+	struct fs_cache_block *b;
+	unsigned int i;
+
+	/* Block is already cached */
+	if(mem_list.max == 0 || fs_cache_find(e, index) != NULL)
+		return;
+
+	/* Allocate a new block */
+	b = malloc(sizeof(struct fs_cache_block));
+	if(b == NULL)
+		return;
+	b->data = malloc(FS_CACHE_BLOCK_SIZE);
+	if(b->data == NULL)
+	{
+		free(b);
+		return;
+	}
+	memcpy(b->data, data, len);
+	b->entry = e;
+	b->index = index;
+	b->len = len;
+	b->slot = -1;
+
+	/* Make room in memory */
+	while(mem_list.count >= mem_list.max && mem_list.last != NULL)
+		fs_cache_spill();
+
+	/* Add block */
+	i = fs_cache_hash(e, index);
+	b->hash_next = hash[i];
+	hash[i] = b;
+	fs_cache_list_push(&mem_list, b);
+	e->blocks++;
+}
+
+static void fs_cache_purge(struct fs_cache_entry *e)
+{
+	struct fs_cache_block *b, *next;
+
+	for(b = mem_list.first; b != NULL; b = next)
+	{
+		next = b->next;
+		if(e == NULL || b->entry == e)
+			fs_cache_block_free(b);
+	}
+	for(b = disk_list.first; b != NULL; b = next)
+	{
+		next = b->next;
+		if(e == NULL || b->entry == e)
+			fs_cache_block_free(b);
+	}
+}
+
+/******************************************************************************
+ *                              Configuration                                 *
+ ******************************************************************************/
+
+void fs_cache_init(void)
+{
+	fs_cache_set_config(NULL);
+}
+
+void fs_cache_free(void)
+{
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Free all blocks */
+	fs_cache_purge(NULL);
+	fs_cache_disk_close();
+	mem_list.max = 0;
+
+	/* Free configuration */
+	if(cache_path != NULL)
+		free(cache_path);
+	cache_path = NULL;
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+int fs_cache_set_config(struct json *config)
+{
+	const char *path = NULL;
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Empty cache */
+	fs_cache_purge(NULL);
+	fs_cache_disk_close();
+
+	/* Get configuration */
+	cache_memory = FS_CACHE_MEMORY;
+	cache_disk = FS_CACHE_DISK;
+	cache_read_ahead = FS_CACHE_READ_AHEAD;
+	if(config != NULL)
+	{
+		if(json_has_key(config, "memory"))
+			cache_memory = json_get_int(config, "memory");
+		if(json_has_key(config, "disk"))
+			cache_disk = json_get_int(config, "disk");
+		if(json_has_key(config, "read_ahead"))
+			cache_read_ahead = json_get_int(config, "read_ahead");
+		path = json_get_string(config, "path");
+	}
+	if(cache_path != NULL)
+		free(cache_path);
+	cache_path = strdup(path != NULL ? path : FS_CACHE_PATH);
+
+	/* Update cache size (a file is cached by at least one block) */
+	mem_list.max = cache_memory * 1024 / FS_CACHE_BLOCK_SIZE;
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	return 0;
+}
+
+struct json *fs_cache_get_config(void)
+{
+	struct json *cfg;
+
+	/* Create a JSON object */
+	cfg = json_new();
+	if(cfg == NULL)
+		return NULL;
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Fill configuration */
+	json_set_int(cfg, "memory", cache_memory);
+	json_set_int(cfg, "disk", cache_disk);
+	json_set_string(cfg, "path", cache_path);
+	json_set_int(cfg, "read_ahead", cache_read_ahead);
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	return cfg;
+}
+
+/******************************************************************************
+ *                                File I/O                                    *
+ ******************************************************************************/
+
+int fs_cache_open(struct fs_file *f, struct fs_handle *fs, const char *url,
+		  int flags, mode_t mode)
+{
+	struct fs_cache_handle *h;
+	struct fs_cache_entry *e;
+	struct stat st;
+
+	/* Only read-only files are cached */
+	if((flags & O_ACCMODE) != O_RDONLY)
+		return 1;
+
+	/* Cache is disabled */
+	pthread_mutex_lock(&cache_mutex);
+	if(mem_list.max == 0)
+	{
+		pthread_mutex_unlock(&cache_mutex);
+		return 1;
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Allocate handle */
+	h = malloc(sizeof(struct fs_cache_handle));
+	if(h == NULL)
+		return -1;
+
+	/* Open remote file */
+	h->file.handle = fs;
+	if(fs->open(&h->file, url, flags | FS_O_CACHED, mode) != 0)
+	{
+		free(h);
+		return -1;
+	}
+	h->file_pos = 0;
+	h->pos = 0;
+	h->last_end = 0;
+	h->read_ahead = 0;
+	pthread_mutex_init(&h->mutex, NULL);
+
+	/* Get attributes to check cached blocks */
+	memset(&st, 0, sizeof(struct stat));
+	if(fs->fstat(&h->file, &st) != 0)
+		memset(&st, 0, sizeof(struct stat));
+	if(st.st_size <= 0)
+		st.st_size = -1;
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Find cached file */
+	for(e = entries; e != NULL; e = e->next)
+		if(strcmp(e->url, url) == 0)
+			break;
+
+	/* File has changed since blocks have been cached */
+	if(e != NULL && (e->stat_size != st.st_size ||
+			 e->stat_mtime != st.st_mtime))
+	{
+		e->files++;
+		fs_cache_purge(e);
+		e->files--;
+		e->stat_size = st.st_size;
+		e->stat_mtime = st.st_mtime;
+		e->size = st.st_size;
+	}
+
+	/* Add a new file */
+	if(e == NULL)
+	{
+		e = calloc(1, sizeof(struct fs_cache_entry));
+		if(e == NULL || (e->url = strdup(url)) == NULL)
+		{
+			pthread_mutex_unlock(&cache_mutex);
+			free(e);
+			fs->close(&h->file);
+			pthread_mutex_destroy(&h->mutex);
+			free(h);
+			return -1;
+		}
+		e->stat_size = st.st_size;
+		e->stat_mtime = st.st_mtime;
+		e->size = st.st_size;
+		e->next = entries;
+		entries = e;
+	}
+	e->files++;
+	h->entry = e;
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Set file */
+	f->handle = &fs_cache;
+	f->data = h;
+	f->fd = -1;
+
+	return 0;
+}
+
+/* Read a missing block (and next ones for read-ahead) from remote file */
+static ssize_t fs_cache_fill(struct fs_cache_handle *h, off_t index,
+			     size_t offset, unsigned char *buffer,
+			     size_t count, long timeout)
+{
+	struct fs_cache_entry *e = h->entry;
+	off_t start = index * FS_CACHE_BLOCK_SIZE;
+	unsigned char *data;
+	size_t len = 0, size, blen;
+	unsigned long n, blocks;
+	ssize_t ret = 0;
+	int eof = 0;
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Stop read-ahead at end of file or at first cached block */
+	blocks = 1 + h->read_ahead;
+	if(e->size >= 0 && start + (off_t) blocks * FS_CACHE_BLOCK_SIZE >
+			   e->size)
+		blocks = (e->size - start + FS_CACHE_BLOCK_SIZE - 1) /
+			 FS_CACHE_BLOCK_SIZE;
+	for(n = 1; n < blocks; n++)
+		if(fs_cache_find(e, index + n) != NULL)
+			break;
+	blocks = n;
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Allocate buffer */
+	size = blocks * FS_CACHE_BLOCK_SIZE;
+	data = malloc(size);
+	if(data == NULL)
+		return -1;
+
+	/* Seek in remote file */
+	if(h->file_pos != start)
+	{
+		if(h->file.handle->lseek(&h->file, start, SEEK_SET) != start)
+		{
+			h->file_pos = -1;
+			free(data);
+			return -1;
+		}
+		h->file_pos = start;
+	}
+
+	/* Read blocks */
+	while(len < size)
+	{
+		ret = h->file.handle->read_to(&h->file, data + len, size - len,
+					      timeout);
+		if(ret <= 0)
+		{
+			/* End of file (or timeout) */
+			eof = ret == 0 && timeout < 0;
+			break;
+		}
+		len += ret;
+	}
+	h->file_pos += len;
+	if(ret < 0 && len == 0)
+	{
+		free(data);
+		return -1;
+	}
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Update size of file */
+	if(e->size >= 0 && start + (off_t) len >= e->size)
+		eof = 1;
+	else if(eof)
+		e->size = start + len;
+
+	/* Add blocks to cache: last one is added only when it is complete */
+	for(n = 0; n * FS_CACHE_BLOCK_SIZE < len; n++)
+	{
+		blen = len - n * FS_CACHE_BLOCK_SIZE;
+		if(blen > FS_CACHE_BLOCK_SIZE)
+			blen = FS_CACHE_BLOCK_SIZE;
+		if(blen == FS_CACHE_BLOCK_SIZE || eof)
+			fs_cache_add(e, index + n,
+				     data + n * FS_CACHE_BLOCK_SIZE, blen);
+	}
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Copy data */
+	ret = 0;
+	if(offset < len)
+	{
+		ret = len - offset;
+		if((size_t) ret > count)
+			ret = count;
+		memcpy(buffer, data + offset, ret);
+	}
+	free(data);
+
+	return ret;
+}
+
+/* Read data of one block: from cache or from remote file */
+static ssize_t fs_cache_read_block(struct fs_file *f, void *buffer,
+				   size_t count, long timeout)
+{
+	struct fs_cache_handle *h = f->data;
+	struct fs_cache_block *b;
+	size_t offset;
+	off_t index;
+	ssize_t ret = -1;
+
+	if(count == 0)
+		return 0;
+
+	/* Find block */
+	index = h->pos / FS_CACHE_BLOCK_SIZE;
+	offset = h->pos % FS_CACHE_BLOCK_SIZE;
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* End of file */
+	if(h->entry->size >= 0 && h->pos >= h->entry->size)
+	{
+		pthread_mutex_unlock(&cache_mutex);
+		return 0;
+	}
+
+	/* Copy data from cached block */
+	b = fs_cache_find(h->entry, index);
+	if(b != NULL && fs_cache_use(b) == 0)
+	{
+		ret = 0;
+		if(offset < b->len)
+		{
+			ret = b->len - offset;
+			if((size_t) ret > count)
+				ret = count;
+			memcpy(buffer, b->data + offset, ret);
+		}
+	}
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Read block from remote file */
+	if(ret < 0)
+	{
+		/* Update read-ahead: it is only used for sequential read */
+		if(h->pos != h->last_end)
+			h->read_ahead = 0;
+		else if(h->read_ahead == 0)
+			h->read_ahead = 1;
+		else
+			h->read_ahead *= 2;
+		if(h->read_ahead * FS_CACHE_BLOCK_SIZE > cache_read_ahead * 1024)
+			h->read_ahead = cache_read_ahead * 1024 /
+					FS_CACHE_BLOCK_SIZE;
+
+		ret = fs_cache_fill(h, index, offset, buffer, count, timeout);
+		if(ret < 0)
+			return -1;
+	}
+
+	/* Update position */
+	h->pos += ret;
+	h->last_end = h->pos;
+
+	return ret;
+}
+
+/* Must be called with handle locked */
+static ssize_t fs_cache_read_blocks(struct fs_file *f, void *buffer,
+				    size_t count, long timeout)
+{
+	size_t len = 0;
+	ssize_t ret;
+
+	/* Read across blocks until count is reached, as remote file systems:
+	 * with a timeout, data of first block is returned as soon as it is
+	 * available.
+	 */
+	while(len < count)
+	{
+		ret = fs_cache_read_block(f, (unsigned char *) buffer + len,
+					  count - len, timeout);
+		if(ret <= 0)
+		{
+			/* End of file, timeout or error */
+			if(len == 0)
+				return ret;
+			break;
+		}
+		len += ret;
+
+		/* Partial read with timeout */
+		if(timeout >= 0)
+			break;
+	}
+
+	return len;
+}
+
+static ssize_t fs_cache_read_to(struct fs_file *f, void *buffer, size_t count,
+				long timeout)
+{
+	struct fs_cache_handle *h = f->data;
+	ssize_t ret;
+
+	pthread_mutex_lock(&h->mutex);
+	ret = fs_cache_read_blocks(f, buffer, count, timeout);
+	pthread_mutex_unlock(&h->mutex);
+
+	return ret;
+}
+
+static ssize_t fs_cache_read(struct fs_file *f, void *buffer, size_t count)
+{
+	return fs_cache_read_to(f, buffer, count, -1);
+}
+
+static ssize_t fs_cache_write_to(struct fs_file *f, const void *buffer,
+				 size_t count, long timeout)
+{
+	/* Cached files are read-only */
+	return -1;
+}
+
+static ssize_t fs_cache_write(struct fs_file *f, const void *buffer,
+			      size_t count)
+{
+	return fs_cache_write_to(f, buffer, count, -1);
+}
+
+static off_t fs_cache_lseek(struct fs_file *f, off_t offset, int whence)
+{
+	struct fs_cache_handle *h = f->data;
+	off_t size;
+
+	/* Get size of file */
+	pthread_mutex_lock(&cache_mutex);
+	size = h->entry->size;
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Lock handle */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Calculate new position: remote file is only seeked on next miss */
+	switch(whence)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			offset += h->pos;
+			break;
+		case SEEK_END:
+			if(size < 0)
+			{
+				/* Size is unknown: ask remote file */
+				offset = h->file.handle->lseek(&h->file,
+							       offset,
+							       SEEK_END);
+				h->file_pos = offset;
+			}
+			else
+				offset += size;
+			break;
+		default:
+			offset = -1;
+			break;
+	}
+	if(offset >= 0)
+		h->pos = offset;
+
+	/* Unlock handle */
+	pthread_mutex_unlock(&h->mutex);
+
+	return offset < 0 ? -1 : offset;
+}
+
+static ssize_t fs_cache_pread(struct fs_file *f, void *buffer, size_t count,
+			      off_t offset)
+{
+	struct fs_cache_handle *h = f->data;
+	off_t pos, last_end;
+	ssize_t ret;
+
+	/* Lock handle */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Read at offset and restore position */
+	pos = h->pos;
+	last_end = h->last_end;
+	h->pos = offset;
+	ret = fs_cache_read_blocks(f, buffer, count, -1);
+	h->pos = pos;
+	h->last_end = last_end;
+
+	/* Unlock handle */
+	pthread_mutex_unlock(&h->mutex);
+
+	return ret;
+}
+
+static int fs_cache_ftruncate(struct fs_file *f, off_t length)
+{
+	/* Cached files are read-only */
+	return -1;
+}
+
+static void fs_cache_close(struct fs_file *f)
+{
+	struct fs_cache_handle *h = f->data;
+
+	if(h == NULL)
+		return;
+
+	/* Close remote file */
+	h->file.handle->close(&h->file);
+
+	/* Release cached file (its blocks are kept) */
+	pthread_mutex_lock(&cache_mutex);
+	h->entry->files--;
+	fs_cache_entry_release(h->entry);
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Free handle */
+	pthread_mutex_destroy(&h->mutex);
+	free(h);
+	f->data = NULL;
+}
+
+static int fs_cache_fstat(struct fs_file *f, struct stat *buf)
+{
+	struct fs_cache_handle *h = f->data;
+
+	return h->file.handle->fstat(&h->file, buf);
+}
+
+static int fs_cache_fstatvfs(struct fs_file *f, struct statvfs *buf)
+{
+	struct fs_cache_handle *h = f->data;
+
+	return h->file.handle->fstatvfs(&h->file, buf);
+}
+
+/* Only file I/O is used: other calls are done on remote file system */
+struct fs_handle fs_cache = {
+	.read = fs_cache_read,
+	.read_to = fs_cache_read_to,
+	.write = fs_cache_write,
+	.write_to = fs_cache_write_to,
+	.lseek = fs_cache_lseek,
+	.pread = fs_cache_pread,
+	.ftruncate = fs_cache_ftruncate,
+	.close = fs_cache_close,
+	.fstat = fs_cache_fstat,
+	.fstatvfs = fs_cache_fstatvfs,
+};
+
@@ -0,0 +1,40 @@
+/*
+ * fs_cache.h - A block cache for remote file systems
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FS_CACHE_H
+#define _FS_CACHE_H
+
+#include "fs.h"
+
+void fs_cache_init(void);
+void fs_cache_free(void);
+
+/* Configuration (cache is emptied when it is changed) */
+int fs_cache_set_config(struct json *config);
+struct json *fs_cache_get_config(void);
+
+/* Open a file of a remote file system fs through block cache: file must be
+ * opened read-only and f->handle is set to fs_cache.
+ * Return: 0 on success, 1 if cache is disabled, -1 on error.
+ */
+int fs_cache_open(struct fs_file *f, struct fs_handle *fs, const char *url,
+		  int flags, mode_t mode);
+extern struct fs_handle fs_cache;
+
+#endif
+
@@ -24,12 +24,24 @@
 #include "fs_http.h"
 #include "http.h"
 
+/* File is requested by ranges so the connection can be reused after a seek:
+ * the first range after a seek is FS_HTTP_MIN_WINDOW bytes and size of next
+ * ones is doubled until FS_HTTP_MAX_WINDOW bytes for sequential read.
+ * A forward seek of less than FS_HTTP_MAX_SKIP bytes in current range is done
+ * by reading data.
+ */
+#define FS_HTTP_MIN_WINDOW 65536
+#define FS_HTTP_MAX_WINDOW 1048576
+#define FS_HTTP_MAX_SKIP 16384
+
 struct fs_http_handle {
 	struct http_handle *http;
 	int is_seekable;
 	size_t size;
 	long skip_len;
 	long pos;
+	long end;
+	long window;
 	char *url;
 };
 
@@ -43,25 +55,66 @@ void fs_http_free(void)
 	return;
 }
 
+static int fs_http_range(struct fs_http_handle *h, long offset)
+{
+	const char *ext;
+	char req[256];
+	long start, end, size;
+	int code, ret;
+
+	/* Prepare a request with new range */
+	snprintf(req, 255, "Range: bytes=%ld-%ld\r\n", offset,
+		 offset + h->window - 1);
+	http_set_option(h->http, HTTP_EXTRA_HEADER, req, 0);
+
+	/* Do a new request */
+	code = http_get(h->http, h->url);
+	if(code == 206)
+	{
+		/* Get range and file length */
+		ext = http_get_header(h->http, "Content-Range", 0);
+		if(ext == NULL)
+			return -1;
+		ret = sscanf(ext, "bytes %ld-%ld/%ld", &start, &end, &size);
+		if(ret < 2 || start != offset)
+			return -1;
+		if(ret == 3)
+			h->size = size;
+		h->end = end + 1;
+	}
+	else if(code == 416)
+	{
+		/* Range starts at or after end of file (empty file) */
+		h->end = offset;
+		ext = http_get_header(h->http, "Content-Range", 0);
+		if(ext != NULL && sscanf(ext, "bytes */%ld", &size) == 1)
+			h->size = size;
+	}
+	else if(code == 200)
+	{
+		/* Range is not supported: skip data until offset */
+		h->is_seekable = 0;
+		h->skip_len = offset;
+		h->end = -1;
+		ext = http_get_header(h->http, "Content-Length", 0);
+		if(ext != NULL)
+			h->size = strtoul(ext, NULL, 10);
+	}
+	else
+		return -1;
+
+	return 0;
+}
+
 static int fs_http_open(struct fs_file *f, const char *url, int flags,
 			mode_t mode)
 {
 	struct fs_http_handle *h;
 	struct http_handle *http;
-	const char *ext;
-	int code;
 
 	/* Create a new HTTP client */
 	if(http_open(&http, 1) != 0)
-		goto error;
-
-	/* Prepare request with seek option */
-	http_set_option(http, HTTP_EXTRA_HEADER, "Range: bytes=0-\r\n", 0);
-
-	/* Do request */
-	code = http_get(http, url);
-	if(code != 200 && code != 206)
-		goto error;
+		return -1;
 
 	/* Allocate a new handle */
 	h = malloc(sizeof(struct fs_http_handle));
@@ -69,23 +122,24 @@ static int fs_http_open(struct fs_file *f, const char *url, int flags,
 		goto error;
 
 	/* Init structure */
-	f->data = (void*) h;
 	h->url = strdup(url);
 	h->http = http;
 	h->skip_len = 0;
-	h->is_seekable = 0;
+	h->is_seekable = 1;
 	h->size = 0;
 	h->pos = 0;
+	h->end = 0;
+	h->window = FS_HTTP_MIN_WINDOW;
 
-	/* Get accepted range */
-	ext = http_get_header(h->http, "Accept-Ranges", 0);
-	if(ext != NULL && strncmp(ext, "bytes", 5) == 0)
-		h->is_seekable = 1;
-
-	/* Get file length */
-	ext = http_get_header(http, "Content-Length", 0);
-	if(ext != NULL)
-		h->size = strtoul(ext, NULL, 10);
+	/* Request first range */
+	if(h->url == NULL || fs_http_range(h, 0) != 0)
+	{
+		if(h->url != NULL)
+			free(h->url);
+		free(h);
+		goto error;
+	}
+	f->data = (void*) h;
 
 	return 0;
 error:
@@ -104,31 +158,68 @@ static ssize_t fs_http_read_to(struct fs_file *f, void *buf, size_t count,
 			       long timeout)
 {
 	struct fs_http_handle *h;
+	unsigned char *p = buf;
+	size_t done = 0;
+	size_t size;
 	ssize_t len;
 
 	if(f == NULL || f->data == NULL)
 		return -1;
 	h = f->data;
 
-	/* Skip len */
-	while(h->skip_len > 0)
+	/* Fill buffer across ranges */
+	while(done < count)
 	{
-		/* Read data */
-		len = h->skip_len > count ? count : h->skip_len;
-		len = http_read_timeout(h->http, buf, len, timeout);
-		if(len <= 0)
-			return len;
-		h->skip_len -= len;
-	}
+		/* End of current range: request next one */
+		if(h->is_seekable && h->pos >= h->end)
+		{
+			/* End of file */
+			if(h->size > 0 && h->pos >= h->size)
+				break;
+
+			/* Increase range size for sequential read */
+			h->window *= 2;
+			if(h->window > FS_HTTP_MAX_WINDOW)
+				h->window = FS_HTTP_MAX_WINDOW;
+			if(fs_http_range(h, h->pos) != 0)
+				return done > 0 ? done : -1;
+
+			/* End of file (range is empty) */
+			if(h->pos >= h->end)
+				break;
+		}
+
+		/* Skip len */
+		while(h->skip_len > 0)
+		{
+			/* Read data */
+			len = h->skip_len > count - done ? count - done :
+							   h->skip_len;
+			len = http_read_timeout(h->http, p + done, len,
+						timeout);
+			if(len <= 0)
+				return done > 0 ? done : len;
+			h->skip_len -= len;
+		}
 
-	/* Read content */
-	len = http_read_timeout(h->http, buf, count, timeout);
+		/* Read content */
+		size = count - done;
+		if(h->is_seekable && size > h->end - h->pos)
+			size = h->end - h->pos;
+		len = http_read_timeout(h->http, p + done, size, timeout);
+		if(len <= 0)
+			return done > 0 ? done : len;
 
-	/* Update current position */
-	if(len > 0)
+		/* Update current position */
 		h->pos += len;
+		done += len;
 
-	return len;
+		/* Timeout or end of data */
+		if(len < size)
+			break;
+	}
+
+	return done;
 }
 
 static ssize_t fs_http_read(struct fs_file *f, void *buf, size_t count)
@@ -152,8 +243,6 @@ static ssize_t fs_http_write(struct fs_file *f, const void *buf, size_t count)
 static off_t fs_http_lseek(struct fs_file *f, off_t offset, int whence)
 {
 	struct fs_http_handle *h;
-	char req[256];
-	int code;
 
 	if(f == NULL || f->data == NULL)
 		return -1;
@@ -168,32 +257,42 @@ static off_t fs_http_lseek(struct fs_file *f, off_t offset, int whence)
 	{
 		if(h->size == 0)
 			return -1;
-		offset -= h->size;
+		offset += h->size;
 	}
 
+	/* Position is not changed */
+	if(offset == h->pos)
+		return h->pos;
+
 	/* Seek to desired position */
 	if(h->is_seekable)
 	{
-		/* Prepare a request with new location */
-		snprintf(req, 255, "Range: bytes=%ld-\r\n", offset);
-		http_set_option(h->http, HTTP_EXTRA_HEADER, req, 0);
-
-		/* Do a new request */
-		code = http_get(h->http, h->url);
-		if(code != 200 && code != 206)
-			return -1;
+		if(offset > h->pos && offset < h->end &&
+		   offset - h->pos <= FS_HTTP_MAX_SKIP)
+		{
+			/* Skip data in current range */
+			h->skip_len += offset - h->pos;
+		}
+		else
+		{
+			/* Request a new range */
+			h->skip_len = 0;
+			h->window = FS_HTTP_MIN_WINDOW;
+			if(fs_http_range(h, offset) != 0)
+				return -1;
+		}
 	}
 	else
 	{
 		/* Skip diff between current position and asked position */
-		h->skip_len = offset - h->pos;
+		h->skip_len += offset - h->pos;
 		if(h->skip_len < 0)
 		{
 			/* Free extra header */
 			http_set_option(h->http, HTTP_EXTRA_HEADER, NULL, 0);
 
 			/* Do a new request */
-			code = http_get(h->http, h->url);
+			http_get(h->http, h->url);
 
 			/* Update length to skip */
 			h->skip_len = offset;
@@ -328,5 +427,6 @@ struct fs_handle fs_http = {
 	.fstat = fs_http_fstat,
 	.statvfs = fs_http_statvfs,
 	.fstatvfs = fs_http_fstatvfs,
+	.remote = 1,
 };
 
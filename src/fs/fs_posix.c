@@ -16,7 +16,12 @@
  * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
@@ -24,15 +29,189 @@
 #include <mntent.h>
 #include <sys/types.h>
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_LIBURING
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <liburing.h>
+
+#include "realtime.h"
+#include "fs_aio.h"
+
+/* Asynchronous I/O with io_uring: requests are submitted to a ring shared by
+ * all callers and a thread reaps their completions. Kernels without support
+ * of read or statx in io_uring fall back to worker pool of FS, as requests
+ * which can't be submitted or which would overflow completion queue.
+ */
+#define FS_POSIX_RING_SIZE 64
+
+static struct io_uring ring;
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t ring_thread;
+static unsigned int ring_pending = 0;
+static unsigned int ring_max = 0;
+static int ring_read = 0;
+static int ring_statx = 0;
+static int ring_ok = 0;
+
+/* Data of an entry not submitted: its completion is ignored */
+static char ring_dropped;
+#endif
+
 #include "fs_posix.h"
 
+#ifdef HAVE_LIBURING
+static void fs_posix_statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(struct stat));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+static void *fs_posix_ring_thread(void *user_data)
+{
+	struct io_uring_cqe *cqe;
+	struct fs_aio *req;
+	int res;
+
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "fs-uring");
+
+	while(1)
+	{
+		/* Wait next completion */
+		res = io_uring_wait_cqe(&ring, &cqe);
+		if(res == -EINTR)
+			continue;
+		if(res < 0)
+			break;
+		req = io_uring_cqe_get_data(cqe);
+		res = cqe->res;
+		io_uring_cqe_seen(&ring, cqe);
+
+		/* Request without data stops thread */
+		if(req == NULL)
+			break;
+
+		/* Update requests in flight */
+		pthread_mutex_lock(&ring_mutex);
+		ring_pending--;
+		pthread_mutex_unlock(&ring_mutex);
+
+		/* Request has been sent to worker pool */
+		if(req == (void *) &ring_dropped)
+			continue;
+
+		/* Convert result of stat */
+		if(req->file == NULL)
+		{
+			if(res == 0)
+				fs_posix_statx_to_stat(req->priv, &req->stat);
+			free(req->priv);
+			req->priv = NULL;
+		}
+
+		/* Complete request */
+		if(res < 0)
+			fs_aio_complete(req, -1, -res);
+		else
+			fs_aio_complete(req, res, 0);
+	}
+
+	return NULL;
+}
+#endif
+
 void fs_posix_init(void)
 {
+#ifdef HAVE_LIBURING
+	struct io_uring_probe *probe;
+
+	/* Create ring */
+	if(io_uring_queue_init(FS_POSIX_RING_SIZE, &ring, 0) != 0)
+		return;
+
+	/* Check supported operations */
+	probe = io_uring_get_probe_ring(&ring);
+	if(probe != NULL)
+	{
+		ring_read = io_uring_opcode_supported(probe, IORING_OP_READ);
+		ring_statx = io_uring_opcode_supported(probe, IORING_OP_STATX);
+		io_uring_free_probe(probe);
+	}
+
+	/* Requests in flight are limited to completion queue size */
+	ring_max = *ring.cq.kring_entries;
+
+	/* Start completion thread */
+	if((!ring_read && !ring_statx) ||
+	   pthread_create(&ring_thread, NULL, fs_posix_ring_thread, NULL) != 0)
+	{
+		io_uring_queue_exit(&ring);
+		return;
+	}
+	ring_ok = 1;
+#endif
+
 	return;
 }
 
 void fs_posix_free(void)
 {
+#ifdef HAVE_LIBURING
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	if(!ring_ok)
+		return;
+
+	/* Stop completion thread with an empty request, completed after all
+	 * pending requests.
+	 */
+	pthread_mutex_lock(&ring_mutex);
+	ring_ok = 0;
+	while((sqe = io_uring_get_sqe(&ring)) == NULL)
+		io_uring_submit(&ring);
+	io_uring_prep_nop(sqe);
+	io_uring_sqe_set_data(sqe, NULL);
+	io_uring_sqe_set_flags(sqe, IOSQE_IO_DRAIN);
+
+	/* Retry until all entries are taken (completion thread is reaping) */
+	while(io_uring_sq_ready(&ring) > 0)
+	{
+		ret = io_uring_submit(&ring);
+		if(ret < 0 && ret != -EAGAIN && ret != -EBUSY && ret != -EINTR)
+			break;
+		if(ret <= 0)
+			sched_yield();
+	}
+	pthread_mutex_unlock(&ring_mutex);
+	pthread_join(ring_thread, NULL);
+
+	/* Free ring */
+	io_uring_queue_exit(&ring);
+#endif
+
 	return;
 }
 
@@ -142,6 +321,12 @@ static off_t fs_posix_lseek(struct fs_file *f, off_t offset, int whence)
 	return lseek(f->fd, offset, whence);
 }
 
+static ssize_t fs_posix_pread(struct fs_file *f, void *buf, size_t count,
+			      off_t offset)
+{
+	return pread(f->fd, buf, count, offset);
+}
+
 static int fs_posix_ftruncate(struct fs_file *f, off_t length)
 {
 	return ftruncate(f->fd, length);
@@ -210,10 +395,11 @@ static struct fs_dirent *fs_posix_readdir(struct fs_dir *d)
 			d->c_dirent.type = FS_DSK;
 			d->c_dirent.comment_len = 0;
 			d->c_dirent.comment = NULL;
+			d->c_dirent.has_stat = 0;
 			d->c_dirent.name_len = strlen(mnt.mnt_dir);
 			if(d->c_dirent.name_len > 255)
 				d->c_dirent.name_len = 255;
-			strncpy(d->c_dirent.name, mnt.mnt_dir,
+			memmove(d->c_dirent.name, mnt.mnt_dir,
 				d->c_dirent.name_len);
 			d->c_dirent.name[d->c_dirent.name_len] = '\0';
 
@@ -233,7 +419,8 @@ static struct fs_dirent *fs_posix_readdir(struct fs_dir *d)
 	d->c_dirent.offset = dir->d_off;
 	d->c_dirent.comment_len = 0;
 	d->c_dirent.comment = NULL;
-	d->c_dirent.name_len = dir->d_reclen;
+	d->c_dirent.has_stat = 0;
+	d->c_dirent.name_len = strlen(dir->d_name);
 	strcpy(d->c_dirent.name, dir->d_name);
 
 	/* Get type */
@@ -252,11 +439,26 @@ static struct fs_dirent *fs_posix_readdir(struct fs_dir *d)
 			d->c_dirent.type = FS_UNKNOWN;
 	}
 
-	/* Generate path */
-	strncpy(&d->url[d->url_len], dir->d_name, dir->d_reclen);
+	/* Type is unknown or entry is a link: stat entry to get its type (or
+	 * type of its target), otherwise it is only stat on demand.
+	 */
+	if((d->c_dirent.type == FS_UNKNOWN || d->c_dirent.type == FS_LNK) &&
+	   d->url != NULL)
+	{
+		/* Generate path */
+		memcpy(&d->url[d->url_len], dir->d_name,
+		       d->c_dirent.name_len + 1);
 
-	/* Stat directory */
-	stat(d->url, &d->c_dirent.stat);
+		/* Stat entry */
+		if(stat(d->url, &d->c_dirent.stat) == 0)
+		{
+			d->c_dirent.has_stat = 1;
+			if(S_ISREG(d->c_dirent.stat.st_mode))
+				d->c_dirent.type = FS_REG;
+			else if(S_ISDIR(d->c_dirent.stat.st_mode))
+				d->c_dirent.type = FS_DIR;
+		}
+	}
 
 	return &d->c_dirent;
 }
@@ -295,6 +497,113 @@ static int fs_posix_fstatvfs(struct fs_file *f, struct statvfs *buf)
 	return fstatvfs(f->fd, buf);
 }
 
+#ifdef HAVE_LIBURING
+/* Must be called with ring locked */
+static int fs_posix_ring_submit(struct io_uring_sqe **sqes, int count)
+{
+	unsigned int ready;
+	int i;
+
+	/* Requests are in flight until their completion */
+	ring_pending += count;
+
+	/* Submit entries while kernel takes them */
+	while(io_uring_submit(&ring) > 0 && io_uring_sq_ready(&ring) > 0);
+
+	/* Last entries are not taken: they become empty requests, sent with
+	 * next submit, and their requests are returned to worker pool
+	 */
+	ready = io_uring_sq_ready(&ring);
+	if(ready > (unsigned int) count)
+		ready = count;
+	for(i = count - ready; i < count; i++)
+	{
+		io_uring_prep_nop(sqes[i]);
+		io_uring_sqe_set_data(sqes[i], &ring_dropped);
+	}
+
+	return count - ready;
+}
+
+static int fs_posix_aio_read(struct fs_aio *req)
+{
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	/* Lock ring */
+	pthread_mutex_lock(&ring_mutex);
+
+	/* Get a free entry: worker pool is used when ring is full */
+	if(!ring_ok || !ring_read || ring_pending >= ring_max ||
+	   (sqe = io_uring_get_sqe(&ring)) == NULL)
+	{
+		pthread_mutex_unlock(&ring_mutex);
+		return -1;
+	}
+
+	/* Submit read: worker pool is used on failure */
+	io_uring_prep_read(sqe, req->file->fd, req->buf, req->count,
+			   req->offset);
+	io_uring_sqe_set_data(sqe, req);
+	ret = fs_posix_ring_submit(&sqe, 1);
+
+	/* Unlock ring */
+	pthread_mutex_unlock(&ring_mutex);
+
+	return ret == 1 ? 0 : -1;
+}
+
+static int fs_posix_aio_stat(struct fs_aio *reqs, int count)
+{
+	struct io_uring_sqe *sqes[FS_POSIX_RING_SIZE];
+	struct statx *stx;
+	int i, ret;
+
+	/* Lock ring */
+	pthread_mutex_lock(&ring_mutex);
+
+	if(!ring_ok || !ring_statx)
+	{
+		pthread_mutex_unlock(&ring_mutex);
+		return 0;
+	}
+
+	/* Prepare a statx for each request while ring has free entries */
+	for(i = 0; i < count && i < FS_POSIX_RING_SIZE &&
+		   ring_pending + i < ring_max; i++)
+	{
+		stx = malloc(sizeof(struct statx));
+		if(stx == NULL)
+			break;
+		sqes[i] = io_uring_get_sqe(&ring);
+		if(sqes[i] == NULL)
+		{
+			free(stx);
+			break;
+		}
+		reqs[i].priv = stx;
+		io_uring_prep_statx(sqes[i], AT_FDCWD, reqs[i].url, 0,
+				    STATX_BASIC_STATS, stx);
+		io_uring_sqe_set_data(sqes[i], &reqs[i]);
+	}
+
+	/* Submit batch */
+	ret = i > 0 ? fs_posix_ring_submit(sqes, i) : 0;
+
+	/* Free statx of requests returned to worker pool */
+	for(; i > ret; i--)
+	{
+		free(reqs[i-1].priv);
+		reqs[i-1].priv = NULL;
+	}
+
+	/* Unlock ring */
+	pthread_mutex_unlock(&ring_mutex);
+
+	return ret;
+}
+#endif
+
 struct fs_handle fs_posix = {
 	.open = fs_posix_open,
 	.creat = fs_posix_creat,
@@ -303,6 +612,7 @@ struct fs_handle fs_posix = {
 	.write = fs_posix_write,
 	.write_to = fs_posix_write_to,
 	.lseek = fs_posix_lseek,
+	.pread = fs_posix_pread,
 	.ftruncate = fs_posix_ftruncate,
 	.close = fs_posix_close,
 	.mkdir = mkdir,
@@ -319,5 +629,9 @@ struct fs_handle fs_posix = {
 	.fstat = fs_posix_fstat,
 	.statvfs = statvfs,
 	.fstatvfs = fs_posix_fstatvfs,
+#ifdef HAVE_LIBURING
+	.aio_read = fs_posix_aio_read,
+	.aio_stat = fs_posix_aio_stat,
+#endif
 };
 
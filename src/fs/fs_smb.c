@@ -17,14 +17,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
+#include <time.h>
 #include <pthread.h>
 
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -33,10 +33,72 @@ static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 #include <libsmbclient.h>
 
+#include "realtime.h"
 #include "fs_smb.h"
 
 #define FS_SMB_TIMEOUT 10
 
+/* Pool of libsmbclient contexts: a context can't be used by two threads at
+ * the same time, so each thread is bound to its own context on first access,
+ * until FS_SMB_MAX_CONTEXT contexts are created: least used contexts are then
+ * shared. A context keeps its connections to servers and shares (with their
+ * authentication) until fs_smb_free().
+ */
+#define FS_SMB_MAX_CONTEXT 4
+
+struct fs_smb_context {
+	SMBCCTX *ctx;
+	/* Lock on context access */
+	pthread_mutex_t mutex;
+	/* Threads bound to context */
+	int users;
+	struct fs_smb_context *next;
+};
+
+static struct fs_smb_context *contexts = NULL;
+static pthread_mutex_t contexts_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t contexts_key;
+
+/* Read-ahead: a thread reads the FS_SMB_AHEAD_COUNT blocks of
+ * FS_SMB_AHEAD_SIZE bytes which follow current position of a file opened
+ * read-only, so a read is served from memory while next blocks are requested.
+ * It is started on first read which follows previous one without seek, and
+ * not used when file is read through block cache. Blocks are dropped on a seek
+ * out of them.
+ */
+#define FS_SMB_AHEAD_SIZE 65536
+#define FS_SMB_AHEAD_COUNT 4
+
+struct fs_smb_block {
+	off_t offset;
+	size_t len;
+	unsigned char data[FS_SMB_AHEAD_SIZE];
+};
+
+struct fs_smb_handle {
+	/* Context of opened file or directory */
+	struct fs_smb_context *c;
+	SMBCFILE *file;
+	/* Read-ahead can be started and previous read was sequential */
+	int ahead;
+	int sequential;
+	/* Read-ahead thread */
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+	/* Queue of blocks read after position (NULL without read-ahead) */
+	struct fs_smb_block *blocks;
+	unsigned int first;
+	unsigned int count;
+	/* Position of file and of next block to read */
+	off_t pos;
+	off_t next;
+	unsigned long seek_id;
+	int eof;
+	int error;
+};
+
 static void fs_smb_get_auth(const char *srv, const char *shr,
 			    char *wg, int wglen, char *un, int unlen,
 			    char *pw, int pwlen)
@@ -45,97 +107,491 @@ static void fs_smb_get_auth(const char *srv, const char *shr,
 	return;
 }
 
+static void fs_smb_unbind(void *data)
+{
+	struct fs_smb_context *c = data;
+
+	/* Thread has exited: its context can be used by another thread */
+	pthread_mutex_lock(&contexts_mutex);
+	c->users--;
+	pthread_mutex_unlock(&contexts_mutex);
+}
+
 void fs_smb_init(void)
 {
-	/* Initialize smbclient */
-	smbc_init(fs_smb_get_auth, 0);
+	/* Make libsmbclient thread safe */
+	smbc_thread_posix();
+
+	/* Create key for context of threads */
+	pthread_key_create(&contexts_key, fs_smb_unbind);
 
 	return;
 }
 
 void fs_smb_free(void)
 {
+	struct fs_smb_context *c;
+
+	/* Delete key of threads */
+	pthread_key_delete(contexts_key);
+
+	/* Free all contexts */
+	pthread_mutex_lock(&contexts_mutex);
+	while(contexts != NULL)
+	{
+		c = contexts;
+		contexts = c->next;
+
+		smbc_free_context(c->ctx, 1);
+		pthread_mutex_destroy(&c->mutex);
+		free(c);
+	}
+	pthread_mutex_unlock(&contexts_mutex);
+
 	return;
 }
 
+static struct fs_smb_context *fs_smb_new_context(void)
+{
+	struct fs_smb_context *c;
+
+	/* Allocate context */
+	c = calloc(1, sizeof(struct fs_smb_context));
+	if(c == NULL)
+		return NULL;
+
+	/* Create libsmbclient context */
+	c->ctx = smbc_new_context();
+	if(c->ctx == NULL)
+	{
+		free(c);
+		return NULL;
+	}
+	smbc_setDebug(c->ctx, 0);
+	smbc_setFunctionAuthData(c->ctx, fs_smb_get_auth);
+
+	/* Initialize context */
+	if(smbc_init_context(c->ctx) == NULL)
+	{
+		smbc_free_context(c->ctx, 1);
+		free(c);
+		return NULL;
+	}
+	pthread_mutex_init(&c->mutex, NULL);
+
+	return c;
+}
+
+/* Get context of current thread: a context is bound on first call */
+static struct fs_smb_context *fs_smb_get_context(void)
+{
+	struct fs_smb_context *c, *best = NULL;
+	int count = 0;
+
+	/* Context already bound to thread */
+	c = pthread_getspecific(contexts_key);
+	if(c != NULL)
+		return c;
+
+	/* Lock pool */
+	pthread_mutex_lock(&contexts_mutex);
+
+	/* Find least used context */
+	for(c = contexts; c != NULL; c = c->next, count++)
+	{
+		if(best == NULL || c->users < best->users)
+			best = c;
+	}
+
+	/* Create a new context if all are used */
+	if((best == NULL || best->users > 0) && count < FS_SMB_MAX_CONTEXT)
+	{
+		c = fs_smb_new_context();
+		if(c != NULL)
+		{
+			c->next = contexts;
+			contexts = c;
+			best = c;
+		}
+	}
+
+	/* Bind context to thread */
+	if(best != NULL)
+	{
+		best->users++;
+		pthread_setspecific(contexts_key, best);
+	}
+	else
+		errno = ENOMEM;
+
+	/* Unlock pool */
+	pthread_mutex_unlock(&contexts_mutex);
+
+	return best;
+}
+
+static void *fs_smb_thread(void *user_data)
+{
+	struct fs_smb_handle *h = user_data;
+	SMBCCTX *ctx = h->c->ctx;
+	struct fs_smb_block *b;
+	unsigned long seek_id;
+	off_t offset;
+	ssize_t len;
+
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "smb-read-ahead");
+
+	/* Lock queue */
+	pthread_mutex_lock(&h->mutex);
+
+	while(!h->stop)
+	{
+		/* Wait for a free block */
+		if(h->count == FS_SMB_AHEAD_COUNT || h->eof || h->error)
+		{
+			pthread_cond_wait(&h->cond, &h->mutex);
+			continue;
+		}
+
+		/* Get next block: it is not accessed by reader until it is
+		 * added to queue.
+		 */
+		b = &h->blocks[(h->first + h->count) % FS_SMB_AHEAD_COUNT];
+		offset = h->next;
+		seek_id = h->seek_id;
+
+		/* Unlock queue */
+		pthread_mutex_unlock(&h->mutex);
+
+		/* Lock context access */
+		pthread_mutex_lock(&h->c->mutex);
+
+		/* Read block */
+		len = -1;
+		if(smbc_getFunctionLseek(ctx)(ctx, h->file, offset, SEEK_SET) ==
+		   offset)
+		{
+			while((len = smbc_getFunctionRead(ctx)(ctx, h->file,
+					   b->data, FS_SMB_AHEAD_SIZE)) < 0)
+			{
+				/* Skip timeout */
+				if(errno != EAGAIN)
+					break;
+			}
+		}
+
+		/* Unlock context access */
+		pthread_mutex_unlock(&h->c->mutex);
+
+		/* Lock queue */
+		pthread_mutex_lock(&h->mutex);
+
+		/* Position has changed during read: drop block */
+		if(seek_id != h->seek_id)
+			continue;
+
+		/* Add block to queue */
+		if(len > 0)
+		{
+			b->offset = offset;
+			b->len = len;
+			h->next += len;
+			h->count++;
+		}
+		else if(len == 0)
+			h->eof = 1;
+		else
+			h->error = 1;
+
+		/* Wake up reader */
+		pthread_cond_broadcast(&h->cond);
+	}
+
+	/* Unlock queue */
+	pthread_mutex_unlock(&h->mutex);
+
+	return NULL;
+}
+
 static int fs_smb_open(struct fs_file *f, const char *url, int flags,
 		       mode_t mode)
 {
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	struct fs_smb_handle *h;
+	struct fs_smb_context *c;
+
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Allocate handle */
+	f->fd = -1;
+	f->data = h = calloc(1, sizeof(struct fs_smb_handle));
+	if(h == NULL)
+		return -1;
+	h->c = c;
+
+	/* Read-ahead is only used for read-only files not cached */
+	h->ahead = (flags & O_ACCMODE) == O_RDONLY && !(flags & FS_O_CACHED);
+	flags &= ~FS_O_CACHED;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Open file */
-	f->fd = smbc_open(url, flags, mode);
+	h->file = smbc_getFunctionOpen(c->ctx)(c->ctx, url, flags, mode);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
-	/* Bad file descriptor */
-	if(f->fd < SMBC_BASE_FD)
+	/* Bad file */
+	if(h->file == NULL)
+	{
+		free(h);
+		f->data = NULL;
 		return -1;
+	}
 
 	return 0;
 }
 
 static int fs_smb_creat(struct fs_file *f, const char *url, mode_t mode)
 {
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	struct fs_smb_handle *h;
+	struct fs_smb_context *c;
+
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Allocate handle */
+	f->fd = -1;
+	f->data = h = calloc(1, sizeof(struct fs_smb_handle));
+	if(h == NULL)
+		return -1;
+	h->c = c;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Create file */
-	f->fd = smbc_creat(url, mode);
+	h->file = smbc_getFunctionCreat(c->ctx)(c->ctx, url, mode);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
-	/* Bad file descriptor */
-	if(f->fd < SMBC_BASE_FD)
+	/* Bad file */
+	if(h->file == NULL)
+	{
+		free(h);
+		f->data = NULL;
 		return -1;
+	}
 
 	return 0;
 }
 
+static void fs_smb_start_ahead(struct fs_smb_handle *h)
+{
+	/* Start only once: file is read directly on failure */
+	h->ahead = 0;
+
+	/* Allocate blocks */
+	h->blocks = malloc(FS_SMB_AHEAD_COUNT * sizeof(struct fs_smb_block));
+	if(h->blocks == NULL)
+		return;
+	pthread_mutex_init(&h->mutex, NULL);
+	pthread_cond_init(&h->cond, NULL);
+	h->next = h->pos;
+
+	/* Start read-ahead thread */
+	if(pthread_create(&h->thread, NULL, fs_smb_thread, h) != 0)
+	{
+		pthread_cond_destroy(&h->cond);
+		pthread_mutex_destroy(&h->mutex);
+		free(h->blocks);
+		h->blocks = NULL;
+	}
+}
+
+/* Read from queue of read-ahead thread: return 0 on timeout and -1 at end of
+ * file or on error, as fs_smb_read_to().
+ */
+static ssize_t fs_smb_read_ahead(struct fs_smb_handle *h, void *buf,
+				 size_t count, long timeout)
+{
+	struct fs_smb_block *b;
+	struct timespec ts;
+	size_t done = 0;
+	ssize_t len = -1;
+	size_t offset;
+
+	/* Calculate end of wait */
+	if(timeout >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000;
+		if(ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	/* Lock queue */
+	pthread_mutex_lock(&h->mutex);
+
+	while(1)
+	{
+		/* Drop blocks before position */
+		while(h->count > 0)
+		{
+			b = &h->blocks[h->first];
+			if(b->offset + (off_t) b->len > h->pos)
+				break;
+			h->first = (h->first + 1) % FS_SMB_AHEAD_COUNT;
+			h->count--;
+			pthread_cond_broadcast(&h->cond);
+		}
+
+		/* Copy data from first block */
+		b = &h->blocks[h->first];
+		if(h->count > 0 && b->offset <= h->pos)
+		{
+			offset = h->pos - b->offset;
+			len = b->len - offset;
+			if((size_t) len > count - done)
+				len = count - done;
+			memcpy((unsigned char *) buf + done, b->data + offset,
+			       len);
+			h->pos += len;
+			done += len;
+
+			/* Blocking read continues with next blocks until count
+			 * is reached
+			 */
+			if(done == count || timeout >= 0)
+				break;
+			continue;
+		}
+
+		/* Position is out of queue: restart read-ahead from it */
+		if(h->count > 0 || h->next != h->pos)
+		{
+			h->seek_id++;
+			h->first = 0;
+			h->count = 0;
+			h->next = h->pos;
+			h->eof = 0;
+			h->error = 0;
+			pthread_cond_broadcast(&h->cond);
+		}
+
+		/* End of file or error */
+		if(h->eof || h->error)
+		{
+			/* Return data already copied */
+			if(done > 0)
+				break;
+
+			/* Retry read on next call */
+			if(h->error)
+			{
+				h->error = 0;
+				pthread_cond_broadcast(&h->cond);
+			}
+			len = -1;
+			break;
+		}
+
+		/* Wait for next block */
+		if(timeout < 0)
+			pthread_cond_wait(&h->cond, &h->mutex);
+		else if(pthread_cond_timedwait(&h->cond, &h->mutex, &ts) ==
+			ETIMEDOUT)
+		{
+			len = 0;
+			break;
+		}
+	}
+
+	/* Unlock queue */
+	pthread_mutex_unlock(&h->mutex);
+
+	return done > 0 ? done : len;
+}
+
 static ssize_t fs_smb_read(struct fs_file *f, void *buf, size_t count)
 {
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
 	ssize_t len;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Start read-ahead on sequential read */
+	if(h->ahead && h->sequential)
+		fs_smb_start_ahead(h);
+
+	/* Read from read-ahead queue */
+	if(h->blocks != NULL)
+		return fs_smb_read_ahead(h, buf, count, -1);
+
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Wait until data or error */
-	while((len = smbc_read(f->fd, buf, count)) < 0)
+	while((len = smbc_getFunctionRead(ctx)(ctx, h->file, buf, count)) < 0)
 	{
 		/* Skip timeout */
 		if(errno != EAGAIN)
 			break;
 	}
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	/* End of file */
 	if(len == 0)
 		return -1;
 
+	/* Update position */
+	if(len > 0)
+	{
+		h->pos += len;
+		h->sequential = 1;
+	}
+
 	return len;
 }
 
 static ssize_t fs_smb_read_to(struct fs_file *f, void *buf, size_t count,
 				long timeout)
 {
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
 	ssize_t len;
 
 	/* No timeout */
 	if(timeout == -1)
 		return fs_smb_read(f, buf, count);
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Start read-ahead on sequential read */
+	if(h->ahead && h->sequential)
+		fs_smb_start_ahead(h);
+
+	/* Read from read-ahead queue */
+	if(h->blocks != NULL)
+		return fs_smb_read_ahead(h, buf, count, timeout);
+
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Wait timeout */
 	do {
 		/* Attempt to read */
-		len = smbc_read(f->fd, buf, count);
+		len = smbc_getFunctionRead(ctx)(ctx, h->file, buf, count);
 		if(len <= 0)
 		{
 			/* End of file */
@@ -149,29 +605,38 @@ static ssize_t fs_smb_read_to(struct fs_file *f, void *buf, size_t count,
 		timeout -= FS_SMB_TIMEOUT;
 	} while(timeout > 0);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
+
+	/* Update position */
+	if(len > 0)
+	{
+		h->pos += len;
+		h->sequential = 1;
+	}
 
 	return len;
 }
 
 static ssize_t fs_smb_write(struct fs_file *f, const void *buf, size_t count)
 {
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
 	ssize_t len;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Wait until data or error */
-	while((len = smbc_write(f->fd, buf, count)) < 0)
+	while((len = smbc_getFunctionWrite(ctx)(ctx, h->file, buf, count)) < 0)
 	{
 		/* Skip timeout */
 		if(errno != EAGAIN)
 			break;
 	}
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	/* End of file */
 	if(len == 0)
@@ -183,19 +648,21 @@ static ssize_t fs_smb_write(struct fs_file *f, const void *buf, size_t count)
 static ssize_t fs_smb_write_to(struct fs_file *f, const void *buf,
 				 size_t count, long timeout)
 {
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
 	ssize_t len;
 
 	/* No timeout */
 	if(timeout == -1)
 		return fs_smb_write(f, buf, count);
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Wait timeout */
 	do {
 		/* Attempt to write */
-		len = smbc_write(f->fd, buf, count);
+		len = smbc_getFunctionWrite(ctx)(ctx, h->file, buf, count);
 		if(len <= 0)
 		{
 			/* End of file */
@@ -209,153 +676,290 @@ static ssize_t fs_smb_write_to(struct fs_file *f, const void *buf,
 		timeout -= FS_SMB_TIMEOUT;
 	} while(timeout > 0);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	return len;
 }
 
 static off_t fs_smb_lseek(struct fs_file *f, off_t offset, int whence)
 {
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
 	off_t ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Position of a read-ahead file is only updated: its blocks are
+	 * dropped on next read if position is out of them.
+	 */
+	if(h->blocks != NULL && (whence == SEEK_SET || whence == SEEK_CUR))
+	{
+		pthread_mutex_lock(&h->mutex);
+		ret = whence == SEEK_CUR ? h->pos + offset : offset;
+		if(ret >= 0)
+			h->pos = ret;
+		pthread_mutex_unlock(&h->mutex);
+
+		if(ret < 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		return ret;
+	}
+
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Lseek */
-	ret = smbc_lseek(f->fd, offset, whence);
+	ret = smbc_getFunctionLseek(ctx)(ctx, h->file, offset, whence);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
+
+	/* Update position: next read is not sequential */
+	if(h->blocks != NULL && ret >= 0)
+	{
+		pthread_mutex_lock(&h->mutex);
+		h->pos = ret;
+		pthread_mutex_unlock(&h->mutex);
+	}
+	else if(ret >= 0)
+	{
+		h->pos = ret;
+		h->sequential = 0;
+	}
 
 	return ret;
 }
 
+static ssize_t fs_smb_pread(struct fs_file *f, void *buf, size_t count,
+			    off_t offset)
+{
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
+	ssize_t len = -1;
+	off_t pos;
+
+	/* Lock context access: file is not used by another call */
+	pthread_mutex_lock(&h->c->mutex);
+
+	/* Read at offset and restore position of file */
+	pos = smbc_getFunctionLseek(ctx)(ctx, h->file, 0, SEEK_CUR);
+	if(pos >= 0 &&
+	   smbc_getFunctionLseek(ctx)(ctx, h->file, offset, SEEK_SET) == offset)
+	{
+		while((len = smbc_getFunctionRead(ctx)(ctx, h->file, buf,
+						       count)) < 0)
+		{
+			/* Skip timeout */
+			if(errno != EAGAIN)
+				break;
+		}
+		smbc_getFunctionLseek(ctx)(ctx, h->file, pos, SEEK_SET);
+	}
+
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
+
+	return len;
+}
+
 static int fs_smb_ftruncate(struct fs_file *f, off_t length)
 {
+	struct fs_smb_handle *h = f->data;
+	SMBCCTX *ctx = h->c->ctx;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Ftruncate */
-	ret = smbc_ftruncate(f->fd, length);
+	ret = smbc_getFunctionFtruncate(ctx)(ctx, h->file, length);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	return ret;
 }
 
 static void fs_smb_close(struct fs_file *f)
 {
-	if(f->fd < SMBC_BASE_FD)
+	struct fs_smb_handle *h = f->data;
+
+	if(h == NULL)
 		return;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Stop read-ahead thread */
+	if(h->blocks != NULL)
+	{
+		pthread_mutex_lock(&h->mutex);
+		h->stop = 1;
+		pthread_cond_broadcast(&h->cond);
+		pthread_mutex_unlock(&h->mutex);
+		pthread_join(h->thread, NULL);
+
+		pthread_cond_destroy(&h->cond);
+		pthread_mutex_destroy(&h->mutex);
+		free(h->blocks);
+	}
+
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Close file */
-	smbc_close(f->fd);
+	smbc_getFunctionClose(h->c->ctx)(h->c->ctx, h->file);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
+
+	/* Free handle */
+	free(h);
+	f->data = NULL;
 }
 
 static int fs_smb_mkdir(const char *url, mode_t mode)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Mkdir */
-	ret = smbc_mkdir(url, mode);
+	ret = smbc_getFunctionMkdir(c->ctx)(c->ctx, url, mode);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_unlink(const char *url)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Unlink */
-	ret = smbc_unlink(url);
+	ret = smbc_getFunctionUnlink(c->ctx)(c->ctx, url);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_rmdir(const char *url)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Rmdir */
-	ret = smbc_rmdir(url);
+	ret = smbc_getFunctionRmdir(c->ctx)(c->ctx, url);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_rename(const char *oldurl, const char *newurl)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Rename */
-	ret = smbc_rename(oldurl, newurl);
+	ret = smbc_getFunctionRename(c->ctx)(c->ctx, oldurl, c->ctx, newurl);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_chmod(const char *url, mode_t mode)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Chmod */
-	ret = smbc_chmod(url, mode);
+	ret = smbc_getFunctionChmod(c->ctx)(c->ctx, url, mode);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_opendir(struct fs_dir *d, const char *url)
 {
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	struct fs_smb_handle *h;
+	struct fs_smb_context *c;
+
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Allocate handle */
+	d->fd = -1;
+	d->data = h = calloc(1, sizeof(struct fs_smb_handle));
+	if(h == NULL)
+		return -1;
+	h->c = c;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Open directory */
-	d->fd = smbc_opendir(url);
+	h->file = smbc_getFunctionOpendir(c->ctx)(c->ctx, url);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
-	/* Bad file descriptor */
-	if(d->fd < SMBC_BASE_FD)
+	/* Bad directory */
+	if(h->file == NULL)
+	{
+		free(h);
+		d->data = NULL;
 		return -1;
+	}
 
 	return 0;
 }
@@ -367,20 +971,23 @@ static int fs_smb_mount(struct fs_dir *d)
 
 static struct fs_dirent *fs_smb_readdir(struct fs_dir *d)
 {
+	struct fs_smb_handle *h = d->data;
 	struct smbc_dirent *dir;
+	SMBCCTX *ctx;
 
-	if(d->fd < SMBC_BASE_FD)
+	if(h == NULL)
 		return NULL;
+	ctx = h->c->ctx;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Read directory entry */
-	dir = smbc_readdir(d->fd);
+	dir = smbc_getFunctionReaddir(ctx)(ctx, h->file);
 	if(dir == NULL)
 	{
-		/* Unlock libsmbclient access */
-		pthread_mutex_unlock(&mutex);
+		/* Unlock context access */
+		pthread_mutex_unlock(&h->c->mutex);
 		return NULL;
 	}
 
@@ -389,8 +996,10 @@ static struct fs_dirent *fs_smb_readdir(struct fs_dir *d)
 	d->c_dirent.offset = 0;
 	d->c_dirent.comment_len = dir->commentlen;
 	d->c_dirent.comment = dir->comment;
-	d->c_dirent.name_len = dir->namelen;
-	strncpy(d->c_dirent.name, dir->name, 256);
+	d->c_dirent.has_stat = 0;
+	strncpy(d->c_dirent.name, dir->name, 255);
+	d->c_dirent.name[255] = '\0';
+	d->c_dirent.name_len = strlen(d->c_dirent.name);
 
 	/* Get type */
 	switch(dir->smbc_type)
@@ -411,107 +1020,129 @@ static struct fs_dirent *fs_smb_readdir(struct fs_dir *d)
 			d->c_dirent.type = FS_DIR;
 	}
 
-	/* Generate path */
-	strncpy(&d->url[d->url_len], dir->name, dir->namelen);
-	d->url[d->url_len+dir->namelen] = '\0';
+	/* Entry is only stat on demand: type is given by server */
 
-	/* Stat directory */
-	smbc_stat(d->url, &d->c_dirent.stat);
-
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	return &d->c_dirent;
 }
 
 static off_t fs_smb_telldir(struct fs_dir *d)
 {
+	struct fs_smb_handle *h = d->data;
 	off_t ret;
 
-	if(d->fd < SMBC_BASE_FD)
+	if(h == NULL)
 		return -1;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Telldir */
-	ret = smbc_telldir(d->fd);
+	ret = smbc_getFunctionTelldir(h->c->ctx)(h->c->ctx, h->file);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	return ret;
 }
 
 static void fs_smb_closedir(struct fs_dir *d)
 {
-	if(d->fd < SMBC_BASE_FD)
+	struct fs_smb_handle *h = d->data;
+
+	if(h == NULL)
 		return;
 
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
+
 	/* Close directory */
-	smbc_closedir(d->fd);
+	smbc_getFunctionClosedir(h->c->ctx)(h->c->ctx, h->file);
+
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
+
+	/* Free handle */
+	free(h);
+	d->data = NULL;
 }
 
 static int fs_smb_stat(const char *url, struct stat *buf)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Stat file */
-	ret = smbc_stat(url, buf);
+	ret = smbc_getFunctionStat(c->ctx)(c->ctx, url, buf);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_fstat(struct fs_file *f, struct stat *buf)
 {
+	struct fs_smb_handle *h = f->data;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Fstat file */
-	ret = smbc_fstat(f->fd, buf);
+	ret = smbc_getFunctionFstat(h->c->ctx)(h->c->ctx, h->file, buf);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_statvfs(const char *url, struct statvfs *buf)
 {
+	struct fs_smb_context *c;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Get context of thread */
+	c = fs_smb_get_context();
+	if(c == NULL)
+		return -1;
+
+	/* Lock context access */
+	pthread_mutex_lock(&c->mutex);
 
 	/* Statvfs file */
-	ret = smbc_statvfs((char*)url, buf);
+	ret = smbc_getFunctionStatVFS(c->ctx)(c->ctx, (char*)url, buf);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&c->mutex);
 
 	return ret;
 }
 
 static int fs_smb_fstatvfs(struct fs_file *f, struct statvfs *buf)
 {
+	struct fs_smb_handle *h = f->data;
 	int ret;
 
-	/* Lock libsmbclient access */
-	pthread_mutex_lock(&mutex);
+	/* Lock context access */
+	pthread_mutex_lock(&h->c->mutex);
 
 	/* Fstatvfs file */
-	ret = smbc_fstatvfs(f->fd, buf);
+	ret = smbc_getFunctionFstatVFS(h->c->ctx)(h->c->ctx, h->file, buf);
 
-	/* Unlock libsmbclient access */
-	pthread_mutex_unlock(&mutex);
+	/* Unlock context access */
+	pthread_mutex_unlock(&h->c->mutex);
 
 	return ret;
 }
@@ -524,6 +1155,7 @@ struct fs_handle fs_smb = {
 	.write = fs_smb_write,
 	.write_to = fs_smb_write_to,
 	.lseek = fs_smb_lseek,
+	.pread = fs_smb_pread,
 	.ftruncate = fs_smb_ftruncate,
 	.close = fs_smb_close,
 	.mkdir = fs_smb_mkdir,
@@ -540,6 +1172,7 @@ struct fs_handle fs_smb = {
 	.fstat = fs_smb_fstat,
 	.statvfs = fs_smb_statvfs,
 	.fstatvfs = fs_smb_fstatvfs,
+	.remote = 1,
 };
 
 #endif
@@ -1,10 +1,12 @@
 /*
  * http.c - A Tiny HTTP Client
  *
- * Support only HTTP 1.0 with:
+ * Support HTTP 1.0 and HTTP 1.1 with:
  * 	- Basic HTTP Proxy (no auth!)
  * 	- Basic Auth
  *	- Follow redirection
+ *	- Persistent connections (keep-alive)
+ *	- Chunked transfer encoding
  *
  * Copyright (c) 2014   A. Dilly
  *
@@ -24,18 +26,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <netdb.h>
 #include <pthread.h>
 
 #define BUFFER_SIZE 8192
 #define MAX_SIZE_HEADER BUFFER_SIZE
 #define MAX_SIZE_LINE 512
+#define RX_BUFFER_SIZE 16384
 #define DEFAULT_USER_AGENT "tiny_http 0.1"
 #define MAX_FOLLOW 10
+#define RESOLVE_TIMEOUT 5000
+
+/* Connection to server (in ms):
+ *  - CONNECT_TIMEOUT: default time to establish connection (with TLS
+ *                     handshake),
+ *  - CONNECT_DELAY: delay before trying next address of server when previous
+ *                   attempts have not yet succeeded (see RFC 8305).
+ */
+#define CONNECT_TIMEOUT 10000
+#define CONNECT_DELAY 250
+
+/* Keep-alive connection pool:
+ *  - POOL_SIZE: maximum idle connections kept for all hosts,
+ *  - POOL_HOST_SIZE: maximum idle connections kept for one host,
+ *  - POOL_TIMEOUT: idle time after which a connection is closed (in s),
+ *  - DRAIN_SIZE: maximum of unread response data which is read and dropped
+ *                to reuse a connection instead of closing it.
+ */
+#define POOL_SIZE 8
+#define POOL_HOST_SIZE 2
+#define POOL_TIMEOUT 15
+#define DRAIN_SIZE 65536
+
+/* TLS sessions kept to resume handshake with a server (one per host/port) */
+#define SESSION_CACHE_SIZE 16
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -45,6 +80,8 @@
 #include <openssl/ssl.h>
 #endif
 
+#include "realtime.h"
+#include "resolver.h"
 #include "utils.h"
 #include "http.h"
 
@@ -54,17 +91,53 @@ struct http_header {
 	struct http_header *next;
 };
 
+/* Idle connection in pool */
+struct http_conn {
+	int sock;
+	char *hostname;
+	unsigned int port;
+	int is_ssl;
+#ifdef HAVE_OPENSSL
+	SSL *ssl;
+#endif
+	time_t time;
+	struct http_conn *next;
+};
+
+#ifdef HAVE_OPENSSL
+/* TLS session of a server */
+struct http_session {
+	char *hostname;
+	unsigned int port;
+	SSL_SESSION *session;
+	struct http_session *next;
+};
+#endif
+
 struct http_handle {
 	/* Socket */
 	int sock;
 	char *hostname;
 	unsigned int port;
+	int reused;
 	/* SSL part */
 	int is_ssl;
 #ifdef HAVE_OPENSSL
 	SSL *ssl;
-	SSL_CTX *ssl_ctx;
 #endif
+	/* Response body */
+	int reuse;		/*!< Connection can be kept after body */
+	int chunked;		/*!< Transfer-Encoding is chunked */
+	int body_end;		/*!< All body has been read */
+	long long body_len;	/*!< Remaining length of body (or of current
+				     chunk), -1 when body ends with connection */
+	int chunk_trailer;	/*!< Last chunk read: skip trailer */
+	char chunk_line[MAX_SIZE_LINE];	/*!< Chunk size or trailer line */
+	int chunk_line_len;	/*!< Length of partial line in chunk_line */
+	/* Receive buffer */
+	unsigned char rx_buffer[RX_BUFFER_SIZE];
+	size_t rx_pos;		/*!< Position of first unread byte */
+	size_t rx_len;		/*!< Length of received data in buffer */
 	/* Proxy config */
 	int proxy_use;
 	char *proxy_hostname;
@@ -78,6 +151,10 @@ struct http_handle {
 	char *extra;
 	int keep_alive;
 	struct http_header *headers;
+	/* Socket config */
+	unsigned int connect_timeout;
+	int tcp_nodelay;
+	unsigned int rcvbuf;
 	/* Thread */
 	pthread_t thread;
 	pthread_mutex_t mutex;
@@ -105,8 +182,25 @@ static unsigned int proxy_port = 0;
 static char *extra = NULL;
 static int follow = 0;
 static int max_follow = MAX_FOLLOW;
+static int keep_alive = 1;
+static unsigned int connect_timeout = CONNECT_TIMEOUT;
+static int tcp_nodelay = 1;
+static unsigned int rcvbuf = 0;
 static pthread_mutex_t def_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Idle connections shared by all handles */
+static struct http_conn *pool = NULL;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef HAVE_OPENSSL
+/* TLS context and client session cache shared by all handles: most recently
+ * used sessions are first.
+ */
+static SSL_CTX *ssl_ctx = NULL;
+static struct http_session *sessions = NULL;
+static pthread_mutex_t ssl_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 int http_set_default_option(int option, const char *c_value,
 			    unsigned int i_value)
 {
@@ -142,6 +236,18 @@ int http_set_default_option(int option, const char *c_value,
 			if(max_follow <= 0)
 				max_follow = 1;
 			break;
+		case HTTP_KEEP_ALIVE:
+			keep_alive = i_value;
+			break;
+		case HTTP_CONNECT_TIMEOUT:
+			connect_timeout = i_value;
+			break;
+		case HTTP_TCP_NODELAY:
+			tcp_nodelay = i_value;
+			break;
+		case HTTP_RCVBUF:
+			rcvbuf = i_value;
+			break;
 	}
 
 	/* Unlock default configuration */
@@ -180,6 +286,18 @@ int http_get_default_option(int option, char **c_value, unsigned int *i_value)
 		case HTTP_MAX_REDIRECT:
 			*i_value = max_follow;
 			break;
+		case HTTP_KEEP_ALIVE:
+			*i_value = keep_alive;
+			break;
+		case HTTP_CONNECT_TIMEOUT:
+			*i_value = connect_timeout;
+			break;
+		case HTTP_TCP_NODELAY:
+			*i_value = tcp_nodelay;
+			break;
+		case HTTP_RCVBUF:
+			*i_value = rcvbuf;
+			break;
 	}
 
 	/* Unlock default configuration */
@@ -216,6 +334,9 @@ int http_open(struct http_handle **handle, int use_default)
 	memset(h, 0, sizeof(struct http_handle));
 	h->sock = -1;
 	h->max_follow = MAX_FOLLOW;
+	h->keep_alive = 1;
+	h->connect_timeout = CONNECT_TIMEOUT;
+	h->tcp_nodelay = 1;
 
 	/* Use default configuration */
 	if(use_default)
@@ -232,6 +353,10 @@ int http_open(struct http_handle **handle, int use_default)
 		h->extra = extra != NULL ? strdup(extra) : NULL;
 		h->follow = follow;
 		h->max_follow = max_follow;
+		h->keep_alive = keep_alive;
+		h->connect_timeout = connect_timeout;
+		h->tcp_nodelay = tcp_nodelay;
+		h->rcvbuf = rcvbuf;
 
 		/* Unlock default configuration */
 		pthread_mutex_unlock(&def_mutex);
@@ -276,6 +401,18 @@ int http_set_option(struct http_handle *h, int option, const char *c_value,
 			if(h->max_follow <= 0)
 				h->max_follow = 1;
 			break;
+		case HTTP_KEEP_ALIVE:
+			h->keep_alive = i_value;
+			break;
+		case HTTP_CONNECT_TIMEOUT:
+			h->connect_timeout = i_value;
+			break;
+		case HTTP_TCP_NODELAY:
+			h->tcp_nodelay = i_value;
+			break;
+		case HTTP_RCVBUF:
+			h->rcvbuf = i_value;
+			break;
 		default:
 			return -1;
 	}
@@ -283,64 +420,649 @@ int http_set_option(struct http_handle *h, int option, const char *c_value,
 	return 0;
 }
 
-static int http_connect(struct http_handle *h, char *hostname,
-			unsigned int port)
+static time_t http_time(void)
 {
-	struct sockaddr_in server_addr;
-	struct hostent *server_ip;
+	struct timespec ts;
 
-	/* Check if a socket is already opened */
-	if(h->sock >= 0)
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static long long http_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+#ifdef HAVE_OPENSSL
+/* Free a TLS connection: on a clean close, a close notify is sent and the one of
+ * server is read if it has already been received, so OpenSSL keeps session
+ * resumable. Otherwise, session is not resumable and caller must remove it from
+ * cache.
+ */
+static void http_ssl_free(SSL *ssl, int sock, int clean)
+{
+	struct pollfd pfd;
+
+	if(clean)
 	{
-		/* Check keep_alive and if hostname/port have changed */
-		if(h->keep_alive && strcmp(h->hostname, hostname) == 0 &&
-		   h->port == port)
-			return 0;
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		if(SSL_shutdown(ssl) == 0 && poll(&pfd, 1, 0) > 0)
+			SSL_shutdown(ssl);
+	}
+	SSL_free(ssl);
+}
+
+static void http_session_free(struct http_session *s)
+{
+	SSL_SESSION_free(s->session);
+	free(s->hostname);
+	free(s);
+}
+
+/* Called by OpenSSL when server sends a new session (or ticket) */
+static int http_session_new(SSL *ssl, SSL_SESSION *session)
+{
+	struct http_handle *h = SSL_get_app_data(ssl);
+	struct http_session *s, **p, **last;
+	int count = 0;
+
+	if(h == NULL || h->hostname == NULL)
+		return 0;
 
-		/* Close previous socket */
+	/* Lock session cache */
+	pthread_mutex_lock(&ssl_mutex);
+
+	/* Remove previous session of server */
+	for(p = &sessions; *p != NULL; p = &(*p)->next)
+	{
+		s = *p;
+		if(s->port == h->port && strcmp(s->hostname, h->hostname) == 0)
+		{
+			*p = s->next;
+			http_session_free(s);
+			break;
+		}
+	}
+
+	/* Add session: cache keeps reference given by OpenSSL */
+	s = malloc(sizeof(struct http_session));
+	if(s == NULL || (s->hostname = strdup(h->hostname)) == NULL)
+	{
+		pthread_mutex_unlock(&ssl_mutex);
+		free(s);
+		return 0;
+	}
+	s->port = h->port;
+	s->session = session;
+	s->next = sessions;
+	sessions = s;
+
+	/* Remove least recently used session when cache is full */
+	for(p = &sessions, last = NULL; *p != NULL; p = &(*p)->next, count++)
+		last = p;
+	if(count > SESSION_CACHE_SIZE)
+	{
+		s = *last;
+		*last = NULL;
+		http_session_free(s);
+	}
+
+	/* Unlock session cache */
+	pthread_mutex_unlock(&ssl_mutex);
+
+	return 1;
+}
+
+/* Create a TLS connection with shared context and last session of server */
+static SSL *http_ssl_new(struct http_handle *h)
+{
+	struct http_session *s, **p;
+	struct in6_addr addr;
+	SSL *ssl = NULL;
+
+	/* Lock session cache */
+	pthread_mutex_lock(&ssl_mutex);
+
+	/* Create openssl context */
+	if(ssl_ctx == NULL)
+	{
+		SSL_library_init();
+		ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+		if(ssl_ctx == NULL)
+			goto end;
+
+		/* Sessions are stored in cache by callback */
+		SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_CLIENT |
+					       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ssl_ctx, http_session_new);
+	}
+
+	/* Create a new SSL object */
+	ssl = SSL_new(ssl_ctx);
+	if(ssl == NULL)
+		goto end;
+	SSL_set_app_data(ssl, h);
+
+	/* Send server name (SNI) when it is not an IP address */
+	if(inet_pton(AF_INET, h->hostname, &addr) != 1 &&
+	   inet_pton(AF_INET6, h->hostname, &addr) != 1)
+		SSL_set_tlsext_host_name(ssl, h->hostname);
+
+	/* Resume last session with server */
+	for(p = &sessions; *p != NULL; p = &(*p)->next)
+	{
+		s = *p;
+		if(s->port == h->port && strcmp(s->hostname, h->hostname) == 0)
+		{
+			SSL_set_session(ssl, s->session);
+			*p = s->next;
+			s->next = sessions;
+			sessions = s;
+			break;
+		}
+	}
+
+end:
+	/* Unlock session cache */
+	pthread_mutex_unlock(&ssl_mutex);
+
+	return ssl;
+}
+
+/* Remove session of server when handshake has failed or when connection has not
+ * been closed cleanly.
+ */
+static void http_session_remove(struct http_handle *h)
+{
+	struct http_session *s, **p;
+
+	/* Lock session cache */
+	pthread_mutex_lock(&ssl_mutex);
+
+	for(p = &sessions; *p != NULL; p = &(*p)->next)
+	{
+		s = *p;
+		if(s->port == h->port && strcmp(s->hostname, h->hostname) == 0)
+		{
+			*p = s->next;
+			http_session_free(s);
+			break;
+		}
+	}
+
+	/* Unlock session cache */
+	pthread_mutex_unlock(&ssl_mutex);
+}
+#endif
+
+static void http_conn_close(struct http_conn *c)
+{
+#ifdef HAVE_OPENSSL
+	if(c->ssl != NULL)
+		http_ssl_free(c->ssl, c->sock, 1);
+#endif
+	if(c->sock >= 0)
+		close(c->sock);
+	FREE_STR(c->hostname);
+	free(c);
+}
+
+/* Close connection of handle: clean is 0 when connection is closed on an error
+ * or before end of response, then TLS session of server is not resumed.
+ */
+static void http_disconnect(struct http_handle *h, int clean)
+{
+	/* Close socket */
+	if(h->sock >= 0)
+	{
+#ifdef HAVE_OPENSSL
+		if(h->ssl != NULL)
+		{
+			http_ssl_free(h->ssl, h->sock, clean);
+			if(!clean && h->hostname != NULL)
+				http_session_remove(h);
+		}
+		h->ssl = NULL;
+#endif
 		close(h->sock);
+		h->sock = -1;
 	}
 
 	/* Reset hostname and port */
 	FREE_STR(h->hostname);
 	h->port = 0;
+	h->reuse = 0;
+
+	/* Drop received data */
+	h->rx_pos = 0;
+	h->rx_len = 0;
+}
+
+/* Move connection of handle to pool when its response has been fully read and
+ * server allows it, otherwise close it.
+ */
+static void http_release(struct http_handle *h)
+{
+	struct http_conn *c, **p, **last, **last_host;
+	int count, host_count;
+	time_t now;
 
-	/* Open socket to HTTP server */
-	h->sock = socket(AF_INET, SOCK_STREAM, 0);
 	if(h->sock < 0)
+		return;
+
+	/* Connection cannot be reused: data received after end of body is not
+	 * expected since no other request has been sent.
+	 */
+	if(!h->reuse || !h->body_end || h->rx_pos != h->rx_len)
+	{
+		http_disconnect(h, h->body_end && h->rx_pos == h->rx_len);
+		return;
+	}
+
+	/* Allocate pool entry */
+	c = malloc(sizeof(struct http_conn));
+	if(c == NULL)
+	{
+		http_disconnect(h, 1);
+		return;
+	}
+
+	/* Move connection to entry */
+	c->sock = h->sock;
+	c->hostname = h->hostname;
+	c->port = h->port;
+	c->is_ssl = h->is_ssl;
+#ifdef HAVE_OPENSSL
+	c->ssl = h->ssl;
+	h->ssl = NULL;
+	if(c->ssl != NULL)
+		SSL_set_app_data(c->ssl, NULL);
+#endif
+	c->time = now = http_time();
+	h->sock = -1;
+	h->hostname = NULL;
+	h->port = 0;
+	h->reuse = 0;
+
+	/* Lock pool */
+	pthread_mutex_lock(&pool_mutex);
+
+	/* Add connection to pool */
+	c->next = pool;
+	pool = c;
+
+	/* Close expired connections and oldest ones when pool is full */
+	while(1)
+	{
+		count = 0;
+		host_count = 0;
+		last = NULL;
+		last_host = NULL;
+		for(p = &pool; *p != NULL; )
+		{
+			c = *p;
+			if(now - c->time > POOL_TIMEOUT)
+			{
+				*p = c->next;
+				http_conn_close(c);
+				continue;
+			}
+			count++;
+			if(c->port == pool->port && c->is_ssl == pool->is_ssl &&
+			   strcmp(c->hostname, pool->hostname) == 0)
+			{
+				host_count++;
+				last_host = p;
+			}
+			last = p;
+			p = &c->next;
+		}
+
+		/* Oldest connections are at end of list */
+		if(host_count > POOL_HOST_SIZE)
+			p = last_host;
+		else if(count > POOL_SIZE)
+			p = last;
+		else
+			break;
+		c = *p;
+		*p = c->next;
+		http_conn_close(c);
+	}
+
+	/* Unlock pool */
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+/* Get an idle connection to host from pool */
+static int http_acquire(struct http_handle *h, const char *hostname,
+			unsigned int port)
+{
+	struct http_conn *c, **p;
+	struct pollfd pfd;
+	time_t now;
+
+	/* Lock pool */
+	pthread_mutex_lock(&pool_mutex);
+
+	/* Find connection: most recent ones are first */
+	now = http_time();
+	for(p = &pool; *p != NULL; )
+	{
+		c = *p;
+		if(c->port != port || c->is_ssl != h->is_ssl ||
+		   strcmp(c->hostname, hostname) != 0)
+		{
+			p = &c->next;
+			continue;
+		}
+		*p = c->next;
+
+		/* An idle connection must not be readable: when it is, server
+		 * closed it or sent unexpected data.
+		 */
+		pfd.fd = c->sock;
+		pfd.events = POLLIN;
+		if(now - c->time > POOL_TIMEOUT || poll(&pfd, 1, 0) != 0)
+		{
+			http_conn_close(c);
+			continue;
+		}
+
+		/* Unlock pool */
+		pthread_mutex_unlock(&pool_mutex);
+
+		/* Move connection to handle */
+		h->sock = c->sock;
+		h->hostname = c->hostname;
+		h->port = c->port;
+#ifdef HAVE_OPENSSL
+		h->ssl = c->ssl;
+		if(h->ssl != NULL)
+			SSL_set_app_data(h->ssl, h);
+#endif
+		h->rx_pos = 0;
+		h->rx_len = 0;
+		free(c);
+
+		return 0;
+	}
+
+	/* Unlock pool */
+	pthread_mutex_unlock(&pool_mutex);
+
+	return -1;
+}
+
+static ssize_t http_drain(struct http_handle *h)
+{
+	unsigned char buffer[BUFFER_SIZE];
+	ssize_t len;
+
+	while(!h->body_end)
+	{
+		len = http_read(h, buffer, BUFFER_SIZE);
+		if(len < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int http_write(struct http_handle *h, const unsigned char *buffer,
+		      size_t length)
+{
+	ssize_t len;
+
+	while(length > 0)
+	{
+#ifdef HAVE_OPENSSL
+		if(h->is_ssl)
+			len = SSL_write(h->ssl, buffer, length);
+		else
+#endif
+#ifdef MSG_NOSIGNAL
+			len = send(h->sock, buffer, length, MSG_NOSIGNAL);
+#else
+			len = write(h->sock, buffer, length);
+#endif
+		if(len <= 0)
+			return -1;
+		buffer += len;
+		length -= len;
+	}
+
+	return 0;
+}
+
+/* Order addresses to alternate IPv6 and IPv4, starting with family of first
+ * address (see RFC 8305).
+ */
+static void http_sort_addrs(struct resolver_addr *addrs, int count)
+{
+	struct resolver_addr first[RESOLVER_MAX_ADDR];
+	struct resolver_addr other[RESOLVER_MAX_ADDR];
+	int first_count = 0, other_count = 0;
+	int i, j;
+
+	/* Split addresses by family */
+	for(i = 0; i < count; i++)
+	{
+		if(addrs[i].addr.ss_family == addrs[0].addr.ss_family)
+			first[first_count++] = addrs[i];
+		else
+			other[other_count++] = addrs[i];
+	}
+
+	/* Interleave families */
+	for(i = 0, j = 0; j < count; i++)
+	{
+		if(i < first_count)
+			addrs[j++] = first[i];
+		if(i < other_count)
+			addrs[j++] = other[i];
+	}
+}
+
+/* Open a socket and start a non-blocking connection to address */
+static int http_connect_start(struct http_handle *h,
+			      struct resolver_addr *addr)
+{
+	int sock, opt;
+
+	/* Open socket */
+	sock = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+	if(sock < 0)
 		return -1;
 
-	/* Get ip address from hostname */
-	server_ip = gethostbyname(h->proxy_use ? h->proxy_hostname : hostname);
-	if (server_ip == NULL)
+	/* Send request without waiting for ACK of previous segment */
+	opt = h->tcp_nodelay ? 1 : 0;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+	/* Receive buffer size must be set before connection to be used for
+	 * TCP window scaling.
+	 */
+	if(h->rcvbuf > 0)
+	{
+		opt = h->rcvbuf;
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+	}
+
+	/* Start connection */
+	if(fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0 ||
+	   (connect(sock, (struct sockaddr *) &addr->addr, addr->len) != 0 &&
+	    errno != EINPROGRESS))
+	{
+		close(sock);
 		return -1;
+	}
 
-	/* Set shoutcast server address */
-	memset(&server_addr, 0, sizeof(server_addr));
-	server_addr.sin_family = AF_INET;
-	server_addr.sin_port = htons(h->proxy_use ? h->proxy_port : port);
-	memcpy(&server_addr.sin_addr.s_addr, server_ip->h_addr,
-	       server_ip->h_length);
+	return sock;
+}
+
+/* Connect to first address of server which answers: a new attempt is started
+ * every CONNECT_DELAY ms (or as soon as an attempt fails) and all attempts run
+ * in parallel until one succeeds or connection timeout expires.
+ */
+static int http_connect_race(struct http_handle *h,
+			     struct resolver_addr *addrs, int count)
+{
+	struct pollfd pfds[RESOLVER_MAX_ADDR];
+	long long now, end, next_time;
+	int n = 0, next = 0, sock = -1;
+	socklen_t len;
+	int timeout;
+	int i, err;
+
+	/* Calculate end of connection */
+	now = http_time_ms();
+	end = now + h->connect_timeout;
+	next_time = now;
+
+	while(sock < 0)
+	{
+		/* Start next attempt */
+		now = http_time_ms();
+		if(next < count && (now >= next_time || n == 0))
+		{
+			pfds[n].fd = http_connect_start(h, &addrs[next++]);
+			pfds[n].events = POLLOUT;
+			if(pfds[n].fd >= 0)
+				n++;
+			next_time = now + CONNECT_DELAY;
+			continue;
+		}
+
+		/* All attempts have failed or timeout */
+		if(n == 0 || (h->connect_timeout > 0 && now >= end))
+			break;
+
+		/* Wait until next attempt or end of connection */
+		timeout = next < count ? next_time - now : -1;
+		if(h->connect_timeout > 0 && (timeout < 0 || end - now < timeout))
+			timeout = end - now;
+		if(poll(pfds, n, timeout) < 0 && errno != EINTR)
+			break;
+
+		/* Check attempts */
+		for(i = 0; i < n; )
+		{
+			if(pfds[i].revents == 0)
+			{
+				i++;
+				continue;
+			}
+
+			/* Connection is established */
+			len = sizeof(err);
+			if(getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err,
+				      &len) == 0 && err == 0)
+			{
+				sock = pfds[i].fd;
+				pfds[i] = pfds[--n];
+				break;
+			}
+
+			/* Connection failed: try next address now */
+			close(pfds[i].fd);
+			pfds[i] = pfds[--n];
+			next_time = now;
+		}
+	}
+
+	/* Close other attempts */
+	for(i = 0; i < n; i++)
+		close(pfds[i].fd);
+
+	/* Socket is used in blocking mode */
+	if(sock >= 0)
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+
+	return sock;
+}
+
+/* Set timeout of blocking socket operations (0 to disable) */
+static void http_set_timeout(int sock, unsigned int timeout)
+{
+	struct timeval tv;
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int http_connect(struct http_handle *h, const char *hostname,
+			unsigned int port, int use_pool)
+{
+	struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+	int count;
+
+	/* Connect to proxy */
+	if(h->proxy_use)
+	{
+		hostname = h->proxy_hostname;
+		port = h->proxy_port;
+	}
+	h->reused = 0;
+
+	/* Check if a socket is already opened */
+	if(h->sock >= 0)
+	{
+		/* Read end of previous response if small enough */
+		if(h->reuse && !h->body_end && !h->chunked &&
+		   h->body_len >= 0 && h->body_len <= DRAIN_SIZE)
+			http_drain(h);
+
+		/* Keep connection if hostname/port have not changed */
+		if(h->sock >= 0 && h->reuse && h->body_end &&
+		   strcmp(h->hostname, hostname) == 0 && h->port == port)
+		{
+			h->reused = 1;
+			return 0;
+		}
+
+		/* Release previous connection */
+		http_release(h);
+	}
+
+	/* Get an idle connection from pool */
+	if(h->keep_alive && use_pool && http_acquire(h, hostname, port) == 0)
+	{
+		h->reused = 1;
+		return 0;
+	}
+
+	/* Get IPv4 / IPv6 addresses of server */
+	count = resolver_lookup(hostname, port, addrs, RESOLVER_MAX_ADDR,
+				RESOLVE_TIMEOUT);
+	if(count <= 0)
+		return -1;
 
 	/* Connect to HTTP server */
-	if(connect(h->sock, (struct sockaddr *)&server_addr,
-		   sizeof(server_addr)) < 0)
+	http_sort_addrs(addrs, count);
+	h->sock = http_connect_race(h, addrs, count);
+	if(h->sock < 0)
+		return -1;
+	h->rx_pos = 0;
+	h->rx_len = 0;
+
+	/* Set hostname and port */
+	h->hostname = strdup(hostname);
+	h->port = port;
+	if(h->hostname == NULL)
 		return -1;
 
 #ifdef HAVE_OPENSSL
 	/* Create connection if HTTPS */
 	if(h->is_ssl)
 	{
-		/* Init library */
-		SSL_library_init();
-
-		/* Create openssl context */
-		h->ssl_ctx = SSL_CTX_new(SSLv23_client_method());
-		if(h->ssl_ctx == NULL)
-			return -1;
-
 		/* Create a new SSL object */
-		h->ssl = SSL_new(h->ssl_ctx);
+		h->ssl = http_ssl_new(h);
 		if(h->ssl == NULL)
 			return -1;
 
@@ -348,16 +1070,19 @@ static int http_connect(struct http_handle *h, char *hostname,
 		if(SSL_set_fd(h->ssl, h->sock) != 1)
 			return -1;
 
-		/* Initiate the TLS/SSL handshake with server */
+		/* Initiate the TLS/SSL handshake with server (abbreviated
+		 * when session is resumed)
+		 */
+		http_set_timeout(h->sock, h->connect_timeout);
 		if(SSL_connect(h->ssl) != 1)
+		{
+			http_session_remove(h);
 			return -1;
+		}
+		http_set_timeout(h->sock, 0);
 	}
 #endif
 
-	/* Set hostname and port */
-	h->hostname = strdup(hostname);
-	h->port = port;
-
 	return 0;
 }
 
@@ -377,42 +1102,125 @@ static void http_free_header(struct http_handle *h)
 	}
 }
 
-static int http_read_line(struct http_handle *h, char *buffer, int length)
+static ssize_t http_recv(struct http_handle *h, unsigned char *buffer,
+			 size_t size)
 {
-	int ret;
-	int i;
+#ifdef HAVE_OPENSSL
+	if(h->is_ssl)
+		return SSL_read(h->ssl, buffer, size);
+#endif
+	return read(h->sock, buffer, size);
+}
 
-	for(i = 0; i < length-1; i++)
-	{
+/* Check if data can be read without waiting on socket */
+static int http_pending(struct http_handle *h)
+{
+	if(h->rx_pos < h->rx_len)
+		return 1;
 #ifdef HAVE_OPENSSL
-		if(h->is_ssl)
-			ret = SSL_read(h->ssl, &buffer[i], 1);
-		else
+	if(h->is_ssl && SSL_pending(h->ssl) > 0)
+		return 1;
 #endif
-			ret = read(h->sock, &buffer[i], 1);
+	return 0;
+}
+
+/* Wait data on socket with a timeout in ms (-1 to block): returns 1 when data
+ * can be read, 0 on timeout and -1 on error.
+ */
+static int http_wait(struct http_handle *h, long timeout)
+{
+	struct timeval tv;
+	fd_set readfs;
+
+	if(timeout < 0 || http_pending(h))
+		return 1;
 
-		if(ret != 1)
-			return i;
+	/* Prepare a select */
+	FD_ZERO(&readfs);
+	FD_SET(h->sock, &readfs);
 
-		if(buffer[i] == '\n')
+	/* Set timeout */
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+
+	/* Do select */
+	if(select(h->sock + 1, &readfs, NULL, NULL, &tv) < 0)
+		return -1;
+
+	return FD_ISSET(h->sock, &readfs) ? 1 : 0;
+}
+
+/* Refill receive buffer when all its data has been read */
+static ssize_t http_fill(struct http_handle *h)
+{
+	ssize_t ret;
+
+	if(h->rx_pos < h->rx_len)
+		return h->rx_len - h->rx_pos;
+
+	/* Read as much data as possible */
+	h->rx_pos = 0;
+	h->rx_len = 0;
+	ret = http_recv(h, h->rx_buffer, RX_BUFFER_SIZE);
+	if(ret <= 0)
+		return -1;
+	h->rx_len = ret;
+
+	return ret;
+}
+
+static int http_read_line(struct http_handle *h, char *buffer, int length)
+{
+	unsigned char *start, *end;
+	size_t len;
+	int i = 0;
+
+	while(i < length - 1)
+	{
+		/* Get received data */
+		if(http_fill(h) < 0)
+			break;
+
+		/* Copy until end of line */
+		start = h->rx_buffer + h->rx_pos;
+		len = h->rx_len - h->rx_pos;
+		if(len > (size_t) (length - 1 - i))
+			len = length - 1 - i;
+		end = memchr(start, '\n', len);
+		if(end != NULL)
+			len = end - start + 1;
+		memcpy(&buffer[i], start, len);
+		h->rx_pos += len;
+		i += len;
+
+		if(end != NULL)
 			break;
 	}
 
-	buffer[i+1] = 0;
-	return i+1;
+	buffer[i] = 0;
+	return i;
 }
 
-static int http_parse_header(struct http_handle *h)
+static int http_parse_header(struct http_handle *h, const char *method)
 {
 	struct http_header *header;
 	char buffer[MAX_SIZE_LINE];
 	int status_code = 0;
 	char *temp, *end;
 	int size = 0;
+	int http11;
 
 	/* Free previous header */
 	http_free_header(h);
 
+	/* Reset response body */
+	h->reuse = 0;
+	h->chunked = 0;
+	h->body_end = 1;
+	h->body_len = 0;
+	h->chunk_trailer = 0;
+	h->chunk_line_len = 0;
+
 	/* Read first line */
 	size = http_read_line(h, buffer, MAX_SIZE_LINE);
 	if(size > 100) //Too long for a first line in HTTP protocol
@@ -426,8 +1234,9 @@ static int http_parse_header(struct http_handle *h)
 	/* Get status code */
 	if(sscanf(buffer, "%*s %d %*s", &status_code) != 1)
 		return -1;
+	http11 = strncmp(buffer, "HTTP/1.1", 8) == 0;
 
-	while(http_read_line(h, buffer, MAX_SIZE_HEADER) != 0)
+	while(http_read_line(h, buffer, MAX_SIZE_LINE) != 0)
 	{
 		/* End of header */
 		if(buffer[0] == '\r' && buffer[1] == '\n')
@@ -455,6 +1264,46 @@ static int http_parse_header(struct http_handle *h)
 		h->headers = header;
 	}
 
+	/* Connection is persistent by default in HTTP/1.1 only */
+	h->reuse = http11;
+	temp = http_get_header(h, "Connection", 0);
+	if(temp != NULL)
+	{
+		if(strncasecmp(temp, "close", 5) == 0)
+			h->reuse = 0;
+		else if(strncasecmp(temp, "keep-alive", 10) == 0)
+			h->reuse = 1;
+	}
+	if(!h->keep_alive)
+		h->reuse = 0;
+
+	/* Get length of response body */
+	temp = http_get_header(h, "Transfer-Encoding", 0);
+	if(strcmp(method, "HEAD") == 0 || status_code / 100 == 1 ||
+	   status_code == 204 || status_code == 304)
+	{
+		/* No body */
+		h->body_len = 0;
+	}
+	else if(temp != NULL && (size = strlen(temp)) >= 7 &&
+		strcasecmp(temp + size - 7, "chunked") == 0)
+	{
+		/* Chunked body: length is read before each chunk */
+		h->chunked = 1;
+		h->body_len = 0;
+	}
+	else if((temp = http_get_header(h, "Content-Length", 0)) != NULL)
+	{
+		h->body_len = strtoll(temp, NULL, 10);
+	}
+	else
+	{
+		/* Body ends when connection is closed */
+		h->body_len = -1;
+		h->reuse = 0;
+	}
+	h->body_end = !h->chunked && h->body_len == 0;
+
 	return status_code;
 }
 
@@ -484,15 +1333,19 @@ int http_request(struct http_handle *h, const char *url, const char *method,
 	/* Check Protocol */
 	if(protocol == URL_HTTPS)
 	{
-		h->is_ssl = 1;
 #ifndef HAVE_OPENSSL
 		fprintf(stderr, "SSL is not supported!\n");
 		goto end;
 #endif
 	}
 
+	/* Connection is changed when protocol differs */
+	if(h->sock >= 0 && h->is_ssl != (protocol == URL_HTTPS))
+		http_disconnect(h, h->body_end);
+	h->is_ssl = protocol == URL_HTTPS;
+
 	/* Connect to HTTP server */
-	if(http_connect(h, hostname, port) != 0)
+	if(http_connect(h, hostname, port, 1) != 0)
 		goto end;
 
 	/* Generate Auth string */
@@ -503,8 +1356,8 @@ int http_request(struct http_handle *h, const char *url, const char *method,
 
 	/* Make HTTP request */
 	len = snprintf(req, MAX_SIZE_HEADER,
-		       "%s %s%s HTTP/1.0\r\n"
-		       "Host: %s\r\n"
+		       "%s %s%s HTTP/1.1\r\n"
+		       "Host: %s%s%s\r\n"
 		       "User-Agent: %s\r\n"
 		       "Connection: %s\r\n"
 		       "Content-type: %s\r\n"
@@ -514,7 +1367,8 @@ int http_request(struct http_handle *h, const char *url, const char *method,
 		       "\r\n",
 		       method, h->proxy_use ? "" : "/", h->proxy_use ? url :
 					       resource != NULL ? resource : "",
-		       hostname,
+		       strchr(hostname, ':') != NULL ? "[" : "", hostname,
+		       strchr(hostname, ':') != NULL ? "]" : "",
 		       h->user_agent == NULL ? DEFAULT_USER_AGENT :
 					       h->user_agent,
 		       h->keep_alive ? "keep-alive" : "close",
@@ -523,32 +1377,37 @@ int http_request(struct http_handle *h, const char *url, const char *method,
 		       auth != NULL ? auth : "",
 		       h->extra != NULL ? h->extra : "");
 
-	/* Send HTTP request */
-#ifdef HAVE_OPENSSL
-	if(h->is_ssl)
-		len = SSL_write(h->ssl, req, len);
-	else
-#endif
-		len = write(h->sock, req, len);
-	if(len <= 0)
-		goto end;
+	/* Send HTTP request and its data */
+	if(http_write(h, (unsigned char *) req, len) != 0 ||
+	   http_write(h, buffer, length) != 0)
+		goto retry;
 
-	/* Send data buffer */
-	while(length > 0)
+	/* Parse HTTP header response */
+	code = http_parse_header(h, method);
+
+retry:
+	/* Connection from pool has been closed by server: retry once with a
+	 * new connection.
+	 */
+	if(code < 0 && h->reused)
 	{
-#ifdef HAVE_OPENSSL
-		if(h->is_ssl)
-			len = SSL_write(h->ssl, buffer, length);
-		else
-#endif
-			len = write(h->sock, buffer, length);
-		if(len < 0)
+		http_disconnect(h, 0);
+		if(http_connect(h, hostname, port, 0) != 0)
 			goto end;
-		length -= len;
+		if(http_write(h, (unsigned char *) req, len) != 0 ||
+		   http_write(h, buffer, length) != 0)
+			goto end;
+		code = http_parse_header(h, method);
+	}
+	if(code < 0)
+	{
+		http_disconnect(h, 0);
+		goto end;
 	}
 
-	/* Parse HTTP header response */
-	code = http_parse_header(h);
+	/* Give connection back to pool when there is no body */
+	if(h->body_end)
+		http_release(h);
 
 	/* Follow redirection */
 	if(h->follow && (code == 301 || code == 302) &&
@@ -643,65 +1502,173 @@ char *http_get_header(struct http_handle *h, const char *name,
 	return NULL;
 }
 
+/* Read a line of chunk framing with a timeout: a partial line is kept in handle
+ * when timeout expires. Returns 1 when line is complete, 0 on timeout and -1 on
+ * error or end of stream.
+ */
+static int http_read_chunk_line(struct http_handle *h, long timeout)
+{
+	unsigned char *start, *end;
+	size_t len;
+	int ret;
+
+	while(h->chunk_line_len < MAX_SIZE_LINE - 1)
+	{
+		/* Wait data */
+		ret = http_wait(h, timeout);
+		if(ret <= 0)
+			return ret;
+
+		/* Get received data */
+		if(http_fill(h) < 0)
+			return -1;
+
+		/* Copy until end of line */
+		start = h->rx_buffer + h->rx_pos;
+		len = h->rx_len - h->rx_pos;
+		if(len > (size_t) (MAX_SIZE_LINE - 1 - h->chunk_line_len))
+			len = MAX_SIZE_LINE - 1 - h->chunk_line_len;
+		end = memchr(start, '\n', len);
+		if(end != NULL)
+			len = end - start + 1;
+		memcpy(&h->chunk_line[h->chunk_line_len], start, len);
+		h->rx_pos += len;
+		h->chunk_line_len += len;
+
+		if(end != NULL)
+			break;
+	}
+
+	/* Line is complete */
+	h->chunk_line[h->chunk_line_len] = 0;
+	h->chunk_line_len = 0;
+
+	return 1;
+}
+
+/* Read size of next chunk: a chunk of zero bytes ends body. Returns 1 when size
+ * has been read (or body is ended), 0 on timeout and -1 on error.
+ */
+static int http_read_chunk_size(struct http_handle *h, long timeout)
+{
+	int ret;
+
+	while(!h->chunk_trailer)
+	{
+		/* Skip end of previous chunk */
+		ret = http_read_chunk_line(h, timeout);
+		if(ret <= 0)
+			return ret;
+		if(h->chunk_line[0] == '\r' || h->chunk_line[0] == '\n')
+			continue;
+
+		/* Parse chunk size (extensions are ignored) */
+		h->body_len = strtoll(h->chunk_line, NULL, 16);
+		if(h->body_len < 0)
+			return -1;
+		if(h->body_len > 0)
+			return 1;
+		h->chunk_trailer = 1;
+	}
+
+	/* Last chunk: skip trailer headers until empty line */
+	do {
+		ret = http_read_chunk_line(h, timeout);
+		if(ret <= 0)
+			return ret;
+	} while(h->chunk_line[0] != '\r' && h->chunk_line[0] != '\n');
+	h->body_end = 1;
+
+	return 1;
+}
+
 ssize_t http_read_timeout(struct http_handle *h, unsigned char *buffer,
 			  size_t size, long timeout)
 {
-	struct timeval tv;
-	fd_set readfs;
 	ssize_t len = 0;
 	ssize_t ret;
+	size_t count;
 
 	if(h == NULL || h->sock < 0)
 		return -1;
 
 	/* Get all buffer */
-	while(size > 0)
+	while(size > 0 && !h->body_end)
 	{
-		/* Uses a timeout */
-		if(timeout >= 0)
+		/* Get next chunk size */
+		if(h->chunked && h->body_len == 0)
 		{
-			/* Prepare a select */
-			FD_ZERO(&readfs);
-			FD_SET(h->sock, &readfs);
+			ret = http_read_chunk_size(h, timeout);
+			if(ret < 0)
+			{
+				h->reuse = 0;
+				if(len == 0)
+					return -1;
+				break;
+			}
+			if(ret == 0 || h->body_end)
+				break;
+		}
 
-			/* Set timeout */
-			tv.tv_sec = 0;
-			tv.tv_usec = timeout*1000;
+		/* Uses a timeout when no data is already available */
+		ret = http_wait(h, timeout);
+		if(ret < 0)
+			return -1;
 
-			/* Do select */
-			ret = select(h->sock + 1, &readfs, NULL, NULL, &tv);
-			if(ret < 0)
-				return -1;
+		/* Timeout */
+		if(ret == 0)
+			break;
 
-			/* Timeout */
-			if(ret == 0)
-				break;
+		/* Read data from TCP socket: do not read after end of body (or
+		 * of chunk)
+		 */
+		count = size;
+		if(h->body_len >= 0 && count > h->body_len)
+			count = h->body_len;
+
+		/* Get data left in receive buffer first, then read large
+		 * requests directly and refill buffer for small ones.
+		 */
+		if(h->rx_pos == h->rx_len && count >= RX_BUFFER_SIZE)
+			ret = http_recv(h, buffer, count);
+		else if((ret = http_fill(h)) > 0)
+		{
+			if((size_t) ret > count)
+				ret = count;
+			memcpy(buffer, h->rx_buffer + h->rx_pos, ret);
+			h->rx_pos += ret;
 		}
 
-		/* Read data from TCP socket */
-		if(timeout == -1 || FD_ISSET(h->sock, &readfs))
+		/* End of stream */
+		if(ret <= 0)
 		{
-	#ifdef HAVE_OPENSSL
-			if(h->is_ssl)
-				ret = SSL_read(h->ssl, buffer, size);
-			else
-	#endif
-				ret = read(h->sock, buffer, size);
+			h->reuse = 0;
+			if(len == 0)
+				return -1;
+			break;
+		}
 
-			/* End of stream */
-			if(ret <= 0)
-			{
-				if(len == 0)
-					return -1;
-				break;
-			}
+		len += ret;
+		buffer += ret;
+		size -= ret;
 
-			len += ret;
-			buffer += ret;
-			size -= ret;
+		/* Update remaining body length */
+		if(h->body_len >= 0)
+		{
+			h->body_len -= ret;
+			if(!h->chunked && h->body_len == 0)
+				h->body_end = 1;
 		}
 	}
 
+	/* Give connection back to pool at end of body */
+	if(h->body_end)
+	{
+		http_release(h);
+		if(len == 0)
+			return -1;
+	}
+
 	return len;
 }
 
@@ -712,6 +1679,9 @@ static void *http_thread(void *user_data)
 	size_t size = BUFFER_SIZE;
 	ssize_t len;
 
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "http-client");
+
 	/* Do request */
 	h->code = http_request(h, h->url, h->method, h->buffer, h->length);
 
@@ -908,21 +1878,10 @@ int http_status(struct http_handle *h)
 
 void http_close_connection(struct http_handle *h)
 {
-	/* Close socket */
-	if(h->sock >= 0)
-	{
-#ifdef HAVE_OPENSSL
-		if(h->is_ssl)
-		{
-			if(h->ssl != NULL)
-				SSL_free(h->ssl);
-			if(h->ssl_ctx != NULL)
-				SSL_CTX_free(h->ssl_ctx);
-		}
-#endif
-		close(h->sock);
-		h->sock = -1;
-	}
+	/* Close socket: connection is already in pool if response has been
+	 * fully read.
+	 */
+	http_disconnect(h, h->body_end);
 
 	/* Lock connection */
 	pthread_mutex_lock(&h->mutex);
@@ -972,3 +1931,44 @@ void http_close(struct http_handle *h)
 	/* Free handle */
 	free(h);
 }
+
+void http_free_pool(void)
+{
+#ifdef HAVE_OPENSSL
+	struct http_session *s;
+#endif
+	struct http_conn *c;
+
+	/* Lock pool */
+	pthread_mutex_lock(&pool_mutex);
+
+	/* Close all idle connections */
+	while(pool != NULL)
+	{
+		c = pool;
+		pool = c->next;
+		http_conn_close(c);
+	}
+
+	/* Unlock pool */
+	pthread_mutex_unlock(&pool_mutex);
+
+#ifdef HAVE_OPENSSL
+	/* Lock session cache */
+	pthread_mutex_lock(&ssl_mutex);
+
+	/* Free TLS sessions and context */
+	while(sessions != NULL)
+	{
+		s = sessions;
+		sessions = s->next;
+		http_session_free(s);
+	}
+	if(ssl_ctx != NULL)
+		SSL_CTX_free(ssl_ctx);
+	ssl_ctx = NULL;
+
+	/* Unlock session cache */
+	pthread_mutex_unlock(&ssl_mutex);
+#endif
+}
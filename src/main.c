@@ -24,9 +24,12 @@
 
 #include "outputs/outputs.h"
 #include "config_file.h"
+#include "realtime.h"
 #include "timers.h"
 #include "avahi.h"
 #include "httpd.h"
+#include "http.h"
+#include "resolver.h"
 #include "fs.h"
 
 #include "modules.h"
@@ -170,6 +173,24 @@ int main(int argc, char* argv[])
 	/* Open configuration */
 	config_open(&config, config_file);
 
+	/* Get Real-time configuration from file */
+	cfg = config_get_json(config, "realtime");
+
+	/* Init real-time scheduling and memory locking */
+	realtime_init(cfg);
+
+	/* Free Real-time configuration */
+	json_free(cfg);
+
+	/* Get file system configuration from file */
+	cfg = config_get_json(config, "fs");
+
+	/* Set block cache of remote file systems */
+	fs_set_config(cfg);
+
+	/* Free file system configuration */
+	json_free(cfg);
+
 	/* Setup signal handler */
 	signal(SIGINT, signal_handler);
 	signal(SIGTERM, signal_handler);
@@ -279,9 +300,18 @@ int main(int argc, char* argv[])
 		free(config_file);
 	config_close(config);
 
+	/* Free real-time resources */
+	realtime_free();
+
 	/* Free file system */
 	fs_free();
 
+	/* Close idle HTTP connections */
+	http_free_pool();
+
+	/* Free DNS cache */
+	resolver_free();
+
 	return EXIT_SUCCESS;
 }
 
@@ -292,6 +322,12 @@ int main(int argc, char* argv[])
 static int config_httpd_default(void *user_data, struct httpd_req *req,
 				struct httpd_res **res)
 {
+	/* Set Real-time to default */
+	realtime_set_config(NULL);
+
+	/* Set file system to default */
+	fs_set_config(NULL);
+
 	/* Set Audio output to default */
 	outputs_set_config(outputs, NULL);
 
@@ -312,6 +348,24 @@ static int config_httpd_reload(void *user_data, struct httpd_req *req,
 	/* Load config from file */
 	config_load(config);
 
+	/* Get Real-time configuration from file */
+	cfg = config_get_json(config, "realtime");
+
+	/* Set Real-time configuration */
+	realtime_set_config(cfg);
+
+	/* Free configuration */
+	json_free(cfg);
+
+	/* Get file system configuration from file */
+	cfg = config_get_json(config, "fs");
+
+	/* Set file system configuration */
+	fs_set_config(cfg);
+
+	/* Free configuration */
+	json_free(cfg);
+
 	/* Get Audio output configuration from file */
 	cfg = config_get_json(config, "output");
 
@@ -347,6 +401,24 @@ static int config_httpd_save(void *user_data, struct httpd_req *req,
 {
 	struct json *cfg = NULL;
 
+	/* Get Real-time configuration */
+	cfg = realtime_get_config();
+
+	/* Set Real-time configuration in file */
+	config_set_json(config, "realtime", cfg);
+
+	/* Free configuration */
+	json_free(cfg);
+
+	/* Get file system configuration */
+	cfg = fs_get_config();
+
+	/* Set file system configuration in file */
+	config_set_json(config, "fs", cfg);
+
+	/* Free configuration */
+	json_free(cfg);
+
 	/* Get Audio output configuration from module */
 	cfg = outputs_get_config(outputs);
 
@@ -392,6 +464,24 @@ static int config_httpd(void *user_data, struct httpd_req *req,
 		/* Create a JSON object */
 		json = json_new();
 
+		/* Get Real-time configuration */
+		if(req->resource == NULL || *req->resource == '\0' ||
+		   strcmp(req->resource, "realtime") == 0)
+		{
+			tmp = realtime_get_config();
+			if(tmp != NULL)
+				json_add(json, "realtime", tmp);
+		}
+
+		/* Get file system configuration */
+		if(req->resource == NULL || *req->resource == '\0' ||
+		   strcmp(req->resource, "fs") == 0)
+		{
+			tmp = fs_get_config();
+			if(tmp != NULL)
+				json_add(json, "fs", tmp);
+		}
+
 		/* Get Audio output configuration from module */
 		if(req->resource == NULL || *req->resource == '\0' ||
 		   strcmp(req->resource, "output") == 0)
@@ -457,6 +547,22 @@ static int config_httpd(void *user_data, struct httpd_req *req,
 			   strcmp(req->resource, str) != 0)
 				continue;
 
+			/* Set Real-time configuration */
+			if(strcmp(str, "realtime") == 0)
+			{
+				/* Set configuration */
+				realtime_set_config(tmp);
+				continue;
+			}
+
+			/* Set file system configuration */
+			if(strcmp(str, "fs") == 0)
+			{
+				/* Set configuration */
+				fs_set_config(tmp);
+				continue;
+			}
+
 			/* Set Audio output configuration */
 			if(strcmp(str, "output") == 0)
 			{
@@ -19,6 +19,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
 #include <pthread.h>
 
 #include <asoundlib.h>
@@ -26,6 +30,7 @@
 #include "output_alsa.h"
 #include "output.h"
 
+#include "realtime.h"
 #include "resample.h"
 #include "cache.h"
 
@@ -35,12 +40,39 @@
 
 #define BUFFER_SIZE 8192/2
 
+/* History of mixed samples kept to drop queued samples (in ms): it is
+ * extended to maximum latency so all device buffer can be dropped.
+ */
+#define DROP_HISTORY 1000
+
+/* Maximum render worker threads */
+#define MAX_WORKERS 4
+
+/* Default ALSA device */
+#define DEFAULT_DEVICE "default"
+
+/* Default volume range of hardware mixer (in dB) */
+#define MIXER_RANGE 60
+
 /* Minimum latency is 10ms */
 #define MIN_LATENCY 10
 
 /* Maximum time before stopping PCM output (default: 5s) */
 #define MAX_SILENCE 5
 
+/* Adaptive latency: raise latency when XRUN_COUNT xruns occur in less than
+ * XRUN_WINDOW seconds and lower it after STABLE_TIME seconds without xrun.
+ */
+#define XRUN_COUNT 3
+#define XRUN_WINDOW 10
+#define STABLE_TIME 60
+
+/* Delay histogram bins (upper bounds in ms) */
+#define DELAY_BINS 9
+static const unsigned int output_alsa_delay_bins[DELAY_BINS-1] = {
+	5, 10, 20, 50, 100, 200, 500, 1000
+};
+
 #ifdef USE_FLOAT
  	#define ALSA_FORMAT SND_PCM_FORMAT_FLOAT
 #else
@@ -67,33 +99,195 @@ struct output_stream {
 	output_stream_event_cb event_cb;
 	void *event_ud;
 	int buffering;
+	/* Device position after last mixed sample (in frames) */
+	uint64_t mix_end;
+	/* Mixed samples history (ring indexed by device position) */
+	unsigned char *hist;
+	uint64_t run_start;
+	/* Drop of queued samples (see enum drop_mode) */
+	int drop;
+	uint64_t drop_start;
+	uint64_t drop_end;
+	/* Samples dropped on pause to play again on resume */
+	unsigned char *replay;
+	size_t replay_len;
+	size_t replay_pos;
+	/* Next period rendered by worker pool (see enum render_state) */
+	unsigned char *render;
+	int render_len;
+	unsigned int render_volume;
+	int render_state;
+	struct output_stream *job_next;
 	/* Next output stream in list */
 	struct output_stream *next;
 };
 
+enum drop_mode {
+	DROP_NONE,	/*!< No drop requested */
+	DROP_PAUSE,	/*!< Drop and play samples again on resume */
+	DROP_FLUSH	/*!< Drop and discard samples */
+};
+
+enum render_state {
+	RENDER_IDLE,	/*!< No period rendered */
+	RENDER_PENDING,	/*!< Period is queued or rendering in worker pool */
+	RENDER_DONE	/*!< Period is rendered and ready to mix */
+};
+
+struct output_config {
+	char *device;
+	unsigned long samplerate;
+	unsigned char channels;
+	unsigned int latency;
+	unsigned int min_latency;
+	unsigned int max_latency;
+};
+
 struct output {
 	/* ALSA output */
 	snd_pcm_t *alsa;
+	char *device;
 	/* Format */
 	unsigned long samplerate;
 	unsigned char channels;
 	/* General volume */
 	unsigned int volume;
+	/* Hardware mixer element for general volume (NULL for software) */
+	snd_mixer_t *mixer;
+	snd_mixer_elem_t *mixer_elem;
+	long mixer_min;
+	long mixer_max;
+	int mixer_db;
+	/* Latency (in ms): device fill is kept under latency when it is
+	 * lowered under latency of device buffer (hw_latency) with start and
+	 * wake up thresholds (set for fill_latency)
+	 */
+	unsigned int latency;
+	unsigned int hw_latency;
+	unsigned int fill_latency;
+	snd_pcm_uframes_t avail_min;
+	unsigned int min_latency;
+	unsigned int max_latency;
+	/* Adaptive latency controller */
+	time_t xrun_start;
+	time_t last_xrun;
+	time_t last_change;
+	unsigned int xrun_count;
+	/* Statistics */
+	unsigned long xruns;
+	unsigned long short_writes;
+	unsigned long delay_hist[DELAY_BINS];
+	unsigned long periods;
+	unsigned long mix_time;
+	unsigned long mix_time_max;
+	uint64_t mix_time_total;
+	/* Playback clock: frames written and last measured delay */
+	uint64_t written;
+	snd_pcm_sframes_t delay;
+	struct timespec delay_time;
+	/* Drop of queued samples: history size (in frames) and request */
+	size_t hist_frames;
+	int drop;
 	/* Thread objects */
 	pthread_t thread;
 	pthread_mutex_t mutex;
 	int stop;
+	/* Render worker pool */
+	pthread_t workers[MAX_WORKERS];
+	int worker_count;
+	pthread_mutex_t pool_mutex;
+	pthread_cond_t pool_cond;
+	pthread_cond_t done_cond;
+	struct output_stream *jobs;
+	int pending;
+	int pool_stop;
+	/* Pending reconfiguration (applied by output thread) */
+	struct output_config *reconfig;
+	pthread_cond_t reconfig_cond;
+	int reconfig_ret;
+	int running;
 	/* Stream list */
 	struct output_stream *streams;
 };
 
 static void *output_alsa_thread(void *user_data);
+static void *output_alsa_worker(void *user_data);
+static void output_alsa_wait_stream(struct output *h, struct output_stream *s);
+
+static time_t output_alsa_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec;
+}
+
+static int output_alsa_set_params(struct output *h, unsigned int latency)
+{
+	/* Set parameters for output */
+	if(snd_pcm_set_params(h->alsa, ALSA_FORMAT,
+			      SND_PCM_ACCESS_RW_INTERLEAVED, h->channels,
+			      h->samplerate, 1, latency*1000) < 0)
+		return -1;
+
+	/* Update latency (thresholds are reset for all buffer) */
+	h->latency = latency;
+	h->hw_latency = latency;
+	h->fill_latency = latency;
+
+	return 0;
+}
 
-int output_alsa_open(struct output **handle, unsigned long samplerate,
-		     unsigned char channels, unsigned int latency)
+static size_t output_alsa_hist_frames(struct output *h)
+{
+	unsigned int ms = DROP_HISTORY;
+
+	/* Cover device buffer at current and maximum adaptive latency */
+	if(h->hw_latency > ms)
+		ms = h->hw_latency;
+	if(h->max_latency > h->min_latency && h->max_latency > ms)
+		ms = h->max_latency;
+
+	return (size_t) ms * h->samplerate / 1000;
+}
+
+static unsigned int output_alsa_set_bounds(struct output *h,
+					   unsigned int latency,
+					   unsigned int min_latency,
+					   unsigned int max_latency)
+{
+	/* Set latency to default */
+	if(latency < MIN_LATENCY)
+		latency = MIN_LATENCY;
+
+	/* Set adaptive latency bounds (disabled when max <= min) */
+	if(min_latency < MIN_LATENCY)
+		min_latency = MIN_LATENCY;
+	if(max_latency > min_latency)
+	{
+		if(latency < min_latency)
+			latency = min_latency;
+		if(latency > max_latency)
+			latency = max_latency;
+	}
+	h->min_latency = min_latency;
+	h->max_latency = max_latency;
+
+	/* Reset adaptive latency controller */
+	h->xrun_count = 0;
+	h->last_change = output_alsa_now();
+
+	return latency;
+}
+
+int output_alsa_open(struct output **handle, const char *device,
+		     unsigned long samplerate, unsigned char channels,
+		     unsigned int latency, unsigned int min_latency,
+		     unsigned int max_latency)
 {
 	struct output *h;
-	int ret;
+	long cpus;
 
 	/* Allocate handle */
 	*handle = malloc(sizeof(struct output));
@@ -102,6 +296,7 @@ int output_alsa_open(struct output **handle, unsigned long samplerate,
 	h = *handle;
 
 	/* Init structure */
+	memset(h, 0, sizeof(struct output));
 	h->streams = NULL;
 	h->stop = 0;
 
@@ -111,37 +306,187 @@ int output_alsa_open(struct output **handle, unsigned long samplerate,
 	h->volume = OUTPUT_VOLUME_MAX;
 
 	/* Open alsa device */
-	if(snd_pcm_open(&h->alsa, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0)
+	if(device == NULL || *device == '\0')
+		device = DEFAULT_DEVICE;
+	h->device = strdup(device);
+	if(snd_pcm_open(&h->alsa, device, SND_PCM_STREAM_PLAYBACK, 0) < 0)
 		return -1;
 
-	/* Set latency to default */
-	if(latency < MIN_LATENCY)
-		latency = MIN_LATENCY;
+	/* Set latency and adaptive latency bounds */
+	latency = output_alsa_set_bounds(h, latency, min_latency, max_latency);
 
 	/* Set parameters for output */
-	ret = snd_pcm_set_params(h->alsa, ALSA_FORMAT,
-				 SND_PCM_ACCESS_RW_INTERLEAVED, h->channels,
-				 h->samplerate, 1, latency*1000);
-	if(ret < 0)
+	if(output_alsa_set_params(h, latency) != 0)
 		return -1;
+	h->hist_frames = output_alsa_hist_frames(h);
 
 	/* Initialize mutex */
 	pthread_mutex_init(&h->mutex, NULL);
+	pthread_cond_init(&h->reconfig_cond, NULL);
+	pthread_mutex_init(&h->pool_mutex, NULL);
+	pthread_cond_init(&h->pool_cond, NULL);
+	pthread_cond_init(&h->done_cond, NULL);
+
+	/* Create render workers: one per additional CPU */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for(h->worker_count = 0; h->worker_count < cpus - 1 &&
+	    h->worker_count < MAX_WORKERS; h->worker_count++)
+	{
+		if(pthread_create(&h->workers[h->worker_count], NULL,
+				  output_alsa_worker, h) != 0)
+			break;
+	}
 
 	/* Create thread */
+	h->running = 1;
 	if(pthread_create(&h->thread, NULL, output_alsa_thread, h) != 0)
+	{
+		h->running = 0;
 		return -1;
+	}
 
 	return 0;
 }
 
+static int output_alsa_apply_volume(struct output *h)
+{
+	long value;
+
+	if(h->mixer_elem == NULL)
+		return -1;
+
+	/* Mute output */
+	if(snd_mixer_selem_has_playback_switch(h->mixer_elem))
+		snd_mixer_selem_set_playback_switch_all(h->mixer_elem,
+							h->volume > 0);
+
+	/* Convert volume to mixer value */
+	if(h->volume == 0)
+		value = h->mixer_min;
+	else if(h->mixer_db)
+	{
+		/* Same attenuation as software volume (in 0.01 dB) */
+		value = h->mixer_max + (long) (2000.0 *
+			log10((double) h->volume / OUTPUT_VOLUME_MAX));
+		if(value < h->mixer_min)
+			value = h->mixer_min;
+	}
+	else
+		value = h->mixer_min + (h->mixer_max - h->mixer_min) *
+			(long long) h->volume / OUTPUT_VOLUME_MAX;
+
+	/* Set volume */
+	if(h->mixer_db)
+		return snd_mixer_selem_set_playback_dB_all(h->mixer_elem,
+							   value, 1);
+	return snd_mixer_selem_set_playback_volume_all(h->mixer_elem, value);
+}
+
+static void output_alsa_close_mixer(struct output *h)
+{
+	if(h->mixer != NULL)
+		snd_mixer_close(h->mixer);
+	h->mixer = NULL;
+	h->mixer_elem = NULL;
+}
+
+int output_alsa_set_mixer(struct output *h, const char *device,
+			  const char *control, unsigned int range)
+{
+	snd_mixer_selem_id_t *sid;
+	snd_pcm_info_t *info;
+	char card[16];
+	int ret = -1;
+
+	pthread_mutex_lock(&h->mutex);
+
+	/* Close previous mixer */
+	output_alsa_close_mixer(h);
+
+	/* Use software volume */
+	if(control == NULL || *control == '\0')
+		goto end;
+
+	/* Use mixer of card of PCM device by default: a PCM device name is not
+	 * a valid mixer name, so "hw:N" is used (or "default" when card is
+	 * unknown)
+	 */
+	if(device == NULL || *device == '\0')
+	{
+		device = "default";
+		snd_pcm_info_alloca(&info);
+		if(h->alsa != NULL && snd_pcm_info(h->alsa, info) == 0 &&
+		   snd_pcm_info_get_card(info) >= 0)
+		{
+			snprintf(card, sizeof(card), "hw:%d",
+				 snd_pcm_info_get_card(info));
+			device = card;
+		}
+	}
+	if(range == 0)
+		range = MIXER_RANGE;
+
+	/* Open mixer and find simple element */
+	if(snd_mixer_open(&h->mixer, 0) < 0)
+	{
+		h->mixer = NULL;
+		goto end;
+	}
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_index(sid, 0);
+	snd_mixer_selem_id_set_name(sid, control);
+	if(snd_mixer_attach(h->mixer, device) < 0 ||
+	   snd_mixer_selem_register(h->mixer, NULL, NULL) < 0 ||
+	   snd_mixer_load(h->mixer) < 0 ||
+	   (h->mixer_elem = snd_mixer_find_selem(h->mixer, sid)) == NULL ||
+	   !snd_mixer_selem_has_playback_volume(h->mixer_elem))
+	{
+		fprintf(stderr, "Failed to open mixer control %s on %s\n",
+			control, device);
+		output_alsa_close_mixer(h);
+		goto end;
+	}
+
+	/* Prefer dB scale and limit its range */
+	if(snd_mixer_selem_get_playback_dB_range(h->mixer_elem, &h->mixer_min,
+						 &h->mixer_max) == 0 &&
+	   h->mixer_min < h->mixer_max)
+	{
+		h->mixer_db = 1;
+		if(h->mixer_min < h->mixer_max - (long) range * 100)
+			h->mixer_min = h->mixer_max - (long) range * 100;
+	}
+	else
+	{
+		h->mixer_db = 0;
+		snd_mixer_selem_get_playback_volume_range(h->mixer_elem,
+							  &h->mixer_min,
+							  &h->mixer_max);
+	}
+
+	/* Apply current volume */
+	ret = output_alsa_apply_volume(h) < 0 ? -1 : 0;
+	if(ret != 0)
+		output_alsa_close_mixer(h);
+
+end:
+	pthread_mutex_unlock(&h->mutex);
+
+	return ret;
+}
+
 int output_alsa_set_volume(struct output *h, unsigned int volume)
 {
+	int ret;
+
 	pthread_mutex_lock(&h->mutex);
 	h->volume = volume;
+
+	/* Apply on hardware mixer */
+	ret = output_alsa_apply_volume(h);
 	pthread_mutex_unlock(&h->mutex);
 
-	return 0;
+	return ret < 0 ? -1 : 0;
 }
 
 unsigned int output_alsa_get_volume(struct output *h)
@@ -185,6 +530,27 @@ struct output_stream *output_alsa_add_stream(struct output *h,
 	s->event_cb = NULL;
 	s->event_ud = NULL;
 	s->buffering = 0;
+	s->mix_end = 0;
+	s->run_start = 0;
+	s->drop = DROP_NONE;
+	s->replay = NULL;
+	s->replay_len = 0;
+	s->replay_pos = 0;
+	s->render_len = 0;
+	s->render_volume = OUTPUT_VOLUME_MAX;
+	s->render_state = RENDER_IDLE;
+	s->job_next = NULL;
+
+	/* Allocate render buffer */
+	s->render = malloc(BUFFER_SIZE * 4);
+	if(s->render == NULL)
+		goto error;
+	realtime_prefault(s->render, BUFFER_SIZE * 4);
+
+	/* Allocate history (drop is not possible without it) */
+	s->hist = malloc(h->hist_frames * h->channels * 4);
+	if(s->hist != NULL)
+		realtime_prefault(s->hist, h->hist_frames * h->channels * 4);
 
 	/* Add cache for write() */
 	if(input_callback == NULL)
@@ -213,16 +579,38 @@ struct output_stream *output_alsa_add_stream(struct output *h,
 	}
 
 	/* Add stream to stream list */
+	pthread_mutex_lock(&h->mutex);
 	s->next = h->streams;
 	h->streams = s;
+	pthread_mutex_unlock(&h->mutex);
 
 	return s;
 
 error:
+	if(s->render != NULL)
+		free(s->render);
+	if(s->hist != NULL)
+		free(s->hist);
 	free(s);
 	return NULL;
 }
 
+static void output_alsa_request_drop(struct output *h,
+				     struct output_stream *s, int mode)
+{
+	/* Drop only samples mixed before request */
+	if(s->drop == DROP_NONE)
+	{
+		s->drop_start = s->run_start;
+		s->drop_end = s->mix_end;
+	}
+	if(mode > s->drop)
+		s->drop = mode;
+
+	/* Output thread will drop samples before next period */
+	h->drop = 1;
+}
+
 int output_alsa_play_stream(struct output *h, struct output_stream *s)
 {
 	pthread_mutex_lock(&h->mutex);
@@ -242,8 +630,9 @@ int output_alsa_pause_stream(struct output *h, struct output_stream *s)
 {
 	pthread_mutex_lock(&h->mutex);
 
-	/* Pause */
+	/* Pause and drop samples queued in device */
 	s->is_playing = 0;
+	output_alsa_request_drop(h, s, DROP_PAUSE);
 
 	pthread_mutex_unlock(&h->mutex);
 
@@ -254,10 +643,19 @@ void output_alsa_flush_stream(struct output *h, struct output_stream *s)
 {
 	pthread_mutex_lock(&h->mutex);
 
+	/* Wait and drop rendered period */
+	output_alsa_wait_stream(h, s);
+	s->render_state = RENDER_IDLE;
+
 	/* Flush the cache */
 	cache_flush(s->cache);
 	resample_flush(s->res);
 
+	/* Drop samples queued in device */
+	output_alsa_request_drop(h, s, DROP_FLUSH);
+	s->replay_len = 0;
+	s->replay_pos = 0;
+
 	/* Must unlock input callback in cache after a flush */
 	if(s->is_playing)
 		cache_unlock(s->cache);
@@ -322,6 +720,39 @@ int output_alsa_set_cache_stream(struct output *h, struct output_stream *s,
 	return ret;
 }
 
+static uint64_t output_alsa_stream_clock(struct output *h,
+					 struct output_stream *s,
+					 struct timespec *now)
+{
+	struct timespec ts;
+	uint64_t played, queued = 0;
+	uint64_t pos;
+	int64_t elapsed;
+
+	/* Get device position from last delay, extrapolated to now */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	pos = h->written - h->delay;
+	if(h->delay > 0)
+	{
+		elapsed = (int64_t) (ts.tv_sec - h->delay_time.tv_sec) *
+			  h->samplerate + ((int64_t) ts.tv_nsec -
+			  h->delay_time.tv_nsec) * h->samplerate / 1000000000;
+		if(elapsed > h->delay)
+			elapsed = h->delay;
+		if(elapsed > 0)
+			pos += elapsed;
+	}
+	if(now != NULL)
+		*now = ts;
+
+	/* Remove samples of stream still queued in device */
+	played = s->played / h->channels;
+	if(s->mix_end > pos)
+		queued = s->mix_end - pos;
+
+	return played > queued ? played - queued : 0;
+}
+
 unsigned long output_alsa_get_status_stream(struct output *h,
 					    struct output_stream *s,
 					    enum output_stream_key key)
@@ -342,7 +773,8 @@ unsigned long output_alsa_get_status_stream(struct output *h,
 				ret = STREAM_PAUSED;
 			break;
 		case OUTPUT_STREAM_PLAYED:
-			ret = s->played * 1000 / h->samplerate / h->channels;
+			ret = output_alsa_stream_clock(h, s, NULL) * 1000 /
+			      h->samplerate;
 			break;
 		case OUTPUT_STREAM_CACHE_STATUS:
 			if(s->delay > 0 && cache_is_ready(s->cache) == 0)
@@ -369,6 +801,31 @@ unsigned long output_alsa_get_status_stream(struct output *h,
 	return ret;
 }
 
+int output_alsa_get_clock_stream(struct output *h, struct output_stream *s,
+				 struct output_clock *clock)
+{
+	/* Lock stream access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Get samples emitted by device */
+	clock->position = output_alsa_stream_clock(h, s, &clock->time);
+	clock->samplerate = h->samplerate;
+	clock->channels = h->channels;
+
+	/* Get delay of queued samples: device, rendered period and cache */
+	clock->delay = (s->played / h->channels - clock->position) * 1000 /
+		       h->samplerate;
+	if(s->render_state == RENDER_DONE && s->render_len > 0)
+		clock->delay += (uint64_t) s->render_len * 1000 /
+				h->samplerate / h->channels;
+	clock->delay += cache_delay(s->cache);
+
+	/* Unlock stream access */
+	pthread_mutex_unlock(&h->mutex);
+
+	return 0;
+}
+
 int output_alsa_set_stream_event_cb(struct output *h, struct output_stream *s,
 				    output_stream_event_cb cb, void *user_data)
 {
@@ -398,6 +855,9 @@ unsigned long output_alsa_abort_stream(struct output *h,
 	s->is_playing = 0;
 	s->abort = 1;
 
+	/* Wait end of rendering */
+	output_alsa_wait_stream(h, s);
+
 	/* Lock cache */
 	cache_lock(s->cache);
 
@@ -405,6 +865,11 @@ unsigned long output_alsa_abort_stream(struct output *h,
 	played = s->played * 1000 / h->samplerate / h->channels;
 
 	/* Add not played samples */
+	if(s->render_state == RENDER_DONE && s->render_len > 0)
+		played += (uint64_t) s->render_len * 1000 / h->samplerate /
+			  h->channels;
+	played += (uint64_t) (s->replay_len - s->replay_pos) * 1000 /
+		  h->samplerate / h->channels;
 	played += cache_delay(s->cache);
 	played += resample_delay(s->res);
 
@@ -437,6 +902,16 @@ static void output_alsa_free_stream(struct output_stream *s)
 	if(s->res != NULL)
 		resample_close(s->res);
 
+	/* Free render buffer */
+	if(s->render != NULL)
+		free(s->render);
+
+	/* Free history and replay buffers */
+	if(s->hist != NULL)
+		free(s->hist);
+	if(s->replay != NULL)
+		free(s->replay);
+
 	/* Free stream */
 	free(s);
 }
@@ -463,6 +938,9 @@ int output_alsa_remove_stream(struct output *h, struct output_stream *s)
 		prev = cur;
 		cur = cur->next;
 	}
+
+	/* Wait end of rendering */
+	output_alsa_wait_stream(h, s);
 	pthread_mutex_unlock(&h->mutex);
 
 	/* Free stream */
@@ -521,33 +999,216 @@ static inline int32_t output_alsa_add(int32_t a, int32_t b)
 }
 #endif
 
-static int output_alsa_mix_streams(struct output *h, unsigned char *in_buffer,
-				   unsigned char *out_buffer, size_t len)
+static void output_alsa_render_stream(struct output_stream *s, size_t len)
 {
-	struct output_stream *s;
 	struct a_format fmt = A_FORMAT_INIT;
+#ifdef USE_FLOAT
+	float *p = (float*) s->render;
+#else
+	int32_t *p = (int32_t*) s->render;
+#endif
+	int i;
+
+	/* Get input data */
+	s->render_len = cache_read(s->cache, s->render, len, &fmt);
+
+	/* Apply stream volume */
+	if(s->render_volume == OUTPUT_VOLUME_MAX)
+		return;
+	for(i = 0; i < s->render_len; i++)
+		p[i] = output_alsa_vol(p[i], s->render_volume);
+}
+
+static void *output_alsa_worker(void *user_data)
+{
+	struct output *h = (struct output *) user_data;
+	struct output_stream *s;
+
+	/* Set thread name and scheduling */
+	realtime_set_thread(REALTIME_OUTPUT, "alsa-render");
+
+	pthread_mutex_lock(&h->pool_mutex);
+	while(!h->pool_stop)
+	{
+		/* Wait next job */
+		if(h->jobs == NULL)
+		{
+			pthread_cond_wait(&h->pool_cond, &h->pool_mutex);
+			continue;
+		}
+
+		/* Get next stream to render */
+		s = h->jobs;
+		h->jobs = s->job_next;
+		pthread_mutex_unlock(&h->pool_mutex);
+
+		/* Render next period of stream */
+		output_alsa_render_stream(s, BUFFER_SIZE);
+
+		/* Notify end of job */
+		pthread_mutex_lock(&h->pool_mutex);
+		s->render_state = RENDER_DONE;
+		h->pending--;
+		pthread_cond_broadcast(&h->done_cond);
+	}
+	pthread_mutex_unlock(&h->pool_mutex);
+
+	return NULL;
+}
+
+static void output_alsa_wait_stream(struct output *h, struct output_stream *s)
+{
+	/* Wait until stream is no more rendered by a worker */
+	pthread_mutex_lock(&h->pool_mutex);
+	while(s->render_state == RENDER_PENDING)
+		pthread_cond_wait(&h->done_cond, &h->pool_mutex);
+	pthread_mutex_unlock(&h->pool_mutex);
+}
+
+static void output_alsa_dispatch_streams(struct output *h)
+{
+	struct output_stream *s;
+
+	/* Don't render in old format before a reconfiguration */
+	if(h->reconfig != NULL)
+		return;
+
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		/* Previous period is not mixed yet */
+		if(!s->is_playing || s->end_of_stream ||
+		   s->render_state != RENDER_IDLE)
+			continue;
+
+		/* Volume is fixed for the period */
+		s->render_volume = s->volume;
+
+		/* No worker: render in output thread */
+		if(h->worker_count == 0)
+		{
+			output_alsa_render_stream(s, BUFFER_SIZE);
+			s->render_state = RENDER_DONE;
+			continue;
+		}
+
+		/* Queue stream in worker pool */
+		pthread_mutex_lock(&h->pool_mutex);
+		s->render_state = RENDER_PENDING;
+		s->job_next = h->jobs;
+		h->jobs = s;
+		h->pending++;
+		pthread_cond_signal(&h->pool_cond);
+		pthread_mutex_unlock(&h->pool_mutex);
+	}
+}
+
+static void output_alsa_hist_write(struct output *h, unsigned char *hist,
+				   uint64_t pos, const unsigned char *buffer,
+				   size_t frames)
+{
+	size_t frame_size = h->channels * 4;
+	size_t off, len;
+
+	/* Copy samples in ring */
+	while(frames > 0)
+	{
+		off = pos % h->hist_frames;
+		len = h->hist_frames - off;
+		if(len > frames)
+			len = frames;
+		memcpy(&hist[off * frame_size], buffer, len * frame_size);
+		buffer += len * frame_size;
+		frames -= len;
+		pos += len;
+	}
+}
+
+static void output_alsa_mix_samples(struct output *h, struct output_stream *s,
+				    unsigned char *in_buffer, int in_size,
+				    unsigned char *out_buffer, int *out_size,
+				    int *first)
+{
 #ifdef USE_FLOAT
 	float *p_in = (float*) in_buffer;
 	float *p_out = (float*) out_buffer;
-	float sample;
 #else
 	int32_t *p_in = (int32_t*) in_buffer;
 	int32_t *p_out = (int32_t*) out_buffer;
-	int32_t sample;
 #endif
+	int i;
+
+	/* Keep samples in history to drop them later */
+	if(s->mix_end != h->written)
+		s->run_start = h->written;
+	if(s->hist != NULL)
+		output_alsa_hist_write(h, s->hist, h->written, in_buffer,
+				       in_size / h->channels);
+
+	/* Update played value and device position of last sample */
+	s->played += in_size;
+	s->mix_end = h->written + in_size / h->channels;
+
+	/* Add it to output buffer */
+	if(*first)
+	{
+		*first = 0;
+		memcpy(p_out, p_in, in_size * 4);
+	}
+	else
+	{
+		for(i = 0; i < *out_size && i < in_size; i++)
+			p_out[i] = output_alsa_add(p_out[i], p_in[i]);
+		for(; i < in_size; i++)
+			p_out[i] = p_in[i];
+	}
+
+	/* Update out_size */
+	if(*out_size < in_size)
+		*out_size = in_size;
+}
+
+static int output_alsa_mix_streams(struct output *h, unsigned char *out_buffer,
+				   size_t len)
+{
+	struct output_stream *s;
 	int out_size = 0;
 	int first = 1;
 	int in_size;
-	int i;
 
 	pthread_mutex_lock(&h->mutex);
+
+	/* Wait all streams rendered during previous period */
+	pthread_mutex_lock(&h->pool_mutex);
+	while(h->pending > 0)
+		pthread_cond_wait(&h->done_cond, &h->pool_mutex);
+	pthread_mutex_unlock(&h->pool_mutex);
+
 	for(s = h->streams; s != NULL; s = s->next)
 	{
-		if(!s->is_playing || s->end_of_stream)
+		/* Play again samples dropped on pause before rendered period */
+		if(s->is_playing && s->replay_len > 0)
+		{
+			in_size = s->replay_len - s->replay_pos;
+			if(in_size > len)
+				in_size = len;
+			output_alsa_mix_samples(h, s,
+						&s->replay[s->replay_pos * 4],
+						in_size, out_buffer, &out_size,
+						&first);
+			s->replay_pos += in_size;
+			if(s->replay_pos >= s->replay_len)
+				s->replay_len = s->replay_pos = 0;
 			continue;
+		}
+
+		/* Keep rendered period of paused stream for next play */
+		if(!s->is_playing || s->end_of_stream ||
+		   s->render_state != RENDER_DONE)
+			continue;
+		s->render_state = RENDER_IDLE;
 
-		/* Get input data */
-		in_size = cache_read(s->cache, in_buffer, len, &fmt);
+		/* Get rendered data */
+		in_size = s->render_len;
 		if(in_size <= 0)
 		{
 			if(in_size < 0)
@@ -592,64 +1253,750 @@ static int output_alsa_mix_streams(struct output *h, unsigned char *in_buffer,
 			s->buffering = 0;
 		}
 
-		/* Update played value (in ms) */
-		s->played += in_size;
-
 		/* Add it to output buffer */
-		if(first)
+		output_alsa_mix_samples(h, s, s->render, in_size, out_buffer,
+					&out_size, &first);
+	}
+
+	/* Render next period in worker pool while this one is played */
+	output_alsa_dispatch_streams(h);
+
+	pthread_mutex_unlock(&h->mutex);
+
+	return out_size;
+}
+
+static void output_alsa_drain(struct output *h)
+{
+	/* Play all pending samples */
+	snd_pcm_drain(h->alsa);
+
+	/* Device is empty */
+	pthread_mutex_lock(&h->mutex);
+	h->delay = 0;
+	pthread_mutex_unlock(&h->mutex);
+}
+
+static uint64_t output_alsa_run_start(struct output_stream *s)
+{
+	/* Dropped samples are not part of stream anymore */
+	if(s->drop != DROP_NONE && s->run_start < s->drop_end)
+		return s->drop_end;
+	return s->run_start;
+}
+
+static void output_alsa_remix(struct output *h, unsigned char *buffer,
+			      uint64_t pos, size_t frames)
+{
+#ifdef USE_FLOAT
+	float *p_out = (float*) buffer, *p_in;
+#else
+	int32_t *p_out = (int32_t*) buffer, *p_in;
+#endif
+	struct output_stream *s;
+	uint64_t start, end, i;
+	size_t off, o;
+	int c;
+
+	/* Start with silence */
+	memset(buffer, 0, frames * h->channels * 4);
+
+	/* Add samples of streams from their history */
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		start = output_alsa_run_start(s);
+		if(start < pos)
+			start = pos;
+		end = s->mix_end;
+		if(end > pos + frames)
+			end = pos + frames;
+		if(s->hist == NULL || start >= end)
+			continue;
+#ifdef USE_FLOAT
+		p_in = (float*) s->hist;
+#else
+		p_in = (int32_t*) s->hist;
+#endif
+		for(i = start; i < end; i++)
+		{
+			off = (i % h->hist_frames) * h->channels;
+			o = (i - pos) * h->channels;
+			for(c = 0; c < h->channels; c++)
+				p_out[o+c] = output_alsa_add(p_out[o+c],
+							     p_in[off+c]);
+		}
+	}
+}
+
+static void output_alsa_save_replay(struct output *h, struct output_stream *s,
+				    uint64_t start, uint64_t end)
+{
+	size_t len, remaining, off;
+	unsigned char *replay;
+	uint64_t i;
+
+	/* Keep samples not yet played again */
+	remaining = s->replay_len - s->replay_pos;
+	len = (end - start) * h->channels;
+	replay = malloc((len + remaining) * 4);
+	if(replay == NULL)
+		return;
+
+	/* Copy dropped samples from history, then remaining samples */
+	for(i = start, off = 0; i < end; i++, off += h->channels * 4)
+		memcpy(&replay[off],
+		       &s->hist[(i % h->hist_frames) * h->channels * 4],
+		       h->channels * 4);
+	if(remaining > 0)
+		memcpy(&replay[len * 4], &s->replay[s->replay_pos * 4],
+		       remaining * 4);
+
+	/* Replace replay buffer */
+	if(s->replay != NULL)
+		free(s->replay);
+	s->replay = replay;
+	s->replay_len = len + remaining;
+	s->replay_pos = 0;
+}
+
+static void output_alsa_append_replay(struct output_stream *s,
+				      const unsigned char *buffer, size_t len)
+{
+	size_t remaining;
+	unsigned char *replay;
+
+	/* Add samples after samples not yet played again */
+	remaining = s->replay_len - s->replay_pos;
+	replay = malloc((len + remaining) * 4);
+	if(replay == NULL)
+		return;
+	if(remaining > 0)
+		memcpy(replay, &s->replay[s->replay_pos * 4], remaining * 4);
+	memcpy(&replay[remaining * 4], buffer, len * 4);
+
+	/* Replace replay buffer */
+	if(s->replay != NULL)
+		free(s->replay);
+	s->replay = replay;
+	s->replay_len = len + remaining;
+	s->replay_pos = 0;
+}
+
+static void output_alsa_convert_replay(struct output *h,
+				       struct output_stream *s,
+				       unsigned long samplerate,
+				       unsigned char channels)
+{
+	struct a_format fmt = A_FORMAT_INIT;
+	struct resample_handle *res;
+	unsigned char *replay = NULL;
+	size_t pos, len = 0, size;
+	ssize_t in, out;
+
+	/* Resample samples to play again from previous format */
+	if(s->replay_len > s->replay_pos &&
+	   resample_open(&res, samplerate, channels, h->samplerate,
+			 h->channels, NULL, NULL, NULL) == 0)
+	{
+		size = (uint64_t) (s->replay_len - s->replay_pos) *
+		       h->samplerate / samplerate * h->channels / channels +
+		       BUFFER_SIZE;
+		replay = malloc(size * 4);
+		pos = s->replay_pos;
+		while(replay != NULL && len < size)
+		{
+			in = resample_write(res, &s->replay[pos * 4],
+					    s->replay_len - pos, &fmt);
+			if(in > 0)
+				pos += in;
+			out = resample_read(res, &replay[len * 4], size - len,
+					    &fmt);
+			if(out > 0)
+				len += out;
+			if(in <= 0 && out <= 0)
+				break;
+		}
+		resample_close(res);
+	}
+
+	/* Replace replay buffer */
+	if(s->replay != NULL)
+		free(s->replay);
+	s->replay = replay;
+	s->replay_len = replay != NULL ? len : 0;
+	s->replay_pos = 0;
+}
+
+/* Must be called with output locked */
+static void output_alsa_requeue(struct output *h, uint64_t pos)
+{
+	struct output_stream *s;
+	uint64_t start, count;
+
+	/* Move samples mixed after device position back to streams: they are
+	 * mixed again before their next samples
+	 */
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		if(s->mix_end <= pos)
+			continue;
+
+		/* Keep samples still in history */
+		start = output_alsa_run_start(s);
+		if(start < pos)
+			start = pos;
+		if(s->hist != NULL && start < s->mix_end)
 		{
-			first = 0;
-			for(i = 0; i < in_size; i++)
+			output_alsa_save_replay(h, s, start, s->mix_end);
+			count = (s->mix_end - start) * h->channels;
+			s->played = s->played > count ? s->played - count : 0;
+		}
+		s->mix_end = pos;
+	}
+	h->written = pos;
+}
+
+/* Must be called with output locked */
+static int output_alsa_can_requeue(struct output *h, uint64_t pos)
+{
+	struct output_stream *s;
+
+	/* Samples after device position must be in history */
+	for(s = h->streams; s != NULL; s = s->next)
+		if(s->mix_end > pos && s->hist == NULL &&
+		   s->mix_end > output_alsa_run_start(s))
+			return 0;
+
+	return 1;
+}
+
+/* Must be called with output locked */
+static void output_alsa_drop_device(struct output *h)
+{
+	snd_pcm_sframes_t delay;
+
+	/* Get device position and stop device just after */
+	if(snd_pcm_delay(h->alsa, &delay) < 0 || delay < 0)
+		delay = 0;
+	snd_pcm_drop(h->alsa);
+	if(delay > h->written)
+		delay = h->written;
+
+	/* Keep queued samples to play them again */
+	output_alsa_requeue(h, h->written - delay);
+
+	/* Device is empty */
+	h->delay = 0;
+	clock_gettime(CLOCK_MONOTONIC, &h->delay_time);
+}
+
+static void output_alsa_resize_hist(struct output *h, struct output_stream *s,
+				    size_t hist_frames, int keep)
+{
+	size_t frame_size = h->channels * 4;
+	unsigned char *hist;
+	uint64_t start, i;
+
+	/* Allocate history for new latency and format */
+	hist = malloc(hist_frames * frame_size);
+
+	/* Copy last samples when format is kept */
+	if(keep && hist != NULL && s->hist != NULL)
+	{
+		start = output_alsa_run_start(s);
+		i = hist_frames < h->hist_frames ? hist_frames : h->hist_frames;
+		if(s->mix_end > i && s->mix_end - i > start)
+			start = s->mix_end - i;
+		for(i = start; i < s->mix_end; i++)
+			memcpy(&hist[(i % hist_frames) * frame_size],
+			       &s->hist[(i % h->hist_frames) * frame_size],
+			       frame_size);
+		s->run_start = start;
+	}
+	else
+		s->run_start = s->mix_end;
+
+	/* Replace history */
+	if(s->hist != NULL)
+		free(s->hist);
+	s->hist = hist;
+}
+
+static void output_alsa_drop_streams(struct output *h, unsigned char *buffer,
+				     size_t len, int stopped)
+{
+	snd_pcm_sframes_t delay, frames;
+	struct output_stream *s;
+	uint64_t pos, start, first, written, count;
+	int remix = 0;
+
+	pthread_mutex_lock(&h->mutex);
+	h->drop = 0;
+
+	/* Get device position */
+	if(stopped || snd_pcm_delay(h->alsa, &delay) < 0 || delay < 0)
+		delay = 0;
+	pos = h->written - delay;
+
+	/* Find first queued sample to drop */
+	start = h->written;
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		if(s->drop == DROP_NONE || s->hist == NULL ||
+		   s->drop_end <= pos)
+			continue;
+		if(s->drop_start < start)
+			start = s->drop_start > pos ? s->drop_start : pos;
+	}
+	if(start >= h->written)
+		goto end;
+
+	/* Check if samples of other streams are queued */
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		if(s->mix_end <= pos || s->mix_end <= output_alsa_run_start(s))
+			continue;
+		remix = 1;
+
+		/* Samples can't be mixed again */
+		if(s->hist == NULL && s->mix_end > start)
+			goto end;
+	}
+
+	written = h->written;
+	if(!remix)
+	{
+		/* Only dropped samples are queued: drop all device buffer */
+		snd_pcm_drop(h->alsa);
+		snd_pcm_prepare(h->alsa);
+		start = pos;
+		h->written = pos;
+
+		/* Older samples are not in history anymore */
+		if(written - start > h->hist_frames)
+			start = written - h->hist_frames;
+	}
+	else
+	{
+		/* Remove last samples from device buffer */
+		frames = snd_pcm_rewindable(h->alsa);
+		if(frames > (snd_pcm_sframes_t) (h->written - start))
+			frames = h->written - start;
+		if(frames > (snd_pcm_sframes_t) h->hist_frames)
+			frames = h->hist_frames;
+		if(frames <= 0 || (frames = snd_pcm_rewind(h->alsa, frames)) <= 0)
+			goto end;
+		start = h->written - frames;
+		h->written = start;
+
+		/* Mix again other streams */
+		while(h->written < written)
+		{
+			frames = len / h->channels;
+			if(frames > (snd_pcm_sframes_t) (written - h->written))
+				frames = written - h->written;
+			output_alsa_remix(h, buffer, h->written, frames);
+			frames = snd_pcm_writei(h->alsa, buffer, frames);
+			if(frames <= 0)
+				break;
+			h->written += frames;
+		}
+	}
+
+	/* Update dropped streams */
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		if(s->drop == DROP_NONE || s->drop_end <= start)
+			continue;
+
+		/* Keep dropped samples to play them on resume */
+		first = s->drop_start > start ? s->drop_start : start;
+		if(s->drop == DROP_PAUSE && s->hist != NULL)
+			output_alsa_save_replay(h, s, first, s->drop_end);
+
+		/* Remove dropped samples from played value */
+		count = (s->drop_end - first) * h->channels;
+		s->played = s->played > count ? s->played - count : 0;
+	}
+
+	/* Update clock */
+	if(snd_pcm_delay(h->alsa, &delay) < 0 || delay < 0)
+		delay = 0;
+	h->delay = delay;
+	clock_gettime(CLOCK_MONOTONIC, &h->delay_time);
+
+end:
+	/* Samples after device position have been replaced */
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		if(s->mix_end > h->written)
+			s->mix_end = h->written;
+		s->drop = DROP_NONE;
+	}
+
+	pthread_mutex_unlock(&h->mutex);
+}
+
+static int output_alsa_apply_config(struct output *h, struct output_config *c,
+				    int stopped)
+{
+	unsigned long samplerate = h->samplerate;
+	unsigned char channels = h->channels;
+	unsigned int hw_latency = h->hw_latency;
+	unsigned int latency;
+	struct output_stream *s;
+	size_t hist_frames;
+	snd_pcm_t *alsa;
+	char *device;
+	int ret = 0;
+	int swap;
+	int err;
+
+	/* Get new latency */
+	latency = output_alsa_set_bounds(h, c->latency, c->min_latency,
+					 c->max_latency);
+	swap = h->alsa == NULL || strcmp(c->device, h->device) != 0;
+
+	/* Only latency is lowered: device buffer is kept as is and output
+	 * thread keeps device fill under new latency
+	 */
+	if(!swap && c->samplerate == samplerate && c->channels == channels &&
+	   latency <= hw_latency)
+	{
+		h->latency = latency;
+		goto end;
+	}
+
+	/* Stop device: queued samples are played again after reconfiguration
+	 * instead of waiting end of playback
+	 */
+	if(!stopped && h->alsa != NULL)
+		output_alsa_drop_device(h);
+
+	/* Swap ALSA device (or open it again after a failure) */
+	if(swap)
+	{
+		/* Keep current device open until new one is opened */
+		err = snd_pcm_open(&alsa, c->device, SND_PCM_STREAM_PLAYBACK,
+				   0);
+		if(err < 0 && h->alsa != NULL)
+		{
+			/* New device can use same hardware: close current */
+			snd_pcm_close(h->alsa);
+			h->alsa = NULL;
+			err = snd_pcm_open(&alsa, c->device,
+					   SND_PCM_STREAM_PLAYBACK, 0);
+		}
+
+		if(err == 0)
+		{
+			if(h->alsa != NULL)
+				snd_pcm_close(h->alsa);
+			h->alsa = alsa;
+			device = strdup(c->device);
+			if(device != NULL)
 			{
-				sample = output_alsa_vol(p_in[i], s->volume);
-				p_out[i] = sample;
+				free(h->device);
+				h->device = device;
 			}
 		}
 		else
 		{
-			/* Add it to output buffer */
-			for(i = 0; i < in_size; i++)
+			/* Reopen previous device: output has failed until a
+			 * next configuration when it is not possible
+			 */
+			if(h->alsa == NULL &&
+			   snd_pcm_open(&h->alsa, h->device,
+					SND_PCM_STREAM_PLAYBACK, 0) < 0)
 			{
-				sample = output_alsa_vol(p_in[i], s->volume);
-				p_out[i] = output_alsa_add(p_out[i], sample);
+				h->alsa = NULL;
+				return -1;
 			}
+			ret = -1;
 		}
+	}
 
-		/* Update out_size */
-		if(out_size < in_size);
-			out_size = in_size;
+	/* Set new format and latency */
+	h->samplerate = c->samplerate;
+	h->channels = c->channels;
+	if(output_alsa_set_params(h, latency) != 0)
+	{
+		/* Restore previous configuration */
+		h->samplerate = samplerate;
+		h->channels = channels;
+		output_alsa_set_params(h, hw_latency);
+		return -1;
 	}
+
+end:
+	/* Same format: keep streams as is */
+	hist_frames = output_alsa_hist_frames(h);
+	if(samplerate == h->samplerate && channels == h->channels &&
+	   hist_frames == h->hist_frames)
+		return ret;
+
+	/* Switch streams to new format, with their cache and decoder */
+	for(s = h->streams; s != NULL; s = s->next)
+	{
+		/* Reallocate history for new latency and format */
+		output_alsa_resize_hist(h, s, hist_frames,
+					samplerate == h->samplerate &&
+					channels == h->channels);
+		s->drop = DROP_NONE;
+
+		/* Same format: keep stream as is */
+		if(samplerate == h->samplerate && channels == h->channels)
+			continue;
+
+		/* Play rendered period after samples to play again and
+		 * convert them to new format
+		 */
+		output_alsa_wait_stream(h, s);
+		if(s->render_state == RENDER_DONE && s->render_len > 0)
+		{
+			output_alsa_append_replay(s, s->render, s->render_len);
+			s->render_state = RENDER_IDLE;
+		}
+		output_alsa_convert_replay(h, s, samplerate, channels);
+
+		/* Change resampler target and convert cached samples */
+		resample_set_output(s->res, h->samplerate, h->channels);
+		cache_convert(s->cache, h->samplerate, h->channels);
+
+		/* Convert played samples */
+		s->played = s->played * h->samplerate * h->channels /
+			    samplerate / channels;
+	}
+	h->hist_frames = hist_frames;
+
+	return ret;
+}
+
+static void output_alsa_reconfig(struct output *h, int stopped)
+{
+	/* Apply new configuration */
+	pthread_mutex_lock(&h->mutex);
+	h->reconfig_ret = output_alsa_apply_config(h, h->reconfig, stopped);
+	h->reconfig = NULL;
+	pthread_cond_broadcast(&h->reconfig_cond);
 	pthread_mutex_unlock(&h->mutex);
+}
 
-	return out_size;
+static void output_alsa_update_stats(struct output *h,
+				     snd_pcm_sframes_t frames,
+				     unsigned long mix_time)
+{
+	snd_pcm_sframes_t delay;
+	unsigned long ms;
+	int i;
+
+	/* Get current delay of PCM output */
+	if(snd_pcm_delay(h->alsa, &delay) < 0 || delay < 0)
+		delay = 0;
+	ms = delay * 1000 / h->samplerate;
+
+	/* Lock stats access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Update playback clock */
+	h->written += frames;
+	h->delay = delay;
+	clock_gettime(CLOCK_MONOTONIC, &h->delay_time);
+
+	/* Update delay histogram */
+	for(i = 0; i < DELAY_BINS - 1; i++)
+		if(ms < output_alsa_delay_bins[i])
+			break;
+	h->delay_hist[i]++;
+
+	/* Update mix time */
+	h->periods++;
+	h->mix_time = mix_time;
+	h->mix_time_total += mix_time;
+	if(mix_time > h->mix_time_max)
+		h->mix_time_max = mix_time;
+
+	/* Unlock stats access */
+	pthread_mutex_unlock(&h->mutex);
+}
+
+static void output_alsa_adapt_latency(struct output *h, int xrun)
+{
+	unsigned int latency;
+	time_t now;
+
+	/* Adaptive latency is disabled */
+	if(h->max_latency <= h->min_latency)
+		return;
+
+	/* Get current time */
+	now = output_alsa_now();
+	latency = h->latency;
+
+	if(xrun)
+	{
+		/* Start a new xrun window */
+		if(now - h->xrun_start > XRUN_WINDOW)
+		{
+			h->xrun_start = now;
+			h->xrun_count = 0;
+		}
+		h->xrun_count++;
+		h->last_xrun = now;
+
+		/* Too many xruns: double latency */
+		if(h->xrun_count < XRUN_COUNT || latency >= h->max_latency)
+			return;
+		latency *= 2;
+		if(latency > h->max_latency)
+			latency = h->max_latency;
+
+		/* Drop pending samples: sound is already broken */
+		if(latency > h->hw_latency)
+			snd_pcm_drop(h->alsa);
+	}
+	else
+	{
+		/* Lower latency by 25% after a stable period */
+		if(latency <= h->min_latency ||
+		   now - h->last_xrun < STABLE_TIME ||
+		   now - h->last_change < STABLE_TIME)
+			return;
+		latency -= latency / 4;
+		if(latency < h->min_latency)
+			latency = h->min_latency;
+	}
+
+	/* Keep device buffer when it is large enough: output thread rewinds
+	 * samples over lower latency and keeps device fill under it, so
+	 * playback is not interrupted. Otherwise, reconfigure PCM output
+	 * (restore buffer on failure).
+	 */
+	pthread_mutex_lock(&h->mutex);
+	if(latency <= h->hw_latency)
+		h->latency = latency;
+	else if(output_alsa_set_params(h, latency) != 0)
+		output_alsa_set_params(h, h->hw_latency);
+	pthread_mutex_unlock(&h->mutex);
+
+	/* Reset controller */
+	h->xrun_count = 0;
+	h->last_change = now;
+}
+
+static void output_alsa_set_fill(struct output *h)
+{
+	snd_pcm_uframes_t buffer_size, period_size, max;
+	snd_pcm_sframes_t delay, frames;
+	snd_pcm_sw_params_t *params;
+
+	/* Get maximum device fill for latency */
+	if(snd_pcm_get_params(h->alsa, &buffer_size, &period_size) < 0)
+		return;
+	max = (snd_pcm_uframes_t) h->latency * h->samplerate / 1000;
+	if(max > buffer_size)
+		max = buffer_size;
+	if(max < period_size)
+		max = period_size;
+
+	/* Remove samples over maximum fill from device buffer instead of
+	 * waiting end of their playback: streams play them again after
+	 */
+	pthread_mutex_lock(&h->mutex);
+	if(snd_pcm_delay(h->alsa, &delay) == 0 &&
+	   delay > (snd_pcm_sframes_t) max)
+	{
+		frames = snd_pcm_rewindable(h->alsa);
+		if(frames > delay - (snd_pcm_sframes_t) max)
+			frames = delay - max;
+		if(frames > 0 && frames <= h->written &&
+		   output_alsa_can_requeue(h, h->written - frames) &&
+		   (frames = snd_pcm_rewind(h->alsa, frames)) > 0)
+		{
+			output_alsa_requeue(h, h->written - frames);
+			h->delay = delay - frames;
+			clock_gettime(CLOCK_MONOTONIC, &h->delay_time);
+		}
+	}
+	pthread_mutex_unlock(&h->mutex);
+
+	/* Start device and wake up output thread at maximum fill */
+	h->avail_min = buffer_size - max;
+	if(h->avail_min < period_size)
+		h->avail_min = period_size;
+	snd_pcm_sw_params_alloca(&params);
+	if(snd_pcm_sw_params_current(h->alsa, params) < 0 ||
+	   snd_pcm_sw_params_set_start_threshold(h->alsa, params, max) < 0 ||
+	   snd_pcm_sw_params_set_avail_min(h->alsa, params, h->avail_min) < 0
+	   || snd_pcm_sw_params(h->alsa, params) < 0)
+		return;
+
+	h->fill_latency = h->latency;
 }
 
 static void *output_alsa_thread(void *user_data)
 {
 	struct output *h = (struct output *) user_data;
+	struct timespec mix_start, mix_end;
 	snd_pcm_sframes_t frames;
-	unsigned char *in_buffer, *out_buffer;
+	unsigned char *out_buffer;
 	int in_size = BUFFER_SIZE;
 	int out_size = 0;
 	time_t start = 0;
 	int stopped = 1;
+	int xrun;
+
+	/* Set thread name and scheduling */
+	realtime_set_thread(REALTIME_OUTPUT, "alsa-output");
 
 	/* Allocate buffer */
-	in_buffer = malloc(in_size * 4);
-	if(in_buffer == NULL)
-		return NULL;
 	out_buffer = malloc(in_size * 4);
 	if(out_buffer == NULL)
-	{
-		free(in_buffer);
 		return NULL;
-	}
+
+	/* Prefault buffer */
+	realtime_prefault(out_buffer, in_size * 4);
 
 	/* Wait end signal */
 	while(!h->stop)
 	{
-		out_size = output_alsa_mix_streams(h, in_buffer, out_buffer,
-						   in_size) / h->channels;
+		/* Drop samples of paused or flushed streams */
+		if(h->drop && h->alsa != NULL)
+			output_alsa_drop_streams(h, out_buffer, in_size,
+						 stopped);
+
+		/* Apply new configuration */
+		if(h->reconfig != NULL)
+		{
+			output_alsa_reconfig(h, stopped);
+			if(h->alsa == NULL)
+				stopped = 1;
+			start = 0;
+		}
+
+		/* Output has failed: wait for a new configuration */
+		if(h->alsa == NULL)
+		{
+			usleep(MIN_LATENCY * 1000);
+			continue;
+		}
+
+		/* Latency changed under device buffer: update device fill */
+		if(h->latency != h->fill_latency)
+			output_alsa_set_fill(h);
+
+		/* Wait until device fill is under latency before mixing */
+		if(h->latency < h->hw_latency && !stopped &&
+		   snd_pcm_state(h->alsa) == SND_PCM_STATE_RUNNING &&
+		   snd_pcm_avail_update(h->alsa) <
+		   (snd_pcm_sframes_t) h->avail_min)
+			snd_pcm_wait(h->alsa, h->hw_latency);
+
+		clock_gettime(CLOCK_MONOTONIC, &mix_start);
+		out_size = output_alsa_mix_streams(h, out_buffer, in_size) /
+			   h->channels;
+		clock_gettime(CLOCK_MONOTONIC, &mix_end);
+
 		if(out_size == 0)
 		{
 			/* ALSA PCM is stopped */
@@ -669,7 +2016,7 @@ static void *output_alsa_thread(void *user_data)
 			if(time(NULL) - start > MAX_SILENCE)
 			{
 				/* Stop ALSA PCM output */
-				snd_pcm_drain(h->alsa);
+				output_alsa_drain(h);
 				stopped = 1;
 				continue;
 			}
@@ -690,29 +2037,160 @@ static void *output_alsa_thread(void *user_data)
 		frames = snd_pcm_writei(h->alsa, out_buffer, out_size);
 
 		/* Try again to send frames */
+		xrun = 0;
 		if (frames < 0)
-			frames = snd_pcm_recover(h->alsa, frames, 0);
+		{
+			/* Count underruns */
+			if(frames == -EPIPE)
+			{
+				pthread_mutex_lock(&h->mutex);
+				h->xruns++;
+				pthread_mutex_unlock(&h->mutex);
+				xrun = 1;
+			}
+			frames = snd_pcm_recover(h->alsa, frames, 1);
+		}
 
 		/* Problem with ALSA */
 		if (frames < 0)
 		{
-			printf("snd_pcm_writei failed!\n");
+			fprintf(stderr, "snd_pcm_writei failed: %s\n",
+				snd_strerror(frames));
 			break;
 		}
 
-		/* Underrun */
+		/* Short write */
 		if (frames > 0 && frames < (long) out_size)
-			printf("Short write (expected %li, wrote %li)\n",
-			      (long) out_size, frames);
+		{
+			pthread_mutex_lock(&h->mutex);
+			h->short_writes++;
+			pthread_mutex_unlock(&h->mutex);
+		}
+
+		/* Update statistics (mix time in us) */
+		output_alsa_update_stats(h, frames,
+			       (mix_end.tv_sec - mix_start.tv_sec) * 1000000 +
+			       (mix_end.tv_nsec - mix_start.tv_nsec) / 1000);
+
+		/* Update latency */
+		output_alsa_adapt_latency(h, xrun);
 	}
 
-	/* Free buffers */
-	free(in_buffer);
+	/* Free buffer */
 	free(out_buffer);
 
+	/* Notify end of thread */
+	pthread_mutex_lock(&h->mutex);
+	h->running = 0;
+	pthread_cond_broadcast(&h->reconfig_cond);
+	pthread_mutex_unlock(&h->mutex);
+
 	return NULL;
 }
 
+struct json *output_alsa_get_stats(struct output *h)
+{
+	struct json *json, *hist, *tmp;
+	unsigned int from = 0;
+	int i;
+
+	/* Create JSON object */
+	json = json_new();
+	if(json == NULL)
+		return NULL;
+
+	/* Lock stats access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Fill latency status */
+	json_set_int(json, "latency", h->latency);
+	json_set_bool(json, "adaptive_latency",
+		      h->max_latency > h->min_latency);
+	json_set_int(json, "min_latency", h->min_latency);
+	json_set_int(json, "max_latency", h->max_latency);
+
+	/* Fill counters */
+	json_set_int64(json, "xruns", h->xruns);
+	json_set_int64(json, "short_writes", h->short_writes);
+	json_set_int64(json, "periods", h->periods);
+
+	/* Fill mix time per period (in us) */
+	json_set_int64(json, "mix_time", h->mix_time);
+	json_set_int64(json, "mix_time_max", h->mix_time_max);
+	json_set_int64(json, "mix_time_avg", h->periods > 0 ?
+				     h->mix_time_total / h->periods : 0);
+
+	/* Fill delay histogram (in ms, "to" is -1 for last bin) */
+	hist = json_new_array();
+	for(i = 0; hist != NULL && i < DELAY_BINS; i++)
+	{
+		tmp = json_new();
+		if(tmp == NULL)
+			continue;
+		json_set_int(tmp, "from", from);
+		json_set_int(tmp, "to", i < DELAY_BINS - 1 ?
+					 (int) output_alsa_delay_bins[i] : -1);
+		json_set_int64(tmp, "count", h->delay_hist[i]);
+		if(json_array_add(hist, tmp) != 0)
+			json_free(tmp);
+		if(i < DELAY_BINS - 1)
+			from = output_alsa_delay_bins[i];
+	}
+	json_add(json, "delay_histogram", hist);
+
+	/* Unlock stats access */
+	pthread_mutex_unlock(&h->mutex);
+
+	return json;
+}
+
+int output_alsa_reconfigure(struct output *h, const char *device,
+			    unsigned long samplerate, unsigned char channels,
+			    unsigned int latency, unsigned int min_latency,
+			    unsigned int max_latency)
+{
+	struct output_config c;
+	int ret;
+
+	/* Prepare new configuration */
+	if(device == NULL || *device == '\0')
+		device = DEFAULT_DEVICE;
+	c.device = (char *) device;
+	c.samplerate = samplerate;
+	c.channels = channels;
+	c.latency = latency;
+	c.min_latency = min_latency;
+	c.max_latency = max_latency;
+
+	/* Lock output access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Output thread is not running: apply directly */
+	if(!h->running)
+	{
+		ret = output_alsa_apply_config(h, &c, 1);
+		pthread_mutex_unlock(&h->mutex);
+		return ret;
+	}
+
+	/* Wait end of a previous reconfiguration */
+	while(h->reconfig != NULL && h->running)
+		pthread_cond_wait(&h->reconfig_cond, &h->mutex);
+
+	/* Give configuration to output thread and wait until applied */
+	h->reconfig = &c;
+	h->reconfig_ret = -1;
+	while(h->reconfig == &c && h->running)
+		pthread_cond_wait(&h->reconfig_cond, &h->mutex);
+	if(h->reconfig == &c)
+		h->reconfig = NULL;
+	ret = h->reconfig_ret;
+
+	/* Unlock output access */
+	pthread_mutex_unlock(&h->mutex);
+
+	return ret;
+}
 
 int output_alsa_close(struct output *h)
 {
@@ -728,6 +2206,16 @@ int output_alsa_close(struct output *h)
 	if(pthread_join(h->thread, NULL) < 0)
 		return -1;
 
+	/* Wait end of pending jobs and stop workers */
+	pthread_mutex_lock(&h->pool_mutex);
+	while(h->pending > 0)
+		pthread_cond_wait(&h->done_cond, &h->pool_mutex);
+	h->pool_stop = 1;
+	pthread_cond_broadcast(&h->pool_cond);
+	pthread_mutex_unlock(&h->pool_mutex);
+	while(h->worker_count > 0)
+		pthread_join(h->workers[--h->worker_count], NULL);
+
 	/* Free streams */
 	while(h->streams != NULL)
 	{
@@ -736,13 +2224,18 @@ int output_alsa_close(struct output *h)
 		output_alsa_free_stream(s);
 	}
 
-	/* Close alsa */
+	/* Close mixer and alsa */
+	output_alsa_close_mixer(h);
 	if(h->alsa != NULL)
 		snd_pcm_close(h->alsa);
 
 	/* Free ALSA config */
 	snd_config_update_free_global();
 
+	/* Free device name */
+	if(h->device != NULL)
+		free(h->device);
+
 	/* Free structure */
 	free(h);
 
@@ -752,6 +2245,7 @@ int output_alsa_close(struct output *h)
 struct output_module output_alsa = {
 	.open = (void*) &output_alsa_open,
 	.set_volume = (void*) &output_alsa_set_volume,
+	.set_mixer = (void*) &output_alsa_set_mixer,
 	.get_volume = (void*) &output_alsa_get_volume,
 	.add_stream = (void*) &output_alsa_add_stream,
 	.play_stream = (void*) &output_alsa_play_stream,
@@ -766,5 +2260,8 @@ struct output_module output_alsa = {
 	.abort_stream = (void*) &output_alsa_abort_stream,
 	.restore_stream = (void*) &output_alsa_restore_stream,
 	.remove_stream = (void*) &output_alsa_remove_stream,
+	.get_clock_stream = (void*) &output_alsa_get_clock_stream,
+	.get_stats = (void*) &output_alsa_get_stats,
+	.reconfigure = (void*) &output_alsa_reconfigure,
 	.close = (void*) &output_alsa_close,
 };
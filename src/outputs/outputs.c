@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <pthread.h>
 
@@ -44,6 +45,73 @@
 /* Output ID length */
 #define OUTPUTS_ID_SIZE 10
 
+/* Name of zone configured with root keys of configuration */
+#define DEFAULT_ZONE "default"
+
+/* Fan-out buffer size (in samples): 1s at 96kHz in stereo.
+ * A zone which lags more than this size skips oldest samples.
+ */
+#define TEE_SIZE 192000
+
+struct output_tee_format {
+	/* Position of first sample with this format */
+	uint64_t pos;
+	struct a_format fmt;
+	/* Next format in list */
+	struct output_tee_format *next;
+};
+
+struct output_tee_reader {
+	/* Fan-out buffer */
+	struct output_tee *tee;
+	/* Position of next sample to read */
+	uint64_t pos;
+	/* Next reader in list */
+	struct output_tee_reader *next;
+};
+
+struct output_tee {
+	/* Shared input callback (decoder) */
+	a_read_cb input_callback;
+	void *user_data;
+	/* Decoded samples: first sample is at position base */
+	unsigned char *buffer;
+	size_t len;
+	uint64_t base;
+	int end_of_stream;
+	/* Format list */
+	struct output_tee_format *formats;
+	/* Readers: one per zone */
+	struct output_tee_reader *readers;
+	/* Not used by stream anymore: free with last reader */
+	int closing;
+	/* Mutex for thread-safe */
+	pthread_mutex_t mutex;
+};
+
+struct output_zone_stream {
+	/* Zone of stream */
+	struct output_zone *zone;
+	/* Stream of zone */
+	struct output_stream_handle *s;
+	/* Output stream module handle */
+	void *stream;
+	/* Reader on fan-out buffer (NULL to read stream input directly) */
+	struct output_tee_reader *reader;
+	/* Switch to stream input when all samples of reader have been read */
+	int detach;
+	/* Reads in progress: reader is switched when none is running */
+	int reading;
+	pthread_cond_t cond;
+	pthread_mutex_t mutex;
+	/* Samples written ahead of other zones with output_write_stream() */
+	size_t ahead;
+	/* Played status (saved on reload) */
+	unsigned long played;
+	/* Next zone in list */
+	struct output_zone_stream *next;
+};
+
 struct output_stream_handle {
 	/* Stream properties */
 	char id[OUTPUTS_ID_SIZE+1];
@@ -55,13 +123,19 @@ struct output_stream_handle {
 	int use_cache_thread;
 	void *input_callback;
 	void *user_data;
+	/* Stream event callback */
+	output_stream_event_cb event_cb;
+	void *event_ud;
 	/* Stream status */
 	int is_playing;
-	unsigned long played;
+	/* Zones routing (NULL to use output routing) */
+	char *route;
+	/* Fan-out buffer used when stream is sent to several zones */
+	struct output_tee *tee;
+	/* Output stream in each zone: first handles events */
+	struct output_zone_stream *zones;
 	/* Next stream in list */
 	struct output_stream_handle *next;
-	/* Output stream module handle */
-	void *stream;
 };
 
 struct output_handle {
@@ -70,6 +144,8 @@ struct output_handle {
 	char *name;
 	/* Global volume for the handle */
 	unsigned int volume;
+	/* Zones routing (NULL to use zones configuration) */
+	char *route;
 	/* Outputs associated handle */
 	struct outputs_handle *outputs;
 	pthread_mutex_t *mutex;
@@ -90,19 +166,38 @@ struct output_list {
 	struct output_list *next;
 };
 
+struct output_zone {
+	/* Zone name */
+	char *name;
+	/* Output module */
+	struct output_list *current;
+	struct output_module *mod;
+	void *handle;
+	/* Configuration */
+	char *device;
+	char *modules;
+	unsigned long samplerate;
+	unsigned char channels;
+	unsigned int latency;
+	unsigned int min_latency;
+	unsigned int max_latency;
+	/* Hardware mixer for master volume (NULL for software volume) */
+	char *mixer;
+	char *mixer_device;
+	unsigned int mixer_range;
+	int hw_volume;
+	/* Next zone in list */
+	struct output_zone *next;
+};
+
 struct outputs_handle {
 	/* Output module list */
 	int output_count;
 	struct output_list *list;
-	/* Current output module */
-	void *handle;
-	struct output_module *mod;
-	struct output_list *current;
+	/* Output zones: first is the default zone */
+	struct output_zone *zones;
 	struct output_handle *handles;
 	/* Configuration */
-	unsigned long samplerate;
-	unsigned char channels;
-	unsigned int latency;
 	unsigned int volume;
 	/* Mutex for thread-safe */
 	pthread_mutex_t mutex;
@@ -111,60 +206,380 @@ struct outputs_handle {
 static int output_reset_volume_stream(struct outputs_handle *h,
 				      struct output_handle *handle,
 				      struct output_stream_handle *stream);
+static void outputs_route_stream(struct outputs_handle *h,
+				 struct output_handle *handle,
+				 struct output_stream_handle *s);
 
-int outputs_open(struct outputs_handle **handle, struct json *config)
+/******************************************************************************
+ *                               Fan-out part                                 *
+ ******************************************************************************/
+
+static struct output_tee *output_tee_open(a_read_cb input_callback,
+					  void *user_data)
 {
-	struct outputs_handle *h;
-	struct output_list list[] = {
-		{"alsa", "ALSA", "ALSA audio output.", &output_alsa, NULL},
-	};
-	struct output_list *l;
-	int i;
+	struct output_tee *t;
 
 	/* Allocate structure */
-	*handle = malloc(sizeof(struct outputs_handle));
-	if(*handle == NULL)
-		return -1;
-	h = *handle;
+	t = malloc(sizeof(struct output_tee));
+	if(t == NULL)
+		return NULL;
 
 	/* Init structure */
-	h->list = NULL;
-	h->output_count = 0;
-	h->mod = NULL;
-	h->current = NULL;
-	h->handle = NULL;
-	h->handles = NULL;
-	h->samplerate = 0;
-	h->channels = 0;
-	h->latency = 0;
+	memset(t, 0, sizeof(struct output_tee));
+	t->input_callback = input_callback;
+	t->user_data = user_data;
 
-	/* Create output list */
-	for(i = 0; i < sizeof(list)/sizeof(struct output_list); i++)
+	/* Allocate buffer */
+	t->buffer = malloc(TEE_SIZE * 4);
+	if(t->buffer == NULL)
 	{
-		/* Add output module */
-		l = malloc(sizeof(struct output_list));
-		if(l != NULL)
+		free(t);
+		return NULL;
+	}
+
+	/* Init thread mutex */
+	pthread_mutex_init(&t->mutex, NULL);
+
+	return t;
+}
+
+static void output_tee_drop(struct output_tee *t, size_t len)
+{
+	struct output_tee_format *f;
+
+	if(len > t->len)
+		len = t->len;
+
+	/* Move remaining samples */
+	if(len < t->len)
+		memmove(t->buffer, &t->buffer[len*4], (t->len - len) * 4);
+	t->len -= len;
+	t->base += len;
+
+	/* Free formats of dropped samples */
+	while(t->formats != NULL && t->formats->next != NULL &&
+	      t->formats->next->pos <= t->base)
+	{
+		f = t->formats;
+		t->formats = f->next;
+		free(f);
+	}
+}
+
+static int output_tee_fill(struct output_tee *t, size_t size)
+{
+	struct a_format fmt = { 0, 0 };
+	struct output_tee_format *f, *last;
+	int len;
+
+	if(size > TEE_SIZE)
+		size = TEE_SIZE;
+
+	/* Drop oldest samples when full: lagging zones skip them */
+	if(t->len + size > TEE_SIZE)
+		output_tee_drop(t, t->len + size - TEE_SIZE);
+
+	/* Decode next samples */
+	len = t->input_callback(t->user_data, &t->buffer[t->len*4], size,
+				&fmt);
+	if(len < 0)
+	{
+		t->end_of_stream = 1;
+		return -1;
+	}
+	t->end_of_stream = 0;
+	if(len == 0)
+		return 0;
+
+	/* Add a new format in list */
+	for(last = t->formats; last != NULL && last->next != NULL;
+	    last = last->next);
+	if(last == NULL || last->fmt.samplerate != fmt.samplerate ||
+	   last->fmt.channels != fmt.channels)
+	{
+		f = malloc(sizeof(struct output_tee_format));
+		if(f != NULL)
 		{
-			l->id = list[i].id ? strdup(list[i].id) : NULL;
-			l->name =  list[i].name ? strdup(list[i].name) : NULL;
-			l->description =  list[i].description != NULL ?
-					     strdup(list[i].description) : NULL;
-			l->mod = list[i].mod;
-			l->next = h->list;
-			h->list = l;
-			h->output_count++;
+			f->pos = t->base + t->len;
+			format_cpy(&f->fmt, &fmt);
+			f->next = NULL;
+			if(last == NULL)
+				t->formats = f;
+			else
+				last->next = f;
 		}
 	}
+	t->len += len;
 
-	/* Init thread mutex */
-	pthread_mutex_init(&h->mutex, NULL);
+	return len;
+}
 
-	/* Set configuration */
-	outputs_set_config(h, config);
+static int output_tee_read(void *user_data, unsigned char *buffer,
+			   size_t size, struct a_format *fmt)
+{
+	struct output_tee_reader *r = user_data, *l;
+	struct output_tee *t = r->tee;
+	struct output_tee_format *f;
+	uint64_t min;
+	size_t len;
+	int ret = 0;
+
+	/* Lock fan-out access */
+	pthread_mutex_lock(&t->mutex);
+
+	/* Samples have been dropped */
+	if(r->pos < t->base)
+		r->pos = t->base;
+
+	/* Most advanced zone decodes next samples for all zones */
+	if(r->pos == t->base + t->len)
+		output_tee_fill(t, size);
+
+	/* No samples available */
+	len = t->base + t->len - r->pos;
+	if(len == 0 || t->formats == NULL)
+	{
+		ret = t->end_of_stream ? -1 : 0;
+		goto end;
+	}
+
+	/* Get format of samples and stop at next format change */
+	for(f = t->formats; f->next != NULL && f->next->pos <= r->pos;
+	    f = f->next);
+	if(f->next != NULL && f->next->pos - r->pos < len)
+		len = f->next->pos - r->pos;
+	if(len > size)
+		len = size;
+
+	/* Copy samples */
+	memcpy(buffer, &t->buffer[(r->pos - t->base) * 4], len * 4);
+	format_cpy(fmt, &f->fmt);
+	r->pos += len;
+	ret = len;
+
+	/* Drop samples read by all zones */
+	for(l = t->readers, min = r->pos; l != NULL; l = l->next)
+		if(l->pos < min)
+			min = l->pos;
+	if(min > t->base)
+		output_tee_drop(t, min - t->base);
+
+end:
+	/* Unlock fan-out access */
+	pthread_mutex_unlock(&t->mutex);
+
+	return ret;
+}
+
+static struct output_tee_reader *output_tee_add_reader(struct output_tee *t)
+{
+	struct output_tee_reader *r;
+
+	/* Allocate reader */
+	r = malloc(sizeof(struct output_tee_reader));
+	if(r == NULL)
+		return NULL;
+
+	/* Start reading at most recent decoded sample */
+	pthread_mutex_lock(&t->mutex);
+	r->tee = t;
+	r->pos = t->base + t->len;
+	r->next = t->readers;
+	t->readers = r;
+	pthread_mutex_unlock(&t->mutex);
+
+	return r;
+}
+
+static size_t output_tee_pending(struct output_tee_reader *r)
+{
+	struct output_tee *t = r->tee;
+	size_t len;
+
+	/* Get count of samples decoded but not yet read by reader */
+	pthread_mutex_lock(&t->mutex);
+	len = r->pos < t->base ? t->len : t->base + t->len - r->pos;
+	pthread_mutex_unlock(&t->mutex);
+
+	return len;
+}
+
+static void output_tee_close(struct output_tee *t);
+
+static void output_tee_remove_reader(struct output_tee_reader *r)
+{
+	struct output_tee *t = r->tee;
+	struct output_tee_reader **rp;
+	int close;
+
+	/* Remove reader from list */
+	pthread_mutex_lock(&t->mutex);
+	for(rp = &t->readers; *rp != NULL; rp = &(*rp)->next)
+	{
+		if(*rp == r)
+		{
+			*rp = r->next;
+			break;
+		}
+	}
+	close = t->closing && t->readers == NULL;
+	pthread_mutex_unlock(&t->mutex);
+
+	/* Free reader */
+	free(r);
+
+	/* Free fan-out buffer after last reader */
+	if(close)
+		output_tee_close(t);
+}
+
+static void output_tee_release(struct output_tee *t)
+{
+	int close;
+
+	if(t == NULL)
+		return;
+
+	/* Free now or when last reader is removed */
+	pthread_mutex_lock(&t->mutex);
+	t->closing = 1;
+	close = t->readers == NULL;
+	pthread_mutex_unlock(&t->mutex);
+
+	if(close)
+		output_tee_close(t);
+}
+
+static void output_tee_flush(struct output_tee *t)
+{
+	struct output_tee_reader *r;
+
+	/* Drop all decoded samples */
+	pthread_mutex_lock(&t->mutex);
+	output_tee_drop(t, t->len);
+	for(r = t->readers; r != NULL; r = r->next)
+		r->pos = t->base;
+	t->end_of_stream = 0;
+	pthread_mutex_unlock(&t->mutex);
+}
+
+static void output_tee_close(struct output_tee *t)
+{
+	struct output_tee_format *f;
+
+	/* Free formats */
+	while(t->formats != NULL)
+	{
+		f = t->formats;
+		t->formats = f->next;
+		free(f);
+	}
+
+	/* Free buffer */
+	pthread_mutex_destroy(&t->mutex);
+	free(t->buffer);
+	free(t);
+}
+
+/******************************************************************************
+ *                                Zone part                                   *
+ ******************************************************************************/
+
+static int outputs_list_has(const char *list, const char *name)
+{
+	size_t len;
+
+	if(list == NULL || name == NULL)
+		return 0;
+	len = strlen(name);
+
+	/* Look for name in comma separated list */
+	while(list != NULL && *list != '\0')
+	{
+		if(strncmp(list, name, len) == 0 &&
+		   (list[len] == ',' || list[len] == '\0'))
+			return 1;
+		list = strchr(list, ',');
+		if(list != NULL)
+			list++;
+	}
 
 	return 0;
 }
 
+static char *outputs_list_from_json(struct json *array)
+{
+	const char *str;
+	size_t len = 0;
+	char *list;
+	int i, count;
+
+	if(array == NULL)
+		return NULL;
+
+	/* Calculate list length */
+	count = json_array_length(array);
+	for(i = 0; i < count; i++)
+	{
+		str = json_to_string(json_array_get(array, i));
+		if(str != NULL)
+			len += strlen(str) + 1;
+	}
+
+	/* Allocate list */
+	list = malloc(len + 1);
+	if(list == NULL)
+		return NULL;
+	*list = '\0';
+
+	/* Fill list */
+	for(i = 0; i < count; i++)
+	{
+		str = json_to_string(json_array_get(array, i));
+		if(str == NULL || *str == '\0')
+			continue;
+		if(*list != '\0')
+			strcat(list, ",");
+		strcat(list, str);
+	}
+
+	return list;
+}
+
+static struct json *outputs_list_to_json(const char *list)
+{
+	struct json *array;
+	const char *next;
+	size_t len;
+
+	/* Create a JSON array */
+	array = json_new_array();
+	if(array == NULL || list == NULL)
+		return array;
+
+	/* Add all names */
+	while(*list != '\0')
+	{
+		next = strchr(list, ',');
+		len = next == NULL ? strlen(list) : next - list;
+		if(len > 0)
+			json_array_add(array, json_new_string_len(list, len));
+		if(next == NULL)
+			break;
+		list = next + 1;
+	}
+
+	return array;
+}
+
+static int outputs_strcmp(const char *s1, const char *s2)
+{
+	/* Compare strings which can be NULL */
+	if(s1 == NULL || s2 == NULL)
+		return s1 != s2;
+	return strcmp(s1, s2);
+}
+
 static struct output_list *outputs_find_module(struct outputs_handle *h,
 					       const char *id)
 {
@@ -181,99 +596,654 @@ static struct output_list *outputs_find_module(struct outputs_handle *h,
 	return NULL;
 }
 
-static void outputs_reload(struct outputs_handle *h, struct output_list *new,
-			   unsigned long samplerate, unsigned char channels,
-			   unsigned int latency)
+static struct output_zone *outputs_find_zone(struct output_zone *zones,
+					     const char *name)
+{
+	struct output_zone *z;
+
+	/* Look for zone name */
+	for(z = zones; z != NULL; z = z->next)
+		if(strcmp(z->name, name) == 0)
+			return z;
+
+	return NULL;
+}
+
+static int outputs_zone_routed(struct output_zone *z,
+			       struct output_handle *handle,
+			       struct output_stream_handle *s)
+{
+	/* Stream or output routing */
+	if(s != NULL && s->route != NULL)
+		return outputs_list_has(s->route, z->name);
+	if(handle->route != NULL)
+		return outputs_list_has(handle->route, z->name);
+
+	/* Zone accepts only some modules */
+	if(z->modules != NULL)
+		return outputs_list_has(z->modules, handle->name);
+
+	return 1;
+}
+
+static struct output_zone *outputs_zone_new(struct outputs_handle *h,
+					    struct json *cfg, const char *name)
+{
+	struct output_zone *z;
+	const char *mixer_device = NULL;
+	const char *device = NULL;
+	const char *mixer = NULL;
+	const char *id = NULL;
+	struct json *tmp;
+	int adaptive = 0;
+
+	/* Allocate zone */
+	z = malloc(sizeof(struct output_zone));
+	if(z == NULL)
+		return NULL;
+	memset(z, 0, sizeof(struct output_zone));
+	z->name = strdup(name);
+
+	/* Get configuration */
+	if(cfg != NULL)
+	{
+		id = json_get_string(cfg, json_has_key(cfg, "id") ? "id" :
+								   "name");
+		device = json_get_string(cfg, "device");
+		z->samplerate = json_get_int(cfg, "samplerate");
+		z->channels = json_get_int(cfg, "channels");
+		z->latency = json_get_int(cfg, "latency");
+		adaptive = json_get_bool(cfg, "adaptive_latency");
+		z->min_latency = json_get_int(cfg, "min_latency");
+		z->max_latency = json_get_int(cfg, "max_latency");
+		if(json_get_ex(cfg, "modules", &tmp) && tmp != NULL)
+			z->modules = outputs_list_from_json(tmp);
+		mixer = json_get_string(cfg, "mixer");
+		mixer_device = json_get_string(cfg, "mixer_device");
+		z->mixer_range = json_get_int(cfg, "mixer_range");
+	}
+
+	/* Set default values */
+	z->current = outputs_find_module(h, id);
+	if(z->current == NULL)
+	{
+		/* Choose ALSA as defaut module */
+		z->current = outputs_find_module(h, "alsa");
+	}
+	if(device != NULL && *device != '\0')
+		z->device = strdup(device);
+	if(mixer != NULL && *mixer != '\0')
+		z->mixer = strdup(mixer);
+	if(mixer_device != NULL && *mixer_device != '\0')
+		z->mixer_device = strdup(mixer_device);
+	if(z->samplerate == 0)
+		z->samplerate = 44100;
+	if(z->channels == 0)
+		z->channels = 2;
+	if(z->latency == 0 || z->latency > MAX_LATENCY)
+		z->latency = DEFAULT_LATENCY;
+
+	/* Set adaptive latency bounds */
+	if(adaptive)
+	{
+		if(z->min_latency == 0 || z->min_latency > z->latency)
+			z->min_latency = z->latency;
+		if(z->max_latency == 0)
+			z->max_latency = z->latency * 4;
+		if(z->max_latency > MAX_LATENCY)
+			z->max_latency = MAX_LATENCY;
+		if(z->max_latency < z->latency)
+			z->max_latency = z->latency;
+	}
+	else
+	{
+		z->min_latency = 0;
+		z->max_latency = 0;
+	}
+
+	return z;
+}
+
+static void outputs_zone_free(struct output_zone *z)
+{
+	/* Free strings */
+	FREE_STRING(z->name);
+	FREE_STRING(z->device);
+	FREE_STRING(z->modules);
+	FREE_STRING(z->mixer);
+	FREE_STRING(z->mixer_device);
+
+	/* Free structure */
+	free(z);
+}
+
+static void outputs_zone_copy(struct output_zone *z, struct output_zone *cfg)
+{
+	/* Take strings from new configuration */
+	FREE_STRING(z->device);
+	z->device = cfg->device;
+	cfg->device = NULL;
+
+	/* Copy values */
+	z->current = cfg->current;
+	z->samplerate = cfg->samplerate;
+	z->channels = cfg->channels;
+	z->latency = cfg->latency;
+	z->min_latency = cfg->min_latency;
+	z->max_latency = cfg->max_latency;
+}
+
+static void outputs_zone_set_mixer(struct outputs_handle *h,
+				   struct output_zone *z)
+{
+	/* Bind master volume to hardware mixer */
+	z->hw_volume = 0;
+	if(z->handle == NULL)
+		return;
+	if(z->mod->set_mixer != NULL)
+		z->hw_volume = z->mod->set_mixer(z->handle, z->mixer_device,
+						 z->mixer,
+						 z->mixer_range) == 0;
+	z->mod->set_volume(z->handle, h->volume);
+}
+
+static void outputs_zone_open(struct outputs_handle *h, struct output_zone *z)
+{
+	if(z->current == NULL)
+		return;
+	z->mod = z->current->mod;
+
+	/* Open output module */
+	if(z->mod->open(&z->handle, z->device, z->samplerate, z->channels,
+			z->latency, z->min_latency, z->max_latency) != 0)
+	{
+		z->mod->close(z->handle);
+		z->handle = NULL;
+		return;
+	}
+
+	/* Set master volume */
+	outputs_zone_set_mixer(h, z);
+}
+
+static struct output_zone_stream *outputs_stream_find_zone(
+					      struct output_stream_handle *s,
+					      struct output_zone *z)
+{
+	struct output_zone_stream *zs;
+
+	for(zs = s->zones; zs != NULL; zs = zs->next)
+		if(zs->zone == z)
+			return zs;
+
+	return NULL;
+}
+
+static int outputs_stream_read(void *user_data, unsigned char *buffer,
+			       size_t size, struct a_format *fmt)
+{
+	struct output_zone_stream *zs = user_data;
+	a_read_cb input_callback = zs->s->input_callback;
+	struct output_tee_reader *r;
+	int ret;
+
+	/* Get reader: a detached reader is removed when zone has read all
+	 * samples decoded for it, so no samples are skipped
+	 */
+	pthread_mutex_lock(&zs->mutex);
+	r = zs->reader;
+	if(r != NULL && zs->detach && output_tee_pending(r) == 0)
+	{
+		output_tee_remove_reader(r);
+		zs->reader = r = NULL;
+		zs->detach = 0;
+	}
+	zs->reading++;
+	pthread_mutex_unlock(&zs->mutex);
+
+	/* Read from fan-out buffer when attached, or from stream input */
+	if(r != NULL)
+		ret = output_tee_read(r, buffer, size, fmt);
+	else
+		ret = input_callback(zs->s->user_data, buffer, size, fmt);
+
+	/* End of read */
+	pthread_mutex_lock(&zs->mutex);
+	if(--zs->reading == 0)
+		pthread_cond_broadcast(&zs->cond);
+	pthread_mutex_unlock(&zs->mutex);
+
+	return ret;
+}
+
+static void outputs_stream_set_reader(struct output_zone_stream *zs,
+				      struct output_tee_reader *r)
+{
+	struct output_tee_reader *old;
+
+	/* Wait end of current read: stream input is never read by two zones
+	 * at same time and previous reader is not used anymore
+	 */
+	pthread_mutex_lock(&zs->mutex);
+	while(zs->reading > 0)
+		pthread_cond_wait(&zs->cond, &zs->mutex);
+	old = zs->reader;
+	zs->reader = r;
+	zs->detach = 0;
+	pthread_mutex_unlock(&zs->mutex);
+
+	/* Remove previous reader */
+	if(old != NULL)
+		output_tee_remove_reader(old);
+}
+
+static int outputs_stream_open(struct outputs_handle *h,
+			       struct output_handle *handle,
+			       struct output_stream_handle *s,
+			       struct output_zone_stream *zs)
+{
+	struct output_zone *z = zs->zone;
+	a_read_cb input_callback = NULL;
+
+	if(z->mod == NULL || z->handle == NULL)
+		return -1;
+
+	/* Read decoded samples from fan-out buffer */
+	if(s->tee != NULL)
+	{
+		zs->reader = output_tee_add_reader(s->tee);
+		if(zs->reader == NULL)
+			return -1;
+	}
+
+	/* Input is read through zone stream, so fan-out buffer can be
+	 * attached later without recreating stream in output module
+	 */
+	if(s->input_callback != NULL)
+		input_callback = &outputs_stream_read;
+
+	/* Add stream to output module */
+	zs->stream = z->mod->add_stream(z->handle, s->samplerate, s->channels,
+					s->cache, s->use_cache_thread,
+					input_callback, zs);
+	if(zs->stream == NULL)
+	{
+		if(zs->reader != NULL)
+			output_tee_remove_reader(zs->reader);
+		zs->reader = NULL;
+		return -1;
+	}
+
+	/* Reset volume */
+	output_reset_volume_stream(h, handle, s);
+
+	/* Restore played status */
+	if(z->mod->restore_stream != NULL)
+		z->mod->restore_stream(z->handle, zs->stream, zs->played);
+
+	/* Play stream */
+	if(s->is_playing)
+		z->mod->play_stream(z->handle, zs->stream);
+
+	return 0;
+}
+
+static void outputs_stream_close(struct output_stream_handle *s,
+				 struct output_zone_stream *zs, int save)
+{
+	struct output_zone *z = zs->zone;
+
+	if(zs->stream != NULL)
+	{
+		/* Abort stream and save played status */
+		if(save && z->mod->abort_stream != NULL)
+			zs->played = z->mod->abort_stream(z->handle,
+							  zs->stream);
+
+		/* Remove stream from output module */
+		z->mod->remove_stream(z->handle, zs->stream);
+		zs->stream = NULL;
+	}
+
+	/* Remove reader from fan-out buffer */
+	outputs_stream_set_reader(zs, NULL);
+	zs->ahead = 0;
+}
+
+static struct output_zone_stream *outputs_zone_stream_new(
+					       struct output_stream_handle *s,
+					       struct output_zone *z)
+{
+	struct output_zone_stream *zs;
+
+	/* Allocate zone stream */
+	zs = malloc(sizeof(struct output_zone_stream));
+	if(zs == NULL)
+		return NULL;
+	memset(zs, 0, sizeof(struct output_zone_stream));
+	zs->zone = z;
+	zs->s = s;
+	pthread_mutex_init(&zs->mutex, NULL);
+	pthread_cond_init(&zs->cond, NULL);
+
+	return zs;
+}
+
+static void outputs_zone_stream_free(struct output_stream_handle *s,
+				     struct output_zone_stream *zs)
+{
+	/* Close stream and free zone stream */
+	outputs_stream_close(s, zs, 0);
+	pthread_cond_destroy(&zs->cond);
+	pthread_mutex_destroy(&zs->mutex);
+	free(zs);
+}
+
+static void outputs_stream_attach_tee(struct outputs_handle *h,
+				      struct output_handle *handle,
+				      struct output_stream_handle *s,
+				      struct output_zone_stream *zs)
+{
+	struct output_tee_reader *r;
+
+	/* Next samples are read from fan-out buffer: no gap in playback */
+	r = output_tee_add_reader(s->tee);
+	if(r != NULL && zs->stream != NULL)
+	{
+		outputs_stream_set_reader(zs, r);
+		return;
+	}
+	if(r != NULL)
+		output_tee_remove_reader(r);
+
+	/* Reopen stream on fan-out buffer */
+	outputs_stream_close(s, zs, 1);
+	outputs_stream_open(h, handle, s, zs);
+}
+
+static void outputs_stream_set_event_cb(struct output_stream_handle *s)
+{
+	struct output_zone_stream *zs = s->zones;
+
+	/* Only first zone notifies stream events */
+	if(zs == NULL || zs->stream == NULL || s->event_cb == NULL)
+		return;
+	zs->zone->mod->set_stream_event_cb(zs->zone->handle, zs->stream,
+					   s->event_cb, s->event_ud);
+}
+
+static void outputs_route_stream(struct outputs_handle *h,
+				 struct output_handle *handle,
+				 struct output_stream_handle *s)
+{
+	struct output_zone_stream **zp, *zs;
+	struct output_zone *z;
+	int count = 0;
+
+	/* Remove stream from zones which are not routed anymore */
+	zp = &s->zones;
+	while(*zp != NULL)
+	{
+		zs = *zp;
+		if(outputs_zone_routed(zs->zone, handle, s))
+		{
+			zp = &zs->next;
+			count++;
+			continue;
+		}
+		*zp = zs->next;
+		outputs_zone_stream_free(s, zs);
+	}
+
+	/* Count new zones */
+	for(z = h->zones; z != NULL; z = z->next)
+		if(outputs_zone_routed(z, handle, s) &&
+		   outputs_stream_find_zone(s, z) == NULL)
+			count++;
+
+	/* Read stream input directly again with only one zone: fan-out
+	 * buffer is freed when zone has read its remaining samples
+	 */
+	if(count <= 1 && s->tee != NULL)
+	{
+		for(zs = s->zones; zs != NULL; zs = zs->next)
+		{
+			pthread_mutex_lock(&zs->mutex);
+			zs->detach = zs->reader != NULL;
+			pthread_mutex_unlock(&zs->mutex);
+		}
+		output_tee_release(s->tee);
+		s->tee = NULL;
+	}
+
+	/* Decode only once for several zones */
+	if(count > 1 && s->tee == NULL && s->input_callback != NULL)
+	{
+		s->tee = output_tee_open(s->input_callback, s->user_data);
+
+		/* Attach current zones to fan-out buffer */
+		for(zs = s->zones; s->tee != NULL && zs != NULL; zs = zs->next)
+			outputs_stream_attach_tee(h, handle, s, zs);
+	}
+
+	/* Add stream to new zones */
+	for(z = h->zones; z != NULL; z = z->next)
+	{
+		if(!outputs_zone_routed(z, handle, s) ||
+		   outputs_stream_find_zone(s, z) != NULL)
+			continue;
+
+		/* Allocate zone stream */
+		zs = outputs_zone_stream_new(s, z);
+		if(zs == NULL)
+			continue;
+
+		/* Add at end of list to keep first zone */
+		*zp = zs;
+		zp = &zs->next;
+
+		/* Open stream in zone */
+		outputs_stream_open(h, handle, s, zs);
+	}
+
+	/* Update event callback */
+	outputs_stream_set_event_cb(s);
+}
+
+static void outputs_route_all(struct outputs_handle *h)
+{
+	struct output_stream_handle *s;
+	struct output_handle *handle;
+
+	for(handle = h->handles; handle != NULL; handle = handle->next)
+		for(s = handle->streams; s != NULL; s = s->next)
+			outputs_route_stream(h, handle, s);
+}
+
+static void outputs_zone_reload(struct outputs_handle *h,
+				struct output_zone *z, struct output_zone *cfg)
 {
 	struct output_stream_handle *stream;
+	struct output_zone_stream *zs;
 	struct output_handle *handle;
 
-	/* Update value */
-	h->samplerate = samplerate;
-	h->channels = channels;
-	h->latency = latency;
+	/* Close streams of zone */
+	for(handle = h->handles; handle != NULL; handle = handle->next)
+		for(stream = handle->streams; stream != NULL;
+		    stream = stream->next)
+			if((zs = outputs_stream_find_zone(stream, z)) != NULL)
+				outputs_stream_close(stream, zs, 1);
 
 	/* Close previous output module */
-	if(h->current != NULL && h->mod != NULL && h->handle != NULL)
+	if(z->mod != NULL && z->handle != NULL)
+		z->mod->close(z->handle);
+	z->handle = NULL;
+	z->mod = NULL;
+
+	/* Open new output module */
+	outputs_zone_copy(z, cfg);
+	outputs_zone_open(h, z);
+
+	/* Reload streams */
+	for(handle = h->handles; handle != NULL; handle = handle->next)
 	{
-		/* Abort all streams */
-		for(handle = h->handles; handle != NULL;
-		    handle = handle->next)
+		for(stream = handle->streams; stream != NULL;
+		    stream = stream->next)
 		{
-			for(stream = handle->streams; stream != NULL;
-			    stream = stream->next)
+			zs = outputs_stream_find_zone(stream, z);
+			if(zs == NULL)
+				continue;
+			outputs_stream_open(h, handle, stream, zs);
+			outputs_stream_set_event_cb(stream);
+		}
+	}
+}
+
+static void outputs_zone_update(struct outputs_handle *h,
+				struct output_zone *z, struct output_zone *cfg)
+{
+	int mixer_changed = 0;
+	int changed = 0;
+
+	/* Update routed modules */
+	FREE_STRING(z->modules);
+	z->modules = cfg->modules;
+	cfg->modules = NULL;
+
+	/* Update mixer */
+	if(outputs_strcmp(cfg->mixer, z->mixer) != 0 ||
+	   outputs_strcmp(cfg->mixer_device, z->mixer_device) != 0 ||
+	   cfg->mixer_range != z->mixer_range)
+		mixer_changed = 1;
+	FREE_STRING(z->mixer);
+	FREE_STRING(z->mixer_device);
+	z->mixer = cfg->mixer;
+	z->mixer_device = cfg->mixer_device;
+	z->mixer_range = cfg->mixer_range;
+	cfg->mixer = NULL;
+	cfg->mixer_device = NULL;
+
+	/* Check configuration changes */
+	if(outputs_strcmp(cfg->device, z->device) != 0 ||
+	   cfg->samplerate != z->samplerate || cfg->channels != z->channels ||
+	   cfg->latency != z->latency || cfg->min_latency != z->min_latency ||
+	   cfg->max_latency != z->max_latency)
+		changed = 1;
+	if(cfg->current == z->current && !changed)
+	{
+		/* Bind new mixer */
+		if(mixer_changed)
+			outputs_zone_set_mixer(h, z);
+		return;
+	}
+
+	/* Reconfigure current output without closing streams */
+	if(cfg->current == z->current && z->handle != NULL &&
+	   z->mod->reconfigure != NULL &&
+	   z->mod->reconfigure(z->handle, cfg->device, cfg->samplerate,
+			       cfg->channels, cfg->latency, cfg->min_latency,
+			       cfg->max_latency) == 0)
+	{
+		outputs_zone_copy(z, cfg);
+		outputs_zone_set_mixer(h, z);
+		return;
+	}
+
+	/* Reload output */
+	outputs_zone_reload(h, z, cfg);
+}
+
+static void outputs_zone_close(struct outputs_handle *h, struct output_zone *z)
+{
+	struct output_zone_stream **zp, *zs;
+	struct output_stream_handle *stream;
+	struct output_handle *handle;
+
+	/* Remove streams from zone */
+	for(handle = h->handles; handle != NULL; handle = handle->next)
+	{
+		for(stream = handle->streams; stream != NULL;
+		    stream = stream->next)
+		{
+			for(zp = &stream->zones; *zp != NULL; zp = &(*zp)->next)
 			{
-				/* Abort stream and save played status */
-				if(h->mod->abort_stream != NULL)
-					stream->played = h->mod->abort_stream(
-							        h->handle,
-							        stream->stream);
+				zs = *zp;
+				if(zs->zone != z)
+					continue;
+				*zp = zs->next;
+				outputs_zone_stream_free(stream, zs);
+				break;
 			}
+			outputs_stream_set_event_cb(stream);
+		}
+	}
+
+	/* Close output module */
+	if(z->mod != NULL && z->handle != NULL)
+		z->mod->close(z->handle);
+
+	/* Free zone */
+	outputs_zone_free(z);
+}
+
+/******************************************************************************
+ *                               Outputs part                                 *
+ ******************************************************************************/
+
+int outputs_open(struct outputs_handle **handle, struct json *config)
+{
+	struct outputs_handle *h;
+	struct output_list list[] = {
+		{"alsa", "ALSA", "ALSA audio output.", &output_alsa, NULL},
+	};
+	struct output_list *l;
+	int i;
+
+	/* Allocate structure */
+	*handle = malloc(sizeof(struct outputs_handle));
+	if(*handle == NULL)
+		return -1;
+	h = *handle;
+
+	/* Init structure */
+	h->list = NULL;
+	h->output_count = 0;
+	h->zones = NULL;
+	h->handles = NULL;
+
+	/* Create output list */
+	for(i = 0; i < sizeof(list)/sizeof(struct output_list); i++)
+	{
+		/* Add output module */
+		l = malloc(sizeof(struct output_list));
+		if(l != NULL)
+		{
+			l->id = list[i].id ? strdup(list[i].id) : NULL;
+			l->name =  list[i].name ? strdup(list[i].name) : NULL;
+			l->description =  list[i].description != NULL ?
+					     strdup(list[i].description) : NULL;
+			l->mod = list[i].mod;
+			l->next = h->list;
+			h->list = l;
+			h->output_count++;
 		}
-
-		/* Close output */
-		h->mod->close(h->handle);
-		h->handle = NULL;
-		h->current = NULL;
-		h->mod = NULL;
 	}
 
-	/* Open new output module and reload all streams */
-	if(new != NULL)
-	{
-		h->current = new;
-		h->mod = h->current->mod;
+	/* Init thread mutex */
+	pthread_mutex_init(&h->mutex, NULL);
 
-		/* Open output module */
-		if(h->mod->open(&h->handle, h->samplerate, h->channels,
-				h->latency) != 0)
-		{
-			h->mod->close(h->handle);
-			h->handle = NULL;
-			return;
-		}
+	/* Set configuration */
+	outputs_set_config(h, config);
 
-		/* Reload streams */
-		for(handle = h->handles; handle != NULL;
-		    handle = handle->next)
-		{
-			for(stream = handle->streams; stream != NULL;
-			    stream = stream->next)
-			{
-				/* Add stream */
-				stream->stream = h->mod->add_stream(h->handle,
-						       stream->samplerate,
-						       stream->channels,
-						       stream->cache,
-						       stream->use_cache_thread,
-						       stream->input_callback,
-						       stream->user_data);
-
-				/* Reset volume */
-				output_reset_volume_stream(h, handle, stream);
-
-				/* Restore played status */
-				if(h->mod->restore_stream != NULL)
-					h->mod->restore_stream(h->handle,
-							       stream->stream,
-							       stream->played);
-
-				/* Play stream */
-				if(stream->stream != NULL && stream->is_playing)
-					h->mod->play_stream(h->handle,
-							    stream->stream);
-			}
-		}
-	}
+	return 0;
 }
 
 int outputs_set_config(struct outputs_handle *h, struct json *cfg)
 {
-	struct output_list *current = NULL;
-	unsigned long samplerate = 0;
-	unsigned char channels = 0;
-	unsigned int latency = 0;
-	const char *id;
+	struct output_zone *zones, *z, *n, **zp, **tail;
+	struct json *list = NULL, *tmp;
+	const char *name;
+	int i;
 
 	if(h == NULL)
 		return -1;
@@ -281,57 +1251,123 @@ int outputs_set_config(struct outputs_handle *h, struct json *cfg)
 	/* Lock output access */
 	pthread_mutex_lock(&h->mutex);
 
-	/* Free all configuration */
-	current = NULL;
-	samplerate = 0;
-	channels = 0;
-	latency = 0;
+	/* Get master volume */
 	h->volume = OUTPUT_VOLUME_MAX;
+	if(cfg != NULL && json_has_key(cfg, "volume"))
+		h->volume = json_get_int(cfg, "volume");
+	if(h->volume > OUTPUT_VOLUME_MAX)
+		h->volume = OUTPUT_VOLUME_MAX;
 
-	/* Get configuration */
-	if(cfg != NULL)
+	/* Get default zone configured with root keys */
+	zones = outputs_zone_new(h, cfg, DEFAULT_ZONE);
+	if(zones == NULL)
+		goto end;
+	tail = &zones->next;
+
+	/* Get additional zones */
+	if(cfg != NULL && json_get_ex(cfg, "zones", &list) && list != NULL)
+	{
+		for(i = 0; i < json_array_length(list); i++)
+		{
+			tmp = json_array_get(list, i);
+			name = json_get_string(tmp, "zone");
+			if(name == NULL || *name == '\0' ||
+			   outputs_find_zone(zones, name) != NULL)
+				continue;
+
+			/* Add zone */
+			*tail = outputs_zone_new(h, tmp, name);
+			if(*tail != NULL)
+				tail = &(*tail)->next;
+		}
+	}
+
+	/* Close removed zones */
+	zp = &h->zones;
+	while(*zp != NULL)
 	{
-		id = json_get_string(cfg, "name");
-		current = outputs_find_module(h, id);
-		samplerate = json_get_int(cfg, "samplerate");
-		channels = json_get_int(cfg, "channels");
-		latency = json_get_int(cfg, "latency");
-		h->volume = json_has_key(cfg, "volume") ?
-						   json_get_int(cfg, "volume") :
-						   OUTPUT_VOLUME_MAX;
+		z = *zp;
+		if(outputs_find_zone(zones, z->name) != NULL)
+		{
+			zp = &z->next;
+			continue;
+		}
+		*zp = z->next;
+		outputs_zone_close(h, z);
 	}
 
-	/* Set default values */
-	if(current == NULL)
+	/* Update current zones and open new zones */
+	for(tail = &zones; *tail != NULL; tail = &(*tail)->next)
 	{
-		/* Choose ALSA as defaut module */
-		current = outputs_find_module(h, "alsa");
+		n = *tail;
+
+		/* Look for current zone */
+		for(zp = &h->zones; *zp != NULL &&
+		    strcmp((*zp)->name, n->name) != 0; zp = &(*zp)->next);
+		if(*zp == NULL)
+		{
+			/* Open new zone */
+			outputs_zone_open(h, n);
+			continue;
+		}
+
+		/* Update zone and replace its configuration in new list */
+		z = *zp;
+		*zp = z->next;
+		outputs_zone_update(h, z, n);
+		z->next = n->next;
+		*tail = z;
+		outputs_zone_free(n);
 	}
-	if(samplerate == 0)
-		samplerate = 44100;
-	if(channels == 0)
-		channels = 2;
-	if(h->volume > OUTPUT_VOLUME_MAX)
-		h->volume = OUTPUT_VOLUME_MAX;
-	if(latency == 0 || latency > MAX_LATENCY)
-		latency = DEFAULT_LATENCY;
 
-	/* Reload output */
-	if(current != h->current || samplerate != h->samplerate ||
-	   channels != h->channels || latency != h->latency)
-		outputs_reload(h, current, samplerate, channels, latency);
+	/* Current zones are now in new list */
+	h->zones = zones;
 
+	/* Route all streams to zones and update their volume */
+	outputs_route_all(h);
+	output_reset_volume_stream(h, NULL, NULL);
+
+end:
 	/* Unlock output access */
 	pthread_mutex_unlock(&h->mutex);
 
 	return 0;
 }
 
-struct json *outputs_get_config(struct outputs_handle *h)
+static void outputs_get_zone_config(struct output_zone *z, struct json *cfg)
 {
-	struct json *cfg;
 	char *name = NULL;
 
+	/* Fill zone configuration */
+	if(z->current != NULL)
+		name = z->current->id;
+	json_set_string(cfg, "id", name);
+	if(z->device != NULL)
+		json_set_string(cfg, "device", z->device);
+	json_set_int(cfg, "samplerate", z->samplerate);
+	json_set_int(cfg, "channels", z->channels);
+	json_set_int(cfg, "latency", z->latency);
+	json_set_bool(cfg, "adaptive_latency", z->max_latency > 0);
+	if(z->max_latency > 0)
+	{
+		json_set_int(cfg, "min_latency", z->min_latency);
+		json_set_int(cfg, "max_latency", z->max_latency);
+	}
+	if(z->modules != NULL)
+		json_add(cfg, "modules", outputs_list_to_json(z->modules));
+	if(z->mixer != NULL)
+		json_set_string(cfg, "mixer", z->mixer);
+	if(z->mixer_device != NULL)
+		json_set_string(cfg, "mixer_device", z->mixer_device);
+	if(z->mixer_range != 0)
+		json_set_int(cfg, "mixer_range", z->mixer_range);
+}
+
+struct json *outputs_get_config(struct outputs_handle *h)
+{
+	struct json *cfg, *list, *tmp;
+	struct output_zone *z;
+
 	if(h == NULL)
 		return NULL;
 
@@ -343,14 +1379,28 @@ struct json *outputs_get_config(struct outputs_handle *h)
 	/* Lock output access */
 	pthread_mutex_lock(&h->mutex);
 
-	/* Fill configuration */
-	if(h->current != NULL)
-		name = h->current->id;
-	json_set_string(cfg, "id", name);
-	json_set_int(cfg, "samplerate", h->samplerate);
-	json_set_int(cfg, "channels", h->channels);
+	/* Fill configuration of default zone */
+	if(h->zones != NULL)
+		outputs_get_zone_config(h->zones, cfg);
 	json_set_int(cfg, "volume", h->volume);
 
+	/* Add other zones */
+	if(h->zones != NULL && h->zones->next != NULL)
+	{
+		list = json_new_array();
+		for(z = h->zones->next; list != NULL && z != NULL; z = z->next)
+		{
+			tmp = json_new();
+			if(tmp == NULL)
+				continue;
+			json_set_string(tmp, "zone", z->name);
+			outputs_get_zone_config(z, tmp);
+			if(json_array_add(list, tmp) != 0)
+				json_free(tmp);
+		}
+		json_add(cfg, "zones", list);
+	}
+
 	/* Unlock output access */
 	pthread_mutex_unlock(&h->mutex);
 
@@ -359,6 +1409,7 @@ struct json *outputs_get_config(struct outputs_handle *h)
 
 int outputs_set_volume(struct outputs_handle *h, unsigned int volume)
 {
+	struct output_zone *z;
 	int ret = -1;
 
 	if(h == NULL)
@@ -367,10 +1418,16 @@ int outputs_set_volume(struct outputs_handle *h, unsigned int volume)
 	/* Lock output access */
 	pthread_mutex_lock(&h->mutex);
 
-	if(h->current != NULL && h->mod != NULL && h->handle != NULL)
-		ret = h->mod->set_volume(h->handle, volume);
+	/* Set volume on all zones */
+	for(z = h->zones; z != NULL; z = z->next)
+		if(z->mod != NULL && z->handle != NULL &&
+		   z->mod->set_volume(z->handle, volume) == 0)
+			ret = 0;
 	h->volume = volume;
 
+	/* Update software volume of streams */
+	output_reset_volume_stream(h, NULL, NULL);
+
 	/* Unlock output access */
 	pthread_mutex_unlock(&h->mutex);
 
@@ -378,6 +1435,7 @@ int outputs_set_volume(struct outputs_handle *h, unsigned int volume)
 }
 unsigned int outputs_get_volue(struct outputs_handle *h)
 {
+	struct output_zone *z;
 	unsigned int vol = 0;
 
 	if(h == NULL)
@@ -386,8 +1444,10 @@ unsigned int outputs_get_volue(struct outputs_handle *h)
 	/* Lock output access */
 	pthread_mutex_lock(&h->mutex);
 
-	if(h->current != NULL && h->mod != NULL && h->handle != NULL)
-		vol = h->mod->get_volume(h->handle);
+	/* Get volume of default zone */
+	z = h->zones;
+	if(z != NULL && z->mod != NULL && z->handle != NULL)
+		vol = z->mod->get_volume(z->handle);
 
 	/* Unlock output access */
 	pthread_mutex_unlock(&h->mutex);
@@ -399,6 +1459,7 @@ void outputs_close(struct outputs_handle *h)
 {
 	struct output_handle *handle;
 	struct output_list *l;
+	struct output_zone *z;
 
 	if(h == NULL)
 		return;
@@ -412,9 +1473,13 @@ void outputs_close(struct outputs_handle *h)
 		output_close(handle);
 	}
 
-	/* Close output */
-	if(h->current != NULL && h->mod != NULL && h->handle != NULL)
-		h->mod->close(h->handle);
+	/* Close all zones */
+	while(h->zones != NULL)
+	{
+		z = h->zones;
+		h->zones = z->next;
+		outputs_zone_close(h, z);
+	}
 
 	/* Free output list */
 	while(h->list != NULL)
@@ -460,6 +1525,7 @@ int output_open(struct output_handle **handle, struct outputs_handle *outputs,
 	h->mutex = &outputs->mutex;
 	h->streams = NULL;
 	h->volume = OUTPUT_VOLUME_MAX;
+	h->route = NULL;
 
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
@@ -474,6 +1540,29 @@ int output_open(struct output_handle **handle, struct outputs_handle *outputs,
 	return 0;
 }
 
+static void output_free_stream(struct output_stream_handle *s)
+{
+	struct output_zone_stream *zs;
+
+	/* Remove stream from all zones */
+	while(s->zones != NULL)
+	{
+		zs = s->zones;
+		s->zones = zs->next;
+		outputs_zone_stream_free(s, zs);
+	}
+
+	/* Free fan-out buffer */
+	output_tee_release(s->tee);
+
+	/* Free strings */
+	FREE_STRING(s->name);
+	FREE_STRING(s->route);
+
+	/* Free structure */
+	free(s);
+}
+
 struct output_stream_handle *output_add_stream(struct output_handle *h,
 					       const char *name,
 					       unsigned long samplerate,
@@ -484,26 +1573,20 @@ struct output_stream_handle *output_add_stream(struct output_handle *h,
 					       void *user_data)
 {
 	struct output_stream_handle *s = NULL;
-	struct output_stream *stream;
+	struct output_zone_stream *zs;
 
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h == NULL || h->outputs->mod == NULL)
-		goto end;
-
-	/* Add stream to output module */
-	stream = h->outputs->mod->add_stream(h->outputs->handle, samplerate,
-					     channels, cache, use_cache_thread,
-					     input_callback, user_data);
-	if(stream == NULL)
+	/* Check output */
+	if(h == NULL || h->outputs->zones == NULL)
 		goto end;
 
 	/* Alloc stream structure */
 	s = malloc(sizeof(struct output_stream_handle));
 	if(s == NULL)
 		goto end;
+	memset(s, 0, sizeof(struct output_stream_handle));
 
 	/* Fill handle */
 	random_string(s->id, OUTPUTS_ID_SIZE);
@@ -514,13 +1597,20 @@ struct output_stream_handle *output_add_stream(struct output_handle *h,
 	s->use_cache_thread = use_cache_thread;
 	s->input_callback = input_callback;
 	s->user_data = user_data;
-	s->stream = stream;
 	s->is_playing = 0;
-	s->played = 0;
 	s->volume = OUTPUT_VOLUME_MAX;
 
-	/* Reset volume */
-	output_reset_volume_stream(h->outputs, h, s);
+	/* Add stream to its zones */
+	outputs_route_stream(h->outputs, h, s);
+
+	/* Stream must be opened in at least one zone */
+	for(zs = s->zones; zs != NULL && zs->stream == NULL; zs = zs->next);
+	if(zs == NULL)
+	{
+		output_free_stream(s);
+		s = NULL;
+		goto end;
+	}
 
 	/* Add stream to stream list */
 	s->next = h->streams;
@@ -558,17 +1648,51 @@ void output_remove_stream(struct output_handle *h,
 			lp = &l->next;
 	}
 
-	/* Remove stream from output module */
-	h->outputs->mod->remove_stream(h->outputs->handle, s->stream);
+	/* Remove stream from all zones and free it */
+	output_free_stream(s);
 
 	/* Unlock output access */
 	pthread_mutex_unlock(h->mutex);
+}
+
+static int output_route(struct output_handle *h,
+			struct output_stream_handle *s, const char *zones)
+{
+	char **route;
 
-	/* Free stream name */
-	free(s->name);
+	/* Replace stream or output routing */
+	route = s != NULL ? &s->route : &h->route;
+	FREE_STRING(*route);
+	*route = zones != NULL ? strdup(zones) : NULL;
 
-	/* Free structure */
-	free(s);
+	/* Update routing of streams */
+	if(s != NULL)
+		outputs_route_stream(h->outputs, h, s);
+	else
+		for(s = h->streams; s != NULL; s = s->next)
+			outputs_route_stream(h->outputs, h, s);
+
+	return 0;
+}
+
+int output_set_route(struct output_handle *h, struct output_stream_handle *s,
+		     const char *zones)
+{
+	int ret;
+
+	if(h == NULL)
+		return -1;
+
+	/* Lock output access */
+	pthread_mutex_lock(h->mutex);
+
+	/* Set routing */
+	ret = output_route(h, s, zones);
+
+	/* Unlock output access */
+	pthread_mutex_unlock(h->mutex);
+
+	return ret;
 }
 
 int output_set_volume(struct output_handle *h, unsigned int volume)
@@ -648,6 +1772,7 @@ void output_close(struct output_handle *h)
 
 	/* Free output name */
 	free(h->name);
+	FREE_STRING(h->route);
 
 	/* Free structure */
 	free(h);
@@ -659,6 +1784,7 @@ void output_close(struct output_handle *h)
 
 int output_play_stream(struct output_handle *h, struct output_stream_handle *s)
 {
+	struct output_zone_stream *zs;
 	int ret = -1;
 
 	if(h == NULL || s == NULL)
@@ -667,14 +1793,12 @@ int output_play_stream(struct output_handle *h, struct output_stream_handle *s)
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
-	{
-		/* Play stream */
-		ret = h->outputs->mod->play_stream(h->outputs->handle,
-						   s->stream);
-	}
+	/* Play stream in all zones */
+	for(zs = s->zones; zs != NULL; zs = zs->next)
+		if(zs->stream != NULL &&
+		   zs->zone->mod->play_stream(zs->zone->handle,
+					      zs->stream) == 0)
+			ret = 0;
 	s->is_playing = 1;
 
 	/* Unlock output access */
@@ -685,6 +1809,7 @@ int output_play_stream(struct output_handle *h, struct output_stream_handle *s)
 
 int output_pause_stream(struct output_handle *h, struct output_stream_handle *s)
 {
+	struct output_zone_stream *zs;
 	int ret = -1;
 
 	if(h == NULL || s == NULL)
@@ -693,14 +1818,12 @@ int output_pause_stream(struct output_handle *h, struct output_stream_handle *s)
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
-	{
-		/* Pause stream */
-		ret = h->outputs->mod->pause_stream(h->outputs->handle,
-						    s->stream);
-	}
+	/* Pause stream in all zones */
+	for(zs = s->zones; zs != NULL; zs = zs->next)
+		if(zs->stream != NULL &&
+		   zs->zone->mod->pause_stream(zs->zone->handle,
+					       zs->stream) == 0)
+			ret = 0;
 	s->is_playing = 0;
 
 	/* Unlock output access */
@@ -712,30 +1835,49 @@ int output_pause_stream(struct output_handle *h, struct output_stream_handle *s)
 void output_flush_stream(struct output_handle *h,
 			 struct output_stream_handle *s)
 {
+	struct output_zone_stream *zs;
+	int detach;
+
 	if(h == NULL || s == NULL)
 		return;
 
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
+	/* Flush decoded samples not yet read by all zones first, so a zone
+	 * can't refill its stream with old samples
+	 */
+	if(s->tee != NULL)
+		output_tee_flush(s->tee);
+
+	/* Flush stream in all zones */
+	for(zs = s->zones; zs != NULL; zs = zs->next)
 	{
-		/* Flush stream */
-		h->outputs->mod->flush_stream(h->outputs->handle, s->stream);
+		/* Drop samples of a detached reader */
+		pthread_mutex_lock(&zs->mutex);
+		detach = zs->detach;
+		pthread_mutex_unlock(&zs->mutex);
+		if(detach)
+			outputs_stream_set_reader(zs, NULL);
+
+		if(zs->stream != NULL)
+			zs->zone->mod->flush_stream(zs->zone->handle,
+						    zs->stream);
+		zs->ahead = 0;
 	}
 
 	/* Unlock output access */
 	pthread_mutex_unlock(h->mutex);
 }
 
-ssize_t output_write_stream(struct output_handle *h, 
+ssize_t output_write_stream(struct output_handle *h,
 			    struct output_stream_handle *s,
 			    const unsigned char *buffer, size_t size,
 			    struct a_format *fmt)
 {
-	ssize_t ret = -1;
+	struct output_zone_stream *zs;
+	ssize_t ret = -1, len;
+	size_t skip;
 
 	if(h == NULL || s == NULL)
 		return -1;
@@ -743,16 +1885,34 @@ ssize_t output_write_stream(struct output_handle *h,
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
+	/* Write samples in all zones: a zone skips samples it has already
+	 * written ahead of others, since remaining samples are written again
+	 * by caller. Smallest written size is returned.
+	 */
+	for(zs = s->zones; zs != NULL; zs = zs->next)
 	{
-		/* Flush stream */
-		ret = h->outputs->mod->write_stream(h->outputs->handle,
-						    s->stream, buffer, size,
-						    fmt);
+		if(zs->stream == NULL)
+			continue;
+		skip = zs->ahead < size ? zs->ahead : size;
+		len = 0;
+		if(skip < size)
+			len = zs->zone->mod->write_stream(zs->zone->handle,
+							  zs->stream,
+							  buffer + skip * 4,
+							  size - skip, fmt);
+		if(len < 0)
+			continue;
+		zs->ahead += len;
+		if(ret < 0 || (size_t) ret > skip + len)
+			ret = skip + len;
 	}
 
+	/* Update samples written ahead of returned size */
+	for(zs = s->zones; ret > 0 && zs != NULL; zs = zs->next)
+		if(zs->stream != NULL)
+			zs->ahead = zs->ahead > (size_t) ret ?
+				    zs->ahead - ret : 0;
+
 	/* Unlock output access */
 	pthread_mutex_unlock(h->mutex);
 
@@ -764,10 +1924,11 @@ static int output_reset_volume_stream(struct outputs_handle *h,
 				      struct output_stream_handle *stream)
 {
 	struct output_stream_handle *s;
+	struct output_zone_stream *zs;
 	struct output_handle *l;
-	unsigned long vol;
+	unsigned long vol, zvol;
 
-	if(h == NULL || h->mod == NULL || h->handle == NULL)
+	if(h == NULL)
 		return -1;
 
 	for(l = (handle == NULL ? h->handles : handle); l != NULL;
@@ -776,15 +1937,25 @@ static int output_reset_volume_stream(struct outputs_handle *h,
 		for(s = (stream == NULL ? l->streams : stream); s != NULL;
 		    s = stream == NULL ? s->next : NULL)
 		{
-			if(s->stream == NULL)
-				continue;
-
 			/* Calculate volume */
 			vol = s->volume * l->volume / OUTPUT_VOLUME_MAX;
-			vol = vol * h->volume / OUTPUT_VOLUME_MAX;
 
-			/* Set stream volume */
-			h->mod->set_volume_stream(h->handle, s->stream, vol);
+			/* Set stream volume in all zones */
+			for(zs = s->zones; zs != NULL; zs = zs->next)
+			{
+				if(zs->stream == NULL)
+					continue;
+
+				/* Master volume in software */
+				zvol = vol;
+				if(!zs->zone->hw_volume)
+					zvol = vol * h->volume /
+					       OUTPUT_VOLUME_MAX;
+
+				zs->zone->mod->set_volume_stream(
+							       zs->zone->handle,
+							       zs->stream, zvol);
+			}
 		}
 	}
 
@@ -818,6 +1989,7 @@ int output_set_volume_stream(struct output_handle *h,
 unsigned int output_get_volume_stream(struct output_handle *h,
 				      struct output_stream_handle *s)
 {
+	struct output_zone_stream *zs;
 	unsigned int ret = 0;
 
 	if(h == NULL || s == NULL)
@@ -826,14 +1998,11 @@ unsigned int output_get_volume_stream(struct output_handle *h,
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
-	{
-		/* Get stream volume */
-		ret = h->outputs->mod->get_volume_stream(h->outputs->handle,
-							 s->stream);
-	}
+	/* Get stream volume from first zone */
+	zs = s->zones;
+	if(zs != NULL && zs->stream != NULL)
+		ret = zs->zone->mod->get_volume_stream(zs->zone->handle,
+						       zs->stream);
 	s->volume = ret;
 
 	/* Unlock output access */
@@ -845,6 +2014,7 @@ unsigned int output_get_volume_stream(struct output_handle *h,
 int output_set_cache_stream(struct output_handle *h,
 			    struct output_stream_handle *s, unsigned long cache)
 {
+	struct output_zone_stream *zs;
 	int ret = -1;
 
 	if(h == NULL || s == NULL)
@@ -853,14 +2023,13 @@ int output_set_cache_stream(struct output_handle *h,
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
-	{
-		/* Set new cache volume */
-		ret = h->outputs->mod->set_cache_stream(h->outputs->handle,
-							s->stream, cache);
-	}
+	/* Set new cache in all zones */
+	for(zs = s->zones; zs != NULL; zs = zs->next)
+		if(zs->stream != NULL &&
+		   zs->zone->mod->set_cache_stream(zs->zone->handle,
+						   zs->stream, cache) == 0)
+			ret = 0;
+	s->cache = cache;
 
 	/* Unlock output access */
 	pthread_mutex_unlock(h->mutex);
@@ -872,6 +2041,7 @@ unsigned long output_get_status_stream(struct output_handle *h,
 				       struct output_stream_handle *s,
 				       enum output_stream_key key)
 {
+	struct output_zone_stream *zs;
 	unsigned long ret = 0;
 
 	if(h == NULL || s == NULL)
@@ -880,14 +2050,38 @@ unsigned long output_get_status_stream(struct output_handle *h,
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
-	{
-		/* Get stream status */
-		ret = h->outputs->mod->get_status_stream(h->outputs->handle,
-							 s->stream, key);
-	}
+	/* Get stream status from first zone */
+	zs = s->zones;
+	if(zs != NULL && zs->stream != NULL)
+		ret = zs->zone->mod->get_status_stream(zs->zone->handle,
+						       zs->stream, key);
+
+	/* Unlock output access */
+	pthread_mutex_unlock(h->mutex);
+
+	return ret;
+}
+
+int output_get_clock_stream(struct output_handle *h,
+			    struct output_stream_handle *s,
+			    struct output_clock *clock)
+{
+	struct output_zone_stream *zs;
+	int ret = -1;
+
+	if(h == NULL || s == NULL || clock == NULL)
+		return -1;
+	memset(clock, 0, sizeof(struct output_clock));
+
+	/* Lock output access */
+	pthread_mutex_lock(h->mutex);
+
+	/* Get stream clock from first zone */
+	zs = s->zones;
+	if(zs != NULL && zs->stream != NULL &&
+	   zs->zone->mod->get_clock_stream != NULL)
+		ret = zs->zone->mod->get_clock_stream(zs->zone->handle,
+						      zs->stream, clock);
 
 	/* Unlock output access */
 	pthread_mutex_unlock(h->mutex);
@@ -907,15 +2101,16 @@ int output_set_stream_event_cb(struct output_handle *h,
 	/* Lock output access */
 	pthread_mutex_lock(h->mutex);
 
-	/* Check output module */
-	if(h->outputs != NULL && h->outputs->mod != NULL &&
-	   h->outputs->handle != NULL && s->stream != NULL)
-	{
-		/* Set stream event callback */
-		ret = h->outputs->mod->set_stream_event_cb(h->outputs->handle,
-							   s->stream, cb,
-							   user_data);
-	}
+	/* Save callback to set it again when zones change */
+	s->event_cb = cb;
+	s->event_ud = user_data;
+
+	/* Set stream event callback on first zone */
+	if(s->zones != NULL && s->zones->stream != NULL)
+		ret = s->zones->zone->mod->set_stream_event_cb(
+							s->zones->zone->handle,
+							s->zones->stream, cb,
+							user_data);
 
 	/* Unlock output access */
 	pthread_mutex_unlock(h->mutex);
@@ -983,6 +2178,7 @@ static int outputs_httpd_volume(void *user_data, struct httpd_req *req,
 	struct output_stream_handle *s = NULL;
 	struct output_handle *handle = NULL;
 	unsigned int vol = 0;
+	struct output_zone *z;
 	struct json *json;
 	int is_master;
 	char *str;
@@ -1053,8 +2249,9 @@ static int outputs_httpd_volume(void *user_data, struct httpd_req *req,
 		/* Check URL */
 		if(is_master)
 		{
-			if(h->mod != NULL && h->handle != NULL)
-				h->mod->set_volume(h->handle, vol);
+			for(z = h->zones; z != NULL; z = z->next)
+				if(z->mod != NULL && z->handle != NULL)
+					z->mod->set_volume(z->handle, vol);
 			h->volume = vol;
 		}
 		else
@@ -1078,13 +2275,36 @@ static int outputs_httpd_volume(void *user_data, struct httpd_req *req,
 	return 200;
 }
 
+static void outputs_get_zone_status(struct output_zone *z, struct json *root)
+{
+	/* Get output configuration */
+	if(z->current != NULL && z->handle != NULL)
+	{
+		json_set_string(root, "id", z->current->id);
+		json_set_string(root, "name", z->current->name);
+		json_set_string(root, "description", z->current->description);
+	}
+	else
+	{
+		json_set_string(root, "id", NO_ID);
+		json_set_string(root, "name", NO_NAME);
+		json_set_string(root, "description", NO_DESCRIPTION);
+	}
+	if(z->device != NULL)
+		json_set_string(root, "device", z->device);
+	json_set_int(root, "samplerate", z->samplerate);
+	json_set_int(root, "channels", z->channels);
+}
+
 static int outputs_httpd_status(void *user_data, struct httpd_req *req,
 				struct httpd_res **res)
 {
 	struct outputs_handle *h = user_data;
-	struct json *root, *list, *list2, *tmp, *tmp2;
+	struct json *root, *list, *list2, *list3, *tmp, *tmp2;
 	struct output_stream_handle *s;
+	struct output_zone_stream *zs;
 	struct output_handle *l;
+	struct output_zone *z;
 	char *str;
 
 	/* Create a new object */
@@ -1093,22 +2313,24 @@ static int outputs_httpd_status(void *user_data, struct httpd_req *req,
 	/* Lock output access */
 	pthread_mutex_lock(&h->mutex);
 
-	/* Get output configuration */
-	if(h->current != NULL)
-	{
-		json_set_string(root, "id", h->current->id);
-		json_set_string(root, "name", h->current->name);
-		json_set_string(root, "description", h->current->description);
-	}
-	else
+	/* Get default zone status */
+	if(h->zones != NULL)
+		outputs_get_zone_status(h->zones, root);
+	json_set_int(root, "volume", h->volume);
+
+	/* Get all zones status */
+	list = json_new_array();
+	for(z = h->zones; list != NULL && z != NULL; z = z->next)
 	{
-		json_set_string(root, "id", NO_ID);
-		json_set_string(root, "name", NO_NAME);
-		json_set_string(root, "description", NO_DESCRIPTION);
+		tmp = json_new();
+		if(tmp == NULL)
+			continue;
+		json_set_string(tmp, "zone", z->name);
+		outputs_get_zone_status(z, tmp);
+		if(json_array_add(list, tmp) != 0)
+			json_free(tmp);
 	}
-	json_set_int(root, "samplerate", h->samplerate);
-	json_set_int(root, "channels", h->channels);
-	json_set_int(root, "volume", h->volume);
+	json_add(root, "zones", list);
 
 	/* Create a new JSON array */
 	list = json_new_array();
@@ -1142,6 +2364,14 @@ static int outputs_httpd_status(void *user_data, struct httpd_req *req,
 				json_set_int(tmp2, "channels", s->channels);
 				json_set_int(tmp2, "volume", s->volume);
 
+				/* Get stream zones */
+				list3 = json_new_array();
+				for(zs = s->zones; list3 != NULL && zs != NULL;
+				    zs = zs->next)
+					json_array_add(list3, json_new_string(
+								zs->zone->name));
+				json_add(tmp2, "zones", list3);
+
 				/* Add object to array */
 				if(json_array_add(list2, tmp2) != 0)
 					json_free(tmp2);
@@ -1172,6 +2402,135 @@ static int outputs_httpd_status(void *user_data, struct httpd_req *req,
 	return 200;
 }
 
+static struct json *outputs_get_zone_stats(struct output_zone *z)
+{
+	struct json *root = NULL;
+
+	/* Get statistics from output module */
+	if(z->current != NULL && z->mod != NULL && z->handle != NULL &&
+	   z->mod->get_stats != NULL)
+		root = z->mod->get_stats(z->handle);
+
+	/* Create an empty object */
+	if(root == NULL)
+		root = json_new();
+	if(root == NULL)
+		return NULL;
+
+	/* Add output ID */
+	if(z->current != NULL)
+		json_set_string(root, "id", z->current->id);
+	else
+		json_set_string(root, "id", NO_ID);
+
+	return root;
+}
+
+static int outputs_httpd_stats(void *user_data, struct httpd_req *req,
+			       struct httpd_res **res)
+{
+	struct outputs_handle *h = user_data;
+	struct json *root, *list, *tmp;
+	struct output_zone *z;
+	char *str;
+
+	/* Lock output access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Get statistics of default zone */
+	root = h->zones != NULL ? outputs_get_zone_stats(h->zones) : NULL;
+	if(root == NULL)
+		root = json_new();
+
+	/* Get statistics of all zones */
+	list = json_new_array();
+	for(z = h->zones; list != NULL && z != NULL; z = z->next)
+	{
+		tmp = outputs_get_zone_stats(z);
+		if(tmp == NULL)
+			continue;
+		json_set_string(tmp, "zone", z->name);
+		if(json_array_add(list, tmp) != 0)
+			json_free(tmp);
+	}
+	json_add(root, "zones", list);
+
+	/* Unlock output access */
+	pthread_mutex_unlock(&h->mutex);
+
+	/* Get JSON string */
+	str = strdup(json_export(root));
+
+	/* Free JSON object */
+	json_free(root);
+
+	*res = httpd_new_response(str, 1, 0);
+	return 200;
+}
+
+static int outputs_httpd_route(void *user_data, struct httpd_req *req,
+			       struct httpd_res **res)
+{
+	struct outputs_handle *h = user_data;
+	struct output_stream_handle *s = NULL;
+	struct output_handle *handle = NULL;
+	struct output_zone_stream *zs;
+	struct json *json, *list;
+	char *route = NULL;
+	char *str;
+
+	/* Lock output access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Get output or stream from url */
+	if(req->resource == NULL ||
+	   outputs_find_stream_from_url(h, req->resource, &handle, &s, 1) != 0)
+	{
+		pthread_mutex_unlock(&h->mutex);
+		return 404;
+	}
+
+	/* Set new routing: array of zone names or null for default */
+	if(req->method == HTTPD_PUT)
+	{
+		if(req->json != NULL)
+			route = outputs_list_from_json(req->json);
+		output_route(handle, s, route);
+		FREE_STRING(route);
+	}
+
+	/* Create a JSON object */
+	json = json_new();
+
+	/* Get routing */
+	route = s != NULL ? s->route : handle->route;
+	list = route != NULL ? outputs_list_to_json(route) : NULL;
+	json_add(json, "route", list);
+
+	/* Get zones of stream */
+	if(s != NULL)
+	{
+		list = json_new_array();
+		for(zs = s->zones; list != NULL && zs != NULL; zs = zs->next)
+			json_array_add(list, json_new_string(zs->zone->name));
+		json_add(json, "zones", list);
+	}
+
+	/* Unlock output access */
+	pthread_mutex_unlock(&h->mutex);
+
+	/* Get JSON string */
+	str = strdup(json_export(json));
+
+	/* Free JSON object */
+	json_free(json);
+
+	/* Create response */
+	*res = httpd_new_response(str, 1, 0);
+
+	return 200;
+}
+
 static int outputs_httpd_list(void *user_data, struct httpd_req *req,
 			      struct httpd_res **res)
 {
@@ -1239,6 +2598,8 @@ static int outputs_httpd_list(void *user_data, struct httpd_req *req,
 struct url_table outputs_urls[] = {
 	{"/volume", HTTPD_EXT_URL, HTTPD_PG , 0, &outputs_httpd_volume},
 	{"/status", 0,             HTTPD_GET, 0, &outputs_httpd_status},
+	{"/stats",  0,             HTTPD_GET, 0, &outputs_httpd_stats},
+	{"/route",  HTTPD_EXT_URL, HTTPD_PG , HTTPD_JSON, &outputs_httpd_route},
 	{"/list",   0,             HTTPD_GET, 0, &outputs_httpd_list},
 	{0, 0, 0, 0}
 };
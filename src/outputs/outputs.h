@@ -24,8 +24,10 @@
 #include "json.h"
 
 struct output_module {
-	int (*open)(void **, unsigned long, unsigned char, unsigned int);
+	int (*open)(void **, const char *, unsigned long, unsigned char,
+		    unsigned int, unsigned int, unsigned int);
 	int (*set_volume)(void *, unsigned int);
+	int (*set_mixer)(void *, const char *, const char *, unsigned int);
 	unsigned int (*get_volume)(void *);
 	void *(*add_stream)(void *, unsigned long, unsigned char, unsigned long,
 			    int, a_read_cb, void *);
@@ -39,11 +41,15 @@ struct output_module {
 					   enum output_stream_key);
 	int (*set_stream_event_cb)(void *, void *, output_stream_event_cb,
 				   void *);
+	int (*get_clock_stream)(void *, void *, struct output_clock *);
 	ssize_t (*write_stream)(void *, void *, const unsigned char *, size_t,
 				struct a_format *);
 	unsigned long (*abort_stream)(void *, void *);
 	void (*restore_stream)(void *, void *, unsigned long);
 	int (*remove_stream)(void *, void *);
+	struct json *(*get_stats)(void *);
+	int (*reconfigure)(void *, const char *, unsigned long, unsigned char,
+			   unsigned int, unsigned int, unsigned int);
 	int (*close)(void *);
 };
 
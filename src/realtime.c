@@ -0,0 +1,284 @@
+/*
+ * realtime.c - Real-time scheduling, CPU affinity and memory locking
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* Stack size to prefault for real-time threads (64kB) */
+#define PREFAULT_STACK_SIZE 65536
+
+/* Thread name length (including '\0') */
+#define THREAD_NAME_SIZE 16
+
+struct realtime_thread {
+	/* SCHED_FIFO priority (0 to keep SCHED_OTHER) */
+	int priority;
+	/* CPU affinity */
+	int cpu_count;
+	cpu_set_t cpus;
+};
+
+static const char *realtime_class_names[REALTIME_CLASS_COUNT] = {
+	NULL, "output", "cache"
+};
+
+static struct realtime_thread realtime_threads[REALTIME_CLASS_COUNT];
+static pthread_mutex_t realtime_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int realtime_memlock = 0;
+
+int realtime_init(struct json *config)
+{
+	/* Reset all classes */
+	memset(realtime_threads, 0, sizeof(realtime_threads));
+	realtime_memlock = 0;
+
+	/* Set configuration */
+	return realtime_set_config(config);
+}
+
+void realtime_free(void)
+{
+	/* Unlock memory */
+	if(realtime_memlock)
+		munlockall();
+	realtime_memlock = 0;
+}
+
+static void realtime_parse_class(struct realtime_thread *t, struct json *cfg)
+{
+	struct json *cpus;
+	int min, max;
+	int i, cpu;
+
+	/* Reset values */
+	t->priority = 0;
+	t->cpu_count = 0;
+	CPU_ZERO(&t->cpus);
+	if(cfg == NULL)
+		return;
+
+	/* Get priority and check bounds */
+	t->priority = json_get_int(cfg, "priority");
+	if(t->priority > 0)
+	{
+		min = sched_get_priority_min(SCHED_FIFO);
+		max = sched_get_priority_max(SCHED_FIFO);
+		if(t->priority < min)
+			t->priority = min;
+		if(t->priority > max)
+			t->priority = max;
+	}
+	else
+		t->priority = 0;
+
+	/* Get CPU list */
+	if(json_get_ex(cfg, "cpus", &cpus) == 0 || cpus == NULL)
+		return;
+	for(i = 0; i < json_array_length(cpus); i++)
+	{
+		cpu = json_to_int(json_array_get(cpus, i));
+		if(cpu < 0 || cpu >= CPU_SETSIZE)
+			continue;
+		CPU_SET(cpu, &t->cpus);
+		t->cpu_count++;
+	}
+}
+
+int realtime_set_config(struct json *config)
+{
+	struct json *tmp;
+	int memlock = 0;
+	int ret = 0;
+	int i;
+
+	/* Lock configuration access */
+	pthread_mutex_lock(&realtime_mutex);
+
+	/* Get thread classes configuration */
+	for(i = REALTIME_NONE + 1; i < REALTIME_CLASS_COUNT; i++)
+	{
+		tmp = NULL;
+		if(config != NULL)
+			json_get_ex(config, realtime_class_names[i], &tmp);
+		realtime_parse_class(&realtime_threads[i], tmp);
+	}
+
+	/* Lock all current and future pages in RAM */
+	if(config != NULL)
+		memlock = json_get_bool(config, "memlock");
+	if(memlock && !realtime_memlock)
+	{
+		if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		{
+			fprintf(stderr, "Failed to lock memory\n");
+			memlock = 0;
+			ret = -1;
+		}
+	}
+	else if(!memlock && realtime_memlock)
+		munlockall();
+	realtime_memlock = memlock;
+
+	/* Unlock configuration access */
+	pthread_mutex_unlock(&realtime_mutex);
+
+	return ret;
+}
+
+struct json *realtime_get_config(void)
+{
+	struct json *cfg, *tmp, *cpus;
+	struct realtime_thread *t;
+	int i, cpu;
+
+	/* Create a JSON object */
+	cfg = json_new();
+	if(cfg == NULL)
+		return NULL;
+
+	/* Lock configuration access */
+	pthread_mutex_lock(&realtime_mutex);
+
+	/* Fill configuration */
+	json_set_bool(cfg, "memlock", realtime_memlock);
+	for(i = REALTIME_NONE + 1; i < REALTIME_CLASS_COUNT; i++)
+	{
+		t = &realtime_threads[i];
+
+		/* Create class object */
+		tmp = json_new();
+		if(tmp == NULL)
+			continue;
+		json_set_int(tmp, "priority", t->priority);
+
+		/* Add CPU list */
+		cpus = json_new_array();
+		for(cpu = 0; cpus != NULL && cpu < CPU_SETSIZE; cpu++)
+			if(CPU_ISSET(cpu, &t->cpus))
+				json_array_add(cpus, json_new_int(cpu));
+		json_add(tmp, "cpus", cpus);
+
+		/* Add class to configuration */
+		json_add(cfg, realtime_class_names[i], tmp);
+	}
+
+	/* Unlock configuration access */
+	pthread_mutex_unlock(&realtime_mutex);
+
+	return cfg;
+}
+
+static void realtime_prefault_stack(void)
+{
+	unsigned char stack[PREFAULT_STACK_SIZE];
+
+	/* Touch stack pages */
+	memset(stack, 0, sizeof(stack));
+	__asm__ __volatile__("" : : "r" (stack) : "memory");
+}
+
+int realtime_set_thread(enum realtime_class cls, const char *name)
+{
+	struct realtime_thread t;
+	struct sched_param param;
+	char tname[THREAD_NAME_SIZE];
+	int memlock;
+	int ret = 0;
+
+	/* Set thread name (truncated to 15 characters) */
+	if(name != NULL)
+	{
+		strncpy(tname, name, THREAD_NAME_SIZE - 1);
+		tname[THREAD_NAME_SIZE - 1] = '\0';
+		pthread_setname_np(pthread_self(), tname);
+	}
+
+	if(cls <= REALTIME_NONE || cls >= REALTIME_CLASS_COUNT)
+		return 0;
+
+	/* Copy class configuration */
+	pthread_mutex_lock(&realtime_mutex);
+	memcpy(&t, &realtime_threads[cls], sizeof(t));
+	memlock = realtime_memlock;
+	pthread_mutex_unlock(&realtime_mutex);
+
+	/* Set CPU affinity */
+	if(t.cpu_count > 0 &&
+	   pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+				  &t.cpus) != 0)
+	{
+		fprintf(stderr, "Failed to set CPU affinity of %s thread\n",
+			realtime_class_names[cls]);
+		ret = -1;
+	}
+
+	/* Set SCHED_FIFO policy */
+	if(t.priority > 0)
+	{
+		param.sched_priority = t.priority;
+		if(pthread_setschedparam(pthread_self(), SCHED_FIFO,
+					 &param) != 0)
+		{
+			fprintf(stderr, "Failed to set SCHED_FIFO on %s "
+				"thread\n", realtime_class_names[cls]);
+			ret = -1;
+		}
+	}
+
+	/* Prefault stack of real-time threads */
+	if(memlock || t.priority > 0)
+		realtime_prefault_stack();
+
+	return ret;
+}
+
+void realtime_prefault(void *buffer, size_t size)
+{
+	volatile unsigned char *p = buffer;
+	long page;
+	size_t i;
+
+	if(buffer == NULL || size == 0)
+		return;
+
+	/* Get page size */
+	page = sysconf(_SC_PAGESIZE);
+	if(page <= 0)
+		page = 4096;
+
+	/* Write on each page of the buffer */
+	for(i = 0; i < size; i += page)
+		p[i] = p[i];
+	p[size-1] = p[size-1];
+}
+
@@ -539,6 +539,48 @@ flush:
 	return size;
 }
 
+int resample_set_output(struct resample_handle *h, unsigned long samplerate,
+			unsigned char channels)
+{
+	unsigned char *p;
+	int ret;
+
+	if(h == NULL || samplerate == 0 || channels == 0)
+		return -1;
+
+	/* Lock buffer access */
+	pthread_mutex_lock(&h->mutex);
+
+	/* Input buffer is down-mixed to output channels: drop it */
+	if(channels != h->out_channels)
+		h->in_len = 0;
+
+	/* Drop converted data in old format */
+	h->tmp_len = 0;
+
+	/* Resize temp buffer for write() purpose */
+	if(h->tmp_buffer != NULL && channels != h->out_channels)
+	{
+		p = realloc(h->tmp_buffer, BUFFER_SIZE * channels * 4);
+		if(p != NULL)
+		{
+			h->tmp_buffer = p;
+			h->tmp_size = BUFFER_SIZE * channels;
+		}
+	}
+
+	/* Reset resample/mixer engine with new output format */
+	resample_free(h);
+	h->out_samplerate = samplerate;
+	h->out_channels = channels;
+	ret = resample_init(h);
+
+	/* Unlock buffer access */
+	pthread_mutex_unlock(&h->mutex);
+
+	return ret;
+}
+
 unsigned long resample_delay(struct resample_handle *h)
 {
 	double delay;
@@ -0,0 +1,331 @@
+/*
+ * resolver.c - Asynchronous hostname resolver with cache
+ *
+ * Copyright (c) 2014   A. Dilly
+ *
+ * AirCat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation.
+ *
+ * AirCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <pthread.h>
+
+#include "realtime.h"
+#include "resolver.h"
+
+/* Resolver cache:
+ *  - CACHE_SIZE: maximum hostnames kept in cache,
+ *  - CACHE_TTL: time during which a result is used without new lookup (in s),
+ *  - CACHE_NEG_TTL: time during which a failed lookup is not retried (in s).
+ * getaddrinfo() doesn't give TTL of DNS records, so fixed values are used.
+ */
+#define CACHE_SIZE 32
+#define CACHE_TTL 300
+#define CACHE_NEG_TTL 10
+
+struct resolver_entry {
+	char *hostname;
+	/* Last result */
+	struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+	int count;
+	time_t expire;
+	/* Lookup in progress */
+	int pending;
+	/* References: cache, lookup thread and waiting callers */
+	int ref;
+	struct resolver_entry *next;
+};
+
+/* Cache shared by all callers: most recently used entries are first */
+static struct resolver_entry *cache = NULL;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_cond = PTHREAD_COND_INITIALIZER;
+
+static time_t resolver_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Must be called with cache locked */
+static void resolver_unref(struct resolver_entry *e)
+{
+	if(--e->ref > 0)
+		return;
+
+	free(e->hostname);
+	free(e);
+}
+
+/* Copy addresses of an addrinfo list */
+static int resolver_copy(struct resolver_addr *addrs, int count,
+			 struct addrinfo *res)
+{
+	int i;
+
+	for(i = 0; res != NULL && i < count; res = res->ai_next)
+	{
+		if(res->ai_addrlen > sizeof(struct sockaddr_storage) ||
+		   (res->ai_family != AF_INET && res->ai_family != AF_INET6))
+			continue;
+		memset(&addrs[i].addr, 0, sizeof(struct sockaddr_storage));
+		memcpy(&addrs[i].addr, res->ai_addr, res->ai_addrlen);
+		addrs[i].len = res->ai_addrlen;
+		i++;
+	}
+
+	return i;
+}
+
+static void resolver_set_port(struct resolver_addr *addrs, int count,
+			      unsigned int port)
+{
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(addrs[i].addr.ss_family == AF_INET6)
+			((struct sockaddr_in6 *) &addrs[i].addr)->sin6_port =
+								    htons(port);
+		else
+			((struct sockaddr_in *) &addrs[i].addr)->sin_port =
+								    htons(port);
+	}
+}
+
+static void *resolver_thread(void *user_data)
+{
+	struct resolver_entry *e = user_data;
+	struct resolver_addr addrs[RESOLVER_MAX_ADDR];
+	struct addrinfo hints, *res = NULL;
+	int count = 0;
+	int ret;
+
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "resolver");
+
+	/* Resolve hostname (blocking) */
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+	ret = getaddrinfo(e->hostname, NULL, &hints, &res);
+	if(ret == 0)
+	{
+		count = resolver_copy(addrs, RESOLVER_MAX_ADDR, res);
+		freeaddrinfo(res);
+	}
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Update entry: on a temporary failure, previous addresses are kept
+	 * but a new lookup is done after negative TTL.
+	 */
+	if(count > 0)
+	{
+		memcpy(e->addrs, addrs, count * sizeof(struct resolver_addr));
+		e->count = count;
+		e->expire = resolver_time() + CACHE_TTL;
+	}
+	else
+	{
+		if(ret != EAI_AGAIN && ret != EAI_SYSTEM)
+			e->count = 0;
+		e->expire = resolver_time() + CACHE_NEG_TTL;
+	}
+	e->pending = 0;
+	resolver_unref(e);
+
+	/* Wake up waiting callers */
+	pthread_cond_broadcast(&cache_cond);
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	return NULL;
+}
+
+/* Get entry of hostname and move it to head of cache: must be called with
+ * cache locked.
+ */
+static struct resolver_entry *resolver_get(const char *hostname)
+{
+	struct resolver_entry *e, **p, **last;
+	int count = 0;
+
+	/* Find hostname in cache */
+	for(p = &cache; *p != NULL; p = &(*p)->next)
+	{
+		if(strcmp((*p)->hostname, hostname) == 0)
+		{
+			e = *p;
+			*p = e->next;
+			e->next = cache;
+			cache = e;
+			return e;
+		}
+	}
+
+	/* Create a new entry */
+	e = calloc(1, sizeof(struct resolver_entry));
+	if(e == NULL)
+		return NULL;
+	e->hostname = strdup(hostname);
+	if(e->hostname == NULL)
+	{
+		free(e);
+		return NULL;
+	}
+	e->ref = 1;
+	e->next = cache;
+	cache = e;
+
+	/* Remove least recently used entry when cache is full */
+	last = NULL;
+	for(p = &cache; *p != NULL; p = &(*p)->next)
+	{
+		if(!(*p)->pending)
+			last = p;
+		count++;
+	}
+	if(count > CACHE_SIZE && last != NULL && *last != e)
+	{
+		e = *last;
+		*last = e->next;
+		resolver_unref(e);
+	}
+
+	return cache;
+}
+
+int resolver_lookup(const char *hostname, unsigned int port,
+		    struct resolver_addr *addrs, int count, long timeout)
+{
+	struct resolver_entry *e;
+	struct addrinfo hints, *res;
+	struct timespec ts;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int ret = 0;
+
+	if(hostname == NULL || addrs == NULL || count <= 0)
+		return -1;
+
+	/* Numeric address: no lookup needed */
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST;
+	if(getaddrinfo(hostname, NULL, &hints, &res) == 0)
+	{
+		count = resolver_copy(addrs, count, res);
+		freeaddrinfo(res);
+		resolver_set_port(addrs, count, port);
+		return count > 0 ? count : -1;
+	}
+
+	/* Calculate end of wait */
+	if(timeout >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000;
+		if(ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Get entry of hostname */
+	e = resolver_get(hostname);
+	if(e == NULL)
+	{
+		pthread_mutex_unlock(&cache_mutex);
+		return -1;
+	}
+
+	/* Start a new lookup when result has expired */
+	if(!e->pending && (e->expire == 0 || resolver_time() >= e->expire))
+	{
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		e->pending = 1;
+		e->ref++;
+		if(pthread_create(&thread, &attr, resolver_thread, e) != 0)
+		{
+			e->pending = 0;
+			e->ref--;
+		}
+		pthread_attr_destroy(&attr);
+	}
+
+	/* Wait end of lookup */
+	e->ref++;
+	while(e->pending && ret != ETIMEDOUT)
+	{
+		if(timeout >= 0)
+			ret = pthread_cond_timedwait(&cache_cond, &cache_mutex,
+						     &ts);
+		else
+			pthread_cond_wait(&cache_cond, &cache_mutex);
+	}
+
+	/* Copy addresses (which may have expired if lookup is not done) */
+	if(count > e->count)
+		count = e->count;
+	memcpy(addrs, e->addrs, count * sizeof(struct resolver_addr));
+	resolver_unref(e);
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+
+	/* Set port */
+	resolver_set_port(addrs, count, port);
+
+	return count > 0 ? count : -1;
+}
+
+void resolver_free(void)
+{
+	struct resolver_entry *e;
+
+	/* Lock cache */
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Remove all entries: entries with a lookup in progress are freed at
+	 * end of lookup.
+	 */
+	while(cache != NULL)
+	{
+		e = cache;
+		cache = e->next;
+		resolver_unref(e);
+	}
+
+	/* Unlock cache */
+	pthread_mutex_unlock(&cache_mutex);
+}
@@ -26,6 +26,7 @@
 #include "http.h"
 #include "decoder.h"
 #include "shoutcast.h"
+#include "realtime.h"
 #include "vring.h"
 
 #ifdef HAVE_CONFIG_H
@@ -493,6 +494,9 @@ static void *shoutcast_thread(void *user_data)
 	struct shout_handle *h = user_data;
 	ssize_t len;
 
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "shoutcast");
+
 	/* Fill buffer until end */
 	while(!h->stop)
 	{
@@ -512,8 +516,8 @@ int shoutcast_read(void *user_data, unsigned char *buffer, size_t size,
 		   struct a_format *fmt)
 {
 	struct shout_handle *h = (struct shout_handle *) user_data;
+	struct decoder_frame frame;
 	struct decoder_info info;
-	unsigned char *in_buffer;
 	int total_samples = 0;
 	ssize_t len = 0;
 	int samples;
@@ -521,26 +525,6 @@ int shoutcast_read(void *user_data, unsigned char *buffer, size_t size,
 	if(h == NULL)
 		return -1;
 
-	/* Process remaining pcm data */
-	if(h->pcm_remaining > 0)
-	{
-		/* Get remaining pcm data from decoder */
-		samples = decoder_decode(h->dec, NULL, 0, buffer, size, &info);
-		if(samples < 0)
-			return -1;
-
-		/* Update audio format */
-		if(info.samplerate != h->samplerate ||
-		   info.channels != h->channels)
-		{
-			h->samplerate = info.samplerate;
-			h->channels = info.channels;
-		}
-
-		h->pcm_remaining -= samples;
-		total_samples += samples;
-	}
-
 	/* Fill output buffer */
 	while(total_samples < size)
 	{
@@ -552,20 +536,27 @@ int shoutcast_read(void *user_data, unsigned char *buffer, size_t size,
 		pthread_mutex_lock(&h->pause_mutex);
 
 		/* Get data */
+		frame.len = 0;
 		if((!h->is_ready && !h->resync) || h->is_paused ||
-		   (len = shoutcast_get_buffer(h, &in_buffer)) <= 0)
+		   (len = shoutcast_get_buffer(h, &frame.buffer)) <= 0)
 		{
-			/* Unlock pause buffer access */
-			pthread_mutex_unlock(&h->pause_mutex);
-			break;
+			/* Remaining pcm data can still be returned */
+			if(h->pcm_remaining == 0)
+			{
+				/* Unlock pause buffer access */
+				pthread_mutex_unlock(&h->pause_mutex);
+				break;
+			}
 		}
+		else
+			frame.len = len;
 
 		/* Resynchronize stream */
-		if(h->resync)
+		if(h->resync && frame.len > 0)
 		{
 			/* Not enough data or failed to synchronize */
 			if(len < h->sync_size ||
-			   (len = h->sync_fn(h, in_buffer, len)) < 0)
+			   (len = h->sync_fn(h, frame.buffer, len)) < 0)
 			{
 				/* Unlock pause buffer access */
 				pthread_mutex_unlock(&h->pause_mutex);
@@ -581,38 +572,39 @@ int shoutcast_read(void *user_data, unsigned char *buffer, size_t size,
 			continue;
 		}
 
-		/* Decode next frame */
-		samples = decoder_decode(h->dec, in_buffer, len > 0 ? len : 0,
-					 &buffer[total_samples * 4],
-					 size - total_samples, &info);
-		if(samples <= 0)
-		{
-			/* Forward used bytes in ring buffer */
-			if(len > 0 && info.used > 0)
-				shoutcast_forward_buffer(h, info.used);
+		/* Only accept current format after first samples */
+		info.samplerate = total_samples > 0 ? h->samplerate : 0;
+		info.channels = total_samples > 0 ? h->channels : 0;
 
-			/* Unlock pause buffer access */
-			pthread_mutex_unlock(&h->pause_mutex);
-			break;
-		}
+		/* Decode remaining pcm data and all frames available in ring
+		 * buffer
+		 */
+		samples = decoder_decode_frames(h->dec, &frame,
+						frame.len > 0 ? 1 : 0,
+						&buffer[total_samples * 4],
+						size - total_samples, &info);
 
-		/* Forward ring buffer to next frame */
-		shoutcast_forward_buffer(h, info.used);
+		/* Forward used bytes in ring buffer */
+		if(frame.len > 0 && frame.used > 0)
+			shoutcast_forward_buffer(h, frame.used);
 
 		/* Unlock pause buffer access */
 		pthread_mutex_unlock(&h->pause_mutex);
 
 		/* Update remaining counter */
-		h->pcm_remaining = info.remaining;
+		if(samples >= 0)
+			h->pcm_remaining = info.remaining;
 
-		/* Check audio format */
-		if(info.samplerate != h->samplerate ||
-		   info.channels != h->channels)
-		{
-			/* Reset internal position */
-			decoder_decode(h->dec, NULL, 0, NULL, 0, NULL);
-			h->pcm_remaining += samples;
+		/* Nothing decoded and no data consumed */
+		if(samples < 0 || (samples == 0 &&
+		   (frame.len == 0 || frame.used == 0)))
 			break;
+
+		/* Update audio format */
+		if(samples > 0)
+		{
+			h->samplerate = info.samplerate;
+			h->channels = info.channels;
 		}
 
 		/* Update samples returned */
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <pthread.h>
 
+#include "realtime.h"
 #include "timers.h"
 #include "utils.h"
 
@@ -184,6 +185,9 @@ static void *timers_thread(void *user_data)
 	struct timespec ts;
 	time_t now;
 
+	/* Set thread name */
+	realtime_set_thread(REALTIME_NONE, "timers");
+
 	/* Lock condition */
 	pthread_mutex_lock(&mutex);
 
@@ -238,15 +238,26 @@ int parse_url(const char *url, int *protocol, char **hostname,
 	else
 		_hostname = url - 1;
 
-	/* Get port */
-	_port = strchr(_hostname, ':');
-	if(_port != NULL)
-		*port = strtol(_port + 1, NULL, 10);
+	/* IPv6 address is enclosed in brackets: http://[::1]:port/ */
+	if(_hostname[1] == '[' && (_port = strchr(_hostname, ']')) != NULL &&
+	   _port < _resource)
+	{
+		*hostname = strndup(_hostname + 2, _port - _hostname - 2);
+		if(_port[1] == ':')
+			*port = strtol(_port + 2, NULL, 10);
+	}
 	else
-		_port = _resource;
+	{
+		/* Get port */
+		_port = strchr(_hostname, ':');
+		if(_port != NULL && _port < _resource)
+			*port = strtol(_port + 1, NULL, 10);
+		else
+			_port = _resource;
 
-	/* Get hostname */
-	*hostname = strndup(_hostname + 1, _port - _hostname - 1);
+		/* Get hostname */
+		*hostname = strndup(_hostname + 1, _port - _hostname - 1);
+	}
 
 	/* Need at least an hostname */
 	if(*hostname == NULL)
@@ -16,10 +16,15 @@
  * along with AirCat.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "vring.h"
 
@@ -27,23 +32,107 @@
 #include "config.h"
 #endif
 
+#ifndef MAP_ANONYMOUS
+	#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * The ring buffer is mapped twice in a row in virtual memory: the byte at
+ * position map_size + i is the byte at position i, so any access of at most
+ * map_size bytes is contiguous without copy.
+ *
+ * Read and write positions run from 0 to twice the mapping size, so a full
+ * buffer can be distinguished from an empty one. The writer is the only one to
+ * update write_pos and the reader is the only one to update read_pos: the
+ * other side loads them with acquire semantic to see the data copied before
+ * the position has been released.
+ */
 struct vring_handle {
 	/* Ring buffer */
 	unsigned char *buffer;
+	size_t map_size;
 	size_t buffer_size;
 	size_t max_rw_size;
 	/* Buffer status */
-	size_t buffer_len;
 	size_t read_pos;
 	size_t write_pos;
-	/* Mutex thread */
-	pthread_mutex_t mutex;
 };
 
+static inline size_t vring_len(struct vring_handle *h, size_t write_pos,
+				size_t read_pos)
+{
+	return write_pos >= read_pos ? write_pos - read_pos :
+				       write_pos + h->map_size * 2 - read_pos;
+}
+
+static inline size_t vring_forward(struct vring_handle *h, size_t pos,
+				   size_t len)
+{
+	pos += len;
+	return pos >= h->map_size * 2 ? pos - h->map_size * 2 : pos;
+}
+
+static inline unsigned char *vring_ptr(struct vring_handle *h, size_t pos)
+{
+	return h->buffer + (pos >= h->map_size ? pos - h->map_size : pos);
+}
+
+static int vring_map(struct vring_handle *h)
+{
+	unsigned char *addr;
+	int fd;
+
+	/* Create a file in memory */
+#ifdef HAVE_MEMFD_CREATE
+	fd = memfd_create("vring", MFD_CLOEXEC);
+#else
+	{
+		char name[] = "/tmp/vring-XXXXXX";
+
+		fd = mkstemp(name);
+		if(fd >= 0)
+			unlink(name);
+	}
+#endif
+	if(fd < 0)
+		return -1;
+	if(ftruncate(fd, h->map_size) != 0)
+		goto error;
+
+	/* Reserve virtual space for both mappings */
+	h->buffer = mmap(NULL, h->map_size * 2, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(h->buffer == MAP_FAILED)
+		goto error;
+
+	/* Map file twice */
+	addr = mmap(h->buffer, h->map_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_FIXED, fd, 0);
+	if(addr != h->buffer)
+		goto unmap;
+	addr = mmap(h->buffer + h->map_size, h->map_size,
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+	if(addr != h->buffer + h->map_size)
+		goto unmap;
+
+	/* Mappings keep file opened */
+	close(fd);
+
+	return 0;
+
+unmap:
+	munmap(h->buffer, h->map_size * 2);
+error:
+	h->buffer = NULL;
+	close(fd);
+	return -1;
+}
+
 int vring_open(struct vring_handle **handle, size_t buffer_size,
 	       size_t max_rw_size)
 {
 	struct vring_handle *h;
+	long page_size;
 
 	/* Check values */
 	if(buffer_size == 0 || max_rw_size == 0)
@@ -56,160 +145,113 @@ int vring_open(struct vring_handle **handle, size_t buffer_size,
 	h = *handle;
 
 	/* Init handle */
+	h->buffer = NULL;
 	h->buffer_size = buffer_size;
 	h->max_rw_size = max_rw_size;
-	h->buffer_len = 0;
 	h->read_pos = 0;
 	h->write_pos = 0;
 
-	/* Allocate buffer */
-	h->buffer = malloc(h->buffer_size+h->max_rw_size);
-	if(h->buffer == NULL)
-		return -1;
+	/* Mapping size must be a multiple of page size */
+	page_size = sysconf(_SC_PAGESIZE);
+	if(page_size <= 0)
+		page_size = 4096;
+	h->map_size = (buffer_size + page_size - 1) / page_size * page_size;
 
-	/* Init mutex */
-	pthread_mutex_init(&h->mutex, NULL);
+	/* Map buffer */
+	if(vring_map(h) != 0)
+		return -1;
 
 	return 0;
 }
 
 size_t vring_get_length(struct vring_handle *h)
 {
-	size_t len;
-
-	/* Lock access to ring buffer */
-	pthread_mutex_lock(&h->mutex);
-
-	/* Copy length */
-	len = h->buffer_len;
-
-	/* Unlock access to ring buffer */
-	pthread_mutex_unlock(&h->mutex);
-
-	return len;
+	return vring_len(h, __atomic_load_n(&h->write_pos, __ATOMIC_ACQUIRE),
+			 __atomic_load_n(&h->read_pos, __ATOMIC_ACQUIRE));
 }
 
 ssize_t vring_read(struct vring_handle *h, unsigned char **buffer,
 		   size_t len, size_t pos)
 {
+	size_t read_pos, buffer_len;
+
 	/* Limit length access */
 	if(len > h->max_rw_size || len == 0)
 		len = h->max_rw_size;
 
-	/* Lock access to ring buffer */
-	pthread_mutex_lock(&h->mutex);
-
 	/* Get available length */
-	if(len > h->buffer_len - pos)
-		len = h->buffer_len - pos;
+	read_pos = h->read_pos;
+	buffer_len = vring_len(h, __atomic_load_n(&h->write_pos,
+						  __ATOMIC_ACQUIRE), read_pos);
+	if(pos > buffer_len)
+		pos = buffer_len;
+	if(len > buffer_len - pos)
+		len = buffer_len - pos;
 
 	/* Set buffer pointer */
-	*buffer = h->buffer + h->read_pos + pos;
-	if(*buffer >= h->buffer + h->buffer_size)
-		*buffer -= h->buffer_size;
-
-	/* Unlock access to ring buffer */
-	pthread_mutex_unlock(&h->mutex);
+	*buffer = vring_ptr(h, read_pos) + pos;
 
 	return len;
 }
 
 ssize_t vring_read_forward(struct vring_handle *h, size_t len)
 {
-	/* Lock access to ring buffer */
-	pthread_mutex_lock(&h->mutex);
+	size_t read_pos, buffer_len;
 
 	/* Check buffer length */
-	if(len > h->buffer_len)
-		len = h->buffer_len;
+	read_pos = h->read_pos;
+	buffer_len = vring_len(h, __atomic_load_n(&h->write_pos,
+						  __ATOMIC_ACQUIRE), read_pos);
+	if(len > buffer_len)
+		len = buffer_len;
 
 	/* No update */
 	if(len == 0)
-	{
-		/* Unlock access to ring buffer */
-		pthread_mutex_unlock(&h->mutex);
 		return 0;
-	}
-
-	/* Update read position and available length */
-	h->read_pos += len;
-	if(h->read_pos >= h->buffer_size)
-		h->read_pos -= h->buffer_size;
-	h->buffer_len -= len;
 
-	/* Unlock access to ring buffer */
-	pthread_mutex_unlock(&h->mutex);
+	/* Release space to writer */
+	__atomic_store_n(&h->read_pos, vring_forward(h, read_pos, len),
+			 __ATOMIC_RELEASE);
 
 	return len;
 }
 
 ssize_t vring_write(struct vring_handle *h, unsigned char **buffer)
 {
+	size_t write_pos, space;
 	ssize_t len = h->max_rw_size;
 
-	/* Lock access to ring buffer */
-	pthread_mutex_lock(&h->mutex);
-
 	/* Check available space in ring buffer */
-	if(len > h->buffer_size - h->buffer_len)
-		len = h->buffer_size - h->buffer_len;
-
-	/* Unlock access to ring buffer */
-	pthread_mutex_unlock(&h->mutex);
+	write_pos = h->write_pos;
+	space = h->buffer_size - vring_len(h, write_pos,
+			      __atomic_load_n(&h->read_pos, __ATOMIC_ACQUIRE));
+	if(len > space)
+		len = space;
 
 	/* Set buffer pointer */
-	*buffer = h->buffer + h->write_pos;
+	*buffer = vring_ptr(h, write_pos);
 
 	return len;
 }
 
 ssize_t vring_write_forward(struct vring_handle *h, size_t len)
 {
-	size_t size = 0;
-	size_t rem = 0;
-
-	/* Lock access to ring buffer */
-	pthread_mutex_lock(&h->mutex);
+	size_t write_pos, space;
 
 	/* Check available space in ring buffer */
-	if(len > h->buffer_size - h->buffer_len)
-		len = h->buffer_size - h->buffer_len;
-
-	/* Unlock access to ring buffer */
-	pthread_mutex_unlock(&h->mutex);
+	write_pos = h->write_pos;
+	space = h->buffer_size - vring_len(h, write_pos,
+			      __atomic_load_n(&h->read_pos, __ATOMIC_ACQUIRE));
+	if(len > space)
+		len = space;
 
 	/* No available space */
 	if(len == 0)
 		return 0;
 
-	/* Overlap in ring buffer */
-	if(h->write_pos + len > h->buffer_size)
-	{
-		/* Copy data to ring buffer start */
-		size = len - (h->buffer_size - h->write_pos);
-		memcpy(h->buffer, h->buffer + h->buffer_size, size);
-	}
-	else if(h->write_pos < h->max_rw_size)
-	{
-		/* Copy data to ring buffer reserve */
-		rem = h->buffer_size + h->write_pos;
-		size = h->max_rw_size - h->write_pos;
-		if(len < size)
-			size = len;
-		memcpy(h->buffer + rem, h->buffer + h->write_pos, size);
-	}
-
-	/* Lock access to ring buffer */
-	pthread_mutex_lock(&h->mutex);
-
-	/* Update write position and available length */
-	h->write_pos += len;
-	if(h->write_pos >= h->buffer_size)
-		h->write_pos -= h->buffer_size;
-	h->buffer_len += len;
-
-	/* Unlock access to ring buffer */
-	pthread_mutex_unlock(&h->mutex);
+	/* Publish data to reader */
+	__atomic_store_n(&h->write_pos, vring_forward(h, write_pos, len),
+			 __ATOMIC_RELEASE);
 
 	return len;
 }
@@ -219,9 +261,9 @@ void vring_close(struct vring_handle *h)
 	if(h == NULL)
 		return;
 
-	/* Free ring buffer */
+	/* Unmap ring buffer */
 	if(h->buffer != NULL)
-		free(h->buffer);
+		munmap(h->buffer, h->map_size * 2);
 
 	/* Free handle */
 	free(h);